@@ -17,7 +17,8 @@
 
 #include "Waves.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 //Lightweight structure stores parameters to draw a shape. 
 struct RenderItem {
@@ -138,6 +139,7 @@ LandAndWavesApp::LandAndWavesApp(HINSTANCE hInstance) :VulkApp(hInstance) {
 bool LandAndWavesApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 	
@@ -477,8 +479,8 @@ void LandAndWavesApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	// Has the GPU finished processing the commands of the current frame resource?
@@ -545,6 +547,7 @@ void LandAndWavesApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void LandAndWavesApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	VkDeviceSize objectSize = pipelineRes->GetShaderResource(1).buffer.objectSize;
@@ -566,6 +569,7 @@ void LandAndWavesApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void LandAndWavesApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -592,6 +596,7 @@ void LandAndWavesApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void LandAndWavesApp::UpdateWaves(const GameTimer& gt) {
+	CPU_ZONE("UpdateWaves");
 	//Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if ((mTimer.TotalTime() - t_base) >= 0.25f) {
@@ -15,7 +15,8 @@
 #include "../../ThirdParty/spirv-reflect/spirv_reflect.h"
 #include <fstream>
 #include "test.h"
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 //Lightweight structure stores parameters to draw a shape. 
 struct RenderItem {
@@ -177,6 +178,7 @@ ShapesApp::~ShapesApp() {
 bool ShapesApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	/*VMVulkanInfo vulkanInfo;
 	vulkanInfo.device = mDevice;
@@ -211,8 +213,8 @@ void ShapesApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	// Has the GPU finished processing the commands of the current frame resource?
@@ -363,6 +365,7 @@ void ShapesApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void ShapesApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	//auto currObjectCB = mCurrFrameResource->ObjectCB;
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	VkDeviceSize objectSize = pipelineRes->pipelineResources[1].buffer.objectSize;
@@ -386,6 +389,7 @@ void ShapesApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void ShapesApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
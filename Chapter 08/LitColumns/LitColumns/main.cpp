@@ -15,7 +15,8 @@
 
 #include "ShaderProgram.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -128,6 +129,7 @@ LitColumnsApp::~LitColumnsApp() {
 bool LitColumnsApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 	
 	BuildShapeGeometry();
 	BuildSkullGeometry();
@@ -633,8 +635,8 @@ void LitColumnsApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	
@@ -667,6 +669,7 @@ void LitColumnsApp::UpdateCamera(const GameTimer& gt) {
 
 
 void LitColumnsApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	VkDeviceSize objectSize = pipelineRes->GetShaderResource(1).buffer.objectSize;
@@ -689,6 +692,7 @@ void LitColumnsApp::UpdateObjectCBs(const GameTimer& gt) {
 
 
 void LitColumnsApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -723,6 +727,7 @@ void LitColumnsApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 void LitColumnsApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	/*VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);*/
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;	
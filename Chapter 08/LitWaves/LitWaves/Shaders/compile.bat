@@ -1,2 +1,3 @@
 C:\VulkanSDK\1.2.141.2\Bin32\glslc.exe %1 -o %1.spv
+"%~dp0..\..\..\..\Tools\ShaderBake\x64\Release\ShaderBake.exe" %1.spv
 pause
\ No newline at end of file
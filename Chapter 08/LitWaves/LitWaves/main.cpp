@@ -18,7 +18,8 @@
 
 #include "Waves.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -155,6 +156,7 @@ LitWavesApp::~LitWavesApp() {
 bool LitWavesApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
@@ -536,6 +538,7 @@ void LitWavesApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void LitWavesApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	VkDeviceSize objectSize = pipelineRes->GetShaderResource(1).buffer.objectSize;
@@ -557,6 +560,7 @@ void LitWavesApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void LitWavesApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -591,6 +595,7 @@ void LitWavesApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void LitWavesApp::UpdateWaves(const GameTimer& gt) {
+	CPU_ZONE("UpdateWaves");
 	//Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if ((mTimer.TotalTime() - t_base) >= 0.25f) {
@@ -624,6 +629,7 @@ void LitWavesApp::UpdateWaves(const GameTimer& gt) {
 }
 
 void LitWavesApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	/*VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);*/
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
@@ -694,8 +700,8 @@ void LitWavesApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	
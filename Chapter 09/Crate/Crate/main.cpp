@@ -16,7 +16,8 @@
 
 #include "ShaderProgram.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -136,6 +137,7 @@ CrateApp::~CrateApp() {
 bool CrateApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	LoadTextures();
 	
@@ -351,8 +353,8 @@ void CrateApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	
@@ -380,6 +382,7 @@ void CrateApp::UpdateCamera(const GameTimer& gt) {
 
 
 void CrateApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	//auto currObjectCB = mCurrFrameResource->ObjectCB;
 	//uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
@@ -401,6 +404,7 @@ void CrateApp::UpdateObjectCBs(const GameTimer& gt) {
 	}
 }
 void CrateApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -434,6 +438,7 @@ void CrateApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void CrateApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	//VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
@@ -16,7 +16,8 @@
 
 #include "ShaderProgram.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -133,6 +134,7 @@ TexColumnsApp::~TexColumnsApp() {
 bool TexColumnsApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	LoadTextures();
 	
@@ -504,8 +506,8 @@ void TexColumnsApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	
@@ -531,6 +533,7 @@ void TexColumnsApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	//auto currObjectCB = mCurrFrameResource->ObjectCB;
 	//uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
@@ -553,6 +556,7 @@ void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void TexColumnsApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -587,6 +591,7 @@ void TexColumnsApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 void TexColumnsApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	//VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);
 	//uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
@@ -14,7 +14,8 @@
 
 #include "ShaderProgram.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -161,6 +162,7 @@ TexWavesApp::~TexWavesApp() {
 bool TexWavesApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
 	LoadTextures();
@@ -727,8 +729,8 @@ void TexWavesApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	
@@ -744,6 +746,7 @@ void TexWavesApp::Update(const GameTimer& gt) {
 
 void TexWavesApp::UpdateWaves(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateWaves");
 	// Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if ((mTimer.TotalTime() - t_base) >= 0.25f)
@@ -792,6 +795,7 @@ void TexWavesApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void TexWavesApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	//auto currObjectCB = mCurrFrameResource->ObjectCB;
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
@@ -812,6 +816,7 @@ void TexWavesApp::UpdateObjectCBs(const GameTimer& gt) {
 	}
 }
 void TexWavesApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -847,6 +852,7 @@ void TexWavesApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 void TexWavesApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	//VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;	
@@ -14,7 +14,8 @@
 
 #include "ShaderProgram.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -165,6 +166,7 @@ BlendApp::~BlendApp() {
 bool BlendApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
 	LoadTextures();
@@ -823,8 +825,8 @@ void BlendApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 
@@ -852,6 +854,7 @@ void BlendApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void BlendApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	//auto currObjectCB = mCurrFrameResource->ObjectCB;
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
@@ -872,6 +875,7 @@ void BlendApp::UpdateObjectCBs(const GameTimer& gt) {
 	}
 }
 void BlendApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -905,6 +909,7 @@ void BlendApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void BlendApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	//VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
@@ -929,6 +934,7 @@ void BlendApp::UpdateMaterialsCBs(const GameTimer& gt) {
 
 void BlendApp::UpdateWaves(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateWaves");
 	// Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if ((mTimer.TotalTime() - t_base) >= 0.25f)
@@ -965,6 +971,7 @@ void BlendApp::UpdateWaves(const GameTimer& gt)
 
 void BlendApp::AnimateMaterials(const GameTimer& gt)
 {
+	CPU_ZONE("AnimateMaterials");
 	// Scroll the water material texture coordinates.
 	auto waterMat = mMaterials["water"].get();
 
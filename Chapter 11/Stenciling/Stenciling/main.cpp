@@ -22,7 +22,8 @@
 
 #include "temp.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 
@@ -186,6 +187,7 @@ StencilApp::~StencilApp() {
 bool StencilApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 	LoadTextures();
 	
 	BuildRoomGeometry();
@@ -993,8 +995,8 @@ void StencilApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	
@@ -1021,6 +1023,7 @@ void StencilApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void StencilApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	//auto currObjectCB = mCurrFrameResource->ObjectCB;
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
@@ -1043,6 +1046,7 @@ void StencilApp::UpdateObjectCBs(const GameTimer& gt) {
 	}
 }
 void StencilApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -1077,6 +1081,7 @@ void StencilApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void StencilApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	//VkDeviceSize minAlignmentSize = mDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	//VkDeviceSize objSize = ((uint32_t)sizeof(MaterialConstants) + minAlignmentSize - 1) & ~(minAlignmentSize - 1);
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
@@ -1104,6 +1109,7 @@ void StencilApp::UpdateMaterialsCBs(const GameTimer& gt) {
 
 void StencilApp::UpdateReflectedPassCB(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateReflectedPassCB");
 	mReflectedPassCB = mMainPassCB;
 
 	glm::vec4 mirrorPlane = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f); // xy plane
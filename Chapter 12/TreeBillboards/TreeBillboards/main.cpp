@@ -14,7 +14,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -170,6 +171,7 @@ TreeBillboardApp::~TreeBillboardApp() {
 bool TreeBillboardApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
 	LoadTextures();
@@ -1052,8 +1054,8 @@ void TreeBillboardApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 
@@ -1080,6 +1082,7 @@ void TreeBillboardApp::UpdateCamera(const GameTimer& gt) {
 
 
 void TreeBillboardApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 	
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -1099,6 +1102,7 @@ void TreeBillboardApp::UpdateObjectCBs(const GameTimer& gt) {
 	}
 }
 void TreeBillboardApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -1133,6 +1137,7 @@ void TreeBillboardApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void TreeBillboardApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& ub = *uniformBuffer;
 	VkDeviceSize objSize = ub[2].objectSize;
@@ -1154,6 +1159,7 @@ void TreeBillboardApp::UpdateMaterialsCBs(const GameTimer& gt) {
 
 void TreeBillboardApp::UpdateWaves(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateWaves");
 	// Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if ((mTimer.TotalTime() - t_base) >= 0.25f)
@@ -1193,6 +1199,7 @@ void TreeBillboardApp::UpdateWaves(const GameTimer& gt)
 
 void TreeBillboardApp::AnimateMaterials(const GameTimer& gt)
 {
+	CPU_ZONE("AnimateMaterials");
 	// Scroll the water material texture coordinates.
 	auto waterMat = mMaterials["water"].get();
 
@@ -15,7 +15,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -162,6 +163,7 @@ BlurApp::~BlurApp() {
 bool BlurApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
 	blurFilter = std::make_unique<BlurFilter>(mDevice,mComputeQueue, mClientWidth, mClientHeight, PREFERRED_IMAGE_FORMAT);
@@ -789,8 +791,8 @@ void BlurApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	// Cycle through the circular frame resource array.
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 
@@ -816,6 +818,7 @@ void BlurApp::UpdateCamera(const GameTimer& gt) {
 }
 
 void BlurApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -835,6 +838,7 @@ void BlurApp::UpdateObjectCBs(const GameTimer& gt) {
 	}
 }
 void BlurApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -869,6 +873,7 @@ void BlurApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void BlurApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& ub = *uniformBuffer;
 	VkDeviceSize objSize = ub[2].objectSize;
@@ -892,6 +897,7 @@ void BlurApp::UpdateMaterialsCBs(const GameTimer& gt) {
 
 void BlurApp::UpdateWaves(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateWaves");
 	// Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if ((mTimer.TotalTime() - t_base) >= 0.25f)
@@ -928,6 +934,7 @@ void BlurApp::UpdateWaves(const GameTimer& gt)
 
 void BlurApp::AnimateMaterials(const GameTimer& gt)
 {
+	CPU_ZONE("AnimateMaterials");
 	// Scroll the water material texture coordinates.
 	auto waterMat = mMaterials["water"].get();
 
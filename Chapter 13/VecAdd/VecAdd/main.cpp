@@ -13,7 +13,8 @@
 
 #include "FrameResource.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct Data
 {
@@ -141,6 +142,7 @@ VecAddCSApp::~VecAddCSApp() {
 bool VecAddCSApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	BuildBuffers();
 	BuildPSOs();
@@ -17,7 +17,8 @@
 #include "GpuWaves.h"
 
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -177,6 +178,7 @@ WavesCSApp::~WavesCSApp() {
 bool WavesCSApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mWaves = std::make_unique<GpuWaves>(mDevice, mMemoryProperties, mGraphicsQueue, mCommandBuffer, 256, 256, 0.25f, 0.03f, 2.0f, 0.2f);
 
@@ -914,6 +916,7 @@ void WavesCSApp::OnKeyboardInput(const GameTimer& gt)
 }
 
 void WavesCSApp::UpdateWavesGPU(const GameTimer& gt) {
+	CPU_ZONE("UpdateWavesGPU");
 	// Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	auto& ud = *wavesUniformDescriptors;
@@ -961,8 +964,8 @@ void WavesCSApp::Update(const GameTimer& gt) {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 
@@ -990,6 +993,7 @@ void WavesCSApp::UpdateCamera(const GameTimer& gt) {
 
 
 void WavesCSApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -1012,6 +1016,7 @@ void WavesCSApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void WavesCSApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mView;
 	glm::mat4 proj = mProj;
 	proj[1][1] *= -1;
@@ -1047,6 +1052,7 @@ void WavesCSApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 void WavesCSApp::UpdateMaterialsCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsCBs");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& ub = *uniformBuffer;
 	VkDeviceSize objSize = ub[2].objectSize;
@@ -1067,6 +1073,7 @@ void WavesCSApp::UpdateMaterialsCBs(const GameTimer& gt) {
 
 void WavesCSApp::AnimateMaterials(const GameTimer& gt)
 {
+	CPU_ZONE("AnimateMaterials");
 	// Scroll the water material texture coordinates.
 	auto waterMat = mMaterials["water"].get();
 
@@ -1,9 +1,8 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(PassConstants* pc, ObjectConstants* oc, MaterialData* md) {
+FrameResource::FrameResource(PassConstants* pc, ObjectConstants* oc) {
 	pPCs = pc;
 	pOCs = oc;
-	pMats = md;
 }
 
 FrameResource::~FrameResource() {
@@ -57,11 +57,10 @@ struct Vertex {
 };
 
 struct FrameResource {
-	FrameResource(PassConstants* pc, ObjectConstants* oc, MaterialData* md);
+	FrameResource(PassConstants* pc, ObjectConstants* oc);
 	FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator=(const FrameResource& rhs) = delete;
 	~FrameResource();
 	PassConstants* pPCs{ nullptr };
 	ObjectConstants* pOCs{ nullptr };
-	MaterialData* pMats{ nullptr };
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 layout(location=0) in vec3 NormalW;
 layout(location=1) in vec3 PosW;
 layout(location=2) in vec2 TexCoord;
@@ -77,8 +78,9 @@ layout (set=2, binding=0) readonly buffer MaterialBuffer{
 }materialData;
 
 
-layout (set=3,binding=0) uniform sampler samp;
-layout (set=3,binding=1) uniform texture2D textureMap[4];
+//bindless heap, only the slots textures were registered in are valid
+layout (set=2,binding=1) uniform sampler samp;
+layout (set=2,binding=2) uniform texture2D textureMap[];
 
 #define NUM_DIR_LIGHTS 3
 #define NUM_POINT_LIGHTS 0
@@ -248,7 +250,7 @@ void main(){
 	float roughness = matData.Roughness;
 	uint diffuseTexIndex = matData.DiffuseMapIndex;
 	
-	diffuseAlbedo *= texture(sampler2D(textureMap[diffuseTexIndex],samp),TexCoord);
+	diffuseAlbedo *= texture(sampler2D(textureMap[nonuniformEXT(diffuseTexIndex)],samp),TexCoord);
 	vec3 norm = normalize(NormalW);
 	// Vector from point being lit to eye.
 	vec3 toEyeW = gEyePosW - PosW;	
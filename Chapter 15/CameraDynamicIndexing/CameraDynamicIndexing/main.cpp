@@ -6,10 +6,13 @@
 #include "../../../Common/Colors.h"
 #include "../../../Common/TextureLoader.h"
 #include "../../../Common/Camera.h"
+#include "../../../Common/BindlessHeap.h"
 #include <memory>
 #include "FrameResource.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
+const uint32_t gMaxTextures = 256;//bindless heap slots
 
 struct RenderItem {
 	RenderItem() = default;
@@ -45,11 +48,9 @@ class CameraAndDynamicIndexingApp : public VulkApp {
 	std::unique_ptr<DescriptorSetPoolCache> descriptorSetPoolCache;
 	std::unique_ptr<VulkanUniformBuffer> uniformBuffer;	
 	std::unique_ptr<VulkanImageList> textures;
-	std::unique_ptr<VulkanUniformBuffer> storageBuffer;
 	std::unique_ptr<VulkanDescriptorList> uniformDescriptors;
-	std::unique_ptr<VulkanDescriptorList> textureDescriptors;
 	std::unique_ptr<VulkanSampler> sampler;
-	std::unique_ptr<VulkanDescriptorList> storageDescriptors;
+	std::unique_ptr<BindlessHeap> mHeap;//materials and every texture, set 2
 	std::unique_ptr<VulkanPipelineLayout> pipelineLayout;
 	std::unique_ptr<VulkanPipeline> opaquePipeline;
 	std::unique_ptr<VulkanPipeline> wireframePipeline;
@@ -110,6 +111,7 @@ CameraAndDynamicIndexingApp::CameraAndDynamicIndexingApp(HINSTANCE hInstance) :V
 	mClearValues[0].color = Colors::LightSteelBlue;
 	mMSAA = false;
 	mDepthBuffer = true;
+	mDescriptorIndexing = true;
 }
 
 CameraAndDynamicIndexingApp::~CameraAndDynamicIndexingApp() {
@@ -129,6 +131,9 @@ CameraAndDynamicIndexingApp::~CameraAndDynamicIndexingApp() {
 bool CameraAndDynamicIndexingApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
+	if (!mDescriptorIndexingSupported)
+		throw std::runtime_error("VK_EXT_descriptor_indexing is needed for the bindless texture heap");
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
 
@@ -203,10 +208,15 @@ void CameraAndDynamicIndexingApp::BuildBuffers() {
 		.build(dynamicBuffer, bufferInfo);
 	uniformBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
 
-	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, true)
-		.AddBuffer(sizeof(MaterialData), mMaterials.size(), gNumFrameResources)
-		.build(dynamicBuffer, bufferInfo);
-	storageBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
+	//materials and textures live in the heap, textures keep their slot for as long as they're loaded
+	mHeap = std::make_unique<BindlessHeap>(mDevice, mMemoryProperties, *sampler, gMaxTextures, sizeof(MaterialData), (uint32_t)mMaterials.size(), gNumFrameResources);
+	auto& tl = *textures;
+	std::vector<uint32_t> heapIndices(tl);
+	for (int i = 0; i < (int)tl; ++i)
+		heapIndices[i] = mHeap->AddTexture(tl[i].imageView);
+	//materials were set up with the load order
+	for (auto& e : mMaterials)
+		e.second->DiffuseSrvHeapIndex = heapIndices[e.second->DiffuseSrvHeapIndex];
 }
 
 void CameraAndDynamicIndexingApp::BuildDescriptors() {
@@ -228,26 +238,6 @@ void CameraAndDynamicIndexingApp::BuildDescriptors() {
 	std::vector<VkDescriptorSet> descriptors{ descriptor0,descriptor1 };
 	uniformDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
 
-	VkDescriptorSet descriptor2 = VK_NULL_HANDLE;
-	
-	VkDescriptorSetLayout descriptorLayout2;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
-		.build(descriptor2, descriptorLayout2);
-
-	descriptors = { descriptor2 };
-	storageDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
-
-	VkDescriptorSet descriptor3 = VK_NULL_HANDLE;	
-	VkDescriptorSetLayout descriptorLayout3 = VK_NULL_HANDLE;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0,VK_DESCRIPTOR_TYPE_SAMPLER,VK_SHADER_STAGE_FRAGMENT_BIT)
-		.AddBinding(1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT,(uint32_t)*textures)
-		.build(descriptor3, descriptorLayout3);
-
-	descriptors = { descriptor3 };
-	textureDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
-
 	VkDeviceSize offset = 0;
 	descriptors = { descriptor0,descriptor1};
 	std::vector<VkDescriptorSetLayout> descriptorLayouts = { descriptorLayout0,descriptorLayout1};
@@ -266,40 +256,12 @@ void CameraAndDynamicIndexingApp::BuildDescriptors() {
 		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), layout, descriptors[i])
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &descrInfo)
 			.update();
-	}
-	{
-		auto& sb = *storageBuffer;
-		VkDescriptorBufferInfo descrInfo{};
-		descrInfo.buffer = sb;
-		descrInfo.range = sb[0].objectCount * sb[0].objectSize * sb[0].repeatCount;
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout2, descriptor2)
-			.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo)
-			.update();
-	}
-	{
-		auto& samp = *sampler;
-		VkDescriptorImageInfo sampInfo;
-		sampInfo.sampler = samp;
-		auto& tl = *textures;
-		std::vector<VkDescriptorImageInfo> imageInfos(tl);
-		for (int i = 0; i < (int)tl; ++i) {
-			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfos[i].imageView = tl[i].imageView;
-
-		}
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout3, descriptor3)
-			.AddBinding(0,VK_DESCRIPTOR_TYPE_SAMPLER,&sampInfo)
-			.AddBinding(1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfos.data(),(uint32_t) tl)
-			.update();
-		
-		
 	}
 	VkPipelineLayout layout{ VK_NULL_HANDLE };
 	PipelineLayoutBuilder::begin(mDevice)
 		.AddDescriptorSetLayout(descriptorLayout0)
 		.AddDescriptorSetLayout(descriptorLayout1)
-		.AddDescriptorSetLayout(descriptorLayout2)
-		.AddDescriptorSetLayout(descriptorLayout3)
+		.AddDescriptorSetLayout(mHeap->getLayout())
 		.build(layout);
 	pipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
 }
@@ -338,13 +300,12 @@ void CameraAndDynamicIndexingApp::BuildPSOs() {
 void CameraAndDynamicIndexingApp::BuildFrameResources() {
 	for (int i = 0; i < gNumFrameResources; i++) {
 		auto& ub = *uniformBuffer;
-		auto& sb = *storageBuffer;
 		PassConstants* pc = (PassConstants*)((uint8_t*)ub[0].ptr + ub[0].objectSize * ub[0].objectCount * i);// ((uint8_t*)pPassCB + passSize * i);
 		ObjectConstants* oc = (ObjectConstants*)((uint8_t*)ub[1].ptr + ub[1].objectSize * ub[1].objectCount * i);// ((uint8_t*)pObjectCB + objectSize * mAllRitems.size() * i);
 		//MaterialConstants* mc = (MaterialConstants*)((uint8_t*)ub[2].ptr + ub[2].objectSize * ub[2].objectCount * i);// ((uint8_t*)pMatCB + matSize * mMaterials.size() * i);
-		MaterialData* md = (MaterialData*)((uint8_t*)sb[0].ptr + sb[0].objectSize * sb[0].objectCount * i);
+		//materials are in the heap
 		//Vertex* pWv = (Vertex*)WaveVertexPtrs[i];
-		mFrameResources.push_back(std::make_unique<FrameResource>(pc, oc, md));// , pWv));
+		mFrameResources.push_back(std::make_unique<FrameResource>(pc, oc));// , pWv));
 	}
 }
 
@@ -613,9 +574,10 @@ void CameraAndDynamicIndexingApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	OnKeyboardInput(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
+	mHeap->BeginFrame(mCurrFrameResourceIndex);
 
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
@@ -625,6 +587,7 @@ void CameraAndDynamicIndexingApp::Update(const GameTimer& gt) {
 }
 
 void CameraAndDynamicIndexingApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -660,6 +623,7 @@ void CameraAndDynamicIndexingApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 void  CameraAndDynamicIndexingApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -672,7 +636,7 @@ void  CameraAndDynamicIndexingApp::UpdateObjectCBs(const GameTimer& gt) {
 			ObjectConstants objConstants;
 			objConstants.World = world;
 			objConstants.TexTransform = e->TexTransform;
-			objConstants.MaterialIndex = e->Mat->MatCBIndex;			
+			objConstants.MaterialIndex = mHeap->MaterialBase() + e->Mat->MatCBIndex;//this frame's copy in the heap
 			memcpy((pObjConsts + (objSize * e->ObjCBIndex)), &objConstants, sizeof(objConstants));
 			//pObjConsts[e->ObjCBIndex] = objConstants;
 			e->NumFramesDirty--;
@@ -681,9 +645,7 @@ void  CameraAndDynamicIndexingApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void CameraAndDynamicIndexingApp::UpdateMaterialsBuffer(const GameTimer& gt) {
-	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;	
-	auto& sb = *storageBuffer;
-	VkDeviceSize objSize = sb[0].objectSize;
+	CPU_ZONE("UpdateMaterialsBuffer");
 	for (auto& e : mMaterials) {
 		Material* mat = e.second.get();
 
@@ -695,7 +657,7 @@ void CameraAndDynamicIndexingApp::UpdateMaterialsBuffer(const GameTimer& gt) {
 			matData.Roughness = mat->Roughness;
 			matData.MatTransform = matTransform;
 			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
-			memcpy((pMatConsts + (objSize * mat->MatCBIndex)), &matData, sizeof(MaterialData));
+			mHeap->WriteMaterial(mat->MatCBIndex, matData);
 			mat->NumFramesDirty--;
 		}
 	}
@@ -780,19 +742,12 @@ void CameraAndDynamicIndexingApp::Draw(const GameTimer& gt) {
 	auto& ud = *uniformDescriptors;
 	//bind descriptors that don't change during pass
 	VkDescriptorSet descriptor0 = ud[0];//pass constant buffer
-	uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize };
+	//the frame resource Update wrote, objects and materials in the heap are read from the same one
+	uint32_t dynamicOffsets[1] = { mCurrFrameResourceIndex * (uint32_t)passSize };
 	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-	//bind storage buffer
-	auto& sb = *storageBuffer;
-	VkDeviceSize matSize = sb[0].objectSize * sb[0].objectCount;
-	auto& sd = *storageDescriptors;
-	VkDescriptorSet descriptor2 = sd[0];
-	dynamicOffsets[0] = mCurrFrame * (uint32_t)matSize;
-	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-	//bind texture array
-	auto& td = *textureDescriptors;
-	VkDescriptorSet descriptor3 = td[0];
-	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
+	//materials and textures, the one bind for the frame
+	VkDescriptorSet heap = *mHeap;
+	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &heap, 0, 0);
 	if (mIsWireframe) {
 		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque_wireframe"]);
 		DrawRenderItems(cmd, mOpaqueRitems);
@@ -808,6 +763,7 @@ void CameraAndDynamicIndexingApp::Draw(const GameTimer& gt) {
 void CameraAndDynamicIndexingApp::DrawRenderItems(VkCommandBuffer cmd, const std::vector<RenderItem*>& ritems) {
 	auto& ub = *uniformBuffer;	
 	VkDeviceSize objectSize = ub[1].objectSize;	
+	VkDeviceSize frameObjects = ub[1].objectCount * (VkDeviceSize)mCurrFrameResourceIndex;
 	auto& ud = *uniformDescriptors;	
 	VkDescriptorSet descriptor1 = ud[1];
 	
@@ -822,7 +778,7 @@ void CameraAndDynamicIndexingApp::DrawRenderItems(VkCommandBuffer cmd, const std
 
 		pvkCmdBindIndexBuffer(cmd, ibv.buffer, indexOffset * sizeof(uint32_t), VK_INDEX_TYPE_UINT32);
 		uint32_t cbvIndex = ri->ObjCBIndex;
-		uint32_t dyoffsets[2] = { (uint32_t)(cbvIndex * objectSize)};
+		uint32_t dyoffsets[2] = { (uint32_t)((frameObjects + cbvIndex) * objectSize)};
 		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 1, 1, &descriptor1, 1, dyoffsets);
 		pvkCmdDrawIndexed(cmd, ri->IndexCount, 1, 0, ri->BaseVertexLocation, 0);
 	}
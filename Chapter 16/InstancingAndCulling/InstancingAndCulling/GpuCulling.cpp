@@ -0,0 +1,305 @@
+#include "GpuCulling.h"
+#include <algorithm>
+#include <cstddef>
+
+GpuCulling::GpuCulling(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, uint32_t numFrames) :device(device_), memoryProperties(memoryProperties_) {
+	mNumFrames = numFrames;
+	mTwoPhase.resize(numFrames, false);
+	pvkCmdDrawIndexedIndirect = (PFN_vkCmdDrawIndexedIndirect)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirect");
+	assert(pvkCmdDrawIndexedIndirect);
+}
+
+GpuCulling::~GpuCulling() {
+	if (pCommands != nullptr)
+		Vulkan::unmapBuffer(device, mReadbackBuffer);
+	Vulkan::cleanupBuffer(device, mInstanceBuffer);
+	Vulkan::cleanupBuffer(device, mBoundsBuffer);
+	Vulkan::cleanupBuffer(device, mVisibleBuffer);
+	Vulkan::cleanupBuffer(device, mCommandBuffer);
+	Vulkan::cleanupBuffer(device, mReadbackBuffer);
+	Vulkan::cleanupBuffer(device, mOccludedBuffer);
+	Vulkan::cleanupBuffer(device, mStatsBuffer);
+}
+
+uint32_t GpuCulling::AddDraw(uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset) {
+	assert(pCommands == nullptr);
+	VkDrawIndexedIndirectCommand command{};
+	command.indexCount = indexCount;
+	command.instanceCount = 0;//counted by the compute shader
+	command.firstIndex = firstIndex;
+	command.vertexOffset = vertexOffset;
+	command.firstInstance = 0;//start of the draw's visible region, set in Build
+	mCommands.push_back(command);
+	return (uint32_t)mCommands.size() - 1;
+}
+
+void GpuCulling::AddInstance(uint32_t drawIndex, const InstanceData& data, const glm::vec3& minW, const glm::vec3& maxW) {
+	assert(pCommands == nullptr);
+	assert(drawIndex < mCommands.size());
+	GpuCullBounds bounds{};
+	bounds.Center = 0.5f * (minW + maxW);
+	bounds.Extents = 0.5f * (maxW - minW);
+	bounds.DrawIndex = drawIndex;
+	mInstances.push_back(data);
+	mBounds.push_back(bounds);
+	mInstanceCount++;
+	//borrow firstInstance to count the draw's instances until Build
+	mCommands[drawIndex].firstInstance++;
+}
+
+void GpuCulling::Build(VkPhysicalDeviceProperties& deviceProperties, VkQueue queue_, VkCommandBuffer cmd_) {
+	assert(!mInstances.empty());
+	//each draw gets as many visible slots as it has instances, one after the other
+	uint32_t firstInstance = 0;
+	for (auto& command : mCommands) {
+		uint32_t count = command.firstInstance;
+		command.firstInstance = firstInstance;
+		firstInstance += count;
+	}
+
+	VkDeviceSize instanceSize = sizeof(InstanceData) * mInstances.size();
+	VkDeviceSize boundsSize = sizeof(GpuCullBounds) * mBounds.size();
+	VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * mCommands.size() * 2 * mNumFrames;
+	Vulkan::Buffer stagingBuffer;
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	props.size = std::max(std::max(instanceSize, boundsSize), commandsSize);
+	Vulkan::initBuffer(device, memoryProperties, props, stagingBuffer);
+	uint8_t* ptr = (uint8_t*)Vulkan::mapBuffer(device, stagingBuffer);
+	memcpy(ptr, mInstances.data(), instanceSize);
+	Vulkan::unmapBuffer(device, stagingBuffer);
+
+	//instances and bounds never change, device local
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	props.size = instanceSize;
+	Vulkan::initBuffer(device, memoryProperties, props, mInstanceBuffer);
+	Vulkan::CopyBufferTo(device, queue_, cmd_, stagingBuffer, mInstanceBuffer, instanceSize);
+
+	//CopyBufferTo always copies from the start of src, reuse the staging buffer for the bounds
+	ptr = (uint8_t*)Vulkan::mapBuffer(device, stagingBuffer);
+	memcpy(ptr, mBounds.data(), boundsSize);
+	Vulkan::unmapBuffer(device, stagingBuffer);
+	props.size = boundsSize;
+	Vulkan::initBuffer(device, memoryProperties, props, mBoundsBuffer);
+	Vulkan::CopyBufferTo(device, queue_, cmd_, stagingBuffer, mBoundsBuffer, boundsSize);
+
+	//indirect commands, a copy per phase per frame with its own visible region,
+	//device local too, Dispatch clears the counts with vkCmdFillBuffer
+	ptr = (uint8_t*)Vulkan::mapBuffer(device, stagingBuffer);
+	VkDrawIndexedIndirectCommand* pStagingCommands = (VkDrawIndexedIndirectCommand*)ptr;
+	for (uint32_t pass = 0; pass < 2 * mNumFrames; ++pass) {
+		for (size_t i = 0; i < mCommands.size(); ++i) {
+			pStagingCommands[pass * mCommands.size() + i] = mCommands[i];
+			pStagingCommands[pass * mCommands.size() + i].firstInstance += mInstanceCount * pass;
+		}
+	}
+	Vulkan::unmapBuffer(device, stagingBuffer);
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	props.size = commandsSize;
+	Vulkan::initBuffer(device, memoryProperties, props, mCommandBuffer);
+	Vulkan::CopyBufferTo(device, queue_, cmd_, stagingBuffer, mCommandBuffer, commandsSize);
+	Vulkan::cleanupBuffer(device, stagingBuffer);
+
+	//visible lists and occlusion flags, only ever touched by the gpu
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	props.size = sizeof(uint32_t) * mInstanceCount * 2 * mNumFrames;
+	Vulkan::initBuffer(device, memoryProperties, props, mVisibleBuffer);
+	props.size = sizeof(uint32_t) * mInstanceCount * mNumFrames;
+	Vulkan::initBuffer(device, memoryProperties, props, mOccludedBuffer);
+
+	//where Dispatch copies the counted commands and the occluded counts for BeginFrame
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	props.size = commandsSize + sizeof(uint32_t) * mNumFrames;
+	Vulkan::initBuffer(device, memoryProperties, props, mReadbackBuffer);
+	pCommands = (VkDrawIndexedIndirectCommand*)Vulkan::mapBuffer(device, mReadbackBuffer);
+	pStats = (uint32_t*)((uint8_t*)pCommands + commandsSize);
+	memset(pCommands, 0, props.size);
+
+	//counted by the cull shader, cleared and copied back by Dispatch
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	props.size = sizeof(uint32_t) * mNumFrames;
+	Vulkan::initBuffer(device, memoryProperties, props, mStatsBuffer);
+
+	Vulkan::Buffer constantBuffer;
+	std::vector<UniformBufferInfo> bufferInfo;
+	UniformBufferBuilder::begin(device, deviceProperties, memoryProperties, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, true)
+		.AddBuffer(sizeof(GpuCullConstants), 2, mNumFrames)
+		.build(constantBuffer, bufferInfo);
+	mConstantBuffer = std::make_unique<VulkanUniformBuffer>(device, constantBuffer, bufferInfo);
+
+	mInstances.clear();
+	mInstances.shrink_to_fit();
+	mBounds.clear();
+	mBounds.shrink_to_fit();
+}
+
+void GpuCulling::GetComputeDescriptors(VkDescriptorBufferInfo* pBufferInfo)const {
+	pBufferInfo[0].buffer = mBoundsBuffer.buffer;
+	pBufferInfo[0].offset = 0;
+	pBufferInfo[0].range = VK_WHOLE_SIZE;
+	pBufferInfo[1].buffer = mCommandBuffer.buffer;
+	pBufferInfo[1].offset = 0;
+	pBufferInfo[1].range = VK_WHOLE_SIZE;
+	pBufferInfo[2].buffer = mVisibleBuffer.buffer;
+	pBufferInfo[2].offset = 0;
+	pBufferInfo[2].range = VK_WHOLE_SIZE;
+	auto& cb = *mConstantBuffer;
+	pBufferInfo[3].buffer = cb;
+	pBufferInfo[3].offset = 0;
+	pBufferInfo[3].range = cb[0].objectSize;
+	pBufferInfo[4].buffer = mOccludedBuffer.buffer;
+	pBufferInfo[4].offset = 0;
+	pBufferInfo[4].range = VK_WHOLE_SIZE;
+	pBufferInfo[5].buffer = mStatsBuffer.buffer;
+	pBufferInfo[5].offset = 0;
+	pBufferInfo[5].range = VK_WHOLE_SIZE;
+}
+
+void GpuCulling::GetVertexDescriptors(VkDescriptorBufferInfo* pBufferInfo)const {
+	pBufferInfo[0].buffer = mInstanceBuffer.buffer;
+	pBufferInfo[0].offset = 0;
+	pBufferInfo[0].range = VK_WHOLE_SIZE;
+	pBufferInfo[1].buffer = mVisibleBuffer.buffer;
+	pBufferInfo[1].offset = 0;
+	pBufferInfo[1].range = VK_WHOLE_SIZE;
+}
+
+GpuCullStats GpuCulling::BeginFrame(uint32_t frame, const glm::vec4 planes[6], const GpuOcclusion& occlusion) {
+	GpuCullStats stats;
+	uint32_t recovered = 0;
+	uint32_t phases = mTwoPhase[frame] ? 2 : 1;
+	for (uint32_t phase = 0; phase < phases; ++phase) {
+		const VkDrawIndexedIndirectCommand* pPassCommands = PassCommands(frame, phase);
+		for (size_t i = 0; i < mCommands.size(); ++i) {
+			if (phase == 1)
+				recovered += pPassCommands[i].instanceCount;
+			stats.Visible += pPassCommands[i].instanceCount;
+		}
+	}
+	mTwoPhase[frame] = occlusion.Enabled;
+	//phase 1 only looks at what phase 0 flagged, whatever it didn't draw stayed hidden
+	stats.Occluded = pStats[frame] - recovered;
+
+	auto& cb = *mConstantBuffer;
+	for (uint32_t phase = 0; phase < 2; ++phase) {
+		GpuCullConstants* pConstants = (GpuCullConstants*)((uint8_t*)cb[0].ptr + cb[0].objectSize * PassIndex(frame, phase));
+		for (int p = 0; p < 6; ++p)
+			pConstants->Planes[p] = planes[p];
+		//phase 0 against the last frame's depth, phase 1 against this frame's phase 0
+		pConstants->OcclusionViewProj = phase == 0 ? occlusion.PrevViewProj : occlusion.ViewProj;
+		pConstants->DepthSize = occlusion.DepthSize;
+		pConstants->HiZLevels = occlusion.HiZLevels;
+		pConstants->Phase = phase;
+		pConstants->InstanceCount = mInstanceCount;
+		pConstants->FirstCommand = (uint32_t)mCommands.size() * PassIndex(frame, phase);
+		pConstants->Frame = frame;
+		pConstants->OcclusionEnabled = occlusion.Enabled && (phase == 1 || occlusion.PrevValid) ? 1 : 0;
+	}
+	return stats;
+}
+
+void GpuCulling::Dispatch(VkCommandBuffer cmd_, VkPipelineLayout pipelineLayout_, VkPipeline pipeline_, VkDescriptorSet descriptorSet_, VkDescriptorSet hizDescriptorSet_, uint32_t frame, uint32_t phase)const {
+	auto& cb = *mConstantBuffer;
+	uint32_t dynamicOffset = (uint32_t)(cb[0].objectSize * PassIndex(frame, phase));
+	VkDescriptorSet descriptorSets[2] = { descriptorSet_,hizDescriptorSet_ };
+	VkDeviceSize passBytes = sizeof(VkDrawIndexedIndirectCommand) * mCommands.size();
+	if (phase == 0) {
+		//both phases start from no instances, the fence has retired the last draws from them
+		for (uint32_t i = 0; i < 2 * mCommands.size(); ++i) {
+			VkDeviceSize offset = passBytes * PassIndex(frame, 0) + sizeof(VkDrawIndexedIndirectCommand) * i + offsetof(VkDrawIndexedIndirectCommand, instanceCount);
+			vkCmdFillBuffer(cmd_, mCommandBuffer.buffer, offset, sizeof(uint32_t), 0);
+		}
+		vkCmdFillBuffer(cmd_, mStatsBuffer.buffer, sizeof(uint32_t) * frame, sizeof(uint32_t), 0);
+		VkBufferMemoryBarrier fillBarriers[2]{};
+		fillBarriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		fillBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		fillBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		fillBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		fillBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		fillBarriers[0].buffer = mCommandBuffer.buffer;
+		fillBarriers[0].offset = passBytes * PassIndex(frame, 0);
+		fillBarriers[0].size = passBytes * 2;
+		fillBarriers[1] = fillBarriers[0];
+		fillBarriers[1].buffer = mStatsBuffer.buffer;
+		fillBarriers[1].offset = sizeof(uint32_t) * frame;
+		fillBarriers[1].size = sizeof(uint32_t);
+		vkCmdPipelineBarrier(cmd_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 2, fillBarriers, 0, nullptr);
+	}
+	vkCmdBindPipeline(cmd_, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+	vkCmdBindDescriptorSets(cmd_, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 2, descriptorSets, 1, &dynamicOffset);
+	//one invocation per instance, 64 per group as in cullinstances.comp
+	vkCmdDispatch(cmd_, (mInstanceCount + 63) / 64, 1, 1);
+
+	VkBufferMemoryBarrier barriers[4]{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;//counts are copied back for BeginFrame
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].buffer = mCommandBuffer.buffer;
+	barriers[0].offset = passBytes * PassIndex(frame, phase);
+	barriers[0].size = passBytes;
+	barriers[1] = barriers[0];
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[1].buffer = mVisibleBuffer.buffer;
+	barriers[1].offset = sizeof(uint32_t) * mInstanceCount * PassIndex(frame, phase);
+	barriers[1].size = sizeof(uint32_t) * mInstanceCount;
+	//phase 0's flags are read by phase 1, its count is copied back for BeginFrame
+	barriers[2] = barriers[1];
+	barriers[2].buffer = mOccludedBuffer.buffer;
+	barriers[2].offset = sizeof(uint32_t) * mInstanceCount * frame;
+	barriers[3] = barriers[0];
+	barriers[3].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[3].buffer = mStatsBuffer.buffer;
+	barriers[3].offset = sizeof(uint32_t) * frame;
+	barriers[3].size = sizeof(uint32_t);
+	vkCmdPipelineBarrier(cmd_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 4, barriers, 0, nullptr);
+
+	VkBufferCopy region{};
+	region.srcOffset = barriers[0].offset;
+	region.dstOffset = barriers[0].offset;
+	region.size = passBytes;
+	vkCmdCopyBuffer(cmd_, mCommandBuffer.buffer, mReadbackBuffer.buffer, 1, &region);
+	if (phase == 0) {
+		//only phase 0 counts the occluded
+		VkBufferCopy statsRegion{};
+		statsRegion.srcOffset = sizeof(uint32_t) * frame;
+		statsRegion.dstOffset = (uint8_t*)(pStats + frame) - (uint8_t*)pCommands;
+		statsRegion.size = sizeof(uint32_t);
+		vkCmdCopyBuffer(cmd_, mStatsBuffer.buffer, mReadbackBuffer.buffer, 1, &statsRegion);
+	}
+	VkBufferMemoryBarrier readback{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+	readback.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	readback.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	readback.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	readback.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	readback.buffer = mReadbackBuffer.buffer;
+	readback.offset = 0;
+	readback.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(cmd_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &readback, 0, nullptr);
+}
+
+void GpuCulling::Draw(VkCommandBuffer cmd_, uint32_t drawIndex, uint32_t frame, uint32_t phase)const {
+	VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * (mCommands.size() * PassIndex(frame, phase) + drawIndex);
+	pvkCmdDrawIndexedIndirect(cmd_, mCommandBuffer.buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+}
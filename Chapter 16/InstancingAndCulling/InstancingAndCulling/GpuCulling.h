@@ -0,0 +1,124 @@
+#pragma once
+#include "../../../Common/Vulkan.h"
+#include "../../../Common/VulkanEx.h"
+#include "FrameResource.h"
+#include <glm/glm.hpp>
+#include <memory>
+
+///<summary>
+/// GPU driven instance culling. Every instance of every draw is uploaded once
+/// to static storage buffers (InstanceData plus world space bounds), and each
+/// frame a compute shader (cullinstances.comp) tests them against the frustum
+/// planes. Survivors are appended with an atomic to their draw's
+/// VkDrawIndexedIndirectCommand::instanceCount, and the slot it returns is
+/// where the instance index goes in the visible list, so the draws are
+/// recorded with vkCmdDrawIndexedIndirect and never go back to the CPU.
+///
+/// The visible list holds a region per draw per phase per frame, the
+/// command's firstInstance points at it so indirect.vert reads
+/// instances[visible[gl_InstanceIndex]].
+///
+/// With occlusion culling each frame runs in two phases. Phase 0 also tests
+/// the frustum survivors against the Hi-Z pyramid of the last frame's depth,
+/// projected with the matrix that frame was drawn with; the ones behind it
+/// are flagged instead of drawn. Once phase 0 is drawn the pyramid is rebuilt
+/// from this frame's depth and phase 1 retests only the flagged instances,
+/// drawing the ones that have come into view since, so nothing stays missing
+/// for a frame when the camera moves.
+///</summary>
+
+// Layouts below must match Shaders/cullinstances.comp (std430/std140).
+struct GpuCullBounds {
+	glm::vec3 Center;
+	uint32_t DrawIndex;
+	glm::vec3 Extents;
+	uint32_t pad0;
+};
+
+struct GpuCullConstants {
+	glm::vec4 Planes[6];
+	glm::mat4 OcclusionViewProj;	// the matrix the Hi-Z pyramid's depth was drawn with
+	glm::vec2 DepthSize;	// depth buffer pixels
+	uint32_t HiZLevels;
+	uint32_t Phase;
+	uint32_t InstanceCount;
+	uint32_t FirstCommand;	// (frame * 2 + phase) * draw count, the commands of this pass
+	uint32_t Frame;
+	uint32_t OcclusionEnabled;
+};
+
+// Occlusion settings for one frame, see BeginFrame.
+struct GpuOcclusion {
+	bool Enabled{ false };
+	bool PrevValid{ false };	// the pyramid holds the last frame's depth
+	glm::mat4 PrevViewProj{ 1.0f };
+	glm::mat4 ViewProj{ 1.0f };
+	glm::vec2 DepthSize{ 0.0f };
+	uint32_t HiZLevels{ 0 };
+};
+
+// What the GPU counted the last time a frame ran.
+struct GpuCullStats {
+	uint32_t Visible{ 0 };	// drawn in either phase
+	uint32_t Occluded{ 0 };	// passed the frustum test but hidden in both phases
+};
+
+class GpuCulling {
+	VkDevice device{ VK_NULL_HANDLE };
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	uint32_t mNumFrames{ 0 };
+	uint32_t mInstanceCount{ 0 };
+
+	// CPU side until Build, then only the commands are kept.
+	std::vector<InstanceData> mInstances;
+	std::vector<GpuCullBounds> mBounds;
+	std::vector<VkDrawIndexedIndirectCommand> mCommands;
+
+	Vulkan::Buffer mInstanceBuffer;
+	Vulkan::Buffer mBoundsBuffer;
+	Vulkan::Buffer mVisibleBuffer;
+	Vulkan::Buffer mCommandBuffer;	// device local, counts reset and counted on the GPU
+	Vulkan::Buffer mReadbackBuffer;	// host visible copy of the commands then the occluded counts
+	VkDrawIndexedIndirectCommand* pCommands{ nullptr };	// mapped mReadbackBuffer
+	uint32_t* pStats{ nullptr };	// in mReadbackBuffer, after the commands
+	std::vector<bool> mTwoPhase;	// per frame, phase 1 was dispatched the last time it ran
+	PFN_vkCmdDrawIndexedIndirect pvkCmdDrawIndexedIndirect{ nullptr };
+	Vulkan::Buffer mOccludedBuffer;	// per instance per frame, 1 if phase 0 found it hidden
+	Vulkan::Buffer mStatsBuffer;	// per frame, how many phase 0 found hidden, device local
+	std::unique_ptr<VulkanUniformBuffer> mConstantBuffer;
+
+	uint32_t PassIndex(uint32_t frame, uint32_t phase)const { return frame * 2 + phase; }
+	VkDrawIndexedIndirectCommand* PassCommands(uint32_t frame, uint32_t phase)const { return pCommands + mCommands.size() * PassIndex(frame, phase); }
+public:
+	GpuCulling(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, uint32_t numFrames);
+	GpuCulling(const GpuCulling& rhs) = delete;
+	GpuCulling& operator=(const GpuCulling& rhs) = delete;
+	~GpuCulling();
+
+	// Returns the draw index to pass to AddInstance and Draw.
+	uint32_t AddDraw(uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset);
+	void AddInstance(uint32_t drawIndex, const InstanceData& data, const glm::vec3& minW, const glm::vec3& maxW);
+	// Upload the static buffers, no more draws or instances after this.
+	void Build(VkPhysicalDeviceProperties& deviceProperties, VkQueue queue_, VkCommandBuffer cmd_);
+
+	uint32_t InstanceCount()const { return mInstanceCount; }
+	uint32_t DrawCount()const { return (uint32_t)mCommands.size(); }
+
+	// Compute set bindings 0-5 and the vertex set bindings 0-1.
+	void GetComputeDescriptors(VkDescriptorBufferInfo* pBufferInfo)const;
+	void GetVertexDescriptors(VkDescriptorBufferInfo* pBufferInfo)const;
+
+	// Once the frame's fence has been waited on: returns what the GPU counted
+	// the last time this frame ran, then resets the counts and sets the planes
+	// and occlusion constants of both phases.
+	GpuCullStats BeginFrame(uint32_t frame, const glm::vec4 planes[6], const GpuOcclusion& occlusion);
+
+	// Record one phase's dispatch and the barrier that makes its commands and visible
+	// list ready for the indirect draws, outside the render pass, then the copy of its
+	// counts for BeginFrame. Phase 0 first clears the frame's counts and occluded count. hizDescriptorSet_
+	// is set 1, the pyramid the phase tests against. Phase 1 must be dispatched when
+	// BeginFrame was given occlusion, and only then.
+	void Dispatch(VkCommandBuffer cmd_, VkPipelineLayout pipelineLayout_, VkPipeline pipeline_, VkDescriptorSet descriptorSet_, VkDescriptorSet hizDescriptorSet_, uint32_t frame, uint32_t phase)const;
+	// Vertex and index buffers are bound by the caller.
+	void Draw(VkCommandBuffer cmd_, uint32_t drawIndex, uint32_t frame, uint32_t phase)const;
+};
@@ -0,0 +1,138 @@
+#include "HiZPyramid.h"
+#include <algorithm>
+
+HiZPyramid::HiZPyramid(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, DescriptorSetPoolCache* pPoolCache_, DescriptorSetLayoutCache* pLayoutCache_,
+	VkQueue queue_, VkCommandBuffer cmd_, VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight) :VulkanObject(device_), memoryProperties(memoryProperties_), pLayoutCache(pLayoutCache_) {
+	//enough sets for any size, so a resize only has to update them
+	DescriptorSetBuilder::begin(pPoolCache_, pLayoutCache_)
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build(buildDescriptorSets, buildDescriptorSetLayout, MaxLevels);
+	DescriptorSetBuilder::begin(pPoolCache_, pLayoutCache_)
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build(readDescriptorSet, readDescriptorSetLayout);
+	BuildResource(queue_, cmd_, depthView, depthWidth, depthHeight);
+}
+
+HiZPyramid::~HiZPyramid() {
+	CleanupResource();
+}
+
+void HiZPyramid::OnResize(VkQueue queue_, VkCommandBuffer cmd_, VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight) {
+	CleanupResource();
+	BuildResource(queue_, cmd_, depthView, depthWidth, depthHeight);
+}
+
+void HiZPyramid::BuildResource(VkQueue queue_, VkCommandBuffer cmd_, VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight) {
+	width = (std::max)(1u, depthWidth >> 1);
+	height = (std::max)(1u, depthHeight >> 1);
+	levels = 1;
+	for (uint32_t size = (std::max)(width, height); size > 1 && levels < MaxLevels; size >>= 1)
+		levels++;
+
+	pyramid = std::make_unique<VulkanTexture>(device, TextureBuilder::begin(device, memoryProperties)
+		.setDimensions(width, height)
+		.setFormat(format)
+		.setMipLevels(levels)
+		.setImageUsage(VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+		.setSamplerFilter(VK_FILTER_NEAREST)
+		.build());
+	//the culling dispatch binds the read set whether or not a build has run yet
+	Vulkan::transitionImage(device, queue_, cmd_, pyramid->operator VkImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, levels);
+
+	levelViews.resize(levels);
+	for (uint32_t level = 0; level < levels; ++level) {
+		VkImageViewCreateInfo viewCI{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewCI.image = pyramid->operator VkImage();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = format;
+		viewCI.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT,level,1,0,1 };
+		VkResult res = vkCreateImageView(device, &viewCI, nullptr, &levelViews[level]);
+		assert(res == VK_SUCCESS);
+	}
+
+	for (uint32_t level = 0; level < levels; ++level) {
+		VkDescriptorImageInfo srcInfo{};
+		srcInfo.sampler = pyramid->operator VkSampler();
+		srcInfo.imageView = level == 0 ? depthView : levelViews[level - 1];
+		srcInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		VkDescriptorImageInfo dstInfo{};
+		dstInfo.imageView = levelViews[level];
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		DescriptorSetUpdater::begin(pLayoutCache, buildDescriptorSetLayout, buildDescriptorSets[level])
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &srcInfo)
+			.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &dstInfo)
+			.update();
+	}
+	VkDescriptorImageInfo readInfo{};
+	readInfo.sampler = pyramid->operator VkSampler();
+	readInfo.imageView = pyramid->operator VkImageView();
+	readInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	DescriptorSetUpdater::begin(pLayoutCache, readDescriptorSetLayout, readDescriptorSet)
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &readInfo)
+		.update();
+}
+
+void HiZPyramid::CleanupResource() {
+	for (auto view : levelViews)
+		vkDestroyImageView(device, view, nullptr);
+	levelViews.clear();
+	pyramid.reset();
+}
+
+void HiZPyramid::Build(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout_, VkPipeline pipeline_, VkImage depthImage)const {
+	//depth to sampled once its writes are done, the pyramid is rewritten from scratch
+	//so its old contents can go, but not before earlier culling dispatches have read them
+	VkImageMemoryBarrier barriers[2]{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = depthImage;
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT,0,1,0,1 };
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = pyramid->operator VkImage();
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT,0,levels,0,1 };
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	//after each level: its writes are visible to the next level, and after the last
+	//one to the culling dispatch, with the depth buffer back as an attachment
+	VkImageMemoryBarrier levelBarriers[2]{};
+	levelBarriers[0] = barriers[1];
+	levelBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	levelBarriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	levelBarriers[1] = barriers[0];
+	levelBarriers[1].srcAccessMask = 0;
+	levelBarriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	levelBarriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	levelBarriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+	uint32_t levelWidth = width;
+	uint32_t levelHeight = height;
+	for (uint32_t level = 0; level < levels; ++level) {
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &buildDescriptorSets[level], 0, nullptr);
+		//8x8 groups as in hiz.comp
+		vkCmdDispatch(cmd, (levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+		levelBarriers[0].subresourceRange.baseMipLevel = level;
+		levelBarriers[0].subresourceRange.levelCount = 1;
+		bool last = level + 1 == levels;
+		VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		if (last)
+			dstStages |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 0, nullptr, 0, nullptr, last ? 2 : 1, levelBarriers);
+		levelWidth = (std::max)(1u, levelWidth >> 1);
+		levelHeight = (std::max)(1u, levelHeight >> 1);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "../../../Common/Vulkan.h"
+#include "../../../Common/VulkanEx.h"
+
+///<summary>
+/// Hierarchical Z pyramid of a depth buffer for occlusion culling. Level 0 is
+/// half the depth buffer's size and every texel holds the farthest depth of
+/// the texels under it, so a box whose nearest point is behind the stored
+/// depth is hidden everywhere the texel covers. Built by hiz.comp one level
+/// at a time, each level reading the one above (level 0 reads the depth
+/// buffer). Odd sizes round down and the last row and column also take the
+/// left over texel, so depth buffer pixel p is always under texel
+/// min(p >> (level + 1), size - 1).
+///
+/// The pyramid is put in GENERAL layout as soon as it is created, and left
+/// there by every build, so the read descriptor set (set 1 of
+/// cullinstances.comp, sampled with texelFetch) is valid to bind even before
+/// the first build.
+///</summary>
+class HiZPyramid : public VulkanObject {
+public:
+	static constexpr uint32_t MaxLevels = 16;
+private:
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	DescriptorSetLayoutCache* pLayoutCache{ nullptr };
+	VkFormat format = VK_FORMAT_R32_SFLOAT;
+	uint32_t width{ 0 };	//level 0
+	uint32_t height{ 0 };
+	uint32_t levels{ 0 };
+	std::unique_ptr<VulkanTexture> pyramid;	//view of all levels
+	std::vector<VkImageView> levelViews;	//one per level, the storage image hiz.comp writes
+
+	// Allocated once, updated whenever the images change.
+	VkDescriptorSetLayout buildDescriptorSetLayout{ VK_NULL_HANDLE };
+	std::vector<VkDescriptorSet> buildDescriptorSets;	//per level: source, destination
+	VkDescriptorSetLayout readDescriptorSetLayout{ VK_NULL_HANDLE };
+	VkDescriptorSet readDescriptorSet{ VK_NULL_HANDLE };
+
+	void BuildResource(VkQueue queue_, VkCommandBuffer cmd_, VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight);
+	void CleanupResource();
+public:
+	HiZPyramid(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, DescriptorSetPoolCache* pPoolCache_, DescriptorSetLayoutCache* pLayoutCache_,
+		VkQueue queue_, VkCommandBuffer cmd_, VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight);
+	HiZPyramid(const HiZPyramid& rhs) = delete;
+	HiZPyramid& operator=(const HiZPyramid& rhs) = delete;
+	~HiZPyramid();
+
+	// The depth image is recreated with the swapchain, the device must be idle.
+	void OnResize(VkQueue queue_, VkCommandBuffer cmd_, VkImageView depthView, uint32_t depthWidth, uint32_t depthHeight);
+
+	uint32_t Levels()const { return levels; }
+	VkDescriptorSetLayout getBuildDescriptorSetLayout()const { return buildDescriptorSetLayout; }
+	VkDescriptorSetLayout getReadDescriptorSetLayout()const { return readDescriptorSetLayout; }
+	VkDescriptorSet getReadDescriptorSet()const { return readDescriptorSet; }
+
+	// Record the reduction of depthImage, outside a render pass. The depth image is
+	// expected in DEPTH_STENCIL_ATTACHMENT_OPTIMAL after its last write and is put
+	// back there, the pyramid is ready for compute shader reads when it returns.
+	void Build(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout_, VkPipeline pipeline_, VkImage depthImage)const;
+};
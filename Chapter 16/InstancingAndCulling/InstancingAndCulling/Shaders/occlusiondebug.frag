@@ -0,0 +1,10 @@
+#version 450
+//the software occlusion buffer, already grey levels
+layout(location=0) in vec2 inTexC;
+layout(location=0) out vec4 outFragColor;
+
+layout (set=0,binding=0) uniform sampler2D occlusionBuffer;
+
+void main(){
+	outFragColor = vec4(texture(occlusionBuffer,inTexC).rrr,1.0);
+}
@@ -0,0 +1,11 @@
+#version 450
+//quad in NDC as GeometryGenerator::CreateQuad makes it, y flipped like ShadowMapping's debug.vert
+layout(location=0) in vec3 inPos;
+layout(location=1) in vec3 inNormal;
+layout(location=2) in vec2 inTexC;
+layout(location=0) out vec2 outTexC;
+
+void main(){
+	gl_Position=vec4(inPos.x,-inPos.y,inPos.z,1.0);
+	outTexC = inTexC;
+}
@@ -6,13 +6,22 @@
 #include "../../../Common/Colors.h"
 #include "../../../Common/TextureLoader.h"
 #include "../../../Common/Camera.h"
+#include "../../../Common/FrustumCulling.h"
+#include "../../../Common/AabbTree.h"
+#include "../../../Common/SoftwareOcclusion.h"
 #include <memory>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <algorithm>
 #include "FrameResource.h"
+#include "GpuCulling.h"
+#include "HiZPyramid.h"
+#include "../../../Common/ThreadPool.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -37,6 +46,10 @@ struct RenderItem {
 	//BoundingBox Bounds;
 	AABB Bounds;
 	std::vector<InstanceData> Instances;
+	FrustumCuller Culler;//world bounds of Instances, same order
+	std::vector<int32_t> Proxies;//mSceneTree proxy of each instance
+	std::vector<uint32_t> VisibleInstances;
+	uint32_t GpuDrawIndex{ 0 };//draw of this item in mGpuCulling
 
 	uint32_t IndexCount{ 0 };
 	uint32_t InstanceCount{ 0 };
@@ -63,6 +76,23 @@ class InstancingAndCullingApp : public VulkApp
 	std::unique_ptr<VulkanPipelineLayout> pipelineLayout;
 	std::unique_ptr<VulkanPipeline> opaquePipeline;
 	std::unique_ptr<VulkanPipeline> wireframePipeline;
+	std::unique_ptr<VulkanDescriptorList> gpuCullDescriptors;
+	std::unique_ptr<VulkanPipelineLayout> cullPipelineLayout;
+	std::unique_ptr<VulkanPipelineLayout> indirectPipelineLayout;
+	std::unique_ptr<VulkanPipeline> cullPipeline;
+	std::unique_ptr<VulkanPipeline> indirectPipeline;
+	std::unique_ptr<VulkanPipeline> indirectWireframePipeline;
+	std::unique_ptr<GpuCulling> mGpuCulling;
+	std::unique_ptr<HiZPyramid> mHiZ;
+	std::unique_ptr<VulkanPipelineLayout> hizPipelineLayout;
+	std::unique_ptr<VulkanPipeline> hizPipeline;
+	std::unique_ptr<VulkanRenderPass> mLoadRenderPass;//phase 1 draws over phase 0 in the same framebuffer
+	std::unique_ptr<VulkanTexture> mOcclusionImage;//mOcclusion's depth as greys, hold V to see it
+	Vulkan::Buffer mOcclusionStaging;//one image per frame, mapped
+	uint8_t* pOcclusionStaging{ nullptr };
+	std::unique_ptr<VulkanDescriptorList> occlusionDebugDescriptors;
+	std::unique_ptr<VulkanPipelineLayout> occlusionDebugPipelineLayout;
+	std::unique_ptr<VulkanPipeline> occlusionDebugPipeline;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map < std::string, std::unique_ptr<Material>> mMaterials;
@@ -79,6 +109,37 @@ class InstancingAndCullingApp : public VulkApp
 	uint32_t mInstanceCount{ 0 };
 
 	bool mFrustumCullingEnabled = true;
+	bool mUseSceneTree = false;//hierarchical culling through mSceneTree, else per ritem flat scan (faster here)
+
+	// Every instance of every render item, user data is ritem index << 32 | instance index.
+	AabbTree mSceneTree;
+	std::vector<uint64_t> mSceneTreeResults;
+	bool mDrift = false;//every 8th skull bobs, cpu paths only since the gpu buffers are static
+	bool mDrifted = false;//the skulls are off their grid positions
+	float mDriftTime = 0.0f;
+
+	bool mGpuCullingEnabled = true;//cullinstances.comp + indirect draws, else the cpu paths above
+	bool mOcclusionCullingEnabled = true;//two phase Hi-Z occlusion on top of the gpu culling
+	bool mHiZValid = false;//the depth buffer holds the last frame, drawn with mPrevViewProj
+	glm::mat4 mPrevViewProj = glm::mat4(1.0f);
+
+	// Cpu paths: boxes inside the nearest few skulls in view are rasterized each frame
+	// and the frustum culling survivors are tested against them before they are written.
+	// Off by default, hold 9 to turn it on.
+	SoftwareOcclusion mOcclusion;
+	bool mSoftwareOcclusionEnabled = false;
+	bool mShowOcclusionBuffer = false;
+	std::vector<uint32_t> mOccluderVisible;//frustum survivors of one render item
+	std::vector<std::pair<float, uint64_t>> mOccluderCandidates;//score, ritem index << 32 | instance index
+
+	// Flat culling and the instance copy are split across these threads.
+	ThreadPool mThreadPool;
+	std::vector<uint32_t> mCullChunkCounts;
+
+	uint32_t mCaptionVisible{ UINT32_MAX };
+	uint32_t mCaptionTotal{ 0 };
+	bool mCaptionGpu{ false };
+	uint32_t mCaptionOccluded{ UINT32_MAX };
 
 	//BoundingFrustum mCamFrustum;
 
@@ -96,7 +157,9 @@ class InstancingAndCullingApp : public VulkApp
 	virtual void OnMouseMove(WPARAM btnState, int x, int y)override;
 
 	void OnKeyboardInput(const GameTimer& gt);
+	void UpdateDrift(const GameTimer& gt);
 	void UpdateInstanceData(const GameTimer& gt);
+	void UpdateCaption(uint32_t visibleCount, uint32_t totalCount, bool gpu, uint32_t occludedCount);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateMaterialsBuffer(const GameTimer& gt);
@@ -109,8 +172,14 @@ class InstancingAndCullingApp : public VulkApp
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
+	void BuildGpuCulling();
+	void BuildLoadRenderPass();
 	void BuildSkullGeometry();	
+	void BuildOcclusionDebug();
+	void RasterizeOccluders(const glm::vec4 planes[6]);
+	void UploadOcclusionBuffer(VkCommandBuffer cmd);
 	void DrawRenderItems(VkCommandBuffer, const std::vector<RenderItem*>& ritems);
+	void DrawIndirectRenderItems(VkCommandBuffer, const std::vector<RenderItem*>& ritems, uint32_t phase);
 public:
 	InstancingAndCullingApp(HINSTANCE hInstance);
 	InstancingAndCullingApp(const InstancingAndCullingApp& rhs) = delete;
@@ -127,11 +196,19 @@ InstancingAndCullingApp::InstancingAndCullingApp(HINSTANCE hInstance) :VulkApp(h
 	mClearValues[0].color = Colors::LightSteelBlue;
 	mMSAA = false;
 	mDepthBuffer = true;
+	//the Hi-Z pyramid is built from the depth buffer after the main pass
+	mDepthImageUsage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	mDepthStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+	mCpuProfile = true;//time the culling paths
 }
 
 InstancingAndCullingApp::~InstancingAndCullingApp() {
 	vkDeviceWaitIdle(mDevice);
 
+	if (pOcclusionStaging != nullptr) {
+		Vulkan::unmapBuffer(mDevice, mOcclusionStaging);
+		Vulkan::cleanupBuffer(mDevice, mOcclusionStaging);
+	}
 	for (auto& pair : mGeometries) {
 		free(pair.second->indexBufferCPU);
 		//if (pair.second->vertexBufferGPU.buffer != mWavesRitem->Geo->vertexBufferGPU.buffer) {
@@ -145,14 +222,21 @@ InstancingAndCullingApp::~InstancingAndCullingApp() {
 bool InstancingAndCullingApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
+	//the indirect draws start each item's visible list at firstInstance
+	if (!mDeviceFeatures.drawIndirectFirstInstance)
+		mGpuCullingEnabled = false;
 
 
 	LoadTextures();
 	BuildSkullGeometry();
 	BuildMaterials();
 	BuildRenderItems();
+	BuildGpuCulling();
+	BuildLoadRenderPass();
+	BuildOcclusionDebug();
 	BuildBuffers();
 	BuildDescriptors();
 	BuildPSOs();
@@ -278,6 +362,87 @@ void InstancingAndCullingApp::BuildDescriptors() {
 		.AddDescriptorSetLayout(descriptorLayout3)
 		.build(layout);
 	pipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
+
+	//gpu culling: compute set, and an instance set reading the compacted visible list in place of set 1
+	VkDescriptorSet cullDescriptor = VK_NULL_HANDLE;
+	VkDescriptorSetLayout cullDescriptorLayout = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build(cullDescriptor, cullDescriptorLayout);
+	{
+		VkDescriptorBufferInfo descrInfo[6]{};
+		mGpuCulling->GetComputeDescriptors(descrInfo);
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), cullDescriptorLayout, cullDescriptor)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[0])
+			.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[1])
+			.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[2])
+			.AddBinding(3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &descrInfo[3])
+			.AddBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[4])
+			.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[5])
+			.update();
+	}
+	//the pyramid owns its sets, they are rewritten when the depth buffer is resized
+	mHiZ = std::make_unique<HiZPyramid>(mDevice, mMemoryProperties, descriptorSetPoolCache.get(), descriptorSetLayoutCache.get(),
+		mGraphicsQueue, mCommandBuffer, mDepthImage.imageView, mClientWidth, mClientHeight);
+	VkDescriptorSet indirectDescriptor = VK_NULL_HANDLE;
+	VkDescriptorSetLayout indirectDescriptorLayout = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.build(indirectDescriptor, indirectDescriptorLayout);
+	{
+		VkDescriptorBufferInfo descrInfo[2]{};
+		mGpuCulling->GetVertexDescriptors(descrInfo);
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), indirectDescriptorLayout, indirectDescriptor)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[0])
+			.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[1])
+			.update();
+	}
+	descriptors = { cullDescriptor,indirectDescriptor };
+	gpuCullDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
+
+	PipelineLayoutBuilder::begin(mDevice)
+		.AddDescriptorSetLayout(cullDescriptorLayout)
+		.AddDescriptorSetLayout(mHiZ->getReadDescriptorSetLayout())
+		.build(layout);
+	cullPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
+	PipelineLayoutBuilder::begin(mDevice)
+		.AddDescriptorSetLayout(mHiZ->getBuildDescriptorSetLayout())
+		.build(layout);
+	hizPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
+	PipelineLayoutBuilder::begin(mDevice)
+		.AddDescriptorSetLayout(descriptorLayout0)
+		.AddDescriptorSetLayout(indirectDescriptorLayout)
+		.AddDescriptorSetLayout(descriptorLayout2)
+		.AddDescriptorSetLayout(descriptorLayout3)
+		.build(layout);
+	indirectPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
+
+	VkDescriptorSet occlusionDescriptor = VK_NULL_HANDLE;
+	VkDescriptorSetLayout occlusionDescriptorLayout = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+		.build(occlusionDescriptor, occlusionDescriptorLayout);
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = mOcclusionImage->operator VkSampler();
+		imageInfo.imageView = mOcclusionImage->operator VkImageView();
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), occlusionDescriptorLayout, occlusionDescriptor)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo)
+			.update();
+	}
+	descriptors = { occlusionDescriptor };
+	occlusionDebugDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
+	PipelineLayoutBuilder::begin(mDevice)
+		.AddDescriptorSetLayout(occlusionDescriptorLayout)
+		.build(layout);
+	occlusionDebugPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
 }
 
 void InstancingAndCullingApp::BuildPSOs() {
@@ -308,6 +473,96 @@ void InstancingAndCullingApp::BuildPSOs() {
 	for (auto& shader : shaders) {
 		Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
 	}
+	{
+		//same pixel shader, instances fetched through the compacted visible list
+		std::vector<Vulkan::ShaderModule> shaders;
+		VkVertexInputBindingDescription vertexInputDescription = {};
+		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
+		ShaderProgramLoader::begin(mDevice)
+			.AddShaderPath("Shaders/indirect.vert.spv")
+			.AddShaderPath("Shaders/default.frag.spv")
+			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
+		PipelineBuilder::begin(mDevice, *indirectPipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setCullMode(VK_CULL_MODE_FRONT_BIT)
+			.setPolygonMode(VK_POLYGON_MODE_FILL)
+			.setDepthTest(VK_TRUE)
+			.build(pipeline);
+		indirectPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
+		mPSOs["opaque_indirect"] = *indirectPipeline;
+		PipelineBuilder::begin(mDevice, *indirectPipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setCullMode(VK_CULL_MODE_FRONT_BIT)
+			.setPolygonMode(VK_POLYGON_MODE_LINE)
+			.setDepthTest(VK_TRUE)
+			.build(pipeline);
+		indirectWireframePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
+		mPSOs["opaque_indirect_wireframe"] = *indirectWireframePipeline;
+		for (auto& shader : shaders) {
+			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
+		}
+	}
+	{
+		//compute pipeline culling the instances and filling the indirect draws
+		std::vector<Vulkan::ShaderModule> shaders;
+		ShaderProgramLoader::begin(mDevice)
+			.AddShaderPath("Shaders/cullinstances.comp.spv")
+			.load(shaders);
+		pipeline = Vulkan::initComputePipeline(mDevice, *cullPipelineLayout, shaders[0]);
+		cullPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
+		mPSOs["cull"] = *cullPipeline;
+		for (auto& shader : shaders) {
+			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
+		}
+	}
+	{
+		//compute pipeline reducing the depth buffer into the Hi-Z pyramid, one dispatch per level
+		std::vector<Vulkan::ShaderModule> shaders;
+		ShaderProgramLoader::begin(mDevice)
+			.AddShaderPath("Shaders/hiz.comp.spv")
+			.load(shaders);
+		pipeline = Vulkan::initComputePipeline(mDevice, *hizPipelineLayout, shaders[0]);
+		hizPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
+		mPSOs["hiz"] = *hizPipeline;
+		for (auto& shader : shaders) {
+			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
+		}
+	}
+	{
+		//software occlusion buffer drawn over the scene
+		std::vector<Vulkan::ShaderModule> shaders;
+		VkVertexInputBindingDescription vertexInputDescription = {};
+		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
+		ShaderProgramLoader::begin(mDevice)
+			.AddShaderPath("Shaders/occlusiondebug.vert.spv")
+			.AddShaderPath("Shaders/occlusiondebug.frag.spv")
+			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
+		PipelineBuilder::begin(mDevice, *occlusionDebugPipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setCullMode(VK_CULL_MODE_NONE)
+			.setPolygonMode(VK_POLYGON_MODE_FILL)
+			.setDepthTest(VK_FALSE)
+			.build(pipeline);
+		occlusionDebugPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
+		mPSOs["occlusion_debug"] = *occlusionDebugPipeline;
+		for (auto& shader : shaders) {
+			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
+		}
+	}
+}
+
+void InstancingAndCullingApp::BuildLoadRenderPass() {
+	//same attachments as mRenderPass so mFramebuffers fit, but both are loaded: phase 1
+	//of occlusion culling adds to what phase 0 drew, the depth back from the Hi-Z build
+	mLoadRenderPass = std::make_unique<VulkanRenderPass>(mDevice, RenderPassBuilder::begin(mDevice)
+		.setColorFormat(mSwapchainFormat.format)
+		.setColorLoadOp(VK_ATTACHMENT_LOAD_OP_LOAD)
+		.setColorInitialLayout(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+		.setColorFinalLayout(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+		.setDepthFormat(mDepthFormat)
+		.setDepthLoadOp(VK_ATTACHMENT_LOAD_OP_LOAD)
+		.setDepthStoreOp(VK_ATTACHMENT_STORE_OP_STORE)
+		.setDepthInitialLayout(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		.setDepthFinalLayout(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		.setDependency(VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0)
+		.build());
 }
 
 void InstancingAndCullingApp::BuildFrameResources() {
@@ -371,12 +626,38 @@ void InstancingAndCullingApp::BuildRenderItems()
 		}
 	}
 
+	// Built once, UpdateDrift moves the boxes of the skulls it moves.
+	skullRitem->Culler.Reserve(mInstanceCount);
+	for (auto& instance : skullRitem->Instances)
+		skullRitem->Culler.AddBox(skullRitem->Bounds.min, skullRitem->Bounds.max, instance.World);
+
 
 	mAllRitems.push_back(std::move(skullRitem));
 
 	// All the render items are opaque.
 	for (auto& e : mAllRitems)
 		mOpaqueRitems.push_back(e.get());
+
+	for (uint32_t r = 0; r < (uint32_t)mAllRitems.size(); ++r) {
+		auto& e = mAllRitems[r];
+		for (uint32_t i = 0; i < (uint32_t)e->Instances.size(); ++i) {
+			AABB bounds = e->Bounds.Transform(e->Instances[i].World);
+			e->Proxies.push_back(mSceneTree.CreateProxy(bounds.min, bounds.max, ((uint64_t)r << 32) | i));
+		}
+	}
+}
+
+void InstancingAndCullingApp::BuildGpuCulling() {
+	// Same instances and world bounds as the cpu paths, uploaded once.
+	mGpuCulling = std::make_unique<GpuCulling>(mDevice, mMemoryProperties, mMaxFrames);
+	for (auto& e : mAllRitems) {
+		e->GpuDrawIndex = mGpuCulling->AddDraw(e->IndexCount, e->StartIndexLocation, e->BaseVertexLocation);
+		for (auto& instance : e->Instances) {
+			AABB bounds = e->Bounds.Transform(instance.World);
+			mGpuCulling->AddInstance(e->GpuDrawIndex, instance, bounds.min, bounds.max);
+		}
+	}
+	mGpuCulling->Build(mDeviceProperties, mGraphicsQueue, mCommandBuffer);
 }
 
 void InstancingAndCullingApp::BuildMaterials()
@@ -562,10 +843,77 @@ void InstancingAndCullingApp::BuildSkullGeometry() {
 
 }
 
+void InstancingAndCullingApp::BuildOcclusionDebug() {
+	//cpu depth goes to a staging buffer per frame and is copied in before the pass
+	uint32_t width = mOcclusion.Width();
+	uint32_t height = mOcclusion.Height();
+	mOcclusionImage = std::make_unique<VulkanTexture>(mDevice, TextureBuilder::begin(mDevice, mMemoryProperties)
+		.setDimensions(width, height)
+		.setFormat(VK_FORMAT_R8_UNORM)
+		.setImageUsage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.setSamplerFilter(VK_FILTER_NEAREST)
+		.build());
+
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	props.size = (VkDeviceSize)width * height * mMaxFrames;
+	Vulkan::initBuffer(mDevice, mMemoryProperties, props, mOcclusionStaging);
+	pOcclusionStaging = (uint8_t*)Vulkan::mapBuffer(mDevice, mOcclusionStaging);
+
+	//lower right quarter of the screen, as ShadowMapping's debug quad
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData quad = geoGen.CreateQuad(0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
+	std::vector<Vertex> vertices(quad.Vertices.size());
+	for (size_t i = 0; i < quad.Vertices.size(); ++i) {
+		vertices[i].Pos = quad.Vertices[i].Position;
+		vertices[i].Normal = quad.Vertices[i].Normal;
+		vertices[i].TexC = quad.Vertices[i].TexC;
+	}
+	std::vector<uint32_t>& indices = quad.Indices32;
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "quadGeo";
+	geo->vertexBufferCPU = malloc(vbByteSize);
+	memcpy(geo->vertexBufferCPU, vertices.data(), vbByteSize);
+	geo->indexBufferCPU = malloc(ibByteSize);
+	memcpy(geo->indexBufferCPU, indices.data(), ibByteSize);
+
+	std::vector<uint32_t> vertexLocations;
+	VertexBufferBuilder::begin(mDevice, mGraphicsQueue, mCommandBuffer, mMemoryProperties)
+		.AddVertices(vbByteSize, (float*)vertices.data())
+		.build(geo->vertexBufferGPU, vertexLocations);
+	std::vector<uint32_t> indexLocations;
+	IndexBufferBuilder::begin(mDevice, mGraphicsQueue, mCommandBuffer, mMemoryProperties)
+		.AddIndices(ibByteSize, indices.data())
+		.build(geo->indexBufferGPU, indexLocations);
+
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (uint32_t)indices.size();
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
+	geo->DrawArgs["quad"] = submesh;
+	mGeometries[geo->Name] = std::move(geo);
+}
+
 
 
 void InstancingAndCullingApp::OnResize() {
 	VulkApp::OnResize();
+	//new, undefined depth buffer: phase 0 can't test against it until a frame is drawn
+	if (mHiZ != nullptr)
+		mHiZ->OnResize(mGraphicsQueue, mCommandBuffer, mDepthImage.imageView, mClientWidth, mClientHeight);
+	mHiZValid = false;
 	mCamera.SetLens(0.25f * MathHelper::Pi, (float)mClientWidth / (float)mClientHeight, 1.0f, 1000.0f);
 }
 void InstancingAndCullingApp::OnMouseDown(WPARAM btnState, int x, int y) {
@@ -599,11 +947,12 @@ void InstancingAndCullingApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	OnKeyboardInput(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	AnimateMaterials(gt);
+	UpdateDrift(gt);
 	UpdateInstanceData(gt);
 	UpdateMaterialsBuffer(gt);
 	UpdateMainPassCB(gt);
@@ -611,6 +960,7 @@ void InstancingAndCullingApp::Update(const GameTimer& gt) {
 }
 
 void InstancingAndCullingApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -644,62 +994,283 @@ void InstancingAndCullingApp::UpdateMainPassCB(const GameTimer& gt) {
 	memcpy(pPassConstants, &mMainPassCB, sizeof(PassConstants));
 }
 
-void InstancingAndCullingApp::UpdateInstanceData(const GameTimer& gt) {
-	glm::mat4 view = mCamera.GetView();	
+// Culls count instances in gCullChunkSize chunks spread over the pool and
+// packs the survivors' InstanceData into dst. Each chunk culls into its own
+// part of scratch and counts, an exclusive scan of the counts gives every
+// chunk a disjoint range of dst, and the chunks copy in parallel again.
+// A null culler keeps everything. With occlusion the frustum survivors are
+// also tested against the software occlusion buffer, the ones it hides are
+// dropped from the chunk and counted in occludedCount.
+static const uint32_t gCullChunkSize = 4096;//multiple of 8 for FrustumCuller
+
+static uint32_t CullAndCompact(ThreadPool& pool, const FrustumCuller* culler, const glm::vec4 planes[6], const InstanceData* instances, uint32_t count,
+	uint8_t* dst, VkDeviceSize stride, std::vector<uint32_t>& scratch, std::vector<uint32_t>& chunkCounts,
+	const SoftwareOcclusion* occlusion = nullptr, uint32_t* occludedCount = nullptr) {
+	uint32_t chunkCount = (count + gCullChunkSize - 1) / gCullChunkSize;
+	scratch.resize((size_t)chunkCount * gCullChunkSize);
+	chunkCounts.resize(chunkCount);
+	std::atomic<uint32_t> occluded{ 0 };
+	pool.Run(chunkCount, [&](uint32_t chunk, uint32_t) {
+		uint32_t begin = chunk * gCullChunkSize;
+		uint32_t end = (std::min)(begin + gCullChunkSize, count);
+		uint32_t* visible = &scratch[begin];
+		if (culler != nullptr) {
+			uint32_t visibleCount = culler->Cull(planes, begin, end, visible);
+			if (occlusion != nullptr) {
+				uint32_t kept = 0;
+				for (uint32_t i = 0; i < visibleCount; ++i) {
+					glm::vec3 center, extents;
+					culler->GetBox(visible[i], center, extents);
+					if (!occlusion->IsOccludedCenterExtents(center, extents))
+						visible[kept++] = visible[i];
+				}
+				occluded += visibleCount - kept;
+				visibleCount = kept;
+			}
+			chunkCounts[chunk] = visibleCount;
+		}
+		else {
+			for (uint32_t i = begin; i < end; ++i)
+				visible[i - begin] = i;
+			chunkCounts[chunk] = end - begin;
+		}
+		});
+
+	uint32_t total = 0;
+	for (auto& offset : chunkCounts) {
+		uint32_t visibleCount = offset;
+		offset = total;//now the chunk's first output slot
+		total += visibleCount;
+	}
+
+	pool.Run(chunkCount, [&](uint32_t chunk, uint32_t) {
+		uint32_t first = chunkCounts[chunk];
+		uint32_t last = chunk + 1 < chunkCount ? chunkCounts[chunk + 1] : total;
+		const uint32_t* visible = &scratch[(size_t)chunk * gCullChunkSize];
+		for (uint32_t i = first; i < last; ++i)
+			memcpy(dst + stride * i, &instances[visible[i - first]], sizeof(InstanceData));
+		});
+	if (occludedCount != nullptr)
+		*occludedCount = occluded;
+	return total;
+}
+
+// Occluder proxy, the unit box scaled into a render item's local bounds. The
+// 12 triangles stand in for a few thousand of the skull's, and at half the
+// bounds the box stays inside the solid part of the mesh, so it never hides
+// what the skull itself wouldn't.
+static const glm::vec3 gOccluderBoxVertices[8] = {
+	{-1.0f,-1.0f,-1.0f},{1.0f,-1.0f,-1.0f},{-1.0f,1.0f,-1.0f},{1.0f,1.0f,-1.0f},
+	{-1.0f,-1.0f,1.0f},{1.0f,-1.0f,1.0f},{-1.0f,1.0f,1.0f},{1.0f,1.0f,1.0f}
+};
+static const uint32_t gOccluderBoxIndices[36] = {
+	0,2,1, 1,2,3,	//-z
+	4,5,6, 5,7,6,	//+z
+	0,4,2, 2,4,6,	//-x
+	1,3,5, 3,7,5,	//+x
+	0,1,4, 1,5,4,	//-y
+	2,6,3, 3,6,7	//+y
+};
+static const float gOccluderBoxScale = 0.5f;
+
+void InstancingAndCullingApp::RasterizeOccluders(const glm::vec4 planes[6]) {
+	//the skulls in view that cover the most screen, roughly size over distance
+	const uint32_t occluderCount = 4;
+	glm::vec3 eye = mCamera.GetPosition();
+	mOccluderCandidates.clear();
+	for (uint32_t r = 0; r < (uint32_t)mAllRitems.size(); ++r) {
+		const FrustumCuller& culler = mAllRitems[r]->Culler;
+		uint32_t visibleCount = culler.Cull(planes, mOccluderVisible);
+		for (uint32_t k = 0; k < visibleCount; ++k) {
+			uint32_t i = mOccluderVisible[k];
+			glm::vec3 center, extents;
+			culler.GetBox(i, center, extents);
+			float distance = (std::max)(glm::length(center - eye), 1.0f);
+			mOccluderCandidates.push_back({ glm::length(extents) / distance,((uint64_t)r << 32) | i });
+		}
+	}
+	uint32_t count = (std::min)(occluderCount, (uint32_t)mOccluderCandidates.size());
+	std::partial_sort(mOccluderCandidates.begin(), mOccluderCandidates.begin() + count, mOccluderCandidates.end(),
+		[](const std::pair<float, uint64_t>& a, const std::pair<float, uint64_t>& b) { return a.first > b.first; });
+
 	glm::mat4 proj = mCamera.GetProj();
-	glm::mat4 projView = proj * view;
+	proj[1][1] *= -1;//as the pass constants, row 0 of the buffer is the top of the screen
+	mOcclusion.BeginFrame(proj * mCamera.GetView());
+	for (uint32_t k = 0; k < count; ++k) {
+		uint64_t userData = mOccluderCandidates[k].second;
+		const RenderItem* e = mAllRitems[userData >> 32].get();
+		glm::vec3 center = 0.5f * (e->Bounds.min + e->Bounds.max);
+		glm::vec3 extents = 0.5f * gOccluderBoxScale * (e->Bounds.max - e->Bounds.min);
+		glm::mat4 world = e->Instances[(uint32_t)userData].World * glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), extents);
+		mOcclusion.AddOccluder(world, gOccluderBoxVertices, sizeof(glm::vec3), 8, gOccluderBoxIndices, 36);
+	}
+	mOcclusion.Rasterize(mThreadPool);
+	if (mShowOcclusionBuffer)
+		mOcclusion.Visualize(pOcclusionStaging + (size_t)mOcclusion.Width() * mOcclusion.Height() * mCurrFrame);
+}
 
-	uint8_t* pInstances = (uint8_t*)mCurrFrameResource->pInstances;
-	auto& sb = *storageBuffer;
-	VkDeviceSize objSize = sb[0].objectSize;
-	for (auto& e : mAllRitems)
-	{
-		const auto& instanceData = e->Instances;
-		int visibleInstanceCount = 0;
+void InstancingAndCullingApp::UploadOcclusionBuffer(VkCommandBuffer cmd) {
+	//the last frame's overlay may still be reading the image
+	VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = mOcclusionImage->operator VkImage();
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1 };
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = (VkDeviceSize)mOcclusion.Width() * mOcclusion.Height() * mCurrFrame;
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT,0,0,1 };
+	region.imageExtent = { mOcclusion.Width(),mOcclusion.Height(),1 };
+	vkCmdCopyBufferToImage(cmd, mOcclusionStaging.buffer, barrier.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
 
-		for (UINT i = 0; i < (UINT)instanceData.size(); ++i)
-		{
-			//XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
-			//XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
+void InstancingAndCullingApp::UpdateCaption(uint32_t visibleCount, uint32_t totalCount, bool gpu, uint32_t occludedCount) {
+	//only rebuilt when something changed, CalculateFrameStats shows it once a second anyway
+	if (visibleCount == mCaptionVisible && totalCount == mCaptionTotal && gpu == mCaptionGpu && occludedCount == mCaptionOccluded)
+		return;
+	mCaptionVisible = visibleCount;
+	mCaptionTotal = totalCount;
+	mCaptionGpu = gpu;
+	mCaptionOccluded = occludedCount;
+	std::wostringstream outs;
+	outs << L"Instancing and Culling Demo" << (gpu ? L" (GPU)" : L"") <<
+		L"    " << visibleCount <<
+		L" objects visible out of " << totalCount;
+	if (occludedCount != UINT32_MAX)
+		outs << L", " << occludedCount << L" occluded";
+	mMainWndCaption = outs.str();
+}
 
-			
-			//glm::mat4 invWorld = glm::inverse(instanceData[i].World);
+void InstancingAndCullingApp::UpdateDrift(const GameTimer& gt) {
+	CPU_ZONE("UpdateDrift");
+	if (!mDrift && !mDrifted)
+		return;
+	float prevTime = mDriftTime;
+	mDriftTime = gt.TotalTime();
+	for (auto& e : mAllRitems) {
+		for (uint32_t i = 0; i < (uint32_t)e->Instances.size(); i += 8) {
+			float phase = 0.37f * i;
+			float from = mDrifted ? 2.0f * sinf(prevTime + phase) : 0.0f;
+			float to = mDrift ? 2.0f * sinf(mDriftTime + phase) : 0.0f;
+			glm::mat4& world = e->Instances[i].World;
+			world[3].y += to - from;
+			e->Culler.SetBox(i, e->Bounds.min, e->Bounds.max, world);
+			AABB bounds = e->Bounds.Transform(world);
+			//most frames a skull stays inside its fat box and the tree isn't touched
+			if (mDrift)
+				mSceneTree.MoveProxy(e->Proxies[i], bounds.min, bounds.max);
+			else
+				mSceneTree.SetProxyBounds(e->Proxies[i], bounds.min, bounds.max);
+		}
+	}
+	//back on the grid, the internal boxes are refit once for the whole batch
+	if (!mDrift)
+		mSceneTree.Refit();
+	mDrifted = mDrift;
+}
 
-			//// View space to the object's local space.
-			//glm::mat4 viewToLocal = invView * invWorld;//order??
+void InstancingAndCullingApp::UpdateInstanceData(const GameTimer& gt) {
+	CPU_ZONE("UpdateInstanceData");
+	//world space planes once per frame, every instance is tested against them
+	glm::vec4 planes[6];
+	mCamera.GetFrustumPlanes(planes);
+
+	if (mGpuCullingEnabled) {
+		if (!mFrustumCullingEnabled) {
+			//w = 1 puts every box on the inside of every plane
+			for (auto& plane : planes)
+				plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		GpuOcclusion occlusion;
+		occlusion.Enabled = mOcclusionCullingEnabled;
+		occlusion.PrevValid = mHiZValid;
+		occlusion.PrevViewProj = mPrevViewProj;
+		glm::mat4 proj = mCamera.GetProj();
+		proj[1][1] *= -1;//as the pass constants, so the pyramid's rows match
+		occlusion.ViewProj = proj * mCamera.GetView();
+		occlusion.DepthSize = glm::vec2(mClientWidth, mClientHeight);
+		occlusion.HiZLevels = mHiZ->Levels();
+		//the counts come back from the last time this frame's commands ran
+		GpuCullStats stats = mGpuCulling->BeginFrame(mCurrFrame, planes, occlusion);
+		UpdateCaption(stats.Visible, mGpuCulling->InstanceCount(), true, mOcclusionCullingEnabled ? stats.Occluded : UINT32_MAX);
+		return;
+	}
 
-			//// Transform the camera frustum from view space to the object's local space.
-			//BoundingFrustum localSpaceFrustum;
-			//mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+	uint8_t* pInstances = (uint8_t*)mCurrFrameResource->pInstances;
+	auto& sb = *storageBuffer;
+	VkDeviceSize objSize = sb[0].objectSize;
 
-			//// Perform the box/frustum intersection test in local space.
-			//if ((localSpaceFrustum.Contains(e->Bounds) != DISJOINT) || (mFrustumCullingEnabled == false))
-			glm::mat4 mvp = projView * instanceData[i].World;
-			if(e->Bounds.InsideFrustum(mvp))
+	//tested after the frustum, so only with it
+	bool softwareOcclusion = mSoftwareOcclusionEnabled && mFrustumCullingEnabled;
+	if (softwareOcclusion)
+		RasterizeOccluders(planes);
+	uint32_t occludedCount = 0;
+
+	if (mFrustumCullingEnabled && mUseSceneTree) {
+		for (auto& e : mAllRitems)
+			e->VisibleInstances.clear();
+		mSceneTree.QueryFrustum(planes, mSceneTreeResults);
+		for (uint64_t userData : mSceneTreeResults) {
+			RenderItem* e = mAllRitems[userData >> 32].get();
+			if (softwareOcclusion) {
+				glm::vec3 center, extents;
+				e->Culler.GetBox((uint32_t)userData, center, extents);
+				if (mOcclusion.IsOccludedCenterExtents(center, extents)) {
+					occludedCount++;
+					continue;
+				}
+			}
+			e->VisibleInstances.push_back((uint32_t)userData);
+		}
+
+		for (auto& e : mAllRitems) {
+			const auto& instanceData = e->Instances;
+			int visibleInstanceCount = 0;
+			for (uint32_t i : e->VisibleInstances)
 			{
 				InstanceData data;
 				data.World = instanceData[i].World;
-				data.TexTransform = instanceData[i].TexTransform;				
+				data.TexTransform = instanceData[i].TexTransform;
 				data.MaterialIndex = instanceData[i].MaterialIndex;
 
 				// Write the instance data to structured buffer for the visible objects.
-				//currInstanceBuffer->CopyData(visibleInstanceCount++, data);
 				memcpy((pInstances + (objSize * visibleInstanceCount++)), &data, sizeof(InstanceData));
 			}
+			e->InstanceCount = visibleInstanceCount;
 		}
+	}
+	else {
+		for (auto& e : mAllRitems) {
+			const FrustumCuller* culler = mFrustumCullingEnabled ? &e->Culler : nullptr;
+			uint32_t occluded = 0;
+			e->InstanceCount = CullAndCompact(mThreadPool, culler, planes, e->Instances.data(), (uint32_t)e->Instances.size(),
+				pInstances, objSize, e->VisibleInstances, mCullChunkCounts, softwareOcclusion ? &mOcclusion : nullptr, &occluded);
+			occludedCount += occluded;
+		}
+	}
 
-		e->InstanceCount = visibleInstanceCount;
-
-		std::wostringstream outs;
-		outs.precision(6);
-		outs << L"Instancing and Culling Demo" <<
-			L"    " << e->InstanceCount <<
-			L" objects visible out of " << e->Instances.size();
-		mMainWndCaption = outs.str();
+	uint32_t visibleCount = 0;
+	uint32_t totalCount = 0;
+	for (auto& e : mAllRitems) {
+		visibleCount += e->InstanceCount;
+		totalCount += (uint32_t)e->Instances.size();
 	}
+	UpdateCaption(visibleCount, totalCount, false, softwareOcclusion ? occludedCount : UINT32_MAX);
 }
 
 void InstancingAndCullingApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[1].objectSize;
@@ -742,6 +1313,40 @@ void InstancingAndCullingApp::OnKeyboardInput(const GameTimer& gt)
 	if (GetAsyncKeyState('2') & 0x8000)
 		mFrustumCullingEnabled = false;
 
+	if (GetAsyncKeyState('3') & 0x8000)
+		mUseSceneTree = true;
+
+	if (GetAsyncKeyState('4') & 0x8000)
+		mUseSceneTree = false;
+
+	if ((GetAsyncKeyState('5') & 0x8000) && mDeviceFeatures.drawIndirectFirstInstance && !mDrifted)
+		mGpuCullingEnabled = true;
+
+	if (GetAsyncKeyState('6') & 0x8000)
+		mGpuCullingEnabled = false;
+
+	if (GetAsyncKeyState('7') & 0x8000)
+		mOcclusionCullingEnabled = true;
+
+	if (GetAsyncKeyState('8') & 0x8000)
+		mOcclusionCullingEnabled = false;
+
+	if (GetAsyncKeyState('9') & 0x8000)
+		mSoftwareOcclusionEnabled = true;
+
+	if (GetAsyncKeyState('0') & 0x8000)
+		mSoftwareOcclusionEnabled = false;
+
+	if (GetAsyncKeyState('M') & 0x8000) {
+		mDrift = true;
+		mGpuCullingEnabled = false;
+	}
+
+	if (GetAsyncKeyState('N') & 0x8000)
+		mDrift = false;
+
+	mShowOcclusionBuffer = (GetAsyncKeyState('V') & 0x8000) != 0;
+
 	mCamera.UpdateViewMatrix();
 }
 
@@ -823,7 +1428,22 @@ void InstancingAndCullingApp::Draw(const GameTimer& gt) {
 
 
 
-	cmd = BeginRender();
+	//the culling dispatch and the occlusion buffer upload have to be recorded outside the render pass
+	cmd = BeginRender(false);
+	bool occlusion = mGpuCullingEnabled && mOcclusionCullingEnabled;
+	//RasterizeOccluders filled this frame's staging image
+	bool showOcclusionBuffer = !mGpuCullingEnabled && mSoftwareOcclusionEnabled && mFrustumCullingEnabled && mShowOcclusionBuffer;
+	if (mGpuCullingEnabled) {
+		auto& gd = *gpuCullDescriptors;
+		//phase 0 tests against the depth the last frame left behind
+		if (occlusion && mHiZValid)
+			mHiZ->Build(cmd, *hizPipelineLayout, mPSOs["hiz"], mDepthImage.image);
+		mGpuCulling->Dispatch(cmd, *cullPipelineLayout, mPSOs["cull"], gd[0], mHiZ->getReadDescriptorSet(), mCurrFrame, 0);
+	}
+	else if (showOcclusionBuffer) {
+		UploadOcclusionBuffer(cmd);
+	}
+	pvkCmdBeginRenderPass(cmd, &mRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 	VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
 	pvkCmdSetViewport(cmd, 0, 1, &viewport);
@@ -850,7 +1470,27 @@ void InstancingAndCullingApp::Draw(const GameTimer& gt) {
 	auto& td = *textureDescriptors;
 	VkDescriptorSet descriptor3 = td[0];
 	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind texture data
-	if (mIsWireframe) {
+	if (mGpuCullingEnabled) {
+		//set 1 differs, so rebind everything with the indirect layout
+		auto& gd = *gpuCullDescriptors;
+		VkDescriptorSet indirectDescriptors[4] = { descriptor0,gd[1],descriptor2,descriptor3 };
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *indirectPipelineLayout, 0, 4, indirectDescriptors, 1, dynamicOffsets);
+		VkPipeline indirectPSO = mPSOs[mIsWireframe ? "opaque_indirect_wireframe" : "opaque_indirect"];
+		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPSO);
+		DrawIndirectRenderItems(cmd, mOpaqueRitems, 0);
+		if (occlusion) {
+			//phase 1: what phase 0 held back, against the depth phase 0 just drew
+			pvkCmdEndRenderPass(cmd);
+			mHiZ->Build(cmd, *hizPipelineLayout, mPSOs["hiz"], mDepthImage.image);
+			mGpuCulling->Dispatch(cmd, *cullPipelineLayout, mPSOs["cull"], gd[0], mHiZ->getReadDescriptorSet(), mCurrFrame, 1);
+			VkRenderPassBeginInfo loadBeginInfo = mRenderPassBeginInfo;
+			loadBeginInfo.renderPass = *mLoadRenderPass;
+			pvkCmdBeginRenderPass(cmd, &loadBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPSO);
+			DrawIndirectRenderItems(cmd, mOpaqueRitems, 1);
+		}
+	}
+	else if (mIsWireframe) {
 		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque_wireframe"]);
 		DrawRenderItems(cmd, mOpaqueRitems);
 
@@ -860,7 +1500,20 @@ void InstancingAndCullingApp::Draw(const GameTimer& gt) {
 		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque"]);
 		DrawRenderItems(cmd, mOpaqueRitems);
 	}
+	if (showOcclusionBuffer) {
+		auto& od = *occlusionDebugDescriptors;
+		VkDescriptorSet occlusionDescriptor = od[0];
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *occlusionDebugPipelineLayout, 0, 1, &occlusionDescriptor, 0, 0);
+		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["occlusion_debug"]);
+		const MeshGeometry* quad = mGeometries["quadGeo"].get();
+		pvkCmdBindVertexBuffers(cmd, 0, 1, &quad->vertexBufferGPU.buffer, mOffsets);
+		pvkCmdBindIndexBuffer(cmd, quad->indexBufferGPU.buffer, 0, VK_INDEX_TYPE_UINT32);
+		pvkCmdDrawIndexed(cmd, quad->DrawArgs.at("quad").IndexCount, 1, 0, 0, 0);
+	}
 	EndRender(cmd);
+	//the depth is stored, whichever path drew it the next frame can build from it
+	mPrevViewProj = mMainPassCB.ViewProj;
+	mHiZValid = true;
 }
 void InstancingAndCullingApp::DrawRenderItems(VkCommandBuffer cmd, const std::vector<RenderItem*>& ritems) {
 	auto& sb = *storageBuffer;
@@ -885,11 +1538,222 @@ void InstancingAndCullingApp::DrawRenderItems(VkCommandBuffer cmd, const std::ve
 	}
 }
 
+void InstancingAndCullingApp::DrawIndirectRenderItems(VkCommandBuffer cmd, const std::vector<RenderItem*>& ritems, uint32_t phase) {
+	for (size_t i = 0; i < ritems.size(); i++) {
+		auto ri = ritems[i];
+		const auto vbv = ri->Geo->vertexBufferGPU;
+		const auto ibv = ri->Geo->indexBufferGPU;
+		pvkCmdBindVertexBuffers(cmd, 0, 1, &vbv.buffer, mOffsets);
+		//first index and vertex offset are in the indirect command
+		pvkCmdBindIndexBuffer(cmd, ibv.buffer, 0, VK_INDEX_TYPE_UINT32);
+		mGpuCulling->Draw(cmd, ri->GpuDrawIndex, mCurrFrame, phase);
+	}
+}
+
+
+// -cullbench: per instance AABB::InsideFrustum (MVP, 8 corners) against
+// FrustumCuller on the same random skulls, no window.
+static int CullBench() {
+	Camera camera;
+	camera.SetLens(0.25f * MathHelper::Pi, 16.0f / 9.0f, 1.0f, 1000.0f);
+	camera.SetPosition(0.0f, 2.0f, -15.0f);
+	camera.UpdateViewMatrix();
+	glm::mat4 projView = camera.GetProj() * camera.GetView();
+	glm::vec3 boundsMin(-5.0f, -3.0f, -4.0f);
+	glm::vec3 boundsMax(5.0f, 3.0f, 4.0f);
+	AABB bounds(boundsMin, boundsMax);
+
+	const uint32_t counts[] = { 10000, 100000, 1000000 };
+	const int iterations = 10;
+	for (uint32_t count : counts) {
+		std::vector<glm::mat4> worlds(count);
+		FrustumCuller culler;
+		culler.Reserve(count);
+		for (auto& world : worlds) {
+			world = glm::translate(glm::mat4(1.0f), glm::vec3(MathHelper::RandF(-500.0f, 500.0f), MathHelper::RandF(-500.0f, 500.0f), MathHelper::RandF(-500.0f, 500.0f)));
+			culler.AddBox(boundsMin, boundsMax, world);
+		}
+
+		uint32_t mvpVisible = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int it = 0; it < iterations; ++it) {
+			mvpVisible = 0;
+			for (auto& world : worlds) {
+				glm::mat4 mvp = projView * world;
+				mvpVisible += bounds.InsideFrustum(mvp) ? 1 : 0;
+			}
+		}
+		auto mid = std::chrono::high_resolution_clock::now();
+		std::vector<uint32_t> visible;
+		for (int it = 0; it < iterations; ++it) {
+			glm::vec4 planes[6];
+			camera.GetFrustumPlanes(planes);
+			culler.Cull(planes, visible);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double mvpMs = std::chrono::duration<double, std::milli>(mid - start).count() / iterations;
+		double planeMs = std::chrono::duration<double, std::milli>(end - mid).count() / iterations;
+		//InsideFrustum only accepts boxes with a corner inside, so it can report fewer
+		std::cout << count << " instances: InsideFrustum " << mvpMs << " ms (" << mvpVisible << " visible), FrustumCuller "
+			<< planeMs << " ms (" << visible.size() << " visible)" << std::endl;
+	}
+	return 0;
+}
+
+// -bvhbench: 1M procedural boxes, AabbTree queries against linear scans.
+static int BvhBench() {
+	const uint32_t count = 1000000;
+	Camera camera;
+	camera.SetLens(0.25f * MathHelper::Pi, 16.0f / 9.0f, 1.0f, 1000.0f);
+	camera.SetPosition(0.0f, 2.0f, -15.0f);
+	camera.UpdateViewMatrix();
+	glm::vec4 planes[6];
+	camera.GetFrustumPlanes(planes);
+
+	std::vector<glm::vec3> mins(count);
+	std::vector<glm::vec3> maxs(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec3 center(MathHelper::RandF(-2000.0f, 2000.0f), MathHelper::RandF(-200.0f, 200.0f), MathHelper::RandF(-2000.0f, 2000.0f));
+		glm::vec3 extents(MathHelper::RandF(0.5f, 4.0f), MathHelper::RandF(0.5f, 4.0f), MathHelper::RandF(0.5f, 4.0f));
+		mins[i] = center - extents;
+		maxs[i] = center + extents;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	AabbTree tree;
+	tree.Reserve(count);
+	std::vector<int32_t> proxies(count);
+	for (uint32_t i = 0; i < count; ++i)
+		proxies[i] = tree.CreateProxy(mins[i], maxs[i], i);
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << count << " objects, tree built in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms, height " << tree.Height() << std::endl;
+
+	FrustumCuller culler;
+	culler.Reserve(count);
+	for (uint32_t i = 0; i < count; ++i)
+		culler.AddBox(mins[i], maxs[i]);
+
+	const int iterations = 10;
+	std::vector<uint64_t> results;
+	std::vector<uint32_t> visible;
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+		tree.QueryFrustum(planes, results);
+	auto mid = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+		culler.Cull(planes, visible);
+	auto mid2 = std::chrono::high_resolution_clock::now();
+	size_t scalarVisible = 0;
+	for (int it = 0; it < iterations; ++it) {
+		scalarVisible = 0;
+		for (uint32_t i = 0; i < count; ++i)
+			scalarVisible += FrustumCuller::Test(planes, 0.5f * (mins[i] + maxs[i]), 0.5f * (maxs[i] - mins[i]), 0.0f) != DISJOINT ? 1 : 0;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	std::cout << "frustum: tree " << std::chrono::duration<double, std::milli>(mid - start).count() / iterations << " ms (" << results.size()
+		<< "), linear SoA " << std::chrono::duration<double, std::milli>(mid2 - mid).count() / iterations << " ms (" << visible.size()
+		<< "), linear scalar " << std::chrono::duration<double, std::milli>(end - mid2).count() / iterations << " ms (" << scalarVisible << ")" << std::endl;
+
+	//picking ray down the view direction
+	glm::vec3 origin = camera.GetPosition();
+	glm::vec3 dir = camera.GetLook();
+	std::vector<AabbTreeHit> hits;
+	start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; ++it)
+		tree.QueryRay(origin, dir, 1000.0f, hits);
+	mid = std::chrono::high_resolution_clock::now();
+	size_t linearHits = 0;
+	for (int it = 0; it < iterations; ++it) {
+		linearHits = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			AABB box(mins[i], maxs[i]);
+			float dist = 0.0f;
+			linearHits += box.Intersects(origin, dir, dist) && dist <= 1000.0f ? 1 : 0;
+		}
+	}
+	end = std::chrono::high_resolution_clock::now();
+	std::cout << "ray: tree " << std::chrono::duration<double, std::milli>(mid - start).count() / iterations << " ms (" << hits.size()
+		<< "), linear " << std::chrono::duration<double, std::milli>(end - mid).count() / iterations << " ms (" << linearHits << ")" << std::endl;
+
+	//10% of the objects jitter, a few of those jump far enough to be reinserted
+	uint32_t reinserted = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i += 10) {
+		glm::vec3 offset = (i % 1000 == 0) ? glm::vec3(MathHelper::RandF(-50.0f, 50.0f), 0.0f, MathHelper::RandF(-50.0f, 50.0f)) : glm::vec3(MathHelper::RandF(-0.05f, 0.05f));
+		mins[i] += offset;
+		maxs[i] += offset;
+		reinserted += tree.MoveProxy(proxies[i], mins[i], maxs[i]) ? 1 : 0;
+	}
+	mid = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 1; i < count; i += 10)
+		tree.SetProxyBounds(proxies[i], mins[i], maxs[i]);
+	tree.Refit();
+	end = std::chrono::high_resolution_clock::now();
+	std::cout << "update: " << count / 10 << " moves " << std::chrono::duration<double, std::milli>(mid - start).count() << " ms (" << reinserted
+		<< " reinserted), refit " << std::chrono::duration<double, std::milli>(end - mid).count() << " ms" << std::endl;
+	return 0;
+}
+
+// -cullthreads: CullAndCompact on 100k and 1M skulls with 1 to N threads.
+static int CullThreadsBench() {
+	Camera camera;
+	camera.SetLens(0.25f * MathHelper::Pi, 16.0f / 9.0f, 1.0f, 1000.0f);
+	camera.SetPosition(0.0f, 2.0f, -15.0f);
+	camera.UpdateViewMatrix();
+	glm::vec4 planes[6];
+	camera.GetFrustumPlanes(planes);
+	glm::vec3 boundsMin(-5.0f, -3.0f, -4.0f);
+	glm::vec3 boundsMax(5.0f, 3.0f, 4.0f);
+
+	const uint32_t counts[] = { 100000, 1000000 };
+	const int iterations = 20;
+	//powers of two up to every hardware thread
+	std::vector<uint32_t> threadCounts;
+	uint32_t maxThreads = (std::max)(1u, std::thread::hardware_concurrency());
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+	for (uint32_t count : counts) {
+		std::vector<InstanceData> instances(count);
+		FrustumCuller culler;
+		culler.Reserve(count);
+		for (auto& instance : instances) {
+			//dense enough that about a third survives
+			instance.World = glm::translate(glm::mat4(1.0f), glm::vec3(MathHelper::RandF(-150.0f, 150.0f), MathHelper::RandF(-150.0f, 150.0f), MathHelper::RandF(0.0f, 300.0f)));
+			culler.AddBox(boundsMin, boundsMax, instance.World);
+		}
+		std::vector<uint8_t> dst(sizeof(InstanceData) * count);
+		std::vector<uint32_t> scratch;
+		std::vector<uint32_t> chunkCounts;
+
+		double baseMs = 0.0;
+		for (uint32_t threads : threadCounts) {
+			ThreadPool pool(threads);
+			uint32_t visibleCount = CullAndCompact(pool, &culler, planes, instances.data(), count, dst.data(), sizeof(InstanceData), scratch, chunkCounts);
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int it = 0; it < iterations; ++it)
+				CullAndCompact(pool, &culler, planes, instances.data(), count, dst.data(), sizeof(InstanceData), scratch, chunkCounts);
+			auto end = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+			if (threads == 1)
+				baseMs = ms;
+			std::cout << count << " instances, " << threads << " threads: " << ms << " ms, x" << baseMs / ms << " (" << visibleCount << " visible)" << std::endl;
+		}
+	}
+	return 0;
+}
 
-int main() {
+int main(int argc, char** argv) {
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
+	if (argc > 1 && std::string(argv[1]) == "-cullbench")
+		return CullBench();
+	if (argc > 1 && std::string(argv[1]) == "-bvhbench")
+		return BvhBench();
+	if (argc > 1 && std::string(argv[1]) == "-cullthreads")
+		return CullThreadsBench();
 
 	try
 	{
@@ -8,7 +8,7 @@ struct ObjectConstants {
 	glm::mat4 World = glm::mat4(1.0f);
 	glm::mat4 TexTransform = glm::mat4(1.0f);
 	uint32_t MaterialIndex;
-	uint32_t ObjPad0;
+	uint32_t ObjectId;	//ObjCBIndex + 1, written to the ID buffer
 	uint32_t ObjPad1;
 	uint32_t ObjPad2;
 };
@@ -0,0 +1,107 @@
+#include "IdBuffer.h"
+#include <climits>
+
+IdBuffer::IdBuffer(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, uint32_t numFrames) :VulkanObject(device_),
+memoryProperties(memoryProperties_) {
+	pending.resize(numFrames, false);
+	BuildResource();
+}
+
+IdBuffer::~IdBuffer() {
+	Vulkan::unmapBuffer(device, readbackBuffer);
+	Vulkan::cleanupBuffer(device, readbackBuffer);
+}
+
+void IdBuffer::BuildResource() {
+	idMap = std::make_unique<VulkanTexture>(device, TextureBuilder::begin(device, memoryProperties)
+		.setDimensions(RegionSize, RegionSize)
+		.setFormat(format)
+		.setImageUsage(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+		.setSamplerFilter(VK_FILTER_NEAREST)
+		.build());
+	depthMap = std::make_unique<VulkanTexture>(device, TextureBuilder::begin(device, memoryProperties)
+		.setDimensions(RegionSize, RegionSize)
+		.setFormat(depthFormat)
+		.setImageAspectFlags(VK_IMAGE_ASPECT_DEPTH_BIT)
+		.setImageUsage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+		.build());
+	//ends in TRANSFER_SRC so Readback can copy straight out of it
+	renderPass = std::make_unique<VulkanRenderPass>(device, RenderPassBuilder::begin(device)
+		.setColorFormat(format)
+		.setColorFinalLayout(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+		.setDepthFormat(depthFormat)
+		.setDependency(VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0)
+		.setDependency(0, VK_SUBPASS_EXTERNAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0)
+		.build());
+	std::vector<VkFramebuffer> framebuffers;
+	FramebufferBuilder::begin(device)
+		.setDimensions(RegionSize, RegionSize)
+		.setColorImageView(*idMap)
+		.setDepthImageView(*depthMap)
+		.setRenderPass(*renderPass)
+		.build(framebuffers);
+	frameBuffer = std::make_unique<VulkanFramebuffer>(device, framebuffers[0]);
+
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	props.size = sizeof(uint32_t) * 2 * RegionSize * RegionSize * pending.size();
+	Vulkan::initBuffer(device, memoryProperties, props, readbackBuffer);
+	pReadback = (uint8_t*)Vulkan::mapBuffer(device, readbackBuffer);
+}
+
+VkViewport IdBuffer::Viewport(int x, int y, uint32_t clientWidth, uint32_t clientHeight)const {
+	int half = (int)RegionSize / 2;
+	return { (float)(half - x),(float)(half - y),(float)clientWidth,(float)clientHeight,0.0f,1.0f };
+}
+
+void IdBuffer::Readback(VkCommandBuffer cmd, uint32_t frame) {
+	VkDeviceSize regionBytes = sizeof(uint32_t) * 2 * RegionSize * RegionSize;
+	VkBufferImageCopy region{};
+	region.bufferOffset = regionBytes * frame;
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT,0,0,1 };
+	region.imageExtent = { RegionSize,RegionSize,1 };
+	vkCmdCopyImageToBuffer(cmd, idMap->operator VkImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &region);
+
+	VkBufferMemoryBarrier barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = readbackBuffer.buffer;
+	barrier.offset = region.bufferOffset;
+	barrier.size = regionBytes;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	pending[frame] = true;
+}
+
+bool IdBuffer::Resolve(uint32_t frame, uint32_t& objectId, uint32_t& primitive) {
+	if (!pending[frame])
+		return false;
+	pending[frame] = false;
+	const uint32_t* texels = (const uint32_t*)(pReadback + sizeof(uint32_t) * 2 * RegionSize * RegionSize * frame);
+	//nearest drawn texel to the centre, so thin triangles can be hovered without pixel precision
+	int half = (int)RegionSize / 2;
+	int bestDist = INT_MAX;
+	objectId = 0;
+	primitive = 0;
+	for (int y = 0; y < (int)RegionSize; ++y) {
+		for (int x = 0; x < (int)RegionSize; ++x) {
+			const uint32_t* texel = texels + 2 * (y * RegionSize + x);
+			if (texel[0] == 0)
+				continue;
+			int dist = (x - half) * (x - half) + (y - half) * (y - half);
+			if (dist < bestDist) {
+				bestDist = dist;
+				objectId = texel[0];
+				primitive = texel[1];
+			}
+		}
+	}
+	return true;
+}
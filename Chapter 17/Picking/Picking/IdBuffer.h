@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "../../../Common/Vulkan.h"
+#include "../../../Common/VulkanEx.h"
+
+///<summary>
+/// GPU picking target. The opaque items are drawn with id.frag into a small
+/// R32G32_UINT attachment centred on the cursor: x is the object id
+/// (ObjCBIndex + 1, 0 where nothing was drawn) and y is gl_PrimitiveID, the
+/// triangle within the draw. The region is copied to a host visible buffer
+/// in the same command buffer, so it can be read once that frame's fence
+/// has signalled, the next time the frame comes round. The CPU never looks
+/// at the mesh, so the cost doesn't depend on triangle count and geometry
+/// displaced on the GPU picks where it is drawn.
+///</summary>
+class IdBuffer : public VulkanObject {
+public:
+	static constexpr uint32_t RegionSize = 7;//odd, so the cursor pixel is the centre texel
+private:
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkFormat format = VK_FORMAT_R32G32_UINT;
+	VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
+	std::unique_ptr<VulkanTexture> idMap;
+	std::unique_ptr<VulkanTexture> depthMap;
+	std::unique_ptr<VulkanFramebuffer> frameBuffer;
+	std::unique_ptr<VulkanRenderPass> renderPass;
+
+	// One region per frame in flight, each is only read after its fence.
+	std::vector<bool> pending;
+	Vulkan::Buffer readbackBuffer;
+	uint8_t* pReadback{ nullptr };
+	void BuildResource();
+public:
+	IdBuffer(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, uint32_t numFrames);
+	IdBuffer(const IdBuffer& rhs) = delete;
+	~IdBuffer();
+	IdBuffer& operator=(const IdBuffer& rhs) = delete;
+	VkRenderPass getRenderPass()const { return renderPass->operator VkRenderPass(); }
+	VkFramebuffer getFramebuffer()const { return frameBuffer->operator VkFramebuffer(); }
+	// Full window viewport shifted so window pixel x, y lands on the centre texel.
+	VkViewport Viewport(int x, int y, uint32_t clientWidth, uint32_t clientHeight)const;
+	VkRect2D ScissorRect()const { return { {0,0},{RegionSize,RegionSize} }; }
+
+	// Record the copy of the region into frame's readback buffer, after the ID render pass.
+	void Readback(VkCommandBuffer cmd, uint32_t frame);
+	// Once frame's fence has been waited on: false if no readback was recorded with it,
+	// otherwise objectId is the nearest drawn texel to the cursor (0 if none).
+	bool Resolve(uint32_t frame, uint32_t& objectId, uint32_t& primitive);
+};
@@ -0,0 +1,18 @@
+#version 450
+//needs the geometryShader feature for gl_PrimitiveID
+layout(location=0) out uvec2 outId;
+
+layout (set=1, binding=0) uniform ObjectCB{
+	mat4 world;	
+	mat4 gTexTransform;
+	uint gMaterialIndex;
+	uint gObjectId;
+	uint gObjPad1;
+	uint gObjPad2;
+};
+
+void main(){
+	//object id is ObjCBIndex + 1 so the clear value 0 means nothing was drawn,
+	//gl_PrimitiveID is the triangle counted from the draw's first index
+	outId = uvec2(gObjectId, uint(gl_PrimitiveID));
+}
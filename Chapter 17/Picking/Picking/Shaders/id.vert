@@ -0,0 +1,53 @@
+#version 450
+
+//normal and texcoords are unused, declared so the vertex layout matches default.vert
+layout(location=0) in vec3 aPos;
+layout(location=1) in vec3 aNormal;
+layout(location=2) in vec2 aTexCoords;
+
+struct Light
+{
+    vec3 Strength;
+    float FalloffStart; // point/spot light only
+    vec3 Direction;   // directional/spot light only
+    float FalloffEnd;   // point/spot light only
+    vec3 Position;    // point light only
+    float SpotPower;    // spot light only
+};
+#define MAX_LIGHTS 16
+
+
+layout (set=0,binding=0) uniform PassCB{
+	mat4 view;
+	mat4 invView;
+	mat4 proj;
+	mat4 invProj;
+	mat4 viewProj;
+	mat4 invViewProj;
+	vec3 gEyePosW;
+	float cbPerObjPad1;
+	vec2 RenderTargetSize;
+	vec2 InvRenderTargetSize;
+	float NearZ;
+	float FarZ;
+	float TotalTime;
+	float DeltaTime;
+	vec4 gAmbientLight;
+	Light gLights[MAX_LIGHTS];
+};
+
+
+layout (set=1, binding=0) uniform ObjectCB{
+	mat4 world;	
+	mat4 gTexTransform;
+	uint gMaterialIndex;
+	uint gObjectId;
+	uint gObjPad1;
+	uint gObjPad2;
+};
+
+void main(){
+	//same transform as default.vert so the ids line up with what was drawn
+	mat4 mvp = viewProj * world;
+	gl_Position = mvp * vec4(aPos,1.0);
+}
\ No newline at end of file
@@ -10,9 +10,13 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <string>
 #include "FrameResource.h"
+#include "IdBuffer.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -68,6 +72,8 @@ class PickingApp : public VulkApp {
 	std::unique_ptr<VulkanPipeline> opaquePipeline;
 	std::unique_ptr<VulkanPipeline> wireframePipeline;
 	std::unique_ptr<VulkanPipeline> highlightPipeline;
+	std::unique_ptr<VulkanPipeline> idPipeline;
+	std::unique_ptr<IdBuffer> mIdBuffer;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map < std::string, std::unique_ptr<Material>> mMaterials;
@@ -75,6 +81,10 @@ class PickingApp : public VulkApp {
 	std::unordered_map<std::string, VkPipeline> mPSOs;
 
 	bool mIsWireframe{ false };
+	// Hover picking through the ID buffer instead of right click ray casts.
+	bool mGpuPicking{ false };
+	bool mHoverInWindow{ false };
+	POINT mHoverPos{ 0,0 };
 
 	RenderItem* mWavesRitem{ nullptr };
 
@@ -114,7 +124,10 @@ class PickingApp : public VulkApp {
 	void BuildRenderItems();
 	void BuildCarGeometry();
 	void DrawRenderItems(VkCommandBuffer, const std::vector<RenderItem*>& ritems);
+	void DrawIdBuffer(VkCommandBuffer cmd);
 	void Pick(int sx, int sy);
+	void PickGpu();
+	void SetPickedTriangle(RenderItem* ri, uint32_t tri);
 public:
 	PickingApp(HINSTANCE hInstance);
 	PickingApp(const PickingApp& rhs) = delete;
@@ -129,6 +142,7 @@ PickingApp::PickingApp(HINSTANCE hInstance) :VulkApp(hInstance) {
 	mClearValues[0].color = Colors::LightSteelBlue;
 	mMSAA = false;
 	mDepthBuffer = true;
+	mGeometryShader = true;//gl_PrimitiveID in id.frag
 }
 
 PickingApp::~PickingApp() {
@@ -149,6 +163,7 @@ PickingApp::~PickingApp() {
 bool PickingApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	//mCamera.SetPosition(0.0f, 2.0f, -15.0f);
 	mCamera.LookAt(glm::vec3(5.0f, 4.0f, -15.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
@@ -160,6 +175,9 @@ bool PickingApp::Initialize() {
 	BuildRenderItems();
 	BuildBuffers();
 	BuildDescriptors();
+	//readback is checked against the frame's fence, one region per frame in flight
+	if (mDeviceFeatures.geometryShader)
+		mIdBuffer = std::make_unique<IdBuffer>(mDevice, mMemoryProperties, mMaxFrames);
 	BuildPSOs();
 	BuildFrameResources();
 
@@ -266,6 +284,10 @@ void PickingApp::BuildCarGeometry()
 	
 	geo->IndexBufferByteSize = ibByteSize;
 
+	//picking walks this instead of every triangle
+	geo->Bvh = std::make_shared<TriangleBvh>();
+	geo->Bvh->Build(vertices.data(), sizeof(Vertex), indices.data(), indices.size());
+
 	SubmeshGeometry submesh;
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
@@ -426,6 +448,27 @@ void PickingApp::BuildPSOs() {
 	for (auto& shader : shaders) {
 		Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
 	}
+
+	if (!mIdBuffer)
+		return;
+	//object and primitive ids for GPU picking, same layout as the other pipelines
+	shaders.clear();
+	vertexAttributeDescriptions.clear();
+	ShaderProgramLoader::begin(mDevice)
+		.AddShaderPath("Shaders/id.vert.spv")
+		.AddShaderPath("Shaders/id.frag.spv")
+		.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
+	PipelineBuilder::begin(mDevice, *pipelineLayout, mIdBuffer->getRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.build(pipeline);
+	idPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
+	mPSOs["id"] = *idPipeline;
+
+	for (auto& shader : shaders) {
+		Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
+	}
 }
 void PickingApp::BuildFrameResources() {
 	for (int i = 0; i < gNumFrameResources; i++) {
@@ -518,7 +561,7 @@ void PickingApp::OnMouseDown(WPARAM btnState, int x, int y) {
 		mLastMousePos.y = y;
 		SetCapture(mhMainWnd);
 	}
-	else if ((btnState & MK_RBUTTON) != 0) {
+	else if ((btnState & MK_RBUTTON) != 0 && !mGpuPicking) {
 		Pick(x, y);
 	}
 }
@@ -550,6 +593,12 @@ void PickingApp::OnKeyboardInput(const GameTimer& gt)
 	else
 		mIsWireframe = false;
 
+	//2 picks whatever is under the cursor through the ID buffer, 3 goes back to right click ray casts
+	if ((GetAsyncKeyState('2') & 0x8000) && mIdBuffer)
+		mGpuPicking = true;
+	if (GetAsyncKeyState('3') & 0x8000)
+		mGpuPicking = false;
+
 	const float dt = gt.DeltaTime();
 
 	if (GetAsyncKeyState('W') & 0x8000)
@@ -570,9 +619,11 @@ void PickingApp::OnKeyboardInput(const GameTimer& gt)
 void PickingApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	OnKeyboardInput(gt);
+	//the frame's fence has been waited on, so its ID readback has landed
+	PickGpu();
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	AnimateMaterials(gt);
@@ -582,6 +633,7 @@ void PickingApp::Update(const GameTimer& gt) {
 }
 
 void PickingApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -617,6 +669,7 @@ void PickingApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 void  PickingApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -630,6 +683,7 @@ void  PickingApp::UpdateObjectCBs(const GameTimer& gt) {
 			objConstants.World = world;
 			objConstants.TexTransform = e->TexTransform;
 			objConstants.MaterialIndex = e->Mat->MatCBIndex;
+			objConstants.ObjectId = e->ObjCBIndex + 1;
 			memcpy((pObjConsts + (objSize * e->ObjCBIndex)), &objConstants, sizeof(objConstants));
 			//pObjConsts[e->ObjCBIndex] = objConstants;
 			e->NumFramesDirty--;
@@ -638,6 +692,7 @@ void  PickingApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void PickingApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
@@ -665,15 +720,9 @@ void PickingApp::Draw(const GameTimer& gt) {
 	uint32_t index = 0;
 	VkCommandBuffer cmd{ VK_NULL_HANDLE };
 
-
-
-	cmd = BeginRender();
-
-	VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
-	pvkCmdSetViewport(cmd, 0, 1, &viewport);
-	VkRect2D scissor = { {0,0},{(uint32_t)mClientWidth,(uint32_t)mClientHeight} };
-	pvkCmdSetScissor(cmd, 0, 1, &scissor);
-
+	//the ID pass has its own render pass, so start the main one after it
+	bool idPass = mGpuPicking && mHoverInWindow;
+	cmd = BeginRender(!idPass);
 
 	auto& ub = *uniformBuffer;
 	VkDeviceSize passSize = ub[0].objectSize;
@@ -693,6 +742,17 @@ void PickingApp::Draw(const GameTimer& gt) {
 	auto& td = *textureDescriptors;
 	VkDescriptorSet descriptor3 = td[0];
 	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
+
+	if (idPass) {
+		DrawIdBuffer(cmd);
+		pvkCmdBeginRenderPass(cmd, &mRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	}
+
+	VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
+	pvkCmdSetViewport(cmd, 0, 1, &viewport);
+	VkRect2D scissor = { {0,0},{(uint32_t)mClientWidth,(uint32_t)mClientHeight} };
+	pvkCmdSetScissor(cmd, 0, 1, &scissor);
+
 	if (mIsWireframe) {
 		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque_wireframe"]);
 		DrawRenderItems(cmd, mRitemLayer[(int)RenderLayer::Opaque]);
@@ -708,6 +768,29 @@ void PickingApp::Draw(const GameTimer& gt) {
 	EndRender(cmd);
 }
 
+// Opaque items into the region of the ID buffer around the cursor, then copy it
+// out for PickGpu to read when this frame comes round again.
+void PickingApp::DrawIdBuffer(VkCommandBuffer cmd) {
+	VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	VkClearValue clearValues[2]{};//id 0 is nothing
+	clearValues[1].depthStencil = { 1.0f,0 };
+	renderPassBeginInfo.clearValueCount = 2;
+	renderPassBeginInfo.pClearValues = clearValues;
+	renderPassBeginInfo.renderPass = mIdBuffer->getRenderPass();
+	renderPassBeginInfo.framebuffer = mIdBuffer->getFramebuffer();
+	renderPassBeginInfo.renderArea = mIdBuffer->ScissorRect();
+	VkViewport viewport = mIdBuffer->Viewport(mHoverPos.x, mHoverPos.y, mClientWidth, mClientHeight);
+	pvkCmdSetViewport(cmd, 0, 1, &viewport);
+	VkRect2D scissor = mIdBuffer->ScissorRect();
+	pvkCmdSetScissor(cmd, 0, 1, &scissor);
+	pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	//descriptor sets bound by Draw carry over, the pipeline layout is the same
+	pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["id"]);
+	DrawRenderItems(cmd, mRitemLayer[(int)RenderLayer::Opaque]);
+	pvkCmdEndRenderPass(cmd);
+	mIdBuffer->Readback(cmd, mCurrFrame);
+}
+
 void PickingApp::DrawRenderItems(VkCommandBuffer cmd, const std::vector<RenderItem*>& ritems) {
 	auto& ub = *uniformBuffer;
 	VkDeviceSize objectSize = ub[1].objectSize;
@@ -777,21 +860,12 @@ void PickingApp::Pick(int x, int y) {
 			Ray ray(localOrigin, localDir);
 			float t = 0.0f;
 			uint32_t tri = UINT32_MAX;
-			if (ray.IntersectMesh<Vertex>(vertices, indices, ri->IndexCount,tri, t)) {
+			bool hit = geo->Bvh ? ray.IntersectMesh(*geo->Bvh, tri, t) : ray.IntersectMesh<Vertex>(vertices, indices, ri->IndexCount, tri, t);
+			if (hit) {
 				
 				//This is the new nearest picked triangle
 				tmin = t;
-				uint32_t pickedTriangle = tri;
-				mPickedRitem->Visible = true;
-				mPickedRitem->IndexCount = 3;
-				mPickedRitem->BaseVertexLocation = 0;
-				//Picked render item needs same world matrix as object picked
-				mPickedRitem->World = ri->World;
-				mPickedRitem->NumFramesDirty = gNumFrameResources;
-
-				//offset to the picked triangle in the mesh index buffer.
-				mPickedRitem->StartIndexLocation = 3 * tri;
-				
+				SetPickedTriangle(ri, tri);
 			}
 		}
 
@@ -799,10 +873,104 @@ void PickingApp::Pick(int x, int y) {
 
 }
 
-int main() {
+// Result of the ID pass recorded the last time this frame ran.
+void PickingApp::PickGpu() {
+	if (!mIdBuffer)
+		return;
+	//where this frame's ID pass goes
+	GetCursorPos(&mHoverPos);
+	ScreenToClient(mhMainWnd, &mHoverPos);
+	mHoverInWindow = mHoverPos.x >= 0 && mHoverPos.y >= 0 && mHoverPos.x < mClientWidth && mHoverPos.y < mClientHeight;
+
+	uint32_t objectId = 0;
+	uint32_t primitive = 0;
+	if (!mIdBuffer->Resolve(mCurrFrame, objectId, primitive) || !mGpuPicking)
+		return;
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque]) {
+		if (ri->Visible && ri->ObjCBIndex + 1 == objectId) {
+			//gl_PrimitiveID counts from the draw's first index
+			SetPickedTriangle(ri, ri->StartIndexLocation / 3 + primitive);
+			return;
+		}
+	}
+	mPickedRitem->Visible = false;
+}
+
+void PickingApp::SetPickedTriangle(RenderItem* ri, uint32_t tri) {
+	//hover picking lands here every frame, only dirty the constants when the pick moves
+	if (mPickedRitem->Visible && mPickedRitem->StartIndexLocation == 3 * tri && mPickedRitem->World == ri->World)
+		return;
+	mPickedRitem->Visible = true;
+	mPickedRitem->IndexCount = 3;
+	mPickedRitem->BaseVertexLocation = 0;
+	//Picked render item needs same world matrix as object picked
+	mPickedRitem->World = ri->World;
+	mPickedRitem->NumFramesDirty = gNumFrameResources;
+
+	//offset to the picked triangle in the mesh index buffer.
+	mPickedRitem->StartIndexLocation = 3 * tri;
+}
+
+// Brute force Ray::IntersectMesh against the triangle BVH on spheres of 1k to 1M
+// triangles, checks both pick the same triangle at the same distance.
+static int PickBench() {
+	const uint32_t slices[] = { 32, 100, 316, 1000 };
+	const uint32_t stacks[] = { 17, 51, 159, 501 };
+	const int rayCount = 200;
+	GeometryGenerator geoGen;
+	for (int m = 0; m < 4; ++m) {
+		GeometryGenerator::MeshData sphere = geoGen.CreateSphere(10.0f, slices[m], stacks[m]);
+		auto vertices = sphere.Vertices.data();
+		auto indices = sphere.Indices32.data();
+		size_t indexCount = sphere.Indices32.size();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		TriangleBvh bvh;
+		bvh.Build(vertices, sizeof(GeometryGenerator::Vertex), indices, indexCount);
+		auto end = std::chrono::high_resolution_clock::now();
+		double buildMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+		//rays from around the sphere aimed near its center, some miss
+		std::vector<glm::vec3> origins(rayCount), dirs(rayCount);
+		for (int i = 0; i < rayCount; ++i) {
+			origins[i] = glm::vec3(MathHelper::RandF(-30.0f, 30.0f), MathHelper::RandF(-30.0f, 30.0f), MathHelper::RandF(-30.0f, 30.0f));
+			glm::vec3 target(MathHelper::RandF(-12.0f, 12.0f), MathHelper::RandF(-12.0f, 12.0f), MathHelper::RandF(-12.0f, 12.0f));
+			dirs[i] = glm::normalize(target - origins[i]);
+		}
+		std::vector<uint32_t> bruteTris(rayCount), bvhTris(rayCount);
+		std::vector<float> bruteDists(rayCount), bvhDists(rayCount);
+		int hits = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < rayCount; ++i) {
+			Ray ray(origins[i], dirs[i]);
+			hits += ray.IntersectMesh(vertices, indices, indexCount, bruteTris[i], bruteDists[i]) ? 1 : 0;
+		}
+		end = std::chrono::high_resolution_clock::now();
+		double bruteUs = std::chrono::duration<double, std::micro>(end - start).count() / rayCount;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < rayCount; ++i) {
+			Ray ray(origins[i], dirs[i]);
+			ray.IntersectMesh(bvh, bvhTris[i], bvhDists[i]);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		double bvhUs = std::chrono::duration<double, std::micro>(end - start).count() / rayCount;
+		int mismatches = 0;
+		for (int i = 0; i < rayCount; ++i) {
+			if (bruteTris[i] != bvhTris[i] || (bruteTris[i] != UINT32_MAX && bruteDists[i] != bvhDists[i]))
+				mismatches++;
+		}
+		std::cout << indexCount / 3 << " triangles: build " << buildMs << " ms, brute force " << bruteUs << " us/ray, bvh " << bvhUs << " us/ray, x" << bruteUs / bvhUs
+			<< " (" << hits << "/" << rayCount << " hit, " << mismatches << " mismatches)" << std::endl;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
+	if (argc > 1 && std::string(argv[1]) == "-pickbench")
+		return PickBench();
 
 	try
 	{
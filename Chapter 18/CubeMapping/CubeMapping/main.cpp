@@ -11,7 +11,8 @@
 #include <iostream>
 #include <sstream>
 #include "FrameResource.h"
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -146,6 +147,7 @@ CubeMapApp::~CubeMapApp() {
 bool CubeMapApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
 	
@@ -872,8 +874,8 @@ void CubeMapApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	OnKeyboardInput(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	AnimateMaterials(gt);
@@ -883,6 +885,7 @@ void CubeMapApp::Update(const GameTimer& gt) {
 
 }
 void CubeMapApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -917,6 +920,7 @@ void CubeMapApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void  CubeMapApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -938,6 +942,7 @@ void  CubeMapApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void CubeMapApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
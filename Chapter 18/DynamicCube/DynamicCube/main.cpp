@@ -12,7 +12,8 @@
 #include <sstream>
 #include "FrameResource.h"
 #include "CubeRenderTarget.h"
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 const uint32_t CubeMapSize = 512;
 
@@ -123,7 +124,7 @@ class DynamicCubeMapApp : public VulkApp {
 	void BuildRenderItems();
 	void BuildShapeGeometry();
 	void BuildSkullGeometry();
-	void DrawRenderItems(VkCommandBuffer, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems);
+	void DrawRenderItems(VkCommandBuffer, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems, uint32_t task = 0, uint32_t taskCount = 1);
 	void BuildCubeFaceCamera(float x, float y, float z);
 public:
 	DynamicCubeMapApp(HINSTANCE hInstance);
@@ -139,6 +140,9 @@ DynamicCubeMapApp::DynamicCubeMapApp(HINSTANCE hInstance) :VulkApp(hInstance) {
 	mClearValues[0].color = Colors::LightSteelBlue;
 	mMSAA = false;
 	mDepthBuffer = true;
+	mRecordThreads = 0;//record the cube faces and the main pass in parallel
+	mGpuProfile = true;//time every face and the main pass
+	mCpuProfile = true;
 }
 
 DynamicCubeMapApp::~DynamicCubeMapApp() {
@@ -158,6 +162,7 @@ bool DynamicCubeMapApp::Initialize()
 {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	// Reset the command list to prep for initialization commands.
 	
@@ -941,72 +946,46 @@ void DynamicCubeMapApp::BuildCubeFaceCamera(float x, float y, float z)
 
 
 void DynamicCubeMapApp::Draw(const GameTimer& gt) {
-	uint32_t index = 0;
-
 	auto& ub = *uniformBuffer;
 	VkDeviceSize passSize = ub[0].objectSize;
 	VkDeviceSize passCount = ub[0].objectCount;
 	auto& ud = *uniformDescriptors;
 	//bind descriptors that don't change during pass
 	VkDescriptorSet descriptor0 = ud[0];//pass constant buffer
-	uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount };
 	
 	//bind storage buffer
-	auto& sb = *storageBuffer;
-	VkDeviceSize matSize = sb[0].objectSize * sb[0].objectCount;
 	auto& sd = *storageDescriptors;
 	VkDescriptorSet descriptor2 = sd[0];
 	auto& td = *textureDescriptors;
 	VkDescriptorSet descriptor3 = td[0];
 	VkDescriptorSet descriptor4 = td[1];
+	auto& ct = *cubeMapDescriptor;
+	VkDescriptorSet descriptor5 = ct;
+	//looked up here, the map isn't safe to index from the record threads
+	VkPipeline offscreenOpaquePSO = mPSOs["offscreen_opaque"];
+	VkPipeline offscreenSkyPSO = mPSOs["offscreen_sky"];
+	VkPipeline opaquePSO = mIsWireframe ? mPSOs["opaque_wireframe"] : mPSOs["opaque"];
+	VkPipeline skyPSO = mPSOs["sky"];
 	VkCommandBuffer cmd = BeginRender(false);//don't want to start main render pass
-	//Offscreen renderpass
-	{
-		uint32_t w = mDynamicCubeMap->getWidth();
-		uint32_t h = mDynamicCubeMap->getHeight();
-		VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-		renderPassBeginInfo.clearValueCount = sizeof(mClearValues) / sizeof(mClearValues[0]);
-		renderPassBeginInfo.pClearValues = mClearValues;
-		renderPassBeginInfo.renderPass = mDynamicCubeMap->getRenderPass();
-		renderPassBeginInfo.framebuffer = mDynamicCubeMap->getFrameBuffer();
-		renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
-		
-		
-		VkViewport viewport = { 0.0f,0.0f,(float)w,(float)h,0.0f,1.0f };
-		pvkCmdSetViewport(cmd, 0, 1, &viewport);
-		VkRect2D scissor = { {0,0},{(uint32_t)w,(uint32_t)h} };
-		pvkCmdSetScissor(cmd, 0, 1, &scissor);
-		for (uint32_t face = 0; face < 6; face++) {
-			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			VkDeviceSize offset = passSize * passCount * mCurrFrame + passSize * (face + 1);
-			dynamicOffsets[0] = (uint32_t)offset;
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["offscreen_opaque"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["offscreen_sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-			pvkCmdEndRenderPass(cmd);
-			//VkResult res = pvkEndCommandBuffer(cmd);
 
-			//assert(res == VK_SUCCESS);
+	//6 offscreen faces, each copied to the cube map after its pass, then the main pass:
+	//reflectors, the opaque items split over MainOpaqueTasks, sky
+	const uint32_t MainOpaqueTasks = 2;
+	std::vector<RecordedPass> passes(7);
+	static const char* FaceNames[6] = { "cube face +x","cube face -x","cube face +y","cube face -y","cube face +z","cube face -z" };
+	for (uint32_t face = 0; face < 6; face++) {
+		RecordedPass& pass = passes[face];
+		pass.Name = FaceNames[face];
+		pass.BeginInfo.clearValueCount = sizeof(mClearValues) / sizeof(mClearValues[0]);
+		pass.BeginInfo.pClearValues = mClearValues;
+		pass.BeginInfo.renderPass = mDynamicCubeMap->getRenderPass();
+		pass.BeginInfo.framebuffer = mDynamicCubeMap->getFrameBuffer();
+		pass.BeginInfo.renderArea = { 0,0,mDynamicCubeMap->getWidth(),mDynamicCubeMap->getHeight() };
+		pass.After = [this, face](VkCommandBuffer cmd) {
 			//transition image, 
 			Vulkan::transitionImageNoSubmit(cmd, mDynamicCubeMap->getRenderTarget(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 			//copy it to cubemap
-			VkImageSubresourceRange cubeFaceSubresourceRange = {};
-			cubeFaceSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			cubeFaceSubresourceRange.baseMipLevel = 0;
-			cubeFaceSubresourceRange.levelCount = 1;
-			cubeFaceSubresourceRange.baseArrayLayer = face;
-			cubeFaceSubresourceRange.layerCount = 1;
-			Vulkan::transitionImageNoSubmit(cmd,  mDynamicCubeMap->CubeMapImage(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,1,6);
+			Vulkan::transitionImageNoSubmit(cmd, mDynamicCubeMap->CubeMapImage(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, 6);
 			// Copy region for transfer from framebuffer to cube face
 			VkImageCopy copyRegion = {};
 
@@ -1037,99 +1016,61 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt) {
 				&copyRegion);
 
 			Vulkan::transitionImageNoSubmit(cmd, mDynamicCubeMap->getRenderTarget(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			Vulkan::transitionImageNoSubmit(cmd, mDynamicCubeMap->CubeMapImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,1,6);
-
-			/*VkResult res = pvkEndCommandBuffer(cmd);
-
-			assert(res == VK_SUCCESS);*/
-		}
+			Vulkan::transitionImageNoSubmit(cmd, mDynamicCubeMap->CubeMapImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 6);
+		};
 	}
-
-	//start main render pass now
-	pvkCmdBeginRenderPass(cmd, &mRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	
-	dynamicOffsets[0] = (uint32_t)(mCurrFrame * passSize * passCount);
-	
-
-	VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
-	pvkCmdSetViewport(cmd, 0, 1, &viewport);
-	VkRect2D scissor = { {0,0},{(uint32_t)mClientWidth,(uint32_t)mClientHeight} };
-	pvkCmdSetScissor(cmd, 0, 1, &scissor);
-
-
-	//auto& ub = *uniformBuffer;
-	//VkDeviceSize passSize = ub[0].objectSize;
-	//auto& ud = *uniformDescriptors;
-	////bind descriptors that don't change during pass
-	//VkDescriptorSet descriptor0 = ud[0];//pass constant buffer
-	//uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize };
-	//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-	////bind storage buffer
-	//auto& sb = *storageBuffer;
-	//VkDeviceSize matSize = sb[0].objectSize * sb[0].objectCount;
-	//auto& sd = *storageDescriptors;
-	//VkDescriptorSet descriptor2 = sd[0];
-	////dynamicOffsets[0] = mCurrFrame * (uint32_t)matSize;
-	////pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-	////bind texture array
-	//auto& td = *textureDescriptors;
-	//VkDescriptorSet descriptor3 = td[0];
-	//VkDescriptorSet descriptor4 = td[1];
-	////pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-	auto& ct = *cubeMapDescriptor;
-	VkDescriptorSet descriptor5 = ct;
-	if (mIsWireframe) {
-		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque_wireframe"]);
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor5, 0, 0);//bind PC data once
-		DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors]);
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-		DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-		DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-	}
-	else
-	{
-		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque"]);
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor5, 0, 0);//bind PC data once
-		DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors]);
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-		
-
-		DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
+	//start main render pass last, EndRender ends it
+	passes[6].BeginInfo = mRenderPassBeginInfo;
+	passes[6].Name = "main";
+	passes[6].TaskCount = MainOpaqueTasks + 2;
+
+	RecordPasses(cmd, passes, [&](uint32_t pass, uint32_t task, VkCommandBuffer cmd) {
+		if (pass < 6) {
+			//offscreen face, pass constants after the main pass's
+			uint32_t dynamicOffsets[1] = { (uint32_t)(passSize * passCount * mCurrFrame + passSize * (pass + 1)) };
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenOpaquePSO);
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *cubeMapPipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenSkyPSO);
+			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
+			return;
+		}
+		uint32_t dynamicOffsets[1] = { (uint32_t)(mCurrFrame * passSize * passCount) };
 		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
 		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
 		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-		
-		pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-		DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-	}
+		if (task == 0) {
+			//reflectors sample the dynamic cube map
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, opaquePSO);
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor5, 0, 0);//bind PC data once
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors]);
+		}
+		else if (task <= MainOpaqueTasks) {
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, opaquePSO);
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque], task - 1, MainOpaqueTasks);
+		}
+		else {
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, skyPSO);
+			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
+		}
+	});
 	EndRender(cmd);
 }
-void DynamicCubeMapApp::DrawRenderItems(VkCommandBuffer cmd, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems) {
+void DynamicCubeMapApp::DrawRenderItems(VkCommandBuffer cmd, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems, uint32_t task, uint32_t taskCount) {
 	auto& ub = *uniformBuffer;
 	VkDeviceSize objectSize = ub[1].objectSize;
 	auto& ud = *uniformDescriptors;
 	VkDescriptorSet descriptor1 = ud[1];
 
-
-	for (size_t i = 0; i < ritems.size(); i++) {
+	//this task's share of the items
+	size_t begin = ritems.size() * task / taskCount;
+	size_t end = ritems.size() * (task + 1) / taskCount;
+	for (size_t i = begin; i < end; i++) {
 		auto ri = ritems[i];
 		uint32_t indexOffset = ri->StartIndexLocation;
 
@@ -1163,8 +1104,8 @@ void DynamicCubeMapApp::Update(const GameTimer& gt) {
 	mSkullRitem->World = skullGlobalRotate*skullOffset * skullLocalRotate * skullScale;
 	mSkullRitem->NumFramesDirty = gNumFrameResources;
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	AnimateMaterials(gt);
@@ -1174,6 +1115,7 @@ void DynamicCubeMapApp::Update(const GameTimer& gt) {
 
 }
 void DynamicCubeMapApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -1210,6 +1152,7 @@ void DynamicCubeMapApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 void DynamicCubeMapApp::UpdateCubeMapFacePassCBs()
 {
+	CPU_ZONE("UpdateCubeMapFacePassCBs");
 	//auto currPassCB = mCurrFrameResource->PassCB.get();
 	auto currPassCB = mCurrFrameResource->pPCs;
 	// Cube map pass cbuffers are stored in elements 1-6.
@@ -1260,6 +1203,7 @@ void DynamicCubeMapApp::UpdateCubeMapFacePassCBs()
 
 
 void  DynamicCubeMapApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -1281,6 +1225,7 @@ void  DynamicCubeMapApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void DynamicCubeMapApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
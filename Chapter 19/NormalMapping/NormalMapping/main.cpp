@@ -11,7 +11,8 @@
 #include <iostream>
 #include <sstream>
 #include "FrameResource.h"
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -153,6 +154,7 @@ NormalMapApp::~NormalMapApp() {
 bool NormalMapApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
 
@@ -774,8 +776,8 @@ void NormalMapApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	OnKeyboardInput(gt);
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	AnimateMaterials(gt);
@@ -785,6 +787,7 @@ void NormalMapApp::Update(const GameTimer& gt) {
 
 }
 void NormalMapApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -819,6 +822,7 @@ void NormalMapApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void  NormalMapApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -840,6 +844,7 @@ void  NormalMapApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void NormalMapApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
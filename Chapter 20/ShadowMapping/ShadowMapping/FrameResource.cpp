@@ -1,9 +1,7 @@
 #include "FrameResource.h"
 
 
-FrameResource::FrameResource(PassConstants* pc, ObjectConstants* oc, MaterialData* md) {
-	pPCs = pc;
-	pOCs = oc;
+FrameResource::FrameResource(MaterialData* md) {
 	pMats = md;
 }
 
@@ -57,11 +57,9 @@ struct Vertex {
 };
 
 struct FrameResource {
-	FrameResource(PassConstants* pc, ObjectConstants* id, MaterialData* md);
+	FrameResource(MaterialData* md);
 	FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator=(const FrameResource& rhs) = delete;
 	~FrameResource();
-	PassConstants* pPCs{ nullptr };
-	ObjectConstants* pOCs{ nullptr };
 	MaterialData* pMats{ nullptr };
 };
@@ -7,6 +7,8 @@
 #include "../../../Common/Colors.h"
 #include "../../../Common/TextureLoader.h"
 #include "../../../Common/Camera.h"
+#include "../../../Common/RingBuffer.h"
+#include "../../../Common/DrawQueue.h"
 #include <memory>
 #include <fstream>
 #include <iostream>
@@ -14,7 +16,8 @@
 #include <future>
 #include "FrameResource.h"
 #include "ShadowMap.h"
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -33,6 +36,7 @@ struct RenderItem {
 	int NumFramesDirty = gNumFrameResources;
 
 	uint32_t ObjCBIndex = -1;
+	uint32_t ObjCBOffset{ 0 };//this frame's object constants in the frame ring
 
 	Material* Mat{ nullptr };
 	MeshGeometry* Geo{ nullptr };
@@ -65,7 +69,11 @@ class ShadowMapApp : public VulkApp
 
 	std::unique_ptr<DescriptorSetLayoutCache> descriptorSetLayoutCache;
 	std::unique_ptr<DescriptorSetPoolCache> descriptorSetPoolCache;
-	std::unique_ptr<VulkanUniformBuffer> uniformBuffer;
+	std::unique_ptr<FrameRingBuffer> mFrameRing;//pass and object constants, written every frame
+	//rebuilt every frame, sorted by state and depth before submission
+	DrawQueue mShadowQueue;
+	DrawQueue mMainQueue;
+	uint32_t mCaptionSaved{ UINT32_MAX };
 	std::unique_ptr<VulkanImageList> textures;
 	std::unique_ptr<VulkanImage> cubeMapTexture;
 	std::unique_ptr<VulkanUniformBuffer> storageBuffer;
@@ -101,8 +109,11 @@ class ShadowMapApp : public VulkApp
 
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
-	PassConstants mMainPassCB;  // index 0 of pass cbuffer.
-	PassConstants mShadowPassCB;// index 1 of pass cbuffer.
+	PassConstants mMainPassCB;
+	PassConstants mShadowPassCB;
+	uint32_t mMainPassOffset{ 0 };//this frame's, in the frame ring
+	uint32_t mShadowPassOffset{ 0 };
+	bool mFrameRingFull{ false };//some constants didn't fit this frame, nothing is drawn with stale offsets
 
 	Camera mCamera;
 
@@ -162,7 +173,8 @@ class ShadowMapApp : public VulkApp
 	void BuildRenderItems();
 	void BuildShapeGeometry();
 	void BuildSkullGeometry();
-	void DrawRenderItems(VkCommandBuffer, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems);
+	void AddRenderItems(DrawQueue& queue, VkPipeline pipeline, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems, RenderLayer layer, const glm::mat4& view, float nearZ, float farZ);
+	void UpdateCaption();
 	void DrawSceneToShadowMap();
 public:
 	ShadowMapApp(HINSTANCE hInstance);
@@ -203,6 +215,7 @@ ShadowMapApp::~ShadowMapApp() {
 bool ShadowMapApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
@@ -262,15 +275,11 @@ void ShadowMapApp::LoadTextures() {
 }
 
 void ShadowMapApp::BuildBuffers() {
+	//pass and object constants are allocated from the ring every frame, bound with dynamic offsets
+	mFrameRing = std::make_unique<FrameRingBuffer>(mDevice, mDeviceProperties, mMemoryProperties, 256 * 1024, mMaxFrames);
+
 	Vulkan::Buffer dynamicBuffer;
-	//pass and object constants are dynamic uniform buffers
 	std::vector<UniformBufferInfo> bufferInfo;
-	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, true)
-		.AddBuffer(sizeof(PassConstants), 2, gNumFrameResources)//one for main, one for shadow
-		.AddBuffer(sizeof(ObjectConstants), mAllRitems.size(), gNumFrameResources)		
-		.build(dynamicBuffer, bufferInfo);
-	uniformBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
-
 	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, true)
 		.AddBuffer(sizeof(MaterialData), mMaterials.size(), gNumFrameResources)
 		.build(dynamicBuffer, bufferInfo);
@@ -797,20 +806,15 @@ void ShadowMapApp::BuildDescriptors() {
 	shadowDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
 
 
-	VkDeviceSize offset = 0;
 	descriptors = { descriptor0,descriptor1 };
 	std::vector<VkDescriptorSetLayout> descriptorLayouts = { descriptorLayout0,descriptorLayout1 };
-	auto& ub = *uniformBuffer;
+	VkDeviceSize ranges[2] = { sizeof(PassConstants),sizeof(ObjectConstants) };
 	for (int i = 0; i < (int)descriptors.size(); ++i) {
-		//descriptorBufferInfo.clear();
-		VkDeviceSize range = ub[i].objectSize;// bufferInfo[i].objectCount* bufferInfo[i].objectSize* bufferInfo[i].repeatCount;
-		VkDeviceSize bufferSize = ub[i].objectCount * ub[i].objectSize * ub[i].repeatCount;
+		//the whole ring, the dynamic offset picks this frame's constants
 		VkDescriptorBufferInfo descrInfo{};
-		descrInfo.buffer = ub;
-		descrInfo.offset = offset;
-		descrInfo.range = ub[i].objectSize;
-		//descriptorBufferInfo.push_back(descrInfo);
-		offset += bufferSize;
+		descrInfo.buffer = *mFrameRing;
+		descrInfo.offset = 0;
+		descrInfo.range = ranges[i];
 		VkDescriptorSetLayout layout = descriptorLayouts[i];
 		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), layout, descriptors[i])
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &descrInfo)
@@ -1023,14 +1027,9 @@ void ShadowMapApp::BuildPSOs() {
 
 void ShadowMapApp::BuildFrameResources() {
 	for (int i = 0; i < gNumFrameResources; i++) {
-		auto& ub = *uniformBuffer;
 		auto& sb = *storageBuffer;
-		PassConstants* pc = (PassConstants*)((uint8_t*)ub[0].ptr + ub[0].objectSize * ub[0].objectCount * i);// ((uint8_t*)pPassCB + passSize * i);
-		ObjectConstants* oc = (ObjectConstants*)((uint8_t*)ub[1].ptr + ub[1].objectSize * ub[1].objectCount * i);// ((uint8_t*)pObjectCB + objectSize * mAllRitems.size() * i);
-		//MaterialConstants* mc = (MaterialConstants*)((uint8_t*)ub[2].ptr + ub[2].objectSize * ub[2].objectCount * i);// ((uint8_t*)pMatCB + matSize * mMaterials.size() * i);
 		MaterialData* md = (MaterialData*)((uint8_t*)sb[0].ptr + sb[0].objectSize * sb[0].objectCount * i);
-		//Vertex* pWv = (Vertex*)WaveVertexPtrs[i];
-		mFrameResources.push_back(std::make_unique<FrameResource>(pc, oc, md));// , pWv));
+		mFrameResources.push_back(std::make_unique<FrameResource>(md));
 	}
 }
 void ShadowMapApp::OnResize()
@@ -1073,9 +1072,12 @@ void ShadowMapApp::Update(const GameTimer& gt) {
 	
 
 	if (state == ProgState::Draw) {
+		//the slot's fence has signalled, its constants can be overwritten
+		mFrameRing->BeginFrame(mCurrFrame);
+		mFrameRingFull = false;
 
-		//Cycle through the circular frame resource array
-		mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+		//Use the frame resource of the slot VulkApp::Update just waited on
+		mCurrFrameResourceIndex = (int)mCurrFrame;
 		mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 		OnKeyboardInput(gt);
@@ -1132,27 +1134,20 @@ void ShadowMapApp::OnKeyboardInput(const GameTimer& gt)
 	mCamera.UpdateViewMatrix();
 }
 void  ShadowMapApp::UpdateObjectCBs(const GameTimer& gt) {
-
-	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
-	auto& ub = *uniformBuffer;
-	VkDeviceSize objSize = ub[1].objectSize;
+	CPU_ZONE("UpdateObjectCBs");
+	//every item drawn this frame gets fresh constants from the ring
 	for (auto& e : mAllRitems) {
-		//Only update the cbuffer data if the constants have changed.
-		//This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0) {
-			glm::mat4 world = e->World;
-			ObjectConstants objConstants;
-			objConstants.World = world;
-			objConstants.TexTransform = e->TexTransform;
-			objConstants.MaterialIndex = e->Mat->MatCBIndex;
-			memcpy((pObjConsts + (objSize * e->ObjCBIndex)), &objConstants, sizeof(objConstants));
-			//pObjConsts[e->ObjCBIndex] = objConstants;
-			e->NumFramesDirty--;
-		}
+		ObjectConstants objConstants;
+		objConstants.World = e->World;
+		objConstants.TexTransform = e->TexTransform;
+		objConstants.MaterialIndex = e->Mat->MatCBIndex;
+		if (!mFrameRing->PushUniform(objConstants, e->ObjCBOffset))
+			mFrameRingFull = true;
 	}
 }
 
 void ShadowMapApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
@@ -1181,6 +1176,7 @@ void ShadowMapApp::AnimateMaterials(const GameTimer& gt)
 
 void ShadowMapApp::UpdateShadowTransform(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateShadowTransform");
 	// Only the first "main" light casts a shadow.
 	glm::vec3 lightDir = mRotatedLightDirections[0];
 	glm::vec3 lightPos = -2.0f * mSceneBounds.Radius * lightDir;
@@ -1223,6 +1219,7 @@ void ShadowMapApp::UpdateShadowTransform(const GameTimer& gt)
 	mShadowTransform = S;
 }
 void ShadowMapApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -1233,7 +1230,6 @@ void ShadowMapApp::UpdateMainPassCB(const GameTimer& gt) {
 
 
 
-	PassConstants* pPassConstants = mCurrFrameResource->pPCs;
 	mMainPassCB.View = view;
 	mMainPassCB.Proj = proj;
 	mMainPassCB.ViewProj = viewProj;
@@ -1256,10 +1252,12 @@ void ShadowMapApp::UpdateMainPassCB(const GameTimer& gt) {
 	mMainPassCB.Lights[2].Direction = mRotatedLightDirections[2];
 	mMainPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
 
-	memcpy(pPassConstants, &mMainPassCB, sizeof(PassConstants));
+	if (!mFrameRing->PushUniform(mMainPassCB, mMainPassOffset))
+		mFrameRingFull = true;
 }
 
 void ShadowMapApp::UpdateShadowPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateShadowPassCB");
 	glm::mat4 view = mLightView;
 	glm::mat4 proj = mLightProj;
 	proj[1][1] *= -1;
@@ -1271,7 +1269,6 @@ void ShadowMapApp::UpdateShadowPassCB(const GameTimer& gt) {
 	uint32_t w = mShadowMap->Width();
 	uint32_t h = mShadowMap->Height();
 
-	PassConstants* pPassConstants = mCurrFrameResource->pPCs;
 	mShadowPassCB.View = view;
 	mShadowPassCB.Proj = proj;
 	mShadowPassCB.ViewProj = viewProj;
@@ -1294,28 +1291,23 @@ void ShadowMapApp::UpdateShadowPassCB(const GameTimer& gt) {
 	mShadowPassCB.Lights[2].Direction = mRotatedLightDirections[2];
 	mShadowPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
 
-	auto& ub = *uniformBuffer;
-	auto size = ub[0].objectSize;
-	uint8_t* ptr = (uint8_t*)pPassConstants + size;
-	memcpy(ptr, &mShadowPassCB, sizeof(PassConstants));
+	if (!mFrameRing->PushUniform(mShadowPassCB, mShadowPassOffset))
+		mFrameRingFull = true;
 }
 
 void ShadowMapApp::Draw(const GameTimer& gt) {
 	uint32_t index = 0;
 	VkCommandBuffer cmd = VK_NULL_HANDLE;
-	if (ProgState::Init == state) {
+	if (ProgState::Init == state || (ProgState::Draw == state && mFrameRingFull)) {
 		cmd = BeginRender(true);
 		EndRender(cmd);
 	}
 	else if(ProgState::Draw == state) {
 
-		auto& ub = *uniformBuffer;
-		VkDeviceSize passSize = ub[0].objectSize;
-		VkDeviceSize passCount = ub[0].objectCount;
 		auto& ud = *uniformDescriptors;
 		//bind descriptors that don't change during pass
 		VkDescriptorSet descriptor0 = ud[0];//pass constant buffer
-		uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount };
+		uint32_t dynamicOffsets[1] = { mShadowPassOffset };
 
 		//bind storage buffer
 		auto& sb = *storageBuffer;
@@ -1330,7 +1322,6 @@ void ShadowMapApp::Draw(const GameTimer& gt) {
 
 		VkCommandBuffer cmd = BeginRender(false);//don't want to start main render pass
 		{
-			dynamicOffsets[0] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount + (uint32_t)passSize };
 			//shadow pass
 			uint32_t w = mShadowMap->Width();
 			uint32_t h = mShadowMap->Height();
@@ -1352,14 +1343,17 @@ void ShadowMapApp::Draw(const GameTimer& gt) {
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
+			mShadowQueue.Clear();
+			AddRenderItems(mShadowQueue, mPSOs["shadow_opaque"], *shadowPipelineLayout, mRitemLayer[(int)RenderLayer::Opaque], RenderLayer::Opaque, mLightView, mLightNearZ, mLightFarZ);
+			mShadowQueue.Sort();
+			mShadowQueue.Submit(cmd);
 			pvkCmdEndRenderPass(cmd);
 			//Vulkan::transitionImage(mDevice,mGraphicsQueue,cmd,mShadowMap->getRenderTargetView(),VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,VK_IMAGE_LAYOUT)
 		}
 		//start main render pass now
 		pvkCmdBeginRenderPass(cmd, &mRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		dynamicOffsets[0] = (uint32_t)(mCurrFrame * passSize * passCount);
+		dynamicOffsets[0] = mMainPassOffset;
 
 
 		VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
@@ -1367,93 +1361,69 @@ void ShadowMapApp::Draw(const GameTimer& gt) {
 		VkRect2D scissor = { {0,0},{(uint32_t)mClientWidth,(uint32_t)mClientHeight} };
 		pvkCmdSetScissor(cmd, 0, 1, &scissor);
 
-		if (mIsWireframe) {
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque_wireframe"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-		}
-		else if (mIsFlatShader) {
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaqueFlat"]);
-
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-		}
-		else
-		{
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque"]);
-
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-			
-		}
+		//sets 0-5 are laid out the same in the main, debug and sky layouts, so stay bound across them
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
+		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
+
+		VkPipeline opaquePipeline = mIsWireframe ? mPSOs["opaque_wireframe"] : mIsFlatShader ? mPSOs["opaqueFlat"] : mPSOs["opaque"];
+		glm::mat4 view = mCamera.GetView();
+		float nearZ = mCamera.GetNearZ();
+		float farZ = mCamera.GetFarZ();
+		mMainQueue.Clear();
+		AddRenderItems(mMainQueue, opaquePipeline, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque], RenderLayer::Opaque, view, nearZ, farZ);
+		AddRenderItems(mMainQueue, mPSOs["debug"], *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug], RenderLayer::Debug, view, nearZ, farZ);
+		AddRenderItems(mMainQueue, mPSOs["sky"], *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky], RenderLayer::Sky, view, nearZ, farZ);
+		mMainQueue.Sort();
+		mMainQueue.Submit(cmd);
 		EndRender(cmd);
+		UpdateCaption();
 	}
 	
 
 }
-void ShadowMapApp::DrawRenderItems(VkCommandBuffer cmd, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems) {
-	auto& ub = *uniformBuffer;
-	VkDeviceSize objectSize = ub[1].objectSize;
+void ShadowMapApp::AddRenderItems(DrawQueue& queue, VkPipeline pipeline, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems, RenderLayer layer, const glm::mat4& view, float nearZ, float farZ) {
 	auto& ud = *uniformDescriptors;
 	VkDescriptorSet descriptor1 = ud[1];
 
-
 	for (size_t i = 0; i < ritems.size(); i++) {
 		auto ri = ritems[i];
-		uint32_t indexOffset = ri->StartIndexLocation;
-
-		const auto vbv = ri->Geo->vertexBufferGPU;
-		const auto ibv = ri->Geo->indexBufferGPU;
-		pvkCmdBindVertexBuffers(cmd, 0, 1, &vbv.buffer, mOffsets);
-
-		pvkCmdBindIndexBuffer(cmd, ibv.buffer, indexOffset * sizeof(uint32_t), VK_INDEX_TYPE_UINT32);
-		uint32_t cbvIndex = ri->ObjCBIndex;
-		uint32_t dyoffsets[2] = { (uint32_t)(cbvIndex * objectSize) };
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &descriptor1, 1, dyoffsets);
-		pvkCmdDrawIndexed(cmd, ri->IndexCount, 1, 0, ri->BaseVertexLocation, 0);
+		DrawQueue::Packet packet;
+		packet.Pipeline = pipeline;
+		packet.Layout = layout;
+		packet.ObjectSet = descriptor1;
+		packet.ObjectSetIndex = 1;
+		packet.ObjectOffset = ri->ObjCBOffset;
+		packet.VertexBuffer = ri->Geo->vertexBufferGPU.buffer;
+		packet.IndexBuffer = ri->Geo->indexBufferGPU.buffer;
+		packet.IndexCount = ri->IndexCount;
+		packet.FirstIndex = ri->StartIndexLocation;
+		packet.VertexOffset = (int32_t)ri->BaseVertexLocation;
+		//view space z of the object's origin, good enough to order whole objects
+		float z = (view * ri->World[3]).z;
+		queue.Add(packet, (uint32_t)layer, (z - nearZ) / (farZ - nearZ));
 	}
 }
 
+void ShadowMapApp::UpdateCaption() {
+	const DrawQueue::Stats& shadow = mShadowQueue.GetStats();
+	const DrawQueue::Stats& scene = mMainQueue.GetStats();
+	uint32_t saved = shadow.PipelineBindsSaved + shadow.DescriptorBindsSaved + shadow.BufferBindsSaved +
+		scene.PipelineBindsSaved + scene.DescriptorBindsSaved + scene.BufferBindsSaved;
+	//draw lists only change with the scene, skip rebuilding the same string
+	if (saved == mCaptionSaved)
+		return;
+	mCaptionSaved = saved;
+	std::wostringstream outs;
+	outs << L"Shadow Mapping Demo    " << (shadow.Draws + scene.Draws) << L" draws, binds saved: " <<
+		(shadow.PipelineBindsSaved + scene.PipelineBindsSaved) << L" pipeline, " <<
+		(shadow.DescriptorBindsSaved + scene.DescriptorBindsSaved) << L" descriptor, " <<
+		(shadow.BufferBindsSaved + scene.BufferBindsSaved) << L" buffer";
+	mMainWndCaption = outs.str();
+}
+
 
 
 
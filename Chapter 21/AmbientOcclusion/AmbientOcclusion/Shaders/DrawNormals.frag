@@ -4,6 +4,7 @@
 layout(location=0) in vec3 inNormalW;
 layout(location=1) in vec3 inTangentW;
 layout(location=3) in vec2 inTexC;
+layout(location=4) flat in uint inMaterialIndex;
 
 layout(location=0) out vec4 outFragColor;
 
@@ -55,16 +56,6 @@ layout (set=0,binding=0) uniform PassCB{
 	Light gLights[MAX_LIGHTS];
 };
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 world;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
-};
-
-
 struct MaterialData
 {
 	vec4   DiffuseAlbedo;
@@ -91,7 +82,7 @@ layout (constant_id=0) const int enableAlphaTest=0;
 
 void main(){
 	//MaterialData matData = gMaterialData[gMaterialIndex];
-	MaterialData matData = materialData.materials[gMaterialIndex];
+	MaterialData matData = materialData.materials[inMaterialIndex];
 	//float4 diffuseAlbedo = matData.DiffuseAlbedo;
 	vec4 diffuseAlbedo = matData.DiffuseAlbedo;
 	//float3 fresnelR0 = matData.FresnelR0;	
@@ -7,6 +7,7 @@ layout(location=3) in vec3 inTangentU;
 layout(location=0) out vec3 outNormalW;
 layout(location=1) out vec3 outTangentW;
 layout(location=3) out vec2 outTexC;
+layout(location=4) flat out uint outMaterialIndex;
 
 struct Light
 {
@@ -48,15 +49,21 @@ layout (set=0,binding=0) uniform PassCB{
 };
 
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 world;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+struct ObjectData
+{
+	mat4 World;
+	mat4 TexTransform;
+	uint MaterialIndex;
+	uint ObjPad0;
+	uint ObjPad1;
+	uint ObjPad2;
 };
 
+//every item's constants, an item is drawn with firstInstance = its index
+layout (set=1, binding=0) readonly buffer ObjectBuffer{
+	ObjectData objects[];
+}objectData;
+
 struct MaterialData
 {
 	vec4   DiffuseAlbedo;
@@ -74,6 +81,10 @@ layout (set=2, binding=0) readonly buffer MaterialBuffer{
 }materialData;
 
 void main(){
+	ObjectData objData = objectData.objects[gl_InstanceIndex];
+	mat4 world = objData.World;
+	mat4 gTexTransform = objData.TexTransform;
+	uint gMaterialIndex = objData.MaterialIndex;
 	MaterialData matData = materialData.materials[gMaterialIndex];
 	
 	
@@ -93,4 +104,5 @@ void main(){
 	vec4 texC = gTexTransform * vec4(inTexC,0.0f,1.0f);
 	outTexC = (matData.MatTransform*texC).xy;
 	
- }
\ No newline at end of file
+ 	outMaterialIndex = gMaterialIndex;
+}
\ No newline at end of file
@@ -7,6 +7,7 @@ layout(location=2) in vec4 inSsaoPosH;
 layout(location=3) in vec3 inNormalW;
 layout(location=4) in vec3 inTangentW;
 layout(location=5) in vec2 inTexC;
+layout(location=6) flat in uint inMaterialIndex;
 layout(location=0) out vec4 outFragColor;
 
 struct Light
@@ -57,16 +58,6 @@ layout (set=0,binding=0) uniform PassCB{
 	Light gLights[MAX_LIGHTS];
 };
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 world;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
-};
-
-
 struct MaterialData
 {
 	vec4   DiffuseAlbedo;
@@ -341,7 +332,7 @@ float textureProj(vec4 shadowCoord, vec2 off)
 
 void main(){
 	//MaterialData matData = gMaterialData[gMaterialIndex];
-	MaterialData matData = materialData.materials[gMaterialIndex];
+	MaterialData matData = materialData.materials[inMaterialIndex];
 	//float4 diffuseAlbedo = matData.DiffuseAlbedo;
 	vec4 diffuseAlbedo = matData.DiffuseAlbedo;
 	//float3 fresnelR0 = matData.FresnelR0;	
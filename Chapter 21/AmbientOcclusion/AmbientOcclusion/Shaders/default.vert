@@ -10,6 +10,7 @@ layout(location=2) out vec4 outSsaoPosH;
 layout(location=3) out vec3 outNormalW;
 layout(location=4) out vec3 outTangentW;
 layout(location=5) out vec2 outTexC;
+layout(location=6) flat out uint outMaterialIndex;
 
 struct Light
 {
@@ -51,15 +52,21 @@ layout (set=0,binding=0) uniform PassCB{
 };
 
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 world;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+struct ObjectData
+{
+	mat4 World;
+	mat4 TexTransform;
+	uint MaterialIndex;
+	uint ObjPad0;
+	uint ObjPad1;
+	uint ObjPad2;
 };
 
+//every item's constants, an item is drawn with firstInstance = its index
+layout (set=1, binding=0) readonly buffer ObjectBuffer{
+	ObjectData objects[];
+}objectData;
+
 struct MaterialData
 {
 	vec4   DiffuseAlbedo;
@@ -77,6 +84,10 @@ layout (set=2, binding=0) readonly buffer MaterialBuffer{
 }materialData;
 
 void main(){
+	ObjectData objData = objectData.objects[gl_InstanceIndex];
+	mat4 world = objData.World;
+	mat4 gTexTransform = objData.TexTransform;
+	uint gMaterialIndex = objData.MaterialIndex;
 	MaterialData matData = materialData.materials[gMaterialIndex];
 	//vec4 posH = vec4(aPos,1.0) * world;
 	//gl_Position = posH * viewProj;
@@ -99,4 +110,5 @@ void main(){
 	
 	// Generate projective tex-coords to project shadow map onto scene.
     outShadowPosH = shadowTransform*vec4(outPosW,1.0);//mul(posW, gShadowTransform);
+	outMaterialIndex = gMaterialIndex;
 }
\ No newline at end of file
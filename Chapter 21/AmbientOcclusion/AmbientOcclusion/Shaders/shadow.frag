@@ -1,6 +1,7 @@
 #version 450
 
 layout(location=0) in vec2 inTexC;
+layout(location=1) flat in uint inMaterialIndex;
 layout(location=0) out vec4 outFragColor;
 
 struct Light
@@ -50,16 +51,6 @@ layout (set=0,binding=0) uniform PassCB{
 	Light gLights[MAX_LIGHTS];
 };
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 world;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
-};
-
-
 struct MaterialData
 {
 	vec4   DiffuseAlbedo;
@@ -90,7 +81,7 @@ layout (constant_id=2) const int enableAlphaTest=0;
 
 void main(){
 	//MaterialData matData = gMaterialData[gMaterialIndex];
-	MaterialData matData = materialData.materials[gMaterialIndex];
+	MaterialData matData = materialData.materials[inMaterialIndex];
 	//float4 diffuseAlbedo = matData.DiffuseAlbedo;
 	vec4 diffuseAlbedo = matData.DiffuseAlbedo;
 	//float3 fresnelR0 = matData.FresnelR0;	
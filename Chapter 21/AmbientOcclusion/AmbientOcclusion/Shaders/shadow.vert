@@ -5,6 +5,7 @@ layout(location=1) in vec3 inNormal;
 layout(location=2) in vec2 inTexC;
 layout(location=3) in vec3 inTangentU;
 layout(location=0) out vec2 outTexC;
+layout(location=1) flat out uint outMaterialIndex;
 
 struct Light
 {
@@ -46,15 +47,21 @@ layout (set=0,binding=0) uniform PassCB{
 };
 
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 world;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+struct ObjectData
+{
+	mat4 World;
+	mat4 TexTransform;
+	uint MaterialIndex;
+	uint ObjPad0;
+	uint ObjPad1;
+	uint ObjPad2;
 };
 
+//every item's constants, an item is drawn with firstInstance = its index
+layout (set=1, binding=0) readonly buffer ObjectBuffer{
+	ObjectData objects[];
+}objectData;
+
 struct MaterialData
 {
 	vec4   DiffuseAlbedo;
@@ -72,6 +79,10 @@ layout (set=2, binding=0) readonly buffer MaterialBuffer{
 }materialData;
 
 void main(){
+	ObjectData objData = objectData.objects[gl_InstanceIndex];
+	mat4 world = objData.World;
+	mat4 gTexTransform = objData.TexTransform;
+	uint gMaterialIndex = objData.MaterialIndex;
 	MaterialData matData = materialData.materials[gMaterialIndex];
 	//vec4 posH = vec4(aPos,1.0) * world;
 	//gl_Position = posH * viewProj;
@@ -82,4 +93,5 @@ void main(){
 	
     outTexC = (matData.MatTransform*texC).xy;
 	
+	outMaterialIndex = gMaterialIndex;
 }
\ No newline at end of file
@@ -34,15 +34,6 @@ layout (set=0,binding=0) uniform PassCB{
 };
 
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 gWorld;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
-};
-
 layout (set=3,binding=0) uniform sampler samp;
 layout (set=3,binding=1) uniform texture2D textureMap[6];
 
@@ -37,16 +37,23 @@ layout (set=0,binding=0) uniform PassCB{
 };
 
 
-layout (set=1, binding=0) uniform ObjectCB{
-	mat4 gWorld;	
-	mat4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+struct ObjectData
+{
+	mat4 World;
+	mat4 TexTransform;
+	uint MaterialIndex;
+	uint ObjPad0;
+	uint ObjPad1;
+	uint ObjPad2;
 };
 
+//every item's constants, an item is drawn with firstInstance = its index
+layout (set=1, binding=0) readonly buffer ObjectBuffer{
+	ObjectData objects[];
+}objectData;
+
 void main(){
+	mat4 gWorld = objectData.objects[gl_InstanceIndex].World;
 	outPosL = inPosL;
 	vec4 posW = gWorld * vec4(inPosL,1.0f);
 	posW.xyz += gEyePosW;
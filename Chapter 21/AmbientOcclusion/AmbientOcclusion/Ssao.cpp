@@ -1,7 +1,7 @@
 #include "Ssao.h"
 #define SSAO_DIM 256
-Ssao::Ssao(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, VkQueue queue_, VkCommandBuffer cmd_,VkImageView depthImageView_,VkFormat depthFormat_, uint32_t width_, uint32_t height_) :VulkanObject(device_),
-memoryProperties(memoryProperties_), queue(queue_), cmd(cmd_),depthImageView(depthImageView_),depthFormat(depthFormat_){
+Ssao::Ssao(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, VkQueue queue_, VkCommandBuffer cmd_, uint32_t width_, uint32_t height_) :VulkanObject(device_),
+memoryProperties(memoryProperties_), queue(queue_), cmd(cmd_){
 	OnResize(width_, height_);
     BuildOffsetVectors();
     BuildRandomVectorTexture();
@@ -70,62 +70,8 @@ void Ssao::BuildResources() {
         .setSamplerAddressMode(VK_SAMPLER_ADDRESS_MODE_REPEAT)
         .build());
     
-    mNormalMap = std::make_unique<VulkanTexture>(device,TextureBuilder::begin(device, memoryProperties)
-        .setDimensions(mRenderTargetWidth, mRenderTargetHeight)
-        .setFormat(NormalMapFormat)        
-        .setImageUsage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-        .build());
-    normalRenderPass = std::make_unique<VulkanRenderPass>(device, RenderPassBuilder::begin(device)
-        .setColorFormat(NormalMapFormat)
-        .setDepthFormat(depthFormat)
-        .setColorInitialLayout(VK_IMAGE_LAYOUT_UNDEFINED)
-        .setColorFinalLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-        .setDepthInitialLayout(VK_IMAGE_LAYOUT_UNDEFINED)
-        .setDepthFinalLayout(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-        .setDepthLoadOp(VK_ATTACHMENT_LOAD_OP_CLEAR)
-        .setDepthStoreOp(VK_ATTACHMENT_STORE_OP_STORE)
-        .build());
-    std::vector<VkFramebuffer> framebuffers;
-    FramebufferBuilder::begin(device)
-        .setDimensions(mRenderTargetWidth, mRenderTargetHeight) 
-        .setColorImageView(*mNormalMap)
-        .setDepthImageView(depthImageView)
-        .setRenderPass(*normalRenderPass)
-        .build(framebuffers);
-    normalFramebuffer = std::make_unique<VulkanFramebuffer>(device, framebuffers[0]);
-
-    mAmbientMap0 = std::make_unique<VulkanTexture>(device,TextureBuilder::begin(device, memoryProperties)
-        .setDimensions(mRenderTargetWidth / 2, mRenderTargetHeight / 2)
-        .setFormat(AmbientMapFormat)        
-        .setImageUsage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)        
-        .build());
-    
-    mAmbientMap1 = std::make_unique<VulkanTexture>(device,TextureBuilder::begin(device, memoryProperties)
-        .setDimensions(mRenderTargetWidth / 2, mRenderTargetHeight / 2)
-        .setFormat(AmbientMapFormat)        
-        .setImageUsage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-        .build());
-    Vulkan::transitionImage(device, queue, cmd, mAmbientMap1->operator VkImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    ssaoRenderPass = std::make_unique<VulkanRenderPass>(device, RenderPassBuilder::begin(device)
-        .setColorFormat(AmbientMapFormat)
-        .setColorInitialLayout(VK_IMAGE_LAYOUT_UNDEFINED)
-        .setColorFinalLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-        .setColorLoadOp(VK_ATTACHMENT_LOAD_OP_CLEAR)
-        .setColorStoreOp(VK_ATTACHMENT_STORE_OP_STORE)
-        .build());
-
-    std::vector<VkImageView> colorImageViews = { *mAmbientMap0,*mAmbientMap1 };
-    FramebufferBuilder::begin(device)
-        .setDimensions(mRenderTargetWidth / 2, mRenderTargetHeight / 2)
-        .setColorImageViews(colorImageViews)
-        .setRenderPass(*ssaoRenderPass)
-        .build(framebuffers);
-    ssaoFramebuffers = std::make_unique<VulkanFramebuffers>(device, framebuffers);
-
-   
-    
-
+    Vulkan::SamplerProperties sampProps;
+    mMapSampler = std::make_unique<VulkanSampler>(device, Vulkan::initSampler(device, sampProps));
 }
 
 void Ssao::BuildRandomVectorTexture() {
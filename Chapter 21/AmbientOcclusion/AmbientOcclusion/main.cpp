@@ -6,15 +6,19 @@
 #include "../../../Common/Colors.h"
 #include "../../../Common/TextureLoader.h"
 #include "../../../Common/Camera.h"
+#include "../../../Common/RenderGraph.h"
+#include "../../../Common/GeometryArena.h"
 #include <memory>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <future>
+#include <chrono>
 #include "FrameResource.h"
 #include "ShadowMap.h"
 #include "Ssao.h"
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 struct RenderItem {
 	RenderItem() = default;
@@ -65,16 +69,23 @@ class SsaoApp : public VulkApp
 
 	std::unique_ptr<DescriptorSetLayoutCache> descriptorSetLayoutCache;
 	std::unique_ptr<DescriptorSetPoolCache> descriptorSetPoolCache;
+	std::unique_ptr<DescriptorSetCache> descriptorSetCache;
+	//ssao inputs and blur sources, written every frame into the slot's pools so they always
+	//sample the current depth and render graph images
+	std::unique_ptr<FrameDescriptorPools> frameDescriptorPools;
+	VkDescriptorSetLayout imageSetLayout{ VK_NULL_HANDLE };
+	VkDescriptorSet mSsaoInputSets[5]{};//normal, depth, random vectors, blur temp, raw ambient
 	std::unique_ptr<VulkanUniformBuffer> uniformBuffer;
 	std::unique_ptr<VulkanImageList> textures;
 	std::unique_ptr<VulkanImage> cubeMapTexture;
 	std::unique_ptr<VulkanUniformBuffer> storageBuffer;
+	//every item's ObjectConstants packed, one array per frame resource
+	std::unique_ptr<VulkanUniformBuffer> objectBuffer;
 	std::unique_ptr<VulkanDescriptorList> uniformDescriptors;
 	std::unique_ptr<VulkanDescriptorList> textureDescriptors;
 	std::unique_ptr<VulkanDescriptorList> storageDescriptors;
 	std::unique_ptr<VulkanDescriptorList> shadowDescriptors;
 	std::unique_ptr<VulkanDescriptorList> ssaoUniformDescriptors;
-	std::unique_ptr<VulkanDescriptorList> ssaoTextureDescriptors;
 	std::unique_ptr<VulkanSampler> sampler;
 	std::unique_ptr<VulkanPipelineLayout> pipelineLayout;
 	std::unique_ptr<VulkanPipelineLayout> cubeMapPipelineLayout;
@@ -96,6 +107,12 @@ class SsaoApp : public VulkApp
 	std::unique_ptr<VulkanPipeline> drawNormalsPipeline;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
+	//every mesh's vertices and indices, after mGeometries so it goes first
+	std::unique_ptr<GeometryArena> mGeometryArena;
+	//an indirect draw per render item, grouped by layer
+	Vulkan::Buffer mDrawCommands;
+	uint32_t mLayerFirstDraw[(int)RenderLayer::Count]{};
+	bool mMultiDrawIndirect{ false };
 	std::unordered_map < std::string, std::unique_ptr<Material>> mMaterials;
 	std::unordered_map<std::string, std::unique_ptr<Texture> > mTextures;
 	std::unordered_map<std::string, VkPipeline> mPSOs;
@@ -121,6 +138,14 @@ class SsaoApp : public VulkApp
 
 	std::unique_ptr<Ssao> mSsao;
 
+	//the frame's passes in the order they are declared to the render graph
+	enum Pass { Shadow, Normals, SsaoMap, BlurHorz, BlurVert, Main, PassCount };
+	std::unique_ptr<RenderGraph> mRenderGraph;
+	RenderGraph::Resource mNormalMap{ 0 };
+	RenderGraph::Resource mAmbientMapRaw{ 0 };	//ssao output
+	RenderGraph::Resource mAmbientMapTemp{ 0 };	//blurred horizontally
+	RenderGraph::Resource mAmbientMap{ 0 };		//blurred both ways, what the main pass samples
+
 	Sphere mSceneBounds;
 
 	float mLightNearZ = 0.0f;
@@ -168,15 +193,18 @@ class SsaoApp : public VulkApp
 
 
 	void LoadTextures();
+	void BuildRenderGraph();
 	void BuildBuffers();
 	void BuildDescriptors();
+	void BuildSsaoInputDescriptors();
 	void BuildPSOs();
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
 	void BuildShapeGeometry();
 	void BuildSkullGeometry();
-	void DrawRenderItems(VkCommandBuffer, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems);
+	void BuildDrawCommands();
+	void DrawRenderItems(VkCommandBuffer, VkPipelineLayout layout, RenderLayer layer, uint32_t task = 0, uint32_t taskCount = 1);
 	void DrawSceneToShadowMap();
 public:
 	SsaoApp(HINSTANCE hInstance);
@@ -193,6 +221,9 @@ SsaoApp::SsaoApp(HINSTANCE hInstance) :VulkApp(hInstance) {
 	mMSAA = false;
 	mDepthBuffer = true;
 	mDepthImageUsage = VK_IMAGE_USAGE_SAMPLED_BIT;//hack to allow sampling depth buffer
+	mRecordThreads = 0;//record the shadow, normal, ssao and main passes in parallel
+	mGpuProfile = true;//time every pass
+	mCpuProfile = true;
 	// Estimate the scene bounding sphere manually since we know how the scene was constructed.
 	// The grid is the "widest object" with a width of 20 and depth of 30.0f, and centered at
 	// the world space origin.  In general, you need to loop over every world space vertex
@@ -206,17 +237,20 @@ SsaoApp::~SsaoApp() {
 
 	for (auto& pair : mGeometries) {
 		free(pair.second->indexBufferCPU);
-		//if (pair.second->vertexBufferGPU.buffer != mWavesRitem->Geo->vertexBufferGPU.buffer) {
 		free(pair.second->vertexBufferCPU);
-		cleanupBuffer(mDevice, pair.second->vertexBufferGPU);
-		//}
-		cleanupBuffer(mDevice, pair.second->indexBufferGPU);
+		//the arena's buffers go with the arena
+		if (pair.second->Arena == nullptr) {
+			cleanupBuffer(mDevice, pair.second->vertexBufferGPU);
+			cleanupBuffer(mDevice, pair.second->indexBufferGPU);
+		}
 	}
+	cleanupBuffer(mDevice, mDrawCommands);
 }
 
 bool SsaoApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
@@ -230,21 +264,80 @@ bool SsaoApp::Initialize() {
 }
 
 void SsaoApp::asyncInit() {
-	mSsao = std::make_unique<Ssao>(mDevice,mMemoryProperties,mBackQueue,mCommandBuffer,mDepthImage.imageView,mDepthFormat,mClientWidth,mClientHeight);
+	mSsao = std::make_unique<Ssao>(mDevice,mMemoryProperties,mBackQueue,mCommandBuffer,mClientWidth,mClientHeight);
 	mShadowMap = std::make_unique<ShadowMap>(mDevice, mMemoryProperties, mBackQueue, mCommandBuffer, 2048, 2048);
+	BuildRenderGraph();
 
 	LoadTextures();
+	//room for the shapes and the skull (31076 vertices, 181017 indices) with some to spare
+	mGeometryArena = std::make_unique<GeometryArena>(mDevice, mBackQueue, mCommandBuffer, mMemoryProperties, (uint32_t)sizeof(Vertex), 64 * 1024, 256 * 1024);
 	BuildShapeGeometry();
 	BuildSkullGeometry();
+	{
+		GeometryArena::Stats arenaStats = mGeometryArena->GetStats();
+		std::wostringstream outs;
+		outs << mMainWndCaption << L", " << arenaStats.Meshes << L" meshes in " << (arenaStats.VertexBytes + arenaStats.IndexBytes) / 1024 << L" KB of geometry arena";
+		mMainWndCaption = outs.str();
+	}
 	BuildMaterials();
 	BuildRenderItems();
 	BuildBuffers();
+	BuildDrawCommands();
 	BuildDescriptors();
 	BuildPSOs();
 	BuildFrameResources();
 	state = ProgState::Draw;
 }
 
+void SsaoApp::BuildRenderGraph() {
+	mRenderGraph = std::make_unique<RenderGraph>(mDevice, mMemoryProperties);
+	RenderGraph& graph = *mRenderGraph;
+	RenderGraph::Resource shadowMap = graph.ImportImage("shadow map", mShadowMap->getImage(), mShadowMap->getRenderTargetView(), mShadowMap->Format(), mShadowMap->Width(), mShadowMap->Height(), VK_IMAGE_LAYOUT_UNDEFINED);
+	RenderGraph::Resource depth = graph.ImportImage("depth", mDepthImage.image, mDepthImage.imageView, mDepthFormat, mClientWidth, mClientHeight, VK_IMAGE_LAYOUT_UNDEFINED);
+	mNormalMap = graph.CreateImage("normal map", Ssao::NormalMapFormat, mSsao->NormalMapWidth(), mSsao->NormalMapHeight());
+	//three ambient maps rather than ping-ponging two, lifetimes the graph can see and alias
+	mAmbientMapRaw = graph.CreateImage("ambient map", Ssao::AmbientMapFormat, mSsao->SsaoMapWidth(), mSsao->SsaoMapHeight());
+	mAmbientMapTemp = graph.CreateImage("ambient map blurred horizontally", Ssao::AmbientMapFormat, mSsao->SsaoMapWidth(), mSsao->SsaoMapHeight());
+	mAmbientMap = graph.CreateImage("ambient map blurred", Ssao::AmbientMapFormat, mSsao->SsaoMapWidth(), mSsao->SsaoMapHeight());
+
+	VkClearDepthStencilValue depthClear = { 1.0f,0 };
+	VkClearColorValue normalClear = { 0.0f,0.0f,1.0f,0.0f };
+	RenderGraph::Pass pass = graph.AddPass("shadow")
+		.WriteDepth(shadowMap, &depthClear);
+	assert(pass == Shadow);
+	pass = graph.AddPass("normals")
+		.WriteColor(mNormalMap, &normalClear)
+		.WriteDepth(depth, &depthClear);
+	assert(pass == Normals);
+	//the ssao and blur passes cover every pixel, no need to clear
+	pass = graph.AddPass("ssao")
+		.Read(mNormalMap)
+		.Read(depth)
+		.WriteColor(mAmbientMapRaw);
+	assert(pass == SsaoMap);
+	pass = graph.AddPass("blur horizontally")
+		.Read(mAmbientMapRaw)
+		.WriteColor(mAmbientMapTemp);
+	assert(pass == BlurHorz);
+	pass = graph.AddPass("blur vertically")
+		.Read(mAmbientMapTemp)
+		.WriteColor(mAmbientMap);
+	assert(pass == BlurVert);
+	//the app's render pass to the swapchain
+	pass = graph.AddPass("main", true)
+		.Read(shadowMap)
+		.Read(mAmbientMap)
+		.WriteDepth(depth)
+		.SideEffect();
+	assert(pass == Main);
+	graph.Compile();
+
+	std::wostringstream outs;
+	outs << L"Ambient Occlusion Demo    " << graph.BarrierCount() << L" barriers in " << graph.BarrierBatches() << L" batches per frame, transients "
+		<< graph.AllocatedBytes() / 1024 << L" KB (" << (graph.TransientBytes() - graph.AllocatedBytes()) / 1024 << L" KB saved by aliasing)";
+	mMainWndCaption = outs.str();
+}
+
 void SsaoApp::LoadTextures() {
 	std::vector<Vulkan::Image> texturesList;
 	ImageLoader::begin(mDevice, mCommandBuffer, mBackQueue, mMemoryProperties)
@@ -273,21 +366,62 @@ void SsaoApp::LoadTextures() {
 
 void SsaoApp::BuildBuffers() {
 	Vulkan::Buffer dynamicBuffer;
-	//pass and object constants are dynamic uniform buffers
+	//pass and ssao constants are dynamic uniform buffers
 	std::vector<UniformBufferInfo> bufferInfo;
 	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, true)
 		.AddBuffer(sizeof(PassConstants), 2, gNumFrameResources)//one for main, one for shadow
-		.AddBuffer(sizeof(ObjectConstants), mAllRitems.size(), gNumFrameResources)
 		.AddBuffer(sizeof(SsaoConstants), 1, gNumFrameResources)
 		.build(dynamicBuffer, bufferInfo);
 	uniformBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
 
+	//object constants are an array the shaders index with gl_InstanceIndex, so they're packed
+	//(std430 stride, not minUniformBufferOffsetAlignment) and only each frame's array is aligned
+	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, true)
+		.AddBuffer(sizeof(ObjectConstants) * mAllRitems.size(), 1, gNumFrameResources)
+		.build(dynamicBuffer, bufferInfo);
+	objectBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
+
 	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, true)
 		.AddBuffer(sizeof(MaterialData), mMaterials.size(), gNumFrameResources)
 		.build(dynamicBuffer, bufferInfo);
 	storageBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
 }
 
+void SsaoApp::BuildDrawCommands() {
+	//an item's draw never changes, its ObjectConstants do, so the commands are written once.
+	//firstInstance is the item's index into the object array
+	std::vector<VkDrawIndexedIndirectCommand> commands;
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer) {
+		mLayerFirstDraw[layer] = (uint32_t)commands.size();
+		for (auto ri : mRitemLayer[layer]) {
+			SubmeshGeometry submesh;
+			submesh.IndexCount = ri->IndexCount;
+			submesh.StartIndexLocation = ri->StartIndexLocation;
+			submesh.BaseVertexLocation = ri->BaseVertexLocation;
+			commands.push_back(mGeometryArena->DrawCommand(*ri->Geo, submesh, 1, ri->ObjCBIndex));
+		}
+	}
+	//more than one draw per vkCmdDrawIndexedIndirect, with a firstInstance, needs both features
+	mMultiDrawIndirect = mDeviceFeatures.multiDrawIndirect && mDeviceFeatures.drawIndirectFirstInstance;
+
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+	props.size = sizeof(VkDrawIndexedIndirectCommand) * commands.size();
+	Vulkan::initBuffer(mDevice, mMemoryProperties, props, mDrawCommands);
+	void* ptr = Vulkan::mapBuffer(mDevice, mDrawCommands);
+	memcpy(ptr, commands.data(), props.size);
+	Vulkan::unmapBuffer(mDevice, mDrawCommands);
+
+	std::wostringstream outs;
+	outs << mMainWndCaption << L", " << commands.size() << (mMultiDrawIndirect ? L" items in a multi-draw per pass" : L" items drawn one by one");
+	mMainWndCaption = outs.str();
+}
+
 
 void SsaoApp::BuildShapeGeometry()
 {
@@ -417,20 +551,9 @@ void SsaoApp::BuildShapeGeometry()
 	geo->indexBufferCPU = malloc(ibByteSize);
 	memcpy(geo->indexBufferCPU, indices.data(), ibByteSize);
 
-	std::vector<uint32_t> vertexLocations;
-	VertexBufferBuilder::begin(mDevice, mBackQueue, mCommandBuffer, mMemoryProperties)
-		.AddVertices(vbByteSize, (float*)vertices.data())
-		.build(geo->vertexBufferGPU, vertexLocations);
-
-	std::vector<uint32_t> indexLocations;
-	IndexBufferBuilder::begin(mDevice, mBackQueue, mCommandBuffer, mMemoryProperties)
-		.AddIndices(ibByteSize, indices.data())
-		.build(geo->indexBufferGPU, indexLocations);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-
-	geo->IndexBufferByteSize = ibByteSize;
+	bool added = mGeometryArena->Add(*geo, vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size());
+	assert(added);
+	(void)added;
 
 	geo->DrawArgs["box"] = boxSubmesh;
 	geo->DrawArgs["grid"] = gridSubmesh;
@@ -536,22 +659,9 @@ void SsaoApp::BuildSkullGeometry() {
 	geo->indexBufferCPU = malloc(ibByteSize);
 	memcpy(geo->indexBufferCPU, indices.data(), ibByteSize);
 
-	std::vector<uint32_t> vertexLocations;
-	VertexBufferBuilder::begin(mDevice, mBackQueue, mCommandBuffer, mMemoryProperties)
-		.AddVertices(vbByteSize, (float*)vertices.data())
-		.build(geo->vertexBufferGPU, vertexLocations);
-
-	std::vector<uint32_t> indexLocations;
-	IndexBufferBuilder::begin(mDevice, mBackQueue, mCommandBuffer, mMemoryProperties)
-		.AddIndices(ibByteSize, indices.data())
-		.build(geo->indexBufferGPU, indexLocations);
-
-
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-
-	geo->IndexBufferByteSize = ibByteSize;
+	bool added = mGeometryArena->Add(*geo, vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size());
+	assert(added);
+	(void)added;
 
 	SubmeshGeometry submesh;
 	submesh.IndexCount = (uint32_t)indices.size();
@@ -756,6 +866,8 @@ void SsaoApp::BuildRenderItems()
 void SsaoApp::BuildDescriptors() {
 	descriptorSetPoolCache = std::make_unique<DescriptorSetPoolCache>(mDevice);
 	descriptorSetLayoutCache = std::make_unique<DescriptorSetLayoutCache>(mDevice);
+	descriptorSetCache = std::make_unique<DescriptorSetCache>(descriptorSetPoolCache.get());
+	frameDescriptorPools = std::make_unique<FrameDescriptorPools>(mDevice, mMaxFrames);
 
 	VkDescriptorSet descriptor0 = VK_NULL_HANDLE;
 	VkDescriptorSetLayout descriptorLayout0;
@@ -766,7 +878,7 @@ void SsaoApp::BuildDescriptors() {
 	VkDescriptorSet descriptor1 = VK_NULL_HANDLE;
 	VkDescriptorSetLayout descriptorLayout1;
 	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
 		.build(descriptor1, descriptorLayout1);
 
 	std::vector<VkDescriptorSet> descriptors{ descriptor0,descriptor1 };
@@ -800,24 +912,13 @@ void SsaoApp::BuildDescriptors() {
 		.build(descriptor4, descriptorLayout4);
 	
 
-	//for ssao map to compositor pass
-	VkDescriptorSet descriptor7 = VK_NULL_HANDLE;
-	VkDescriptorSetLayout descriptorLayout7;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
-		.build(descriptor7, descriptorLayout7);
-	
-	descriptors = { descriptor3,descriptor4,descriptor7 };
-	textureDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
-
-	//build stuff for shadow
-	VkDescriptorSet descriptor5 = VK_NULL_HANDLE;
-	VkDescriptorSetLayout descriptorLayout5 = VK_NULL_HANDLE;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
-		.build(descriptor5, descriptorLayout5);
-	descriptors = { descriptor5 };
-	shadowDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
+	//the shadow map and ssao maps are each a single combined image sampler, those sets are
+	//looked up by what they sample once it's known (an aliased map shares a set)
+	std::vector<VkDescriptorSetLayoutBinding> imageBindings = { { 0,VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,1,VK_SHADER_STAGE_FRAGMENT_BIT,nullptr } };
+	VkDescriptorSetLayout imageLayout = descriptorSetLayoutCache->create(imageBindings);
+	imageSetLayout = imageLayout;
+	VkDescriptorSet descriptor5 = VK_NULL_HANDLE;//shadow map
+	VkDescriptorSet descriptor7 = VK_NULL_HANDLE;//ssao map to compositor pass
 
 
 	//descriptor for Ssao constant
@@ -832,36 +933,13 @@ void SsaoApp::BuildDescriptors() {
 	
 
 
-	//descriptors for Ssao textures
-	VkDescriptorSet descriptor8 = VK_NULL_HANDLE;
-	VkDescriptorSetLayout descriptorLayout8 = VK_NULL_HANDLE;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)		
-		.build(descriptor8, descriptorLayout8);
-	VkDescriptorSet descriptor9 = VK_NULL_HANDLE;
-	VkDescriptorSetLayout descriptorLayout9 = VK_NULL_HANDLE;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
-		.build(descriptor9, descriptorLayout9);
-	VkDescriptorSet descriptor10 = VK_NULL_HANDLE;
-	VkDescriptorSetLayout descriptorLayout10 = VK_NULL_HANDLE;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
-		.build(descriptor10, descriptorLayout10);
-	VkDescriptorSet descriptor11 = VK_NULL_HANDLE;
-	VkDescriptorSetLayout descriptorLayout11;
-	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
-		.build(descriptor11, descriptorLayout11);
-	descriptors = { descriptor8,descriptor9,descriptor10,descriptor11 };
-	ssaoTextureDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
 
 	
 	
 
 	VkDeviceSize offset = 0;
-	descriptors = { descriptor0,descriptor1 };
-	std::vector<VkDescriptorSetLayout> descriptorLayouts = { descriptorLayout0,descriptorLayout1 };
+	descriptors = { descriptor0 };
+	std::vector<VkDescriptorSetLayout> descriptorLayouts = { descriptorLayout0 };
 	auto& ub = *uniformBuffer;
 	for (int i = 0; i < (int)descriptors.size(); ++i) {
 		//descriptorBufferInfo.clear();
@@ -878,6 +956,17 @@ void SsaoApp::BuildDescriptors() {
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &descrInfo)
 			.update();
 	}
+	{
+		//a frame's whole object array, the dynamic offset picks the frame
+		auto& ob = *objectBuffer;
+		VkDescriptorBufferInfo descrInfo{};
+		descrInfo.buffer = ob;
+		descrInfo.offset = 0;
+		descrInfo.range = ob[0].objectSize;
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout1, descriptor1)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, &descrInfo)
+			.update();
+	}
 	{
 		auto& sb = *storageBuffer;
 		VkDescriptorBufferInfo descrInfo{};
@@ -924,27 +1013,18 @@ void SsaoApp::BuildDescriptors() {
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		imageInfo.imageView = mShadowMap->getRenderTargetView();
 		imageInfo.sampler = mShadowMap->getRenderTargetSampler();
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout5, descriptor5)
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), imageLayout)
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
-			.update();
-	}
-	{
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getSsaoImageView(0);
-		imageInfo.sampler = mSsao->getSsaoImageSampler(0);
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout7, descriptor7)
-			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
-			.update();
+			.update(descriptorSetCache.get(), descriptor5);
 	}
 	{
 		VkDescriptorImageInfo imageInfo{};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getSsaoImageView(1);
-		imageInfo.sampler = mSsao->getSsaoImageSampler(1);
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout11, descriptor11)
+		imageInfo.imageView = mRenderGraph->GetImageView(mAmbientMap);
+		imageInfo.sampler = mSsao->getMapSampler();
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), imageLayout)
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
-			.update();
+			.update(descriptorSetCache.get(), descriptor7);
 	}
 	{
 		//update ssao uniformdescriptors
@@ -954,12 +1034,12 @@ void SsaoApp::BuildDescriptors() {
 		auto& ub = *uniformBuffer;
 		
 		
-			VkDeviceSize range = ub[2].objectSize;// bufferInfo[i].objectCount* bufferInfo[i].objectSize* bufferInfo[i].repeatCount;
-			VkDeviceSize bufferSize = ub[2].objectCount * ub[2].objectSize * ub[2].repeatCount;
+			VkDeviceSize range = ub[1].objectSize;// bufferInfo[i].objectCount* bufferInfo[i].objectSize* bufferInfo[i].repeatCount;
+			VkDeviceSize bufferSize = ub[1].objectCount * ub[1].objectSize * ub[1].repeatCount;
 			VkDescriptorBufferInfo descrInfo{};
 			descrInfo.buffer = ub;
 			descrInfo.offset = offset;
-			descrInfo.range = ub[2].objectSize;
+			descrInfo.range = ub[1].objectSize;
 			//descriptorBufferInfo.push_back(descrInfo);
 			offset += bufferSize;
 			VkDescriptorSetLayout layout = descriptorLayout6;
@@ -968,31 +1048,17 @@ void SsaoApp::BuildDescriptors() {
 				.update();
 		
 	}
-	{
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getNormalMapImageView();
-		imageInfo.sampler = mSsao->getNormalMapSampler();
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout8, descriptor8)
-			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
-			.update();
-
-		auto& samp = *sampler;
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mDepthImage.imageView;// mShadowMap->getRenderTargetView();
-		imageInfo.sampler = samp;//resuse sampler
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout9, descriptor9)
-			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
-			.update();
+	descriptors = { descriptor3,descriptor4,descriptor7 };
+	textureDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
+	descriptors = { descriptor5 };
+	shadowDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
 
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getRandomMapImageView();
-		imageInfo.sampler = mSsao->getRandomMapSampler();
-		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), descriptorLayout10, descriptor10)
-			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
-			.update();
+	auto& poolStats = descriptorSetPoolCache->getStats();
+	std::wostringstream outs;
+	outs << mMainWndCaption << L", " << poolStats.SetsAllocated << L" descriptor sets (" << descriptorSetCache->getHits() << L" shared) from "
+		<< poolStats.Pools << L" pools of " << poolStats.DescriptorCapacity << L" descriptors";
+	mMainWndCaption = outs.str();
 
-	}
 	VkPipelineLayout layout{ VK_NULL_HANDLE };
 	PipelineLayoutBuilder::begin(mDevice)
 		.AddDescriptorSetLayout(descriptorLayout0)
@@ -1019,8 +1085,8 @@ void SsaoApp::BuildDescriptors() {
 		.AddDescriptorSetLayout(descriptorLayout2)
 		.AddDescriptorSetLayout(descriptorLayout3)
 		.AddDescriptorSetLayout(descriptorLayout4)
-		.AddDescriptorSetLayout(descriptorLayout5)
-		.AddDescriptorSetLayout(descriptorLayout7)
+		.AddDescriptorSetLayout(imageLayout)
+		.AddDescriptorSetLayout(imageLayout)
 		.build(layout);
 	pipelineLayout = std::make_unique <VulkanPipelineLayout>(mDevice, layout);
 
@@ -1030,14 +1096,14 @@ void SsaoApp::BuildDescriptors() {
 		.AddDescriptorSetLayout(descriptorLayout2)
 		.AddDescriptorSetLayout(descriptorLayout3)
 		.AddDescriptorSetLayout(descriptorLayout4)
-		.AddDescriptorSetLayout(descriptorLayout5)
+		.AddDescriptorSetLayout(imageLayout)
 		.build(layout);
 	debugPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
 	PipelineLayoutBuilder::begin(mDevice)
 		.AddDescriptorSetLayout(descriptorLayout6)		
-		.AddDescriptorSetLayout(descriptorLayout8)
-		.AddDescriptorSetLayout(descriptorLayout9)
-		.AddDescriptorSetLayout(descriptorLayout10)
+		.AddDescriptorSetLayout(imageLayout)
+		.AddDescriptorSetLayout(imageLayout)
+		.AddDescriptorSetLayout(imageLayout)
 		.build(layout);
 	ssaoPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
 
@@ -1054,202 +1120,157 @@ void SsaoApp::BuildDescriptors() {
 
 }
 
-void SsaoApp::BuildPSOs() {
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/default.vert.spv")
-			.AddShaderPath("Shaders/default.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-
-
-		VkPipeline pipeline{ VK_NULL_HANDLE };
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		opaquePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaque"] = *opaquePipeline;
-
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		opaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaqueFlat"] = *opaqueFlatPipeline;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		noSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaqueNoSsao"] = *noSsaoPipeline;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_LINE)
-			.setDepthTest(VK_TRUE)
-			.build(pipeline);
-		wireframePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaque_wireframe"] = *wireframePipeline;
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/sky.vert.spv")
-			.AddShaderPath("Shaders/sky.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_BACK_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		cubeMapPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-
-		mPSOs["sky"] = *cubeMapPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/shadow.vert.spv")
-			.AddShaderPath("Shaders/shadow.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-
-		PipelineBuilder::begin(mDevice, *shadowPipelineLayout, mShadowMap->getRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_BACK_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		shadowPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-
-		mPSOs["shadow_opaque"] = *shadowPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/debug.vert.spv")
-			.AddShaderPath("Shaders/debug.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *debugPipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		debugPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["debug"] = *debugPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		//pipeline for normals?
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/DrawNormals.vert.spv")
-			.AddShaderPath("Shaders/DrawNormals.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *drawNormalsPipelineLayout, mSsao->getNormalRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS)
-			.build(pipeline);
-		drawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["drawNormals"] = *drawNormalsPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		//pipeline for ssao
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/Ssao.vert.spv")
-			.AddShaderPath("Shaders/Ssao.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *ssaoPipelineLayout, mSsao->getSsaoRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)						
-			.build(pipeline);
-		ssaoPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["ssao"] = *ssaoPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
+void SsaoApp::BuildSsaoInputDescriptors() {
+	//one set per image, an aliased map shares one through the frame's cache
+	DescriptorSetCache* cache = frameDescriptorPools->getCache();
+	auto& samp = *sampler;
+	struct Input {
+		VkImageView view;
+		VkSampler sampler;
+	};
+	Input inputs[5] = {
+		{ mRenderGraph->GetImageView(mNormalMap),mSsao->getMapSampler() },
+		{ mDepthImage.imageView,samp },//the app sampler, for the depth buffer
+		{ mSsao->getRandomMapImageView(),mSsao->getRandomMapSampler() },
+		{ mRenderGraph->GetImageView(mAmbientMapTemp),mSsao->getMapSampler() },
+		{ mRenderGraph->GetImageView(mAmbientMapRaw),mSsao->getMapSampler() },
+	};
+	for (int i = 0; i < 5; ++i) {
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = inputs[i].view;
+		imageInfo.sampler = inputs[i].sampler;
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), imageSetLayout)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
+			.update(cache, mSsaoInputSets[i]);
 	}
-	{
-		//pipeline for ssao
+}
+
+void SsaoApp::BuildPSOs() {
+	//none of the pipelines depend on each other, compile them all at once on worker threads
+	//through the app's pipeline cache, a warm start mostly just reads them back
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	struct ShaderProgram {
 		std::vector<Vulkan::ShaderModule> shaders;
 		VkVertexInputBindingDescription vertexInputDescription = {};
 		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
+	};
+	auto load = [&](ShaderProgram& program, const char* vert, const char* frag) {
 		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/SsaoBlur.vert.spv")
-			.AddShaderPath("Shaders/SsaoBlur.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *ssaoPipelineLayout, mSsao->getSsaoRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT,1)
-			.build(pipeline);
-		ssaoBlurHorzPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["ssaoBlurHorz"] = *ssaoBlurHorzPipeline;
-		PipelineBuilder::begin(mDevice, *ssaoPipelineLayout, mSsao->getSsaoRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT,0)
-			.build(pipeline);
-		ssaoBlurVertPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["ssaoBlurVert"] = *ssaoBlurVertPipeline;
-		for (auto& shader : shaders) {
+			.AddShaderPath(vert)
+			.AddShaderPath(frag)
+			.load(program.shaders, program.vertexInputDescription, program.vertexAttributeDescriptions);
+	};
+	ShaderProgram opaqueProgram, skyProgram, shadowProgram, debugProgram, drawNormalsProgram, ssaoProgram, ssaoBlurProgram;
+	load(opaqueProgram, "Shaders/default.vert.spv", "Shaders/default.frag.spv");
+	load(skyProgram, "Shaders/sky.vert.spv", "Shaders/sky.frag.spv");
+	load(shadowProgram, "Shaders/shadow.vert.spv", "Shaders/shadow.frag.spv");
+	load(debugProgram, "Shaders/debug.vert.spv", "Shaders/debug.frag.spv");
+	load(drawNormalsProgram, "Shaders/DrawNormals.vert.spv", "Shaders/DrawNormals.frag.spv");
+	load(ssaoProgram, "Shaders/Ssao.vert.spv", "Shaders/Ssao.frag.spv");
+	load(ssaoBlurProgram, "Shaders/SsaoBlur.vert.spv", "Shaders/SsaoBlur.frag.spv");
+	auto begin = [&](VkPipelineLayout layout, VkRenderPass renderPass, ShaderProgram& program) {
+		return PipelineBuilder::begin(mDevice, layout, renderPass, program.shaders, program.vertexInputDescription, program.vertexAttributeDescriptions)
+			.setPipelineCache(mPipelineCache);
+	};
+
+	VkPipeline opaque{ VK_NULL_HANDLE }, opaqueFlat{ VK_NULL_HANDLE }, noSsao{ VK_NULL_HANDLE }, wireframe{ VK_NULL_HANDLE };
+	VkPipeline sky{ VK_NULL_HANDLE }, shadow{ VK_NULL_HANDLE }, debug{ VK_NULL_HANDLE }, drawNormals{ VK_NULL_HANDLE };
+	VkPipeline ssao{ VK_NULL_HANDLE }, ssaoBlurHorz{ VK_NULL_HANDLE }, ssaoBlurVert{ VK_NULL_HANDLE };
+	PipelineBatch batch;
+	batch.add(begin(*pipelineLayout, mRenderPass, opaqueProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), opaque);
+	batch.add(begin(*pipelineLayout, mRenderPass, opaqueProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), opaqueFlat);
+	batch.add(begin(*pipelineLayout, mRenderPass, opaqueProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), noSsao);
+	batch.add(begin(*pipelineLayout, mRenderPass, opaqueProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_LINE)
+		.setDepthTest(VK_TRUE), wireframe);
+	batch.add(begin(*pipelineLayout, mRenderPass, skyProgram)
+		.setCullMode(VK_CULL_MODE_BACK_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL), sky);
+	batch.add(begin(*shadowPipelineLayout, mRenderGraph->GetRenderPass(Shadow), shadowProgram)
+		.setCullMode(VK_CULL_MODE_BACK_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL), shadow);
+	batch.add(begin(*debugPipelineLayout, mRenderPass, debugProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL), debug);
+	batch.add(begin(*drawNormalsPipelineLayout, mRenderGraph->GetRenderPass(Normals), drawNormalsProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setDepthCompareOp(VK_COMPARE_OP_LESS), drawNormals);
+	batch.add(begin(*ssaoPipelineLayout, mRenderGraph->GetRenderPass(SsaoMap), ssaoProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL), ssao);
+	batch.add(begin(*ssaoPipelineLayout, mRenderGraph->GetRenderPass(BlurHorz), ssaoBlurProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1), ssaoBlurHorz);
+	batch.add(begin(*ssaoPipelineLayout, mRenderGraph->GetRenderPass(BlurVert), ssaoBlurProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), ssaoBlurVert);
+	batch.build();
+
+	opaquePipeline = std::make_unique<VulkanPipeline>(mDevice, opaque);
+	mPSOs["opaque"] = *opaquePipeline;
+	opaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, opaqueFlat);
+	mPSOs["opaqueFlat"] = *opaqueFlatPipeline;
+	noSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, noSsao);
+	mPSOs["opaqueNoSsao"] = *noSsaoPipeline;
+	wireframePipeline = std::make_unique<VulkanPipeline>(mDevice, wireframe);
+	mPSOs["opaque_wireframe"] = *wireframePipeline;
+	cubeMapPipeline = std::make_unique<VulkanPipeline>(mDevice, sky);
+	mPSOs["sky"] = *cubeMapPipeline;
+	shadowPipeline = std::make_unique<VulkanPipeline>(mDevice, shadow);
+	mPSOs["shadow_opaque"] = *shadowPipeline;
+	debugPipeline = std::make_unique<VulkanPipeline>(mDevice, debug);
+	mPSOs["debug"] = *debugPipeline;
+	drawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, drawNormals);
+	mPSOs["drawNormals"] = *drawNormalsPipeline;
+	ssaoPipeline = std::make_unique<VulkanPipeline>(mDevice, ssao);
+	mPSOs["ssao"] = *ssaoPipeline;
+	ssaoBlurHorzPipeline = std::make_unique<VulkanPipeline>(mDevice, ssaoBlurHorz);
+	mPSOs["ssaoBlurHorz"] = *ssaoBlurHorzPipeline;
+	ssaoBlurVertPipeline = std::make_unique<VulkanPipeline>(mDevice, ssaoBlurVert);
+	mPSOs["ssaoBlurVert"] = *ssaoBlurVertPipeline;
+
+	for (ShaderProgram* program : { &opaqueProgram, &skyProgram, &shadowProgram, &debugProgram, &drawNormalsProgram, &ssaoProgram, &ssaoBlurProgram }) {
+		for (auto& shader : program->shaders) {
 			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
 		}
 	}
+
+	//startup cost with an empty (cold) or loaded (warm) cache
+	double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+	std::wostringstream outs;
+	outs << mMainWndCaption << L", 11 pipelines in " << (int)buildMs << L" ms (" << (mPipelineCacheLoaded ? L"warm" : L"cold") << L" cache)";
+	mMainWndCaption = outs.str();
 }
 
 
@@ -1258,9 +1279,10 @@ void SsaoApp::BuildFrameResources() {
 	for (int i = 0; i < gNumFrameResources; i++) {
 		auto& ub = *uniformBuffer;
 		auto& sb = *storageBuffer;
+		auto& ob = *objectBuffer;
 		PassConstants* pc = (PassConstants*)((uint8_t*)ub[0].ptr + ub[0].objectSize * ub[0].objectCount * i);// ((uint8_t*)pPassCB + passSize * i);
-		ObjectConstants* oc = (ObjectConstants*)((uint8_t*)ub[1].ptr + ub[1].objectSize * ub[1].objectCount * i);// ((uint8_t*)pObjectCB + objectSize * mAllRitems.size() * i);
-		SsaoConstants* sc = (SsaoConstants*)((uint8_t*)ub[2].ptr + ub[2].objectSize * ub[2].objectCount * i);
+		ObjectConstants* oc = (ObjectConstants*)((uint8_t*)ob[0].ptr + ob[0].objectSize * i);
+		SsaoConstants* sc = (SsaoConstants*)((uint8_t*)ub[1].ptr + ub[1].objectSize * ub[1].objectCount * i);
 		MaterialData* md = (MaterialData*)((uint8_t*)sb[0].ptr + sb[0].objectSize * sb[0].objectCount * i);
 		
 		
@@ -1304,9 +1326,12 @@ void SsaoApp::OnMouseUp(WPARAM btnState, int x, int y) {
 void SsaoApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	if (state == ProgState::Draw) {
+		//the slot's fence has signalled, its descriptor sets can be rewritten
+		frameDescriptorPools->beginFrame(mCurrFrame);
+		BuildSsaoInputDescriptors();
 
-		//Cycle through the circular frame resource array
-		mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+		//Use the frame resource of the slot VulkApp::Update just waited on
+		mCurrFrameResourceIndex = (int)mCurrFrame;
 		mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 		OnKeyboardInput(gt);
@@ -1371,10 +1396,9 @@ void SsaoApp::AnimateMaterials(const GameTimer& gt)
 }
 
 void  SsaoApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
-	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
-	auto& ub = *uniformBuffer;
-	VkDeviceSize objSize = ub[1].objectSize;
+	ObjectConstants* pObjConsts = mCurrFrameResource->pOCs;
 	for (auto& e : mAllRitems) {
 		//Only update the cbuffer data if the constants have changed.
 		//This needs to be tracked per frame resource.
@@ -1384,14 +1408,14 @@ void  SsaoApp::UpdateObjectCBs(const GameTimer& gt) {
 			objConstants.World = world;
 			objConstants.TexTransform = e->TexTransform;
 			objConstants.MaterialIndex = e->Mat->MatCBIndex;
-			memcpy((pObjConsts + (objSize * e->ObjCBIndex)), &objConstants, sizeof(objConstants));
-			//pObjConsts[e->ObjCBIndex] = objConstants;
+			pObjConsts[e->ObjCBIndex] = objConstants;
 			e->NumFramesDirty--;
 		}
 	}
 }
 
 void SsaoApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
@@ -1415,6 +1439,7 @@ void SsaoApp::UpdateMaterialsBuffer(const GameTimer& gt) {
 
 void SsaoApp::UpdateShadowTransform(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateShadowTransform");
 	// Only the first "main" light casts a shadow.
 	glm::vec3 lightDir = mRotatedLightDirections[0];
 	glm::vec3 lightPos = -2.0f * mSceneBounds.Radius * lightDir;
@@ -1458,6 +1483,7 @@ void SsaoApp::UpdateShadowTransform(const GameTimer& gt)
 }
 
 void SsaoApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -1503,6 +1529,7 @@ void SsaoApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void SsaoApp::UpdateShadowPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateShadowPassCB");
 	glm::mat4 view = mLightView;
 	glm::mat4 proj = mLightProj;
 	proj[1][1] *= -1;
@@ -1545,6 +1572,7 @@ void SsaoApp::UpdateShadowPassCB(const GameTimer& gt) {
 
 void SsaoApp::UpdateSsaoCB(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateSsaoCB");
 	SsaoConstants ssaoCB;
 
 	glm::mat4 P = mCamera.GetProj();
@@ -1581,7 +1609,6 @@ void SsaoApp::UpdateSsaoCB(const GameTimer& gt)
 	//currSsaoCB->CopyData(0, ssaoCB);
 }
 void SsaoApp::Draw(const GameTimer& gt) {
-	uint32_t index = 0;
 	VkCommandBuffer cmd = VK_NULL_HANDLE;
 	if (ProgState::Init == state) {
 		cmd = BeginRender(true);
@@ -1591,14 +1618,13 @@ void SsaoApp::Draw(const GameTimer& gt) {
 		auto& ub = *uniformBuffer;
 		VkDeviceSize passSize = ub[0].objectSize;
 		VkDeviceSize passCount = ub[0].objectCount;
+		VkDeviceSize ssaoSize = ub[1].objectSize;
+		VkDeviceSize ssaoCount = ub[1].objectCount;
 		auto& ud = *uniformDescriptors;
 		//bind descriptors that don't change during pass
 		VkDescriptorSet descriptor0 = ud[0];//pass constant buffer
-		uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount };
 
 		//bind storage buffer
-		auto& sb = *storageBuffer;
-		VkDeviceSize matSize = sb[0].objectSize * sb[0].objectCount;
 		auto& sd = *storageDescriptors;
 		VkDescriptorSet descriptor2 = sd[0];
 		auto& td = *textureDescriptors;
@@ -1607,296 +1633,151 @@ void SsaoApp::Draw(const GameTimer& gt) {
 		VkDescriptorSet descriptor7 = td[2];
 		auto& sh = *shadowDescriptors;
 		VkDescriptorSet descriptor5 = sh[0];
-		
+		auto& ssub = *ssaoUniformDescriptors;
+		VkDescriptorSet descriptor6 = ssub[0];
+		VkDescriptorSet descriptor8 = mSsaoInputSets[0];
+		VkDescriptorSet descriptor9 = mSsaoInputSets[1];
+		VkDescriptorSet descriptor10 = mSsaoInputSets[2];
+		VkDescriptorSet descriptor11 = mSsaoInputSets[3];
+		VkDescriptorSet descriptor12 = mSsaoInputSets[4];
+		//looked up here, the map isn't safe to index from the record threads
+		VkPipeline shadowPSO = mPSOs["shadow_opaque"];
+		VkPipeline drawNormalsPSO = mPSOs["drawNormals"];
+		VkPipeline ssaoPSO = mPSOs["ssao"];
+		VkPipeline ssaoBlurHorzPSO = mPSOs["ssaoBlurHorz"];
+		VkPipeline ssaoBlurVertPSO = mPSOs["ssaoBlurVert"];
+		VkPipeline opaquePSO = mIsWireframe ? mPSOs["opaque_wireframe"] : mIsFlatShader ? mPSOs["opaqueFlat"] : mNoSsao ? mPSOs["opaqueNoSsao"] : mPSOs["opaque"];
+		VkPipeline debugPSO = mPSOs["debug"];
+		VkPipeline skyPSO = mPSOs["sky"];
 
 		VkCommandBuffer cmd = BeginRender(false);//don't want to start main render pass
-		{
-			dynamicOffsets[0] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount + (uint32_t)passSize };
-			//shadow pass
-			uint32_t w = mShadowMap->Width();
-			uint32_t h = mShadowMap->Height();
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValue[1] = { {1.0f,0.0f } };
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValue;
-			renderPassBeginInfo.renderPass = mShadowMap->getRenderPass();
-			renderPassBeginInfo.framebuffer = mShadowMap->getFramebuffer();
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
-			VkViewport viewport = mShadowMap->Viewport();
-			pvkCmdSetViewport(cmd, 0, 1, &viewport);
-			VkRect2D scissor = mShadowMap->ScissorRect();
-			pvkCmdSetScissor(cmd, 0, 1, &scissor);
-			//vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
-			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["shadow_opaque"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *shadowPipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdEndRenderPass(cmd);
-			//Vulkan::transitionImage(mDevice,mGraphicsQueue,cmd,mShadowMap->getRenderTargetView(),VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,VK_IMAGE_LAYOUT)
-		}
-		VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
-		//pvkCmdSetViewport(cmd, 0, 1, &viewport);
-		VkRect2D scissor = { {0,0},{(uint32_t)mClientWidth,(uint32_t)mClientHeight} };
-		//pvkCmdSetScissor(cmd, 0, 1, &scissor);
-		{
-			dynamicOffsets[0] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount};
-			//normal
-			uint32_t w = mClientWidth;
-			uint32_t h = mClientHeight;
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValues[2] = { {0.0f,0.0f,1.0f}, {1.0f,0.0f } };
-			
-			renderPassBeginInfo.clearValueCount = 2;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = mSsao->getNormalRenderPass();
-			renderPassBeginInfo.framebuffer = mSsao->getNormalFramebuffer();
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };			
-			pvkCmdSetViewport(cmd, 0, 1, &viewport);			
-			pvkCmdSetScissor(cmd, 0, 1, &scissor);
-			//vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
-			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["drawNormals"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *drawNormalsPipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdEndRenderPass(cmd);
-		}
-		{
-			auto ssub = *ssaoUniformDescriptors;
-			auto sstx = *ssaoTextureDescriptors;
-			VkDescriptorSet descriptor6 = ssub[0];
-			VkDescriptorSet descriptor8 = sstx[0];
-			VkDescriptorSet descriptor9 = sstx[1];
-			VkDescriptorSet descriptor10 = sstx[2];
-			//ssao
-			VkDeviceSize ssaoSize = ub[2].objectSize;
-			VkDeviceSize ssaoCount = ub[2].objectCount;
-			dynamicOffsets[0] = { mCurrFrame * (uint32_t)ssaoSize * (uint32_t)ssaoCount };
-			//normal
-			uint32_t w = mSsao->SsaoMapWidth();
-			uint32_t h = mSsao->SsaoMapHeight();
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValues[1] = { {0.0f,0.0f,0.0f}};
-
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = mSsao->getSsaoRenderPass();
-			renderPassBeginInfo.framebuffer = mSsao->getSsaoFramebuffer(0);
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
-			auto ssaoViewport = mSsao->getSsaoViewport();
-			auto ssaoScissor = mSsao->getSsaoScissorRect();
-			pvkCmdSetViewport(cmd, 0, 1, &ssaoViewport);
-			pvkCmdSetScissor(cmd, 0, 1, &ssaoScissor);
-			//vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
-			Vulkan::transitionImageNoSubmit(cmd, mDepthImage.image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			
-			
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["ssao"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 0, 1, &descriptor6, 1, dynamicOffsets);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 1, 1, &descriptor8, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 2, 1, &descriptor9, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 3, 1, &descriptor10, 0, 0);//bind PC data once
-			
-			vkCmdDraw(cmd, 6, 1, 0, 0);
-			pvkCmdEndRenderPass(cmd);
-			
-
 
+		//shadow and normals split the opaque items over OpaqueTasks, the ssao and blur
+		//passes are a single draw, the main pass is the opaque items, debug quad and sky.
+		//The graph has the render passes and the barriers in front of them, the main pass
+		//is the app's, started last and ended by EndRender
+		const uint32_t OpaqueTasks = 2;
+		static const char* PassNames[PassCount] = { "shadow","normals","ssao","blur horz","blur vert","main" };
+		std::vector<RecordedPass> passes;
+		std::vector<uint32_t> graphPasses;
+		for (uint32_t pass = 0; pass < PassCount; ++pass) {
+			if (mRenderGraph->IsCulled(pass))
+				continue;
+			RecordedPass recorded;
+			recorded.BeginInfo = pass == Main ? mRenderPassBeginInfo : mRenderGraph->GetBeginInfo(pass);
+			recorded.Name = PassNames[pass];
+			recorded.TaskCount = pass == Shadow || pass == Normals ? OpaqueTasks : pass == Main ? OpaqueTasks + 2 : 1;
+			recorded.Before = [this, pass](VkCommandBuffer cmd) {
+				mRenderGraph->RecordBarriers(cmd, pass);
+			};
+			passes.push_back(recorded);
+			graphPasses.push_back(pass);
 		}
-		{
-			//blur
-			auto ssub = *ssaoUniformDescriptors;
-			auto sstx = *ssaoTextureDescriptors;
-			auto tx = *textureDescriptors;
-			VkDescriptorSet descriptor6 = ssub[0];
-			VkDescriptorSet descriptor7 = tx[2];
-			VkDescriptorSet descriptor8 = sstx[0];
-			VkDescriptorSet descriptor9 = sstx[1];
-			VkDescriptorSet descriptor10 = sstx[2];
-			VkDescriptorSet descriptor11 = sstx[3];
-			//ssao
-			//blur pass
-			uint32_t w = mSsao->SsaoMapWidth();
-			uint32_t h = mSsao->SsaoMapHeight();
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValues[1] = { {0.0f,0.0f,0.0f} };
-
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = mSsao->getSsaoRenderPass();
-			renderPassBeginInfo.framebuffer = mSsao->getSsaoFramebuffer(1);//draw to second framebuffer (2nd image)
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
-			auto ssaoViewport = mSsao->getSsaoViewport();
-			auto ssaoScissor = mSsao->getSsaoScissorRect();
-			pvkCmdSetViewport(cmd, 0, 1, &ssaoViewport);
-			pvkCmdSetScissor(cmd, 0, 1, &ssaoScissor);
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(0), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(1), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["ssaoBlurHorz"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 0, 1, &descriptor6, 1, dynamicOffsets);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 1, 1, &descriptor8, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 2, 1, &descriptor9, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 3, 1, &descriptor7, 0, 0);//bind PC data once
-
-			vkCmdDraw(cmd, 6, 1, 0, 0);
-			pvkCmdEndRenderPass(cmd);
-			//transition this image to shader read
-			Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(0), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(1), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			renderPassBeginInfo.framebuffer = mSsao->getSsaoFramebuffer(0);//draw to first framebuffer (1st image)
-			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["ssaoBlurVert"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 0, 1, &descriptor6, 1, dynamicOffsets);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 1, 1, &descriptor8, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 2, 1, &descriptor9, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 3, 1, &descriptor11, 0, 0);//bind PC data once
-
-			vkCmdDraw(cmd, 6, 1, 0, 0);
-			pvkCmdEndRenderPass(cmd);
-
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(1), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(0), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-
-
-			
-		}
-		Vulkan::transitionImageNoSubmit(cmd, mDepthImage.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-		//start main render pass now
-		pvkCmdBeginRenderPass(cmd, &mRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		dynamicOffsets[0] = (uint32_t)(mCurrFrame * passSize * passCount);
-
-
-		//VkViewport viewport = { 0.0f,0.0f,(float)mClientWidth,(float)mClientHeight,0.0f,1.0f };
-		pvkCmdSetViewport(cmd, 0, 1, &viewport);
-		//VkRect2D scissor = { {0,0},{(uint32_t)mClientWidth,(uint32_t)mClientHeight} };
-		pvkCmdSetScissor(cmd, 0, 1, &scissor);
-		if (mIsWireframe) {
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque_wireframe"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor7, 0, 0);//bind PC data once
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-		}
-		else if (mIsFlatShader) {
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaqueFlat"]);
-
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
-
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor7, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-		}
-		else if (mNoSsao) {
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaqueNoSsao"]);
-
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
-
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor7, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-		}
-		else
-		{
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["opaque"]);
-
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
-
-			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor7, 0, 0);//bind PC data once
-			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
-			//pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
-
-			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["sky"]);
-			DrawRenderItems(cmd, *cubeMapPipelineLayout, mRitemLayer[(int)RenderLayer::Sky]);
-
-		}
-
-
-
-
 
+		RecordPasses(cmd, passes, [&](uint32_t recorded, uint32_t task, VkCommandBuffer cmd) {
+			uint32_t pass = graphPasses[recorded];
+			switch (pass) {
+			case Shadow: {
+				uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount + (uint32_t)passSize };
+				VkViewport viewport = mShadowMap->Viewport();
+				pvkCmdSetViewport(cmd, 0, 1, &viewport);
+				VkRect2D scissor = mShadowMap->ScissorRect();
+				pvkCmdSetScissor(cmd, 0, 1, &scissor);
+				pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPSO);
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *shadowPipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
+				DrawRenderItems(cmd, *shadowPipelineLayout, RenderLayer::Opaque, task, OpaqueTasks);
+				break;
+			}
+			case Normals: {
+				uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount };
+				pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, drawNormalsPSO);
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once
+				DrawRenderItems(cmd, *drawNormalsPipelineLayout, RenderLayer::Opaque, task, OpaqueTasks);
+				break;
+			}
+			case SsaoMap:
+			case BlurHorz:
+			case BlurVert: {
+				uint32_t dynamicOffsets[1] = { mCurrFrame * (uint32_t)ssaoSize * (uint32_t)ssaoCount };
+				VkViewport ssaoViewport = mSsao->getSsaoViewport();
+				VkRect2D ssaoScissor = mSsao->getSsaoScissorRect();
+				pvkCmdSetViewport(cmd, 0, 1, &ssaoViewport);
+				pvkCmdSetScissor(cmd, 0, 1, &ssaoScissor);
+				//set 3 is the random vectors for ssao, the image to blur for the blur passes
+				VkPipeline pso = pass == SsaoMap ? ssaoPSO : pass == BlurHorz ? ssaoBlurHorzPSO : ssaoBlurVertPSO;
+				VkDescriptorSet inputDescriptor = pass == SsaoMap ? descriptor10 : pass == BlurHorz ? descriptor12 : descriptor11;
+				pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pso);
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 0, 1, &descriptor6, 1, dynamicOffsets);
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 1, 1, &descriptor8, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 2, 1, &descriptor9, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 3, 1, &inputDescriptor, 0, 0);//bind PC data once
+				vkCmdDraw(cmd, 6, 1, 0, 0);
+				break;
+			}
+			case Main: {
+				uint32_t dynamicOffsets[1] = { (uint32_t)(mCurrFrame * passSize * passCount) };
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 0, 1, &descriptor0, 1, dynamicOffsets);//bind PC data
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 2, 1, &descriptor2, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 3, 1, &descriptor3, 0, 0);//bind PC data once		
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 4, 1, &descriptor4, 0, 0);//bind PC data once
+				pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
+				if (task < OpaqueTasks) {
+					pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, opaquePSO);
+					pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor5, 0, 0);//bind PC data once
+					DrawRenderItems(cmd, *pipelineLayout, RenderLayer::Opaque, task, OpaqueTasks);
+				}
+				else if (task == OpaqueTasks) {
+					pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, debugPSO);
+					pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor7, 0, 0);//bind PC data once
+					DrawRenderItems(cmd, *debugPipelineLayout, RenderLayer::Debug);
+				}
+				else {
+					pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 5, 1, &descriptor7, 0, 0);//bind PC data once
+					pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, skyPSO);
+					DrawRenderItems(cmd, *cubeMapPipelineLayout, RenderLayer::Sky);
+				}
+				break;
+			}
+			}
+		});
 		EndRender(cmd);
 	}
 }
 
-void SsaoApp::DrawRenderItems(VkCommandBuffer cmd, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems) {
-	auto& ub = *uniformBuffer;
-	VkDeviceSize objectSize = ub[1].objectSize;
+void SsaoApp::DrawRenderItems(VkCommandBuffer cmd, VkPipelineLayout layout, RenderLayer layer, uint32_t task, uint32_t taskCount) {
+	//every item's constants are in one array, bound once with this frame's offset
+	auto& ob = *objectBuffer;
 	auto& ud = *uniformDescriptors;
 	VkDescriptorSet descriptor1 = ud[1];
-
-
-	for (size_t i = 0; i < ritems.size(); i++) {
+	uint32_t dynamicOffsets[1] = { (uint32_t)(ob[0].objectSize * mCurrFrameResourceIndex) };
+	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &descriptor1, 1, dynamicOffsets);
+
+	//every item's geometry is in the arena, bind it once
+	VkBuffer vertexBuffer = mGeometryArena->VertexBuffer();
+	pvkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, mOffsets);
+	pvkCmdBindIndexBuffer(cmd, mGeometryArena->IndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+	//this task's share of the items
+	const std::vector<RenderItem*>& ritems = mRitemLayer[(int)layer];
+	uint32_t begin = (uint32_t)(ritems.size() * task / taskCount);
+	uint32_t end = (uint32_t)(ritems.size() * (task + 1) / taskCount);
+	if (begin == end)
+		return;
+	if (mMultiDrawIndirect) {
+		VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * (mLayerFirstDraw[(int)layer] + begin);
+		pvkCmdDrawIndexedIndirect(cmd, mDrawCommands.buffer, offset, end - begin, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
+	for (uint32_t i = begin; i < end; i++) {
 		auto ri = ritems[i];
-		uint32_t indexOffset = ri->StartIndexLocation;
-
-		const auto vbv = ri->Geo->vertexBufferGPU;
-		const auto ibv = ri->Geo->indexBufferGPU;
-		pvkCmdBindVertexBuffers(cmd, 0, 1, &vbv.buffer, mOffsets);
-
-		pvkCmdBindIndexBuffer(cmd, ibv.buffer, indexOffset * sizeof(uint32_t), VK_INDEX_TYPE_UINT32);
-		uint32_t cbvIndex = ri->ObjCBIndex;
-		uint32_t dyoffsets[2] = { (uint32_t)(cbvIndex * objectSize) };
-		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &descriptor1, 1, dyoffsets);
-		pvkCmdDrawIndexed(cmd, ri->IndexCount, 1, 0, ri->BaseVertexLocation, 0);
+		uint32_t firstIndex = ri->Geo->StartIndexLocation + ri->StartIndexLocation;
+		int32_t vertexOffset = (int32_t)(ri->Geo->BaseVertexLocation + ri->BaseVertexLocation);
+		pvkCmdDrawIndexed(cmd, ri->IndexCount, 1, firstIndex, vertexOffset, ri->ObjCBIndex);
 	}
 }
 
@@ -14,7 +14,8 @@
 #include "FrameResource.h"
 #include "AnimationHelper.h"
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
 
 
 struct RenderItem {
@@ -151,6 +152,7 @@ QuatApp::~QuatApp() {
 bool QuatApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
 
@@ -856,8 +858,8 @@ void QuatApp::Update(const GameTimer& gt) {
 
 	
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	OnKeyboardInput(gt);
@@ -902,6 +904,7 @@ void QuatApp::AnimateMaterials(const GameTimer& gt)
 }
 
 void  QuatApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -923,6 +926,7 @@ void  QuatApp::UpdateObjectCBs(const GameTimer& gt) {
 }
 
 void QuatApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
@@ -944,6 +948,7 @@ void QuatApp::UpdateMaterialsBuffer(const GameTimer& gt) {
 }
 
 void QuatApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
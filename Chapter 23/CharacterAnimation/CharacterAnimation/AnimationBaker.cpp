@@ -0,0 +1,167 @@
+#include "AnimationBaker.h"
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+const char AnimationBaker::FileMagic[4] = { 'V','A','T','X' };
+const uint32_t AnimationBaker::FileVersion;
+
+const VatClip* VertexAnimationTexture::FindClip(const std::string& clipName)const {
+	for (auto& clip : Clips) {
+		if (clip.Name == clipName)
+			return &clip;
+	}
+	return nullptr;
+}
+
+void AnimationBaker::Layout(uint32_t texelsPerFrame, uint32_t layersPerClip, const SkinnedData& skinnedInfo, VatMode mode, VertexAnimationTexture& vat)const {
+	vat.Mode = mode;
+	vat.SampleRate = mSampleRate;
+	vat.Width = std::min(texelsPerFrame, mMaxWidth);
+	vat.RowsPerFrame = (texelsPerFrame + vat.Width - 1) / vat.Width;
+	vat.Clips.clear();
+
+	uint32_t maxFrames = 0;
+	for (auto& pair : skinnedInfo.Animations()) {
+		VatClip clip;
+		clip.Name = pair.first;
+		clip.Layer = (uint32_t)vat.Clips.size() * layersPerClip;
+		clip.Duration = pair.second.GetClipEndTime() - pair.second.GetClipStartTime();
+		// At least two frames, the bake divides by FrameCount - 1 and vatcrowd.vert blends frame pairs.
+		clip.FrameCount = std::max((uint32_t)std::ceil(clip.Duration * mSampleRate) + 1, 2u);
+		maxFrames = std::max(maxFrames, clip.FrameCount);
+		vat.Clips.push_back(clip);
+	}
+	vat.Height = vat.RowsPerFrame * maxFrames;
+	vat.LayerCount = (uint32_t)vat.Clips.size() * layersPerClip;
+	assert(vat.Height <= mMaxWidth);
+	vat.Texels.assign((size_t)vat.LayerCount * vat.Width * vat.Height, glm::vec4(0.0f));
+}
+
+void AnimationBaker::BakeBoneMatrices(const SkinnedData& skinnedInfo, VertexAnimationTexture& vat)const {
+	uint32_t boneCount = skinnedInfo.BoneCount();
+	Layout(boneCount * 3, 1, skinnedInfo, VatMode::BoneMatrices, vat);
+
+	std::vector<glm::mat4> finalTransforms(boneCount);
+	for (auto& clip : vat.Clips) {
+		float startTime = skinnedInfo.GetClipStartTime(clip.Name);
+		glm::vec4* pLayer = vat.Layer(clip.Layer);
+		for (uint32_t f = 0; f < clip.FrameCount; ++f) {
+			float t = startTime + clip.Duration * f / (float)(clip.FrameCount - 1);
+			skinnedInfo.GetFinalTransforms(clip.Name, t, finalTransforms);
+			glm::vec4* pFrame = pLayer + (size_t)f * vat.RowsPerFrame * vat.Width;
+			for (uint32_t b = 0; b < boneCount; ++b) {
+				// Store rows, the last one is always (0,0,0,1).
+				glm::mat4 m = glm::transpose(finalTransforms[b]);
+				pFrame[b * 3 + 0] = m[0];
+				pFrame[b * 3 + 1] = m[1];
+				pFrame[b * 3 + 2] = m[2];
+			}
+		}
+	}
+}
+
+void AnimationBaker::BakeSkinnedVertices(const SkinnedData& skinnedInfo, const std::vector<M3DLoader::SkinnedVertex>& vertices, VertexAnimationTexture& vat)const {
+	uint32_t vertexCount = (uint32_t)vertices.size();
+	Layout(vertexCount, 2, skinnedInfo, VatMode::SkinnedVertices, vat);
+
+	std::vector<glm::mat4> finalTransforms(skinnedInfo.BoneCount());
+	for (auto& clip : vat.Clips) {
+		float startTime = skinnedInfo.GetClipStartTime(clip.Name);
+		glm::vec4* pPositions = vat.Layer(clip.Layer);
+		glm::vec4* pNormals = vat.Layer(clip.Layer + 1);
+		for (uint32_t f = 0; f < clip.FrameCount; ++f) {
+			float t = startTime + clip.Duration * f / (float)(clip.FrameCount - 1);
+			skinnedInfo.GetFinalTransforms(clip.Name, t, finalTransforms);
+			size_t frameOffset = (size_t)f * vat.RowsPerFrame * vat.Width;
+			for (uint32_t v = 0; v < vertexCount; ++v) {
+				// Same blend as defaultskinned.vert.
+				auto& vertex = vertices[v];
+				float weights[4] = { vertex.BoneWeights.x, vertex.BoneWeights.y, vertex.BoneWeights.z, 0.0f };
+				weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+				glm::vec3 posL(0.0f);
+				glm::vec3 normalL(0.0f);
+				for (int i = 0; i < 4; ++i) {
+					const glm::mat4& m = finalTransforms[vertex.BoneIndices[i]];
+					posL += weights[i] * glm::vec3(m * glm::vec4(vertex.Pos, 1.0f));
+					normalL += weights[i] * (glm::mat3(m) * vertex.Normal);
+				}
+				pPositions[frameOffset + v] = glm::vec4(posL, 1.0f);
+				pNormals[frameOffset + v] = glm::vec4(glm::normalize(normalL), 0.0f);
+			}
+		}
+	}
+}
+
+bool AnimationBaker::Save(const std::string& filename, const VertexAnimationTexture& vat) {
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout)
+		return false;
+	fout.write(FileMagic, sizeof(FileMagic));
+	fout.write((const char*)&FileVersion, sizeof(uint32_t));
+	uint32_t header[5] = { (uint32_t)vat.Mode, vat.Width, vat.Height, vat.LayerCount, vat.RowsPerFrame };
+	fout.write((const char*)header, sizeof(header));
+	fout.write((const char*)&vat.SampleRate, sizeof(float));
+	uint32_t clipCount = (uint32_t)vat.Clips.size();
+	fout.write((const char*)&clipCount, sizeof(uint32_t));
+	for (auto& clip : vat.Clips) {
+		uint32_t nameLength = (uint32_t)clip.Name.size();
+		fout.write((const char*)&nameLength, sizeof(uint32_t));
+		fout.write(clip.Name.data(), nameLength);
+		fout.write((const char*)&clip.Layer, sizeof(uint32_t));
+		fout.write((const char*)&clip.FrameCount, sizeof(uint32_t));
+		fout.write((const char*)&clip.Duration, sizeof(float));
+	}
+	fout.write((const char*)vat.Texels.data(), vat.Texels.size() * sizeof(glm::vec4));
+	return (bool)fout;
+}
+
+bool AnimationBaker::Load(const std::string& filename, VertexAnimationTexture& vat) {
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+	// Anything that doesn't look like what Save writes is rejected before it sizes an
+	// allocation, the caller bakes again.
+	char magic[sizeof(FileMagic)];
+	uint32_t version = 0;
+	fin.read(magic, sizeof(magic));
+	fin.read((char*)&version, sizeof(uint32_t));
+	if (!fin || !std::equal(magic, magic + sizeof(magic), FileMagic) || version != FileVersion)
+		return false;
+	uint32_t header[5];
+	fin.read((char*)header, sizeof(header));
+	fin.read((char*)&vat.SampleRate, sizeof(float));
+	uint32_t clipCount = 0;
+	fin.read((char*)&clipCount, sizeof(uint32_t));
+	if (!fin || header[0] > (uint32_t)VatMode::SkinnedVertices)
+		return false;
+	vat.Mode = (VatMode)header[0];
+	vat.Width = header[1];
+	vat.Height = header[2];
+	vat.LayerCount = header[3];
+	vat.RowsPerFrame = header[4];
+	uint32_t layersPerClip = vat.Mode == VatMode::SkinnedVertices ? 2 : 1;
+	if (vat.Width == 0 || vat.Width > MaxDimension || vat.Height == 0 || vat.Height > MaxDimension ||
+		vat.RowsPerFrame == 0 || vat.RowsPerFrame > vat.Height || vat.LayerCount == 0 || vat.LayerCount > MaxLayers ||
+		clipCount == 0 || clipCount * layersPerClip != vat.LayerCount || !(vat.SampleRate > 0.0f))
+		return false;
+	vat.Clips.resize(clipCount);
+	for (auto& clip : vat.Clips) {
+		uint32_t nameLength = 0;
+		fin.read((char*)&nameLength, sizeof(uint32_t));
+		if (!fin || nameLength > MaxClipName)
+			return false;
+		clip.Name.resize(nameLength);
+		fin.read(&clip.Name[0], nameLength);
+		fin.read((char*)&clip.Layer, sizeof(uint32_t));
+		fin.read((char*)&clip.FrameCount, sizeof(uint32_t));
+		fin.read((char*)&clip.Duration, sizeof(float));
+		if (!fin || clip.Layer + layersPerClip > vat.LayerCount || clip.FrameCount < 2 ||
+			clip.FrameCount > vat.Height / vat.RowsPerFrame || !(clip.Duration >= 0.0f))
+			return false;
+	}
+	vat.Texels.resize((size_t)vat.LayerCount * vat.Width * vat.Height);
+	fin.read((char*)vat.Texels.data(), vat.Texels.size() * sizeof(glm::vec4));
+	return (bool)fin;
+}
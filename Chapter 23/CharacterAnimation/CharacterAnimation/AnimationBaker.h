@@ -0,0 +1,70 @@
+#pragma once
+#include "SkinnedData.h"
+#include "LoadM3d.h"
+
+///<summary>
+/// Bakes animation clips into a vertex animation texture (VAT) so crowds can be
+/// drawn as plain instanced meshes with no per frame CPU animation.  Every clip
+/// is sampled with SkinnedData::GetFinalTransforms at a fixed rate and stored in
+/// its own layer(s) of an RGBA32F texture array:
+///
+///   BoneMatrices:    3 texels per bone (rows of the 3x4 affine transform), the
+///                    vertex shader still blends the 4 bone influences.
+///   SkinnedVertices: 1 texel per vertex, positions in the clip's layer and
+///                    normals in the next one, the vertex shader just fetches.
+///
+/// A frame's texels are wrapped into rows of at most maxWidth texels, frame f
+/// starts at row f * RowsPerFrame.  The baker has no Vulkan dependency so it
+/// can run headless (see -bakevat in main).
+///</summary>
+
+enum class VatMode : uint32_t {
+	BoneMatrices = 0,
+	SkinnedVertices = 1
+};
+
+struct VatClip {
+	std::string Name;
+	uint32_t Layer{ 0 };		// first layer, normals are Layer + 1 for SkinnedVertices
+	uint32_t FrameCount{ 0 };	// frames evenly cover [start,end], first and last included
+	float Duration{ 0.0f };
+};
+
+struct VertexAnimationTexture {
+	VatMode Mode{ VatMode::BoneMatrices };
+	uint32_t Width{ 0 };
+	uint32_t Height{ 0 };
+	uint32_t LayerCount{ 0 };
+	uint32_t RowsPerFrame{ 0 };
+	float SampleRate{ 0.0f };
+	std::vector<VatClip> Clips;
+	std::vector<glm::vec4> Texels;	// LayerCount * Height * Width
+
+	const VatClip* FindClip(const std::string& clipName)const;
+	glm::vec4* Layer(uint32_t layer) { return Texels.data() + (size_t)layer * Width * Height; }
+	size_t LayerByteSize()const { return (size_t)Width * Height * sizeof(glm::vec4); }
+};
+
+class AnimationBaker {
+	// File header, the version goes up whenever the layout Save writes changes.
+	static const char FileMagic[4];
+	static const uint32_t FileVersion = 2;
+	// Load's sanity limits, well above anything Layout produces.
+	static const uint32_t MaxDimension = 16384;
+	static const uint32_t MaxLayers = 2048;
+	static const uint32_t MaxClipName = 1024;
+
+	float mSampleRate{ 30.0f };
+	uint32_t mMaxWidth{ 4096 };//lowest maxImageDimension2D the spec allows
+
+	void Layout(uint32_t texelsPerFrame, uint32_t layersPerClip, const SkinnedData& skinnedInfo, VatMode mode, VertexAnimationTexture& vat)const;
+public:
+	AnimationBaker() = default;
+	AnimationBaker(float sampleRate, uint32_t maxWidth = 4096) :mSampleRate(sampleRate), mMaxWidth(maxWidth) {}
+
+	void BakeBoneMatrices(const SkinnedData& skinnedInfo, VertexAnimationTexture& vat)const;
+	void BakeSkinnedVertices(const SkinnedData& skinnedInfo, const std::vector<M3DLoader::SkinnedVertex>& vertices, VertexAnimationTexture& vat)const;
+
+	static bool Save(const std::string& filename, const VertexAnimationTexture& vat);
+	static bool Load(const std::string& filename, VertexAnimationTexture& vat);
+};
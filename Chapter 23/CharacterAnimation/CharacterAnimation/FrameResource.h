@@ -18,6 +18,12 @@ struct SkinnedConstants
 	glm::mat4 BoneTransforms[96];
 };
 
+//dual quaternion palette, half the size of SkinnedConstants
+struct SkinnedDualQuatConstants
+{
+	glm::mat2x4 BoneDualQuats[96];
+};
+
 
 
 struct PassConstants {
@@ -0,0 +1,243 @@
+#include "GpuAnimation.h"
+
+GpuAnimation::GpuAnimation(VkDevice device_, VkPhysicalDeviceProperties& deviceProperties_, VkPhysicalDeviceMemoryProperties memoryProperties_, VkQueue queue_, VkCommandBuffer cmd_, const SkinnedData& skinnedInfo, uint32_t maxInstances, uint32_t numFrames) :device(device_), memoryProperties(memoryProperties_) {
+	assert(maxInstances <= GPU_ANIMATION_MAX_INSTANCES);
+	assert(skinnedInfo.BoneCount() <= GPU_ANIMATION_MAX_BONES);
+	mMaxInstances = maxInstances;
+	mNumFrames = numFrames;
+	mInstanceCounts.resize(numFrames, 0);
+	BuildData(skinnedInfo);
+	BuildResources(deviceProperties_, queue_, cmd_);
+}
+
+GpuAnimation::~GpuAnimation() {
+	Vulkan::cleanupBuffer(device, mAnimationBuffer);
+	Vulkan::cleanupBuffer(device, mPaletteBuffer);
+}
+
+void GpuAnimation::BuildData(const SkinnedData& skinnedInfo) {
+	mBoneCount = skinnedInfo.BoneCount();
+
+	auto& hierarchy = skinnedInfo.BoneHierarchy();
+	auto& offsets = skinnedInfo.BoneOffsets();
+	mBones.resize(mBoneCount);
+	for (uint32_t i = 0; i < mBoneCount; ++i) {
+		mBones[i] = {};
+		mBones[i].Offset = offsets[i];
+		// The root has no parent, whatever the file says.
+		mBones[i].Parent = i == 0 ? -1 : hierarchy[i];
+		assert(mBones[i].Parent < (int)i);//parents are always stored before their children
+	}
+
+	// Flatten every clip: one track per bone, tracks point into one big keyframe array.
+	for (auto& pair : skinnedInfo.Animations()) {
+		auto& clip = pair.second;
+		GpuClip gpuClip{};
+		gpuClip.FirstTrack = (uint32_t)mTracks.size();
+		gpuClip.BoneCount = (uint32_t)clip.BoneAnimations.size();
+		assert(gpuClip.BoneCount == mBoneCount);
+		for (auto& boneAnim : clip.BoneAnimations) {
+			GpuBoneTrack track{};
+			track.FirstKey = (uint32_t)mKeyframes.size();
+			track.KeyCount = (uint32_t)boneAnim.Keyframes.size();
+			for (auto& key : boneAnim.Keyframes) {
+				GpuKeyframe gpuKey;
+				gpuKey.TranslationTime = glm::vec4(key.Translation, key.TimePos);
+				gpuKey.Scale = glm::vec4(key.Scale, 0.0f);
+				gpuKey.RotationQuat = glm::vec4(key.RotationQuat.x, key.RotationQuat.y, key.RotationQuat.z, key.RotationQuat.w);
+				mKeyframes.push_back(gpuKey);
+			}
+			mTracks.push_back(track);
+		}
+		mClipIndices[pair.first] = (uint32_t)mClips.size();
+		mClips.push_back(gpuClip);
+	}
+}
+
+void GpuAnimation::BuildResources(VkPhysicalDeviceProperties& deviceProperties, VkQueue queue_, VkCommandBuffer cmd_) {
+	// All the static data lives in one device local storage buffer, each array
+	// starting on a storage buffer offset boundary so it can be bound on its own.
+	VkDeviceSize alignment = deviceProperties.limits.minStorageBufferOffsetAlignment;
+	mSizes[0] = sizeof(GpuKeyframe) * mKeyframes.size();
+	mSizes[1] = sizeof(GpuBoneTrack) * mTracks.size();
+	mSizes[2] = sizeof(GpuClip) * mClips.size();
+	mSizes[3] = sizeof(GpuBone) * mBones.size();
+	VkDeviceSize bufSize = 0;
+	for (int i = 0; i < 4; ++i) {
+		mOffsets[i] = bufSize;
+		bufSize += (mSizes[i] + alignment - 1) & ~(alignment - 1);
+	}
+
+	Vulkan::Buffer stagingBuffer;
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	props.size = bufSize;
+	Vulkan::initBuffer(device, memoryProperties, props, stagingBuffer);
+	uint8_t* ptr = (uint8_t*)Vulkan::mapBuffer(device, stagingBuffer);
+	memcpy(ptr + mOffsets[0], mKeyframes.data(), mSizes[0]);
+	memcpy(ptr + mOffsets[1], mTracks.data(), mSizes[1]);
+	memcpy(ptr + mOffsets[2], mClips.data(), mSizes[2]);
+	memcpy(ptr + mOffsets[3], mBones.data(), mSizes[3]);
+	Vulkan::unmapBuffer(device, stagingBuffer);
+
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	Vulkan::initBuffer(device, memoryProperties, props, mAnimationBuffer);
+	Vulkan::CopyBufferTo(device, queue_, cmd_, stagingBuffer, mAnimationBuffer, bufSize);
+	Vulkan::cleanupBuffer(device, stagingBuffer);
+
+	// Palette: written by the compute shader, read by the skinned vertex shaders
+	// as a dynamic uniform buffer, so each palette is uniform offset aligned.
+	alignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
+	mPaletteSize = sizeof(glm::mat4) * GPU_ANIMATION_MAX_BONES;
+	mPaletteSize = (mPaletteSize + alignment - 1) & ~(alignment - 1);
+	mFrameSize = mPaletteSize * mMaxInstances;
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	props.size = mFrameSize * mNumFrames;
+	Vulkan::initBuffer(device, memoryProperties, props, mPaletteBuffer);
+
+	// Per frame instance list, the only thing the CPU writes each frame.
+	Vulkan::Buffer constantBuffer;
+	std::vector<UniformBufferInfo> bufferInfo;
+	UniformBufferBuilder::begin(device, deviceProperties, memoryProperties, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, true)
+		.AddBuffer(sizeof(GpuAnimationConstants), 1, mNumFrames)
+		.build(constantBuffer, bufferInfo);
+	mConstantBuffer = std::make_unique<VulkanUniformBuffer>(device, constantBuffer, bufferInfo);
+	for (uint32_t i = 0; i < mNumFrames; ++i) {
+		SetInstanceCount(i, 0);
+	}
+}
+
+uint32_t GpuAnimation::ClipIndex(const std::string& clipName)const {
+	auto clip = mClipIndices.find(clipName);
+	assert(clip != mClipIndices.end());
+	return clip->second;
+}
+
+void GpuAnimation::GetComputeDescriptors(VkDescriptorBufferInfo* pBufferInfo)const {
+	for (int i = 0; i < 4; ++i) {
+		pBufferInfo[i].buffer = mAnimationBuffer.buffer;
+		pBufferInfo[i].offset = mOffsets[i];
+		pBufferInfo[i].range = mSizes[i];
+	}
+	auto& cb = *mConstantBuffer;
+	pBufferInfo[4].buffer = cb;
+	pBufferInfo[4].offset = 0;
+	pBufferInfo[4].range = cb[0].objectSize;
+	pBufferInfo[5].buffer = mPaletteBuffer.buffer;
+	pBufferInfo[5].offset = 0;
+	pBufferInfo[5].range = VK_WHOLE_SIZE;
+}
+
+void GpuAnimation::GetPaletteDescriptor(VkDescriptorBufferInfo& bufferInfo)const {
+	bufferInfo.buffer = mPaletteBuffer.buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = mPaletteSize;
+}
+
+void GpuAnimation::SetInstance(uint32_t frame, uint32_t instance, uint32_t clipIndex, float timePos) {
+	assert(instance < mMaxInstances);
+	auto& cb = *mConstantBuffer;
+	GpuAnimationConstants* pConstants = (GpuAnimationConstants*)((uint8_t*)cb[0].ptr + cb[0].objectSize * frame);
+	GpuAnimationInstance& inst = pConstants->Instances[instance];
+	inst.ClipIndex = clipIndex;
+	inst.TimePos = timePos;
+	inst.PaletteIndex = (uint32_t)(PaletteOffset(frame, instance) / sizeof(glm::mat4));
+}
+
+void GpuAnimation::SetInstanceCount(uint32_t frame, uint32_t instanceCount) {
+	assert(instanceCount <= mMaxInstances);
+	auto& cb = *mConstantBuffer;
+	GpuAnimationConstants* pConstants = (GpuAnimationConstants*)((uint8_t*)cb[0].ptr + cb[0].objectSize * frame);
+	pConstants->InstanceCount = instanceCount;
+	pConstants->BoneCount = mBoneCount;
+	mInstanceCounts[frame] = instanceCount;
+}
+
+void GpuAnimation::Dispatch(VkCommandBuffer cmd_, VkPipelineLayout pipelineLayout_, VkPipeline pipeline_, VkDescriptorSet descriptorSet_, uint32_t frame)const {
+	uint32_t instanceCount = mInstanceCounts[frame];
+	if (instanceCount == 0)
+		return;
+	auto& cb = *mConstantBuffer;
+	uint32_t dynamicOffset = (uint32_t)(cb[0].objectSize * frame);
+	vkCmdBindPipeline(cmd_, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+	vkCmdBindDescriptorSets(cmd_, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSet_, 1, &dynamicOffset);
+	//one workgroup per instance, one invocation per bone
+	vkCmdDispatch(cmd_, instanceCount, 1, 1);
+
+	VkBufferMemoryBarrier barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = mPaletteBuffer.buffer;
+	barrier.offset = mFrameSize * frame;
+	barrier.size = mFrameSize;
+	vkCmdPipelineBarrier(cmd_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// Same as BoneAnimation::Interpolate, including the scale*rot*trans order it uses when clamped to an end key.
+static glm::mat4 SampleTrack(const GpuKeyframe* keys, uint32_t keyCount, float t) {
+	const GpuKeyframe& first = keys[0];
+	const GpuKeyframe& last = keys[keyCount - 1];
+	if (t <= first.TranslationTime.w || t >= last.TranslationTime.w) {
+		const GpuKeyframe& key = t <= first.TranslationTime.w ? first : last;
+		glm::quat q(key.RotationQuat.w, key.RotationQuat.x, key.RotationQuat.y, key.RotationQuat.z);
+		glm::mat4 rot = glm::mat4(q);
+		glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(key.Scale));
+		glm::mat4 trans = glm::translate(glm::mat4(1.0f), glm::vec3(key.TranslationTime));
+		return scale * rot * trans;
+	}
+	//binary search for the last key at or before t
+	uint32_t lo = 0;
+	uint32_t hi = keyCount - 1;
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+		if (keys[mid].TranslationTime.w <= t)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const GpuKeyframe& k0 = keys[lo];
+	const GpuKeyframe& k1 = keys[lo + 1];
+	float lerpPercent = (t - k0.TranslationTime.w) / (k1.TranslationTime.w - k0.TranslationTime.w);
+	glm::vec3 transVec = glm::mix(glm::vec3(k0.TranslationTime), glm::vec3(k1.TranslationTime), lerpPercent);
+	glm::vec3 scaleVec = glm::mix(glm::vec3(k0.Scale), glm::vec3(k1.Scale), lerpPercent);
+	glm::quat q0(k0.RotationQuat.w, k0.RotationQuat.x, k0.RotationQuat.y, k0.RotationQuat.z);
+	glm::quat q1(k1.RotationQuat.w, k1.RotationQuat.x, k1.RotationQuat.y, k1.RotationQuat.z);
+	glm::quat quat = glm::lerp(q0, q1, lerpPercent);
+	glm::mat4 rot = glm::mat4(quat);
+	glm::mat4 scale = glm::scale(glm::mat4(1.0f), scaleVec);
+	glm::mat4 trans = glm::translate(glm::mat4(1.0f), transVec);
+	return trans * rot * scale;
+}
+
+void GpuAnimation::EvaluatePalette(uint32_t clipIndex, float timePos, std::vector<glm::mat4>& palette)const {
+	const GpuClip& clip = mClips[clipIndex];
+	std::vector<glm::mat4> toParentTransforms(mBoneCount);
+	for (uint32_t i = 0; i < mBoneCount; ++i) {
+		const GpuBoneTrack& track = mTracks[clip.FirstTrack + i];
+		toParentTransforms[i] = SampleTrack(&mKeyframes[track.FirstKey], track.KeyCount, timePos);
+	}
+	// Each bone walks its own parent chain, the way one shader invocation does,
+	// rather than reusing its parent's result.
+	palette.resize(mBoneCount);
+	for (uint32_t i = 0; i < mBoneCount; ++i) {
+		glm::mat4 toRoot = toParentTransforms[i];
+		int parent = mBones[i].Parent;
+		while (parent >= 0) {
+			toRoot = toParentTransforms[parent] * toRoot;
+			parent = mBones[parent].Parent;
+		}
+		palette[i] = toRoot * mBones[i].Offset;
+	}
+}
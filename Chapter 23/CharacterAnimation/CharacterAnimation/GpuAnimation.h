@@ -0,0 +1,117 @@
+#pragma once
+#include "../../../Common/Vulkan.h"
+#include "../../../Common/VulkanEx.h"
+#include "SkinnedData.h"
+#include <glm/glm.hpp>
+#include <memory>
+
+///<summary>
+/// GPU side animation evaluation. All keyframes of all clips are flattened into
+/// storage buffers once at load time, and a compute shader (animate.comp)
+/// samples the clip, walks the bone hierarchy and writes the final bone palette
+/// straight into a buffer the skinned vertex shaders read as their bone UBO.
+/// Each frame the CPU only uploads a clip index and time position per instance.
+///</summary>
+
+// Layouts below must match Shaders/animate.comp (std430/std140).
+struct GpuKeyframe {
+	glm::vec4 TranslationTime;	// xyz = translation, w = time position
+	glm::vec4 Scale;			// xyz = scale
+	glm::vec4 RotationQuat;		// x,y,z,w
+};
+
+struct GpuBoneTrack {
+	uint32_t FirstKey;
+	uint32_t KeyCount;
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+struct GpuClip {
+	uint32_t FirstTrack;
+	uint32_t BoneCount;
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+struct GpuBone {
+	glm::mat4 Offset;
+	int Parent;
+	int pad0;
+	int pad1;
+	int pad2;
+};
+
+struct GpuAnimationInstance {
+	uint32_t ClipIndex;
+	float TimePos;
+	uint32_t PaletteIndex;	// index of the first mat4 of this instance's palette
+	uint32_t pad0;
+};
+
+#define GPU_ANIMATION_MAX_INSTANCES 64
+#define GPU_ANIMATION_MAX_BONES 96
+
+struct GpuAnimationConstants {
+	uint32_t InstanceCount;
+	uint32_t BoneCount;
+	uint32_t pad0;
+	uint32_t pad1;
+	GpuAnimationInstance Instances[GPU_ANIMATION_MAX_INSTANCES];
+};
+
+class GpuAnimation {
+	VkDevice device{ VK_NULL_HANDLE };
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	uint32_t mBoneCount{ 0 };
+	uint32_t mMaxInstances{ 0 };
+	uint32_t mNumFrames{ 0 };
+	VkDeviceSize mPaletteSize{ 0 };	//one instance, aligned for dynamic uniform offsets
+	VkDeviceSize mFrameSize{ 0 };	//all instances of one frame
+	std::vector<uint32_t> mInstanceCounts;	//per frame, dispatch size
+
+	// CPU copies of the flattened data, used by EvaluatePalette.
+	std::vector<GpuKeyframe> mKeyframes;
+	std::vector<GpuBoneTrack> mTracks;
+	std::vector<GpuClip> mClips;
+	std::vector<GpuBone> mBones;
+	std::unordered_map<std::string, uint32_t> mClipIndices;
+
+	// Offsets of each array in mAnimationBuffer, storage buffer aligned.
+	VkDeviceSize mOffsets[4]{};
+	VkDeviceSize mSizes[4]{};
+	Vulkan::Buffer mAnimationBuffer;
+	Vulkan::Buffer mPaletteBuffer;
+	std::unique_ptr<VulkanUniformBuffer> mConstantBuffer;
+
+	void BuildData(const SkinnedData& skinnedInfo);
+	void BuildResources(VkPhysicalDeviceProperties& deviceProperties, VkQueue queue_, VkCommandBuffer cmd_);
+public:
+	GpuAnimation(VkDevice device_, VkPhysicalDeviceProperties& deviceProperties_, VkPhysicalDeviceMemoryProperties memoryProperties_, VkQueue queue_, VkCommandBuffer cmd_, const SkinnedData& skinnedInfo, uint32_t maxInstances, uint32_t numFrames);
+	GpuAnimation(const GpuAnimation& rhs) = delete;
+	GpuAnimation& operator=(const GpuAnimation& rhs) = delete;
+	~GpuAnimation();
+
+	uint32_t BoneCount()const { return mBoneCount; }
+	uint32_t ClipIndex(const std::string& clipName)const;
+
+	// Byte offset of an instance's palette, for the bone set's dynamic offset.
+	uint32_t PaletteOffset(uint32_t frame, uint32_t instance)const { return (uint32_t)(mFrameSize * frame + mPaletteSize * instance); }
+	VkDeviceSize PaletteSize()const { return mPaletteSize; }
+	VkBuffer PaletteBuffer()const { return mPaletteBuffer.buffer; }
+
+	// Fill the compute set (bindings 0-5) and the palette descriptor the
+	// skinned shaders bind as UNIFORM_BUFFER_DYNAMIC.
+	void GetComputeDescriptors(VkDescriptorBufferInfo* pBufferInfo)const;
+	void GetPaletteDescriptor(VkDescriptorBufferInfo& bufferInfo)const;
+
+	// Per frame upload, only the clip and time of each instance.
+	void SetInstance(uint32_t frame, uint32_t instance, uint32_t clipIndex, float timePos);
+	void SetInstanceCount(uint32_t frame, uint32_t instanceCount);
+
+	// Record the dispatch and the barrier that makes the palette visible to the vertex shaders.
+	void Dispatch(VkCommandBuffer cmd_, VkPipelineLayout pipelineLayout_, VkPipeline pipeline_, VkDescriptorSet descriptorSet_, uint32_t frame)const;
+
+	// CPU reference of animate.comp, works from the same flattened data.
+	void EvaluatePalette(uint32_t clipIndex, float timePos, std::vector<glm::mat4>& palette)const;
+};
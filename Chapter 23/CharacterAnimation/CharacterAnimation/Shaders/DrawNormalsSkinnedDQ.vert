@@ -0,0 +1,148 @@
+#version 450
+
+layout(location=0) in vec3 inPosL;
+layout(location=1) in vec3 inNormalL;
+layout(location=2) in vec2 inTexC;
+layout(location=3) in vec3 inTangentL;
+layout(location=4) in vec3 inBoneWeights;
+layout(location=5) in ivec4 inBoneIndices;
+layout(location=0) out vec3 outNormalW;
+layout(location=1) out vec3 outTangentW;
+layout(location=3) out vec2 outTexC;
+
+layout (set=0, binding=0) uniform ObjectCB{
+	mat4 world;	
+	mat4 texTransform;
+	uint materialIndex;
+	uint gObjPad0;
+	uint gObjPad1;
+	uint gObjPad2;
+};
+
+//dual quaternion per bone: [2*i] real part, [2*i+1] dual part
+layout(set=1,binding=0) uniform SkinnedUBO{
+    vec4 boneDualQuats[192];
+};
+
+struct Light
+{
+    vec3 Strength;
+    float FalloffStart; // point/spot light only
+    vec3 Direction;   // directional/spot light only
+    float FalloffEnd;   // point/spot light only
+    vec3 Position;    // point light only
+    float SpotPower;    // spot light only
+};
+#define MAX_LIGHTS 16
+
+
+layout (set=2,binding=0) uniform PassCB{
+	mat4 view;
+	mat4 invView;
+	mat4 proj;
+	mat4 invProj;
+	mat4 viewProj;
+	mat4 invViewProj;
+	mat4 viewProjTex;
+	mat4 shadowTransform;
+	vec3 eyePosW;
+	float cbPerObjPad1;
+	vec2 RenderTargetSize;
+	vec2 InvRenderTargetSize;
+	float NearZ;
+	float FarZ;
+	float TotalTime;
+	float DeltaTime;
+	vec4 ambientLight;	
+	Light gLights[MAX_LIGHTS];
+};
+
+
+
+struct MaterialData
+{
+	vec4   DiffuseAlbedo;
+	vec3   FresnelR0;
+	float    Roughness;
+	mat4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     NormalMapIndex;
+	uint     MatPad1;
+	uint     MatPad2;
+};
+
+layout (set=3, binding=0) readonly buffer MaterialBuffer{
+	MaterialData materials[];
+}materialData;
+
+vec3 quatRotate(vec4 q, vec3 v){
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+vec3 dqTransformPoint(vec4 real, vec4 dual, vec3 p){
+	vec3 t = 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+	return quatRotate(real, p) + t;
+}
+
+void main(){
+	MaterialData matData = materialData.materials[materialIndex];
+	
+	float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    weights[0] = inBoneWeights.x;
+    weights[1] = inBoneWeights.y;
+    weights[2] = inBoneWeights.z;
+    weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+	
+	// Blend the dual quaternions, keeping each in the same hemisphere as the
+	// first so the blend takes the shortest path.
+	vec4 real0 = boneDualQuats[2*inBoneIndices[0]];
+	vec4 blendReal = vec4(0.0f);
+	vec4 blendDual = vec4(0.0f);
+	for(int i = 0; i < 4; ++i)
+	{
+		vec4 real = boneDualQuats[2*inBoneIndices[i]];
+		vec4 dual = boneDualQuats[2*inBoneIndices[i]+1];
+		float w = dot(real, real0) < 0.0f ? -weights[i] : weights[i];
+		blendReal += w * real;
+		blendDual += w * dual;
+	}
+	float invLen = 1.0f / length(blendReal);
+	blendReal *= invLen;
+	blendDual *= invLen;
+
+	vec3 posL = dqTransformPoint(blendReal, blendDual, inPosL);
+	vec3 normalL = quatRotate(blendReal, inNormalL);
+	vec3 tangentL = quatRotate(blendReal, inTangentL);
+	
+	
+	
+    //vin.PosL = posL;
+    //vin.NormalL = normalL;
+    //vin.TangentL.xyz = tangentL;
+	
+	// Transform to world space.
+    //float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    //vout.PosW = posW.xyz;
+	vec4 posW = world * vec4(posL,1.0);
+	
+	
+	// Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
+    //vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+	outNormalW = mat3(world)*normalL;
+		
+	//vout.TangentW = mul(vin.TangentL, (float3x3)gWorld);
+	outTangentW = mat3(world)*tangentL;
+	
+	// Transform to homogeneous clip space.
+    //float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    //vout.PosH = mul(posW, gViewProj);
+	
+	gl_Position = viewProj * posW;
+	
+	// Output vertex attributes for interpolation across triangle.
+	//float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	//vout.TexC = mul(texC, matData.MatTransform).xy;
+	vec4 texC = texTransform * vec4(inTexC,0.0f,1.0f);
+	outTexC = (matData.MatTransform*texC).xy;
+	
+ }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#version 450
+
+layout(location=0) in vec3 inPosL;
+layout(location=1) in vec3 inNormalL;
+layout(location=2) in vec2 inTexC;
+layout(location=3) in vec3 inTangentL;
+layout(location=4) in vec3 inBoneWeights;
+layout(location=5) in ivec4 inBoneIndices;
+layout(location=0) out vec3 outPosW;
+layout(location=1) out vec4 outShadowPosH;
+layout(location=2) out vec4 outSsaoPosH;
+layout(location=3) out vec3 outNormalW;
+layout(location=4) out vec3 outTangentW;
+layout(location=5) out vec2 outTexC;
+
+layout (set=0, binding=0) uniform ObjectCB{
+	mat4 world;	
+	mat4 texTransform;
+	uint materialIndex;
+	uint gObjPad0;
+	uint gObjPad1;
+	uint gObjPad2;
+};
+
+//Baked vertex animation texture, see AnimationBaker.h
+struct CrowdInstance{
+	mat4 instanceWorld;
+	uint layer;
+	uint frameCount;
+	float duration;
+	float timeOffset;
+};
+
+layout(set=1,binding=0) readonly buffer CrowdBuffer{
+	uint vatMode;	//0 = bone matrices, 1 = skinned vertices
+	uint vatWidth;
+	uint vatRowsPerFrame;
+	uint vatPad0;
+	CrowdInstance instances[];
+};
+layout(set=1,binding=1) uniform sampler2DArray vatMap;
+
+struct Light
+{
+    vec3 Strength;
+    float FalloffStart; // point/spot light only
+    vec3 Direction;   // directional/spot light only
+    float FalloffEnd;   // point/spot light only
+    vec3 Position;    // point light only
+    float SpotPower;    // spot light only
+};
+#define MAX_LIGHTS 16
+
+
+layout (set=2,binding=0) uniform PassCB{
+	mat4 view;
+	mat4 invView;
+	mat4 proj;
+	mat4 invProj;
+	mat4 viewProj;
+	mat4 invViewProj;
+	mat4 viewProjTex;
+	mat4 shadowTransform;
+	vec3 eyePosW;
+	float cbPerObjPad1;
+	vec2 RenderTargetSize;
+	vec2 InvRenderTargetSize;
+	float NearZ;
+	float FarZ;
+	float TotalTime;
+	float DeltaTime;
+	vec4 ambientLight;
+
+	Light gLights[MAX_LIGHTS];
+};
+
+
+
+
+struct MaterialData
+{
+	vec4   DiffuseAlbedo;
+	vec3   FresnelR0;
+	float    Roughness;
+	mat4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     NormalMapIndex;
+	uint     MatPad1;
+	uint     MatPad2;
+};
+
+layout (set=3, binding=0) readonly buffer MaterialBuffer{
+	MaterialData materials[];
+}materialData;
+
+vec4 fetchTexel(uint index, uint frame, uint layer){
+	uint x = index % vatWidth;
+	uint y = frame * vatRowsPerFrame + index / vatWidth;
+	return texelFetch(vatMap, ivec3(x, y, layer), 0);
+}
+
+//rows of the 3x4 bone transform
+mat4 fetchBone(uint bone, uint frame, uint layer){
+	vec4 r0 = fetchTexel(bone * 3 + 0, frame, layer);
+	vec4 r1 = fetchTexel(bone * 3 + 1, frame, layer);
+	vec4 r2 = fetchTexel(bone * 3 + 2, frame, layer);
+	return transpose(mat4(r0, r1, r2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main(){
+	MaterialData matData = materialData.materials[materialIndex];
+	CrowdInstance inst = instances[gl_InstanceIndex];
+
+	//loop the clip, blend the two nearest baked frames. The baker writes at least two,
+	//a zero length clip just holds its first
+	uint frameCount = max(inst.frameCount, 2u);
+	float phase = inst.duration > 0.0 ? fract((TotalTime + inst.timeOffset) / inst.duration) : 0.0;
+	float frameF = phase * float(frameCount - 1);
+	uint frame0 = min(uint(frameF), frameCount - 2);
+	uint frame1 = frame0 + 1;
+	float lerpPercent = frameF - float(frame0);
+
+	vec3 posL = vec3(0.0f, 0.0f, 0.0f);
+	vec3 normalL = vec3(0.0f, 0.0f, 0.0f);
+	vec3 tangentL = vec3(0.0f, 0.0f, 0.0f);
+	if(vatMode == 0){
+		float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		weights[0] = inBoneWeights.x;
+		weights[1] = inBoneWeights.y;
+		weights[2] = inBoneWeights.z;
+		weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+		for(int i = 0; i < 4; ++i)
+		{
+			mat4 bone0 = fetchBone(uint(inBoneIndices[i]), frame0, inst.layer);
+			mat4 bone1 = fetchBone(uint(inBoneIndices[i]), frame1, inst.layer);
+			mat4 boneTransform = bone0 * (1.0 - lerpPercent) + bone1 * lerpPercent;
+			posL += weights[i] * (boneTransform*vec4(inPosL,1.0f)).xyz;
+			normalL += weights[i] * (mat3(boneTransform)*inNormalL);
+			tangentL += weights[i]*(mat3(boneTransform)*inTangentL.xyz);
+		}
+	}
+	else{
+		uint v = uint(gl_VertexIndex);
+		posL = mix(fetchTexel(v, frame0, inst.layer).xyz, fetchTexel(v, frame1, inst.layer).xyz, lerpPercent);
+		normalL = mix(fetchTexel(v, frame0, inst.layer + 1).xyz, fetchTexel(v, frame1, inst.layer + 1).xyz, lerpPercent);
+		//tangents aren't baked, keep the bind pose one orthogonal to the animated normal
+		tangentL = inTangentL - dot(inTangentL, normalL) * normalL / max(dot(normalL, normalL), 1e-6);
+	}
+
+	// Transform to world space, the render item's world holds the model's base transform.
+	mat4 instWorld = inst.instanceWorld * world;
+	vec4 posW = instWorld * vec4(posL,1.0);
+	outPosW = posW.xyz;
+	
+	outNormalW = mat3(instWorld)*normalL;
+	outTangentW = mat3(instWorld)*tangentL;
+
+	gl_Position = viewProj * posW;
+	
+	outSsaoPosH = viewProjTex * vec4(outPosW,1.0);
+	
+    vec4 texC = texTransform  *vec4(inTexC, 0.0f, 1.0f);	
+    outTexC = (matData.MatTransform*texC).xy;
+	
+    outShadowPosH = shadowTransform*vec4(outPosW,1.0);
+}
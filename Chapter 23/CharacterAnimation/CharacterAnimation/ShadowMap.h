@@ -13,9 +13,7 @@ class ShadowMap : public VulkanObject {
 	uint32_t width{ 0 };
 	uint32_t height{ 0 };
 	VkFormat format = VK_FORMAT_D32_SFLOAT;
-	std::unique_ptr<VulkanTexture> shadowMap;
-	std::unique_ptr<VulkanFramebuffer> frameBuffer;
-	std::unique_ptr<VulkanRenderPass> renderPass;
+	std::unique_ptr<VulkanTexture> shadowMap;	//the render graph draws it
 	void BuildResource();
 public:
 	ShadowMap(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_, VkQueue queue_, VkCommandBuffer cmd_, uint32_t width, uint32_t height);
@@ -26,8 +24,8 @@ public:
 	VkRect2D ScissorRect()const { return scissorRect; }
 	uint32_t Width()const { return width; }
 	uint32_t Height()const { return height; }
-	VkRenderPass getRenderPass()const { return renderPass->operator VkRenderPass(); }
-	VkFramebuffer getFramebuffer()const { return frameBuffer->operator VkFramebuffer(); }
+	VkFormat Format()const { return format; }
+	VkImage getImage()const { return shadowMap->operator VkImage(); }
 	VkImageView getRenderTargetView()const { return shadowMap->operator VkImageView(); }
 	VkSampler getRenderTargetSampler()const { return shadowMap->operator VkSampler(); }
 };
\ No newline at end of file
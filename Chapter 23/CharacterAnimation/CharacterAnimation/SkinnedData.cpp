@@ -147,4 +147,28 @@ void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,
 		finalTransforms[i] = finalTransform;
 		//XMStoreFloat4x4(&finalTransforms[i], XMMatrixTranspose(finalTransform));
 	}
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos, std::vector<glm::mat2x4>& finalDualQuats)const
+{
+	uint32_t numBones = (uint32_t)mBoneOffsets.size();
+
+	std::vector<glm::mat4> finalTransforms(numBones);
+	GetFinalTransforms(clipName, timePos, finalTransforms);
+
+	for (uint32_t i = 0; i < numBones; ++i)
+	{
+		const glm::mat4& m = finalTransforms[i];
+
+		// Strip any scale so quat_cast sees a pure rotation.
+		glm::mat3 rot = glm::mat3(glm::normalize(glm::vec3(m[0])), glm::normalize(glm::vec3(m[1])), glm::normalize(glm::vec3(m[2])));
+		glm::quat real = glm::normalize(glm::quat_cast(rot));
+		glm::vec3 t = glm::vec3(m[3]);
+
+		// dual = 0.5 * (0,t) * real
+		glm::quat dual = glm::quat(0.0f, t.x, t.y, t.z) * real * 0.5f;
+
+		finalDualQuats[i][0] = glm::vec4(real.x, real.y, real.z, real.w);
+		finalDualQuats[i][1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+	}
 }
\ No newline at end of file
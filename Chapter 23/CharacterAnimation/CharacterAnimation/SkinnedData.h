@@ -69,6 +69,17 @@ public:
 	void GetFinalTransforms(const std::string& clipName, float timePos,
 		std::vector<glm::mat4>& finalTransforms)const;
 
+	// Dual quaternion palette, 2 vec4s per bone: column 0 is the real (rotation)
+	// part, column 1 the dual (translation) part, both stored x,y,z,w.
+	// Bone transforms are assumed to be rigid; any scale is dropped.
+	void GetFinalTransforms(const std::string& clipName, float timePos,
+		std::vector<glm::mat2x4>& finalDualQuats)const;
+
+	// Raw access for systems that repack the animation data, e.g. GpuAnimation.
+	const std::vector<int>& BoneHierarchy()const { return mBoneHierarchy; }
+	const std::vector<glm::mat4>& BoneOffsets()const { return mBoneOffsets; }
+	const std::unordered_map<std::string, AnimationClip>& Animations()const { return mAnimations; }
+
 private:
 	// Gives parentIndex of ith bone.
 	std::vector<int> mBoneHierarchy;
@@ -6,21 +6,45 @@
 #include "../../../Common/Colors.h"
 #include "../../../Common/TextureLoader.h"
 #include "../../../Common/Camera.h"
+#include "../../../Common/RenderGraph.h"
 #include <memory>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <future>
+#include <chrono>
 #include "FrameResource.h"
 #include "ShadowMap.h"
 #include "Ssao.h"
 #include "SkinnedData.h"
 #include "LoadM3d.h"
+#include "GpuAnimation.h"
+#include "AnimationBaker.h"
 
 
 
 
-const int gNumFrameResources = 3;
+//Frame resources, one per frame slot; set to mMaxFrames once VulkApp::Initialize has read -frames.
+int gNumFrameResources = 3;
+// Background crowd drawn from the baked vertex animation texture.
+const uint32_t gCrowdRows = 8;
+const uint32_t gCrowdCols = 8;
+
+// Must match Shaders/vatcrowd.vert (std430).
+struct CrowdHeader {
+	uint32_t VatMode;
+	uint32_t VatWidth;
+	uint32_t VatRowsPerFrame;
+	uint32_t pad0;
+};
+
+struct CrowdInstance {
+	glm::mat4 InstanceWorld;
+	uint32_t Layer;
+	uint32_t FrameCount;
+	float Duration;
+	float TimeOffset;
+};
 //
 //class PipelineLayoutCache : public VulkanObject {
 //	struct PipelineLayoutInfo {
@@ -98,6 +122,11 @@ struct Descriptors{
 	VkDescriptorSet cubeMapDescriptorSet{ VK_NULL_HANDLE };
 	VkDescriptorSet shadowMapDescriptorSet{ VK_NULL_HANDLE };
 	VkDescriptorSet ssaoMapDescriptorSet{ VK_NULL_HANDLE };
+	//not bound with the sets above, boneDescriptorSet is pointed at one of these
+	VkDescriptorSet cpuBoneDescriptorSet{ VK_NULL_HANDLE };
+	VkDescriptorSet gpuBoneDescriptorSet{ VK_NULL_HANDLE };
+	VkDescriptorSet animationDescriptorSet{ VK_NULL_HANDLE };
+	VkDescriptorSet vatDescriptorSet{ VK_NULL_HANDLE };
 };
 
 struct SkinnedModelInstance
@@ -106,9 +135,20 @@ struct SkinnedModelInstance
 
     SkinnedData* SkinnedInfo = nullptr;
     std::vector<glm::mat4> FinalTransforms;
+    std::vector<glm::mat2x4> FinalDualQuats;
     std::string ClipName;
     float TimePos = 0.0f;
 
+    // Skin with dual quaternions instead of linear blend skinning. Selects
+    // the skinned_dq_* pipelines and uploads a 2 x vec4 per bone palette.
+    // Dual quaternions only carry rotation and translation, any bone scale
+    // is dropped. Held down with the 5 key.
+    bool UseDualQuaternions = false;
+
+    // Palette is built by the animate.comp compute pass, only the time
+    // position is advanced here.
+    bool EvaluateOnGpu = false;
+
     // Called every frame and increments the time position, interpolates the 
     // animations for each bone based on the current animation clip, and 
     // generates the final transforms which are ultimately set to the effect
@@ -122,7 +162,12 @@ struct SkinnedModelInstance
             TimePos = 0.0f;
 
         // Compute the final transforms for this time position.
-        SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalTransforms);
+        if (EvaluateOnGpu)
+            return;
+        if (UseDualQuaternions)
+            SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalDualQuats);
+        else
+            SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalTransforms);
     }
 };
 
@@ -146,6 +191,7 @@ struct RenderItem {
 	uint32_t IndexCount{ 0 };
 	uint32_t StartIndexLocation{ 0 };
 	uint32_t BaseVertexLocation{ 0 };
+	uint32_t InstanceCount{ 1 };
 
     // Only applicable to skinned render-items.
     uint32_t SkinnedCBIndex = -1;
@@ -158,6 +204,8 @@ enum class RenderLayer : int
 {
     Opaque = 0,
     SkinnedOpaque,
+    SkinnedOpaqueDQ,
+    VatCrowd,
     Debug,
     Sky,
     Count
@@ -210,6 +258,26 @@ class SkinnedMeshApp : public VulkApp
 	std::unique_ptr<VulkanPipeline> drawNormalsPipeline;
 	std::unique_ptr<VulkanPipeline> skinnedDrawNormalsPipeline;
 
+	std::unique_ptr<VulkanPipeline> skinnedDQOpaquePipeline;
+	std::unique_ptr<VulkanPipeline> skinnedDQWireframePipeline;
+	std::unique_ptr<VulkanPipeline> skinnedDQOpaqueFlatPipeline;
+	std::unique_ptr<VulkanPipeline> skinnedDQNoSsaoPipeline;
+	std::unique_ptr<VulkanPipeline> skinnedDQShadowPipeline;
+	std::unique_ptr<VulkanPipeline> skinnedDQDrawNormalsPipeline;
+
+	std::unique_ptr<VulkanPipelineLayout> animationPipelineLayout;
+	std::unique_ptr<VulkanPipeline> animationPipeline;
+
+	std::unique_ptr<VulkanImage> vatTexture;
+	std::unique_ptr<VulkanUniformBuffer> crowdBuffer;
+	std::unique_ptr<VulkanPipelineLayout> vatPipelineLayout;
+	std::unique_ptr<VulkanPipeline> vatCrowdPipeline;
+	std::unique_ptr<VulkanPipeline> vatCrowdNoSsaoPipeline;
+	std::unique_ptr<VulkanPipeline> vatCrowdFlatPipeline;
+	std::unique_ptr<VulkanPipeline> vatCrowdWireframePipeline;
+	std::unique_ptr<VulkanPipeline> vatCrowdShadowPipeline;
+	std::unique_ptr<VulkanPipeline> vatCrowdDrawNormalsPipeline;
+
 	Descriptors descriptorSets;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
@@ -220,6 +288,8 @@ class SkinnedMeshApp : public VulkApp
 	bool mIsWireframe{ false };
 	bool mIsFlatShader{ false };
 	bool mNoSsao{ false };
+	bool mUseGpuAnimation{ true };//evaluate skinned palettes in animate.comp, the 6 key falls back to the cpu
+	bool mDrawVatCrowd{ true };//instanced crowd animated from mVat
 
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
@@ -234,6 +304,8 @@ class SkinnedMeshApp : public VulkApp
 
 	std::unique_ptr<SkinnedModelInstance> mSkinnedModelInst;
 	SkinnedData mSkinnedInfo;
+	std::unique_ptr<GpuAnimation> mGpuAnimation;
+	VertexAnimationTexture mVat;
 	std::vector<M3DLoader::Subset> mSkinnedSubsets;
 	std::vector<M3DLoader::M3dMaterial> mSkinnedMats;
 	std::vector<std::string> mSkinnedTextureNames;
@@ -244,6 +316,14 @@ class SkinnedMeshApp : public VulkApp
 
 	std::unique_ptr<Ssao> mSsao;
 
+	//the frame's passes in the order they are declared to the render graph
+	enum Pass { Shadow, Normals, SsaoMap, BlurHorz, BlurVert, Main, PassCount };
+	std::unique_ptr<RenderGraph> mRenderGraph;
+	RenderGraph::Resource mNormalMap{ 0 };
+	RenderGraph::Resource mAmbientMapRaw{ 0 };	//ssao output
+	RenderGraph::Resource mAmbientMapTemp{ 0 };	//blurred horizontally
+	RenderGraph::Resource mAmbientMap{ 0 };		//blurred both ways, what the main pass samples
+
 	Sphere mSceneBounds;
 
 	float mLightNearZ = 0.0f;
@@ -282,8 +362,10 @@ class SkinnedMeshApp : public VulkApp
 	void AnimateMaterials(const GameTimer& gt);
 
 	void LoadTextures();
+	void BuildRenderGraph();
 	void LoadSkinnedModel();
 	void BuildBuffers();
+	void BuildVatCrowd();
 	void BuildDescriptors();
 	void BuildPSOs();
 	void BuildFrameResources();
@@ -293,6 +375,7 @@ class SkinnedMeshApp : public VulkApp
 	void DrawRenderItems(VkCommandBuffer, VkPipelineLayout layout, const std::vector<RenderItem*>& ritems);
 	void DrawSceneToShadowMap();
 	void DrawNormalsAndDepth();
+	void DrawVatCrowd(VkCommandBuffer cmd, const char* pso, VkPipelineLayout layout, uint32_t setCount, uint32_t* dynamicOffsets);
 
 public:
 	SkinnedMeshApp(HINSTANCE hInstance);
@@ -333,25 +416,97 @@ SkinnedMeshApp::~SkinnedMeshApp() {
 bool SkinnedMeshApp::Initialize() {
 	if (!VulkApp::Initialize())
 		return false;
+	gNumFrameResources = (int)mMaxFrames;
 
 
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
 
-	mSsao = std::make_unique<Ssao>(mDevice, mMemoryProperties, mBackQueue, mCommandBuffer, mDepthImage.imageView, mDepthFormat, mClientWidth, mClientHeight);
+	mSsao = std::make_unique<Ssao>(mDevice, mMemoryProperties, mBackQueue, mCommandBuffer, mClientWidth, mClientHeight);
 	mShadowMap = std::make_unique<ShadowMap>(mDevice, mMemoryProperties, mBackQueue, mCommandBuffer, 2048, 2048);
+	BuildRenderGraph();
 
 	LoadSkinnedModel();
+	mGpuAnimation = std::make_unique<GpuAnimation>(mDevice, mDeviceProperties, mMemoryProperties, mBackQueue, mCommandBuffer, mSkinnedInfo, 1, mMaxFrames);
+	mSkinnedModelInst->EvaluateOnGpu = mUseGpuAnimation && !mSkinnedModelInst->UseDualQuaternions;//compute pass only builds matrix palettes
+#ifdef _DEBUG
+	{
+		//the compute pass' CPU reference must agree with SkinnedData
+		std::vector<glm::mat4> reference(mSkinnedInfo.BoneCount());
+		std::vector<glm::mat4> palette;
+		uint32_t clipIndex = mGpuAnimation->ClipIndex(mSkinnedModelInst->ClipName);
+		float endTime = mSkinnedInfo.GetClipEndTime(mSkinnedModelInst->ClipName);
+		for (int i = 0; i <= 16; ++i) {
+			float t = endTime * i / 16.0f;
+			mSkinnedInfo.GetFinalTransforms(mSkinnedModelInst->ClipName, t, reference);
+			mGpuAnimation->EvaluatePalette(clipIndex, t, palette);
+			for (size_t b = 0; b < reference.size(); ++b)
+				for (int c = 0; c < 4; ++c)
+					assert(glm::all(glm::lessThan(glm::abs(reference[b][c] - palette[b][c]), glm::vec4(1e-3f))));
+		}
+	}
+#endif
 	LoadTextures();
 	BuildShapeGeometry();	
 	BuildMaterials();
 	BuildRenderItems();
 	BuildBuffers();
+	BuildVatCrowd();
 	BuildDescriptors();
 	BuildPSOs();
 	BuildFrameResources();
 	return true;
 }
 
+void SkinnedMeshApp::BuildRenderGraph() {
+	mRenderGraph = std::make_unique<RenderGraph>(mDevice, mMemoryProperties);
+	RenderGraph& graph = *mRenderGraph;
+	RenderGraph::Resource shadowMap = graph.ImportImage("shadow map", mShadowMap->getImage(), mShadowMap->getRenderTargetView(), mShadowMap->Format(), mShadowMap->Width(), mShadowMap->Height(), VK_IMAGE_LAYOUT_UNDEFINED);
+	RenderGraph::Resource depth = graph.ImportImage("depth", mDepthImage.image, mDepthImage.imageView, mDepthFormat, mClientWidth, mClientHeight, VK_IMAGE_LAYOUT_UNDEFINED);
+	mNormalMap = graph.CreateImage("normal map", Ssao::NormalMapFormat, mSsao->NormalMapWidth(), mSsao->NormalMapHeight());
+	//three ambient maps rather than ping-ponging two, lifetimes the graph can see and alias
+	mAmbientMapRaw = graph.CreateImage("ambient map", Ssao::AmbientMapFormat, mSsao->SsaoMapWidth(), mSsao->SsaoMapHeight());
+	mAmbientMapTemp = graph.CreateImage("ambient map blurred horizontally", Ssao::AmbientMapFormat, mSsao->SsaoMapWidth(), mSsao->SsaoMapHeight());
+	mAmbientMap = graph.CreateImage("ambient map blurred", Ssao::AmbientMapFormat, mSsao->SsaoMapWidth(), mSsao->SsaoMapHeight());
+
+	VkClearDepthStencilValue depthClear = { 1.0f,0 };
+	VkClearColorValue normalClear = { 0.0f,0.0f,1.0f,0.0f };
+	RenderGraph::Pass pass = graph.AddPass("shadow")
+		.WriteDepth(shadowMap, &depthClear);
+	assert(pass == Shadow);
+	pass = graph.AddPass("normals")
+		.WriteColor(mNormalMap, &normalClear)
+		.WriteDepth(depth, &depthClear);
+	assert(pass == Normals);
+	//the ssao and blur passes cover every pixel, no need to clear
+	pass = graph.AddPass("ssao")
+		.Read(mNormalMap)
+		.Read(depth)
+		.WriteColor(mAmbientMapRaw);
+	assert(pass == SsaoMap);
+	pass = graph.AddPass("blur horizontally")
+		.Read(mAmbientMapRaw)
+		.WriteColor(mAmbientMapTemp);
+	assert(pass == BlurHorz);
+	pass = graph.AddPass("blur vertically")
+		.Read(mAmbientMapTemp)
+		.WriteColor(mAmbientMap);
+	assert(pass == BlurVert);
+	//the app's render pass to the swapchain, the skinned passes before it all draw inline
+	pass = graph.AddPass("main", true)
+		.Read(shadowMap)
+		.Read(mAmbientMap)
+		.WriteDepth(depth)
+		.SideEffect();
+	assert(pass == Main);
+	(void)pass;
+	graph.Compile();
+
+	std::wostringstream outs;
+	outs << mMainWndCaption << L"    " << graph.BarrierCount() << L" barriers in " << graph.BarrierBatches() << L" batches per frame, transients "
+		<< graph.AllocatedBytes() / 1024 << L" KB (" << (graph.TransientBytes() - graph.AllocatedBytes()) / 1024 << L" KB saved by aliasing)";
+	mMainWndCaption = outs.str();
+}
+
 void SkinnedMeshApp::LoadSkinnedModel()
 {
 	std::vector<M3DLoader::SkinnedVertex> vertices;
@@ -364,8 +519,21 @@ void SkinnedMeshApp::LoadSkinnedModel()
 	mSkinnedModelInst = std::make_unique<SkinnedModelInstance>();
 	mSkinnedModelInst->SkinnedInfo = &mSkinnedInfo;
 	mSkinnedModelInst->FinalTransforms.resize(mSkinnedInfo.BoneCount());
+	mSkinnedModelInst->FinalDualQuats.resize(mSkinnedInfo.BoneCount());
 	mSkinnedModelInst->ClipName = "Take1";
 	mSkinnedModelInst->TimePos = 0.0f;
+	mSkinnedModelInst->UseDualQuaternions = false;//linear blend skinning by default
+
+	// Crowd animation texture, baked offline with -bakevat, or here on first run or when the
+	// file on disk doesn't fit this model.
+	// vatcrowd.vert reads bone matrices, 3 texels per bone.
+	bool vatFits = AnimationBaker::Load("Models\\soldier.vat", mVat) && mVat.Mode == VatMode::BoneMatrices &&
+		mVat.FindClip(mSkinnedModelInst->ClipName) != nullptr && mVat.Width * mVat.RowsPerFrame >= mSkinnedInfo.BoneCount() * 3;
+	if (!vatFits) {
+		AnimationBaker baker(30.0f);
+		baker.BakeBoneMatrices(mSkinnedInfo, mVat);
+		AnimationBaker::Save("Models\\soldier.vat", mVat);
+	}
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(SkinnedVertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
@@ -484,6 +652,67 @@ void SkinnedMeshApp::BuildBuffers() {
 	storageBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, dynamicBuffer, bufferInfo);
 }
 
+void SkinnedMeshApp::BuildVatCrowd() {
+	//upload every baked layer to one RGBA32F texture array
+	Vulkan::ImageProperties props;
+	props.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	props.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	props.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	props.width = mVat.Width;
+	props.height = mVat.Height;
+	props.layers = mVat.LayerCount;
+	Vulkan::Image image;
+	Vulkan::initImage(mDevice, mMemoryProperties, props, image);
+
+	VkDeviceSize buffSize = mVat.LayerByteSize() * mVat.LayerCount;
+	Vulkan::Buffer stagingBuffer = StagingBufferBuilder::begin(mDevice, mMemoryProperties)
+		.setSize(buffSize)
+		.build();
+	uint8_t* ptr = (uint8_t*)Vulkan::mapBuffer(mDevice, stagingBuffer);
+	memcpy(ptr, mVat.Texels.data(), buffSize);
+	Vulkan::transitionImage(mDevice, mBackQueue, mCommandBuffer, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, mVat.LayerCount);
+	std::vector<VkBufferImageCopy> copyRegions(1);
+	copyRegions[0].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copyRegions[0].imageSubresource.layerCount = mVat.LayerCount;//layers are contiguous in Texels
+	copyRegions[0].imageExtent = { mVat.Width, mVat.Height, 1 };
+	Vulkan::CopyBufferToImage(mDevice, mBackQueue, mCommandBuffer, stagingBuffer, image, copyRegions);
+	Vulkan::transitionImage(mDevice, mBackQueue, mCommandBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, mVat.LayerCount);
+	Vulkan::unmapBuffer(mDevice, stagingBuffer);
+	Vulkan::cleanupBuffer(mDevice, stagingBuffer);
+	vatTexture = std::make_unique<VulkanImage>(mDevice, image);
+
+	//instance data never changes, the shader derives the frame from TotalTime
+	uint32_t crowdCount = gCrowdRows * gCrowdCols;
+	Vulkan::Buffer buffer;
+	std::vector<UniformBufferInfo> bufferInfo;
+	UniformBufferBuilder::begin(mDevice, mDeviceProperties, mMemoryProperties, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, true)
+		.AddBuffer(sizeof(CrowdHeader) + sizeof(CrowdInstance) * crowdCount, 1, 1)
+		.build(buffer, bufferInfo);
+	crowdBuffer = std::make_unique<VulkanUniformBuffer>(mDevice, buffer, bufferInfo);
+
+	auto& cb = *crowdBuffer;
+	CrowdHeader* header = (CrowdHeader*)cb[0].ptr;
+	header->VatMode = (uint32_t)mVat.Mode;
+	header->VatWidth = mVat.Width;
+	header->VatRowsPerFrame = mVat.RowsPerFrame;
+	header->pad0 = 0;
+	const VatClip* clip = mVat.FindClip(mSkinnedModelInst->ClipName);
+	assert(clip != nullptr);
+	CrowdInstance* instances = (CrowdInstance*)(header + 1);
+	for (uint32_t r = 0; r < gCrowdRows; ++r) {
+		for (uint32_t c = 0; c < gCrowdCols; ++c) {
+			CrowdInstance& inst = instances[r * gCrowdCols + c];
+			float x = (c - (gCrowdCols - 1) * 0.5f) * 3.0f;
+			float z = 12.0f + r * 3.0f;
+			inst.InstanceWorld = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+			inst.Layer = clip->Layer;
+			inst.FrameCount = clip->FrameCount;
+			inst.Duration = clip->Duration;
+			inst.TimeOffset = MathHelper::RandF() * clip->Duration;//out of step
+		}
+	}
+}
+
 void SkinnedMeshApp::BuildDescriptors() {
 	descriptorSetPoolCache = std::make_unique<DescriptorSetPoolCache>(mDevice); 
 	descriptorSetLayoutCache = std::make_unique<DescriptorSetLayoutCache>(mDevice);
@@ -591,7 +820,12 @@ void SkinnedMeshApp::BuildDescriptors() {
 	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
 		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
 		.build(ssaoAmbientMap1Set, ssaoAmbientMap1SetLayout);
-	descriptors = { ssaoNormalMapSet,ssaoDepthMapSet,ssaoRandomVecMapSet,ssaoAmbientMap1Set};
+	VkDescriptorSet ssaoAmbientMapRawSet = VK_NULL_HANDLE;
+	VkDescriptorSetLayout ssaoAmbientMapRawSetLayout = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, (uint32_t)1)
+		.build(ssaoAmbientMapRawSet, ssaoAmbientMapRawSetLayout);
+	descriptors = { ssaoNormalMapSet,ssaoDepthMapSet,ssaoRandomVecMapSet,ssaoAmbientMap1Set,ssaoAmbientMapRawSet };
 	ssaoTextureDescriptors = std::make_unique<VulkanDescriptorList>(mDevice, descriptors);
 
 	VkDeviceSize offset = 0;
@@ -623,6 +857,64 @@ void SkinnedMeshApp::BuildDescriptors() {
 			.update();
 	}
 
+	//gpu animation: second bone set reading the compute written palette, same layout as the cpu one
+	VkDescriptorSet gpuBoneDescriptorSet = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
+		.build(gpuBoneDescriptorSet, boneDescriptorSetLayout);
+	{
+		VkDescriptorBufferInfo descrInfo{};
+		mGpuAnimation->GetPaletteDescriptor(descrInfo);
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), boneDescriptorSetLayout, gpuBoneDescriptorSet)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &descrInfo)
+			.update();
+	}
+
+	VkDescriptorSet animationDescriptorSet = VK_NULL_HANDLE;
+	VkDescriptorSetLayout animationDescriptorSetLayout = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build(animationDescriptorSet, animationDescriptorSetLayout);
+	{
+		VkDescriptorBufferInfo descrInfo[6]{};
+		mGpuAnimation->GetComputeDescriptors(descrInfo);
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), animationDescriptorSetLayout, animationDescriptorSet)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[0])
+			.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[1])
+			.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[2])
+			.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[3])
+			.AddBinding(4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &descrInfo[4])
+			.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo[5])
+			.update();
+	}
+
+	//vat crowd: instance buffer and the baked animation texture, replaces the bone set
+	VkDescriptorSet vatDescriptorSet = VK_NULL_HANDLE;
+	VkDescriptorSetLayout vatDescriptorSetLayout = VK_NULL_HANDLE;
+	DescriptorSetBuilder::begin(descriptorSetPoolCache.get(), descriptorSetLayoutCache.get())
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_VERTEX_BIT)
+		.build(vatDescriptorSet, vatDescriptorSetLayout);
+	{
+		auto& cb = *crowdBuffer;
+		VkDescriptorBufferInfo descrInfo{};
+		descrInfo.buffer = cb;
+		descrInfo.range = cb[0].objectCount * cb[0].objectSize * cb[0].repeatCount;
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = *vatTexture;
+		imageInfo.sampler = *sampler;//texelFetch ignores the sampler state
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), vatDescriptorSetLayout, vatDescriptorSet)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &descrInfo)
+			.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
+			.update();
+	}
+
 	//update texture array 
 	{
 		auto& samp = *sampler;
@@ -673,8 +965,8 @@ void SkinnedMeshApp::BuildDescriptors() {
 	{
 		VkDescriptorImageInfo imageInfo{};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getSsaoImageView(0);
-		imageInfo.sampler = mSsao->getSsaoImageSampler(0);
+		imageInfo.imageView = mRenderGraph->GetImageView(mAmbientMap);
+		imageInfo.sampler = mSsao->getMapSampler();
 		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), ssaoAmbientMap0SetLayout, ssaoAmbientMap0Set)
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
 			.update();
@@ -683,17 +975,22 @@ void SkinnedMeshApp::BuildDescriptors() {
 	{
 		VkDescriptorImageInfo imageInfo{};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getSsaoImageView(1);
-		imageInfo.sampler = mSsao->getSsaoImageSampler(1);
+		imageInfo.imageView = mRenderGraph->GetImageView(mAmbientMapTemp);
+		imageInfo.sampler = mSsao->getMapSampler();
 		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), ssaoAmbientMap1SetLayout, ssaoAmbientMap1Set)
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
 			.update();
+
+		imageInfo.imageView = mRenderGraph->GetImageView(mAmbientMapRaw);
+		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), ssaoAmbientMapRawSetLayout, ssaoAmbientMapRawSet)
+			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
+			.update();
 	}
 	{
 		VkDescriptorImageInfo imageInfo{};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = mSsao->getNormalMapImageView();
-		imageInfo.sampler = mSsao->getNormalMapSampler();
+		imageInfo.imageView = mRenderGraph->GetImageView(mNormalMap);
+		imageInfo.sampler = mSsao->getMapSampler();
 		DescriptorSetUpdater::begin(descriptorSetLayoutCache.get(), ssaoNormalMapSetLayout, ssaoNormalMapSet)
 			.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, (uint32_t)1)
 			.update();
@@ -775,6 +1072,15 @@ void SkinnedMeshApp::BuildDescriptors() {
 	descriptorSets.cubeMapDescriptorSet = cubeMapDescriptorSet;
 	descriptorSets.shadowMapDescriptorSet = shadowDescriptorSet;
 	descriptorSets.ssaoMapDescriptorSet = ssaoAmbientMap0Set;
+	descriptorSets.cpuBoneDescriptorSet = boneDescriptorSet;
+	descriptorSets.gpuBoneDescriptorSet = gpuBoneDescriptorSet;
+	descriptorSets.animationDescriptorSet = animationDescriptorSet;
+	descriptorSets.vatDescriptorSet = vatDescriptorSet;
+
+	PipelineLayoutBuilder::begin(mDevice)
+		.AddDescriptorSetLayout(animationDescriptorSetLayout)
+		.build(layout);
+	animationPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
 
 	PipelineLayoutBuilder::begin(mDevice)
 		.AddDescriptorSetLayout(objectDescriptorSetLayout)
@@ -788,6 +1094,18 @@ void SkinnedMeshApp::BuildDescriptors() {
 		.build(layout);
 	debugPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
 
+	PipelineLayoutBuilder::begin(mDevice)
+		.AddDescriptorSetLayout(objectDescriptorSetLayout)
+		.AddDescriptorSetLayout(vatDescriptorSetLayout)
+		.AddDescriptorSetLayout(passCBDescriptorSetLayout)
+		.AddDescriptorSetLayout(materialDescriptorSetLayout)
+		.AddDescriptorSetLayout(textureArraySetLayout)
+		.AddDescriptorSetLayout(cubeMapDescriptorSetLayout)
+		.AddDescriptorSetLayout(shadowDescriptorSetLayout)
+		.AddDescriptorSetLayout(ssaoAmbientMap0SetLayout)
+		.build(layout);
+	vatPipelineLayout = std::make_unique<VulkanPipelineLayout>(mDevice, layout);
+
 	PipelineLayoutBuilder::begin(mDevice)
 		.AddDescriptorSetLayout(ssaoCBDescriptorSetLayout)
 		.AddDescriptorSetLayout(ssaoNormalMapSetLayout)
@@ -809,302 +1127,212 @@ void SkinnedMeshApp::BuildDescriptors() {
 }
 
 void SkinnedMeshApp::BuildPSOs() {
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/default.vert.spv")
-			.AddShaderPath("Shaders/default.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-
-
-		VkPipeline pipeline{ VK_NULL_HANDLE };
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		opaquePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaque"] = *opaquePipeline;
-
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		opaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaqueFlat"] = *opaqueFlatPipeline;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		noSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaqueNoSsao"] = *noSsaoPipeline;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_LINE)
-			.setDepthTest(VK_TRUE)
-			.build(pipeline);
-		wireframePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["opaque_wireframe"] = *wireframePipeline;
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
+	//none of the pipelines depend on each other, compile them all at once on worker threads
+	//through the app's pipeline cache, a warm start mostly just reads them back
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	struct ShaderProgram {
 		std::vector<Vulkan::ShaderModule> shaders;
 		VkVertexInputBindingDescription vertexInputDescription = {};
 		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
+	};
+	auto load = [&](ShaderProgram& program, const char* vert, const char* frag) {
 		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/defaultskinned.vert.spv")
-			.AddShaderPath("Shaders/defaultskinned.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-
-
-		VkPipeline pipeline{ VK_NULL_HANDLE };
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.AddShaderPath(vert)
+			.AddShaderPath(frag)
+			.load(program.shaders, program.vertexInputDescription, program.vertexAttributeDescriptions);
+	};
+	ShaderProgram opaqueProgram, skinnedProgram, skinnedDQProgram, vatCrowdProgram, skyProgram;
+	ShaderProgram shadowProgram, skinnedShadowProgram, skinnedDQShadowProgram, debugProgram;
+	ShaderProgram drawNormalsProgram, skinnedDrawNormalsProgram, skinnedDQDrawNormalsProgram, ssaoProgram, ssaoBlurProgram;
+	ShaderProgram vatCrowdShadowProgram, vatCrowdDrawNormalsProgram;
+	load(opaqueProgram, "Shaders/default.vert.spv", "Shaders/default.frag.spv");
+	load(skinnedProgram, "Shaders/defaultskinned.vert.spv", "Shaders/defaultskinned.frag.spv");
+	load(skinnedDQProgram, "Shaders/defaultskinneddq.vert.spv", "Shaders/defaultskinned.frag.spv");
+	load(vatCrowdProgram, "Shaders/vatcrowd.vert.spv", "Shaders/defaultskinned.frag.spv");
+	load(skyProgram, "Shaders/sky.vert.spv", "Shaders/sky.frag.spv");
+	load(shadowProgram, "Shaders/shadow.vert.spv", "Shaders/shadow.frag.spv");
+	load(skinnedShadowProgram, "Shaders/shadowskinned.vert.spv", "Shaders/shadowskinned.frag.spv");
+	load(skinnedDQShadowProgram, "Shaders/shadowskinneddq.vert.spv", "Shaders/shadowskinned.frag.spv");
+	load(vatCrowdShadowProgram, "Shaders/shadowvatcrowd.vert.spv", "Shaders/shadowskinned.frag.spv");
+	load(debugProgram, "Shaders/debug.vert.spv", "Shaders/debug.frag.spv");
+	load(drawNormalsProgram, "Shaders/DrawNormals.vert.spv", "Shaders/DrawNormals.frag.spv");
+	load(skinnedDrawNormalsProgram, "Shaders/DrawNormalsSkinned.vert.spv", "Shaders/DrawNormalsSkinned.frag.spv");
+	load(skinnedDQDrawNormalsProgram, "Shaders/DrawNormalsSkinnedDQ.vert.spv", "Shaders/DrawNormalsSkinned.frag.spv");
+	load(vatCrowdDrawNormalsProgram, "Shaders/DrawNormalsVatCrowd.vert.spv", "Shaders/DrawNormalsSkinned.frag.spv");
+	load(ssaoProgram, "Shaders/Ssao.vert.spv", "Shaders/Ssao.frag.spv");
+	load(ssaoBlurProgram, "Shaders/SsaoBlur.vert.spv", "Shaders/SsaoBlur.frag.spv");
+	auto begin = [&](VkPipelineLayout layout, VkRenderPass renderPass, ShaderProgram& program) {
+		return PipelineBuilder::begin(mDevice, layout, renderPass, program.shaders, program.vertexInputDescription, program.vertexAttributeDescriptions)
+			.setPipelineCache(mPipelineCache);
+	};
+	//the main pass variants every lit program comes in: lit, flat, without ssao and wireframe
+	struct LitPipelines {
+		VkPipeline opaque{ VK_NULL_HANDLE }, opaqueFlat{ VK_NULL_HANDLE }, noSsao{ VK_NULL_HANDLE }, wireframe{ VK_NULL_HANDLE };
+	};
+	PipelineBatch batch;
+	auto addLit = [&](VkPipelineLayout layout, ShaderProgram& program, LitPipelines& pipelines) {
+		batch.add(begin(layout, mRenderPass, program)
 			.setCullMode(VK_CULL_MODE_FRONT_BIT)
 			.setPolygonMode(VK_POLYGON_MODE_FILL)
 			.setDepthTest(VK_TRUE)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		skinnedOpaquePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["skinned_opaque"] = *skinnedOpaquePipeline;
-
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), pipelines.opaque);
+		batch.add(begin(layout, mRenderPass, program)
 			.setCullMode(VK_CULL_MODE_FRONT_BIT)
 			.setPolygonMode(VK_POLYGON_MODE_FILL)
 			.setDepthTest(VK_TRUE)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		skinnedOpaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["skinned_opaqueFlat"] = *skinnedOpaqueFlatPipeline;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), pipelines.opaqueFlat);
+		batch.add(begin(layout, mRenderPass, program)
 			.setCullMode(VK_CULL_MODE_FRONT_BIT)
 			.setPolygonMode(VK_POLYGON_MODE_FILL)
 			.setDepthTest(VK_TRUE)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 3)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
 			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		skinnedNoSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["skinned_opaqueNoSsao"] = *skinnedNoSsaoPipeline;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), pipelines.noSsao);
+		batch.add(begin(layout, mRenderPass, program)
 			.setCullMode(VK_CULL_MODE_FRONT_BIT)
 			.setPolygonMode(VK_POLYGON_MODE_LINE)
-			.setDepthTest(VK_TRUE)
-			.build(pipeline);
-		skinnedWireframePipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["skinned_opaque_wireframe"] = *skinnedWireframePipeline;
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/sky.vert.spv")
-			.AddShaderPath("Shaders/sky.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *pipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_BACK_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		cubeMapPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-
-		mPSOs["sky"] = *cubeMapPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/shadow.vert.spv")
-			.AddShaderPath("Shaders/shadow.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-
-		PipelineBuilder::begin(mDevice, *shadowPipelineLayout, mShadowMap->getRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_BACK_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		shadowPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-
-		mPSOs["shadow_opaque"] = *shadowPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/shadowskinned.vert.spv")
-			.AddShaderPath("Shaders/shadowskinned.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-
-		PipelineBuilder::begin(mDevice, *shadowPipelineLayout, mShadowMap->getRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setDepthTest(VK_TRUE), pipelines.wireframe);
+	};
+	auto addShadow = [&](VkPipelineLayout layout, ShaderProgram& program, VkPipeline& pipeline) {
+		batch.add(begin(layout, mRenderGraph->GetRenderPass(Shadow), program)
 			.setCullMode(VK_CULL_MODE_BACK_BIT)
 			.setPolygonMode(VK_POLYGON_MODE_FILL)
 			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		skinnedShadowPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-
-		mPSOs["skinned_shadow_opaque"] = *skinnedShadowPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/debug.vert.spv")
-			.AddShaderPath("Shaders/debug.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *debugPipelineLayout, mRenderPass, shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
-			.build(pipeline);
-		debugPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["debug"] = *debugPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		//pipeline for normals?
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/DrawNormals.vert.spv")
-			.AddShaderPath("Shaders/DrawNormals.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *drawNormalsPipelineLayout, mSsao->getNormalRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
+			.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL), pipeline);
+	};
+	auto addDrawNormals = [&](VkPipelineLayout layout, ShaderProgram& program, VkPipeline& pipeline) {
+		batch.add(begin(layout, mRenderGraph->GetRenderPass(Normals), program)
 			.setCullMode(VK_CULL_MODE_FRONT_BIT)
 			.setPolygonMode(VK_POLYGON_MODE_FILL)
 			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS)
-			.build(pipeline);
-		drawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["drawNormals"] = *drawNormalsPipeline;
+			.setDepthCompareOp(VK_COMPARE_OP_LESS), pipeline);
+	};
 
-		for (auto& shader : shaders) {
+	LitPipelines opaque, skinned, skinnedDQ, vatCrowd;
+	VkPipeline sky{ VK_NULL_HANDLE }, debug{ VK_NULL_HANDLE };
+	VkPipeline shadow{ VK_NULL_HANDLE }, skinnedShadow{ VK_NULL_HANDLE }, skinnedDQShadow{ VK_NULL_HANDLE }, vatCrowdShadow{ VK_NULL_HANDLE };
+	VkPipeline drawNormals{ VK_NULL_HANDLE }, skinnedDrawNormals{ VK_NULL_HANDLE }, skinnedDQDrawNormals{ VK_NULL_HANDLE }, vatCrowdDrawNormals{ VK_NULL_HANDLE };
+	VkPipeline ssao{ VK_NULL_HANDLE }, ssaoBlurHorz{ VK_NULL_HANDLE }, ssaoBlurVert{ VK_NULL_HANDLE }, animate{ VK_NULL_HANDLE };
+	addLit(*pipelineLayout, opaqueProgram, opaque);
+	addLit(*pipelineLayout, skinnedProgram, skinned);
+	addLit(*pipelineLayout, skinnedDQProgram, skinnedDQ);
+	//instanced crowd animated from the baked vertex animation texture
+	addLit(*vatPipelineLayout, vatCrowdProgram, vatCrowd);
+	batch.add(begin(*pipelineLayout, mRenderPass, skyProgram)
+		.setCullMode(VK_CULL_MODE_BACK_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL), sky);
+	addShadow(*shadowPipelineLayout, shadowProgram, shadow);
+	addShadow(*shadowPipelineLayout, skinnedShadowProgram, skinnedShadow);
+	addShadow(*shadowPipelineLayout, skinnedDQShadowProgram, skinnedDQShadow);
+	addShadow(*vatPipelineLayout, vatCrowdShadowProgram, vatCrowdShadow);
+	batch.add(begin(*debugPipelineLayout, mRenderPass, debugProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setDepthTest(VK_TRUE)
+		.setDepthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL), debug);
+	addDrawNormals(*drawNormalsPipelineLayout, drawNormalsProgram, drawNormals);
+	addDrawNormals(*drawNormalsPipelineLayout, skinnedDrawNormalsProgram, skinnedDrawNormals);
+	addDrawNormals(*drawNormalsPipelineLayout, skinnedDQDrawNormalsProgram, skinnedDQDrawNormals);
+	addDrawNormals(*vatPipelineLayout, vatCrowdDrawNormalsProgram, vatCrowdDrawNormals);
+	batch.add(begin(*ssaoPipelineLayout, mRenderGraph->GetRenderPass(SsaoMap), ssaoProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL), ssao);
+	batch.add(begin(*ssaoPipelineLayout, mRenderGraph->GetRenderPass(BlurHorz), ssaoBlurProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1), ssaoBlurHorz);
+	batch.add(begin(*ssaoPipelineLayout, mRenderGraph->GetRenderPass(BlurVert), ssaoBlurProgram)
+		.setCullMode(VK_CULL_MODE_FRONT_BIT)
+		.setPolygonMode(VK_POLYGON_MODE_FILL)
+		.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0), ssaoBlurVert);
+	//compute pipeline evaluating skinned palettes on the gpu, the graphics queue always supports compute
+	batch.add(ComputePipelineBuilder::begin(mDevice, *animationPipelineLayout)
+		.setShader("Shaders/animate.comp.spv")
+		.setPipelineCache(mPipelineCache), animate);
+	batch.build();
+
+	opaquePipeline = std::make_unique<VulkanPipeline>(mDevice, opaque.opaque);
+	mPSOs["opaque"] = *opaquePipeline;
+	opaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, opaque.opaqueFlat);
+	mPSOs["opaqueFlat"] = *opaqueFlatPipeline;
+	noSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, opaque.noSsao);
+	mPSOs["opaqueNoSsao"] = *noSsaoPipeline;
+	wireframePipeline = std::make_unique<VulkanPipeline>(mDevice, opaque.wireframe);
+	mPSOs["opaque_wireframe"] = *wireframePipeline;
+	skinnedOpaquePipeline = std::make_unique<VulkanPipeline>(mDevice, skinned.opaque);
+	mPSOs["skinned_opaque"] = *skinnedOpaquePipeline;
+	skinnedOpaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, skinned.opaqueFlat);
+	mPSOs["skinned_opaqueFlat"] = *skinnedOpaqueFlatPipeline;
+	skinnedNoSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, skinned.noSsao);
+	mPSOs["skinned_opaqueNoSsao"] = *skinnedNoSsaoPipeline;
+	skinnedWireframePipeline = std::make_unique<VulkanPipeline>(mDevice, skinned.wireframe);
+	mPSOs["skinned_opaque_wireframe"] = *skinnedWireframePipeline;
+	skinnedDQOpaquePipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDQ.opaque);
+	mPSOs["skinned_dq_opaque"] = *skinnedDQOpaquePipeline;
+	skinnedDQOpaqueFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDQ.opaqueFlat);
+	mPSOs["skinned_dq_opaqueFlat"] = *skinnedDQOpaqueFlatPipeline;
+	skinnedDQNoSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDQ.noSsao);
+	mPSOs["skinned_dq_opaqueNoSsao"] = *skinnedDQNoSsaoPipeline;
+	skinnedDQWireframePipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDQ.wireframe);
+	mPSOs["skinned_dq_opaque_wireframe"] = *skinnedDQWireframePipeline;
+	vatCrowdPipeline = std::make_unique<VulkanPipeline>(mDevice, vatCrowd.opaque);
+	mPSOs["vat_crowd"] = *vatCrowdPipeline;
+	vatCrowdNoSsaoPipeline = std::make_unique<VulkanPipeline>(mDevice, vatCrowd.noSsao);
+	mPSOs["vat_crowd_noSsao"] = *vatCrowdNoSsaoPipeline;
+	vatCrowdFlatPipeline = std::make_unique<VulkanPipeline>(mDevice, vatCrowd.opaqueFlat);
+	mPSOs["vat_crowd_flat"] = *vatCrowdFlatPipeline;
+	vatCrowdWireframePipeline = std::make_unique<VulkanPipeline>(mDevice, vatCrowd.wireframe);
+	mPSOs["vat_crowd_wireframe"] = *vatCrowdWireframePipeline;
+	vatCrowdShadowPipeline = std::make_unique<VulkanPipeline>(mDevice, vatCrowdShadow);
+	mPSOs["vat_crowd_shadow"] = *vatCrowdShadowPipeline;
+	vatCrowdDrawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, vatCrowdDrawNormals);
+	mPSOs["vat_crowd_drawNormals"] = *vatCrowdDrawNormalsPipeline;
+	cubeMapPipeline = std::make_unique<VulkanPipeline>(mDevice, sky);
+	mPSOs["sky"] = *cubeMapPipeline;
+	shadowPipeline = std::make_unique<VulkanPipeline>(mDevice, shadow);
+	mPSOs["shadow_opaque"] = *shadowPipeline;
+	skinnedShadowPipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedShadow);
+	mPSOs["skinned_shadow_opaque"] = *skinnedShadowPipeline;
+	skinnedDQShadowPipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDQShadow);
+	mPSOs["skinned_dq_shadow_opaque"] = *skinnedDQShadowPipeline;
+	debugPipeline = std::make_unique<VulkanPipeline>(mDevice, debug);
+	mPSOs["debug"] = *debugPipeline;
+	drawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, drawNormals);
+	mPSOs["drawNormals"] = *drawNormalsPipeline;
+	skinnedDrawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDrawNormals);
+	mPSOs["skinned_drawNormals"] = *skinnedDrawNormalsPipeline;
+	skinnedDQDrawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, skinnedDQDrawNormals);
+	mPSOs["skinned_dq_drawNormals"] = *skinnedDQDrawNormalsPipeline;
+	ssaoPipeline = std::make_unique<VulkanPipeline>(mDevice, ssao);
+	mPSOs["ssao"] = *ssaoPipeline;
+	ssaoBlurHorzPipeline = std::make_unique<VulkanPipeline>(mDevice, ssaoBlurHorz);
+	mPSOs["ssaoBlurHorz"] = *ssaoBlurHorzPipeline;
+	ssaoBlurVertPipeline = std::make_unique<VulkanPipeline>(mDevice, ssaoBlurVert);
+	mPSOs["ssaoBlurVert"] = *ssaoBlurVertPipeline;
+	animationPipeline = std::make_unique<VulkanPipeline>(mDevice, animate);
+	mPSOs["animate"] = *animationPipeline;
+
+	for (ShaderProgram* program : { &opaqueProgram, &skinnedProgram, &skinnedDQProgram, &vatCrowdProgram, &skyProgram,
+		&shadowProgram, &skinnedShadowProgram, &skinnedDQShadowProgram, &debugProgram,
+		&drawNormalsProgram, &skinnedDrawNormalsProgram, &skinnedDQDrawNormalsProgram, &ssaoProgram, &ssaoBlurProgram,
+		&vatCrowdShadowProgram, &vatCrowdDrawNormalsProgram }) {
+		for (auto& shader : program->shaders) {
 			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
 		}
 	}
-	{
-		//pipeline for normals?
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/DrawNormalsSkinned.vert.spv")
-			.AddShaderPath("Shaders/DrawNormalsSkinned.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *drawNormalsPipelineLayout, mSsao->getNormalRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setDepthTest(VK_TRUE)
-			.setDepthCompareOp(VK_COMPARE_OP_LESS)
-			.build(pipeline);
-		skinnedDrawNormalsPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["skinned_drawNormals"] = *skinnedDrawNormalsPipeline;
 
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		//pipeline for ssao
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/Ssao.vert.spv")
-			.AddShaderPath("Shaders/Ssao.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *ssaoPipelineLayout, mSsao->getSsaoRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.build(pipeline);
-		ssaoPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["ssao"] = *ssaoPipeline;
-
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
-	{
-		//pipeline for ssao
-		std::vector<Vulkan::ShaderModule> shaders;
-		VkVertexInputBindingDescription vertexInputDescription = {};
-		std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
-		ShaderProgramLoader::begin(mDevice)
-			.AddShaderPath("Shaders/SsaoBlur.vert.spv")
-			.AddShaderPath("Shaders/SsaoBlur.frag.spv")
-			.load(shaders, vertexInputDescription, vertexAttributeDescriptions);
-		VkPipeline pipeline = VK_NULL_HANDLE;
-		PipelineBuilder::begin(mDevice, *ssaoPipelineLayout, mSsao->getSsaoRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1)
-			.build(pipeline);
-		ssaoBlurHorzPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["ssaoBlurHorz"] = *ssaoBlurHorzPipeline;
-		PipelineBuilder::begin(mDevice, *ssaoPipelineLayout, mSsao->getSsaoRenderPass(), shaders, vertexInputDescription, vertexAttributeDescriptions)
-			.setCullMode(VK_CULL_MODE_FRONT_BIT)
-			.setPolygonMode(VK_POLYGON_MODE_FILL)
-			.setSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0)
-			.build(pipeline);
-		ssaoBlurVertPipeline = std::make_unique<VulkanPipeline>(mDevice, pipeline);
-		mPSOs["ssaoBlurVert"] = *ssaoBlurVertPipeline;
-		for (auto& shader : shaders) {
-			Vulkan::cleanupShaderModule(mDevice, shader.shaderModule);
-		}
-	}
+	//startup cost with an empty (cold) or loaded (warm) cache
+	double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+	std::wostringstream outs;
+	outs << mMainWndCaption << L", " << mPSOs.size() << L" pipelines in " << (int)buildMs << L" ms (" << (mPipelineCacheLoaded ? L"warm" : L"cold") << L" cache)";
+	mMainWndCaption = outs.str();
 }
 
 
@@ -1488,7 +1716,33 @@ void SkinnedMeshApp::BuildRenderItems()
 		ritem->SkinnedCBIndex = 0;
 		ritem->SkinnedModelInst = mSkinnedModelInst.get();
 
-		mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(ritem.get());
+		if (ritem->SkinnedModelInst->UseDualQuaternions)
+			mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ].push_back(ritem.get());
+		else
+			mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
+	}
+
+	// One instanced draw per soldier submesh for the whole crowd, the
+	// per instance placement and clip phase live in crowdBuffer.
+	for (UINT i = 0; i < mSkinnedMats.size(); ++i)
+	{
+		std::string submeshName = "sm_" + std::to_string(i);
+
+		auto ritem = std::make_unique<RenderItem>();
+		glm::mat4 modelScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.05f, 0.05f, -0.05f));
+		glm::mat4 modelRot = glm::rotate(glm::mat4(1.0f), MathHelper::Pi, glm::vec3(0.0, 1.0f, 0.0f));
+		ritem->World = modelRot * modelScale;
+		ritem->TexTransform = MathHelper::Identity4x4();
+		ritem->ObjCBIndex = objCBIndex++;
+		ritem->Mat = mMaterials[mSkinnedMats[i].Name].get();
+		ritem->Geo = mGeometries["Models\\soldier.m3d"].get();
+		ritem->IndexCount = ritem->Geo->DrawArgs[submeshName].IndexCount;
+		ritem->StartIndexLocation = ritem->Geo->DrawArgs[submeshName].StartIndexLocation;
+		ritem->BaseVertexLocation = ritem->Geo->DrawArgs[submeshName].BaseVertexLocation;
+		ritem->InstanceCount = gCrowdRows * gCrowdCols;
+
+		mRitemLayer[(int)RenderLayer::VatCrowd].push_back(ritem.get());
 		mAllRitems.push_back(std::move(ritem));
 	}
 }
@@ -1497,8 +1751,8 @@ void SkinnedMeshApp::Update(const GameTimer& gt) {
 	VulkApp::Update(gt);
 	
 
-	//Cycle through the circular frame resource array
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	//Use the frame resource of the slot VulkApp::Update just waited on
+	mCurrFrameResourceIndex = (int)mCurrFrame;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	OnKeyboardInput(gt);
@@ -1540,6 +1794,16 @@ void SkinnedMeshApp::OnKeyboardInput(const GameTimer& gt)
 	else
 		mIsFlatShader = false;
 	mNoSsao = (GetAsyncKeyState('3') & 0x8000) ? true : false;
+	mDrawVatCrowd = (GetAsyncKeyState('4') & 0x8000) ? false : true;
+	bool useDualQuaternions = (GetAsyncKeyState('5') & 0x8000) ? true : false;
+	if (useDualQuaternions != mSkinnedModelInst->UseDualQuaternions) {
+		//every skinned item shares the one instance, so they all change layer together
+		mSkinnedModelInst->UseDualQuaternions = useDualQuaternions;
+		std::swap(mRitemLayer[(int)RenderLayer::SkinnedOpaque], mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+	}
+	//held down, palettes are built on the cpu again to compare against animate.comp
+	mUseGpuAnimation = (GetAsyncKeyState('6') & 0x8000) ? false : true;
+	mSkinnedModelInst->EvaluateOnGpu = mUseGpuAnimation && !useDualQuaternions;//compute pass only builds matrix palettes
 
 
 
@@ -1565,6 +1829,7 @@ void SkinnedMeshApp::AnimateMaterials(const GameTimer& gt)
 
 
 void  SkinnedMeshApp::UpdateObjectCBs(const GameTimer& gt) {
+	CPU_ZONE("UpdateObjectCBs");
 
 	uint8_t* pObjConsts = (uint8_t*)mCurrFrameResource->pOCs;
 	auto& ub = *uniformBuffer;
@@ -1587,6 +1852,7 @@ void  SkinnedMeshApp::UpdateObjectCBs(const GameTimer& gt) {
 
 void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateSkinnedCBs");
 	auto currSkinnedCB = mCurrFrameResource->pSCs;
 	float delta = gt.DeltaTime();
 	lastDelta = delta;
@@ -1600,6 +1866,13 @@ void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
 	// We only have one skinned model being animated.
 	mSkinnedModelInst->UpdateSkinnedAnimation(lastDelta);
 
+	if (mSkinnedModelInst->EvaluateOnGpu) {
+		//only the clip and time go up, animate.comp builds the palette
+		mGpuAnimation->SetInstance(mCurrFrame, 0, mGpuAnimation->ClipIndex(mSkinnedModelInst->ClipName), mSkinnedModelInst->TimePos);
+		mGpuAnimation->SetInstanceCount(mCurrFrame, 1);
+		return;
+	}
+
 	//SkinnedConstants skinnedConstants;
 	/*std::copy(
 		std::begin(mSkinnedModelInst->FinalTransforms),
@@ -1608,12 +1881,16 @@ void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
 	
 	
 	//memcpy(currSkinnedCB, &skinnedConstants.BoneTransforms, sizeof(glm::mat4) * mSkinnedModelInst->FinalTransforms.size());// sizeof(skinnedConstants.BoneTransforms));
-	memcpy(currSkinnedCB, mSkinnedModelInst->FinalTransforms.data(), sizeof(glm::mat4) * mSkinnedModelInst->FinalTransforms.size());
+	if (mSkinnedModelInst->UseDualQuaternions)
+		memcpy(currSkinnedCB, mSkinnedModelInst->FinalDualQuats.data(), sizeof(glm::mat2x4) * mSkinnedModelInst->FinalDualQuats.size());
+	else
+		memcpy(currSkinnedCB, mSkinnedModelInst->FinalTransforms.data(), sizeof(glm::mat4) * mSkinnedModelInst->FinalTransforms.size());
 	
 }
 
 void SkinnedMeshApp::UpdateShadowTransform(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateShadowTransform");
 	// Only the first "main" light casts a shadow.
 	glm::vec3 lightDir = mRotatedLightDirections[0];
 	glm::vec3 lightPos = -2.0f * mSceneBounds.Radius * lightDir;
@@ -1657,6 +1934,7 @@ void SkinnedMeshApp::UpdateShadowTransform(const GameTimer& gt)
 }
 
 void SkinnedMeshApp::UpdateMainPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateMainPassCB");
 	glm::mat4 view = mCamera.GetView();
 	glm::mat4 proj = mCamera.GetProj();
 	proj[1][1] *= -1;
@@ -1702,6 +1980,7 @@ void SkinnedMeshApp::UpdateMainPassCB(const GameTimer& gt) {
 }
 
 void SkinnedMeshApp::UpdateShadowPassCB(const GameTimer& gt) {
+	CPU_ZONE("UpdateShadowPassCB");
 	glm::mat4 view = mLightView;
 	glm::mat4 proj = mLightProj;
 	proj[1][1] *= -1;
@@ -1744,6 +2023,7 @@ void SkinnedMeshApp::UpdateShadowPassCB(const GameTimer& gt) {
 
 void SkinnedMeshApp::UpdateSsaoCB(const GameTimer& gt)
 {
+	CPU_ZONE("UpdateSsaoCB");
 	SsaoConstants ssaoCB;
 
 	glm::mat4 P = mCamera.GetProj();
@@ -1784,6 +2064,7 @@ void SkinnedMeshApp::UpdateSsaoCB(const GameTimer& gt)
 
 
 void SkinnedMeshApp::UpdateMaterialsBuffer(const GameTimer& gt) {
+	CPU_ZONE("UpdateMaterialsBuffer");
 	uint8_t* pMatConsts = (uint8_t*)mCurrFrameResource->pMats;
 	auto& sb = *storageBuffer;
 	VkDeviceSize objSize = sb[0].objectSize;
@@ -1859,7 +2140,11 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 		auto& ud = *uniformDescriptors;
 		//bind descriptors that don't change during pass
 		VkDescriptorSet descriptor0 = ud[0];//pass constant buffer
-		uint32_t dynamicOffsets[2] = { mCurrFrame*(uint32_t)boneSize,mCurrFrame * (uint32_t)passSize * (uint32_t)passCount  };
+		//skinned shaders read either the cpu palette or the one animate.comp writes
+		bool gpuAnimation = mSkinnedModelInst->EvaluateOnGpu;
+		descriptorSets.boneDescriptorSet = gpuAnimation ? descriptorSets.gpuBoneDescriptorSet : descriptorSets.cpuBoneDescriptorSet;
+		uint32_t boneOffset = gpuAnimation ? mGpuAnimation->PaletteOffset(mCurrFrame, 0) : mCurrFrame * (uint32_t)boneSize;
+		uint32_t dynamicOffsets[2] = { boneOffset,mCurrFrame * (uint32_t)passSize * (uint32_t)passCount  };
 
 		//bind storage buffer
 		auto& sb = *storageBuffer;
@@ -1882,23 +2167,20 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 		descriptors[5] = descriptorSets.shadowMapDescriptorSet;
 		descriptors[6] = descriptorSets.ssaoMapDescriptorSet;
 		VkCommandBuffer cmd = BeginRender(false);//don't want to start main render pass
+		if (gpuAnimation) {
+			//palette has to be ready before the shadow pass
+			mGpuAnimation->Dispatch(cmd, *animationPipelineLayout, mPSOs["animate"], descriptorSets.animationDescriptorSet, mCurrFrame);
+		}
 		{
 			dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount + (uint32_t)passSize };
 			//shadow pass
-			uint32_t w = mShadowMap->Width();
-			uint32_t h = mShadowMap->Height();
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValue[1] = { {1.0f,0.0f } };
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValue;
-			renderPassBeginInfo.renderPass = mShadowMap->getRenderPass();
-			renderPassBeginInfo.framebuffer = mShadowMap->getFramebuffer();
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
+			VkRenderPassBeginInfo renderPassBeginInfo = mRenderGraph->GetBeginInfo(Shadow);
 			VkViewport viewport = mShadowMap->Viewport();
 			pvkCmdSetViewport(cmd, 0, 1, &viewport);
 			VkRect2D scissor = mShadowMap->ScissorRect();
 			pvkCmdSetScissor(cmd, 0, 1, &scissor);
 			//vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
+			mRenderGraph->RecordBarriers(cmd, Shadow);
 			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["shadow_opaque"]);
 			//bind all descriptors except first
@@ -1910,6 +2192,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_shadow_opaque"]);
 			DrawRenderItems(cmd, *shadowPipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_dq_shadow_opaque"]);
+			DrawRenderItems(cmd, *shadowPipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+			DrawVatCrowd(cmd, "vat_crowd_shadow", *shadowPipelineLayout, 4, dynamicOffsets);
 			pvkCmdEndRenderPass(cmd);
 			//Vulkan::transitionImage(mDevice,mGraphicsQueue,cmd,mShadowMap->getRenderTargetView(),VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,VK_IMAGE_LAYOUT)
 		}
@@ -1920,19 +2205,11 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 		{
 			dynamicOffsets[1] = { mCurrFrame * (uint32_t)passSize * (uint32_t)passCount };
 			//normal
-			uint32_t w = mClientWidth;
-			uint32_t h = mClientHeight;
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValues[2] = { {0.0f,0.0f,1.0f}, {1.0f,0.0f } };
-
-			renderPassBeginInfo.clearValueCount = 2;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = mSsao->getNormalRenderPass();
-			renderPassBeginInfo.framebuffer = mSsao->getNormalFramebuffer();
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
+			VkRenderPassBeginInfo renderPassBeginInfo = mRenderGraph->GetBeginInfo(Normals);
 			pvkCmdSetViewport(cmd, 0, 1, &viewport);
 			pvkCmdSetScissor(cmd, 0, 1, &scissor);
 			//vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
+			mRenderGraph->RecordBarriers(cmd, Normals);
 			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["drawNormals"]);
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawNormalsPipelineLayout, 1, 4, &descriptorSets.boneDescriptorSet, 2, dynamicOffsets);
@@ -1942,6 +2219,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			DrawRenderItems(cmd, *drawNormalsPipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_drawNormals"]);
 			DrawRenderItems(cmd, *drawNormalsPipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_dq_drawNormals"]);
+			DrawRenderItems(cmd, *drawNormalsPipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+			DrawVatCrowd(cmd, "vat_crowd_drawNormals", *drawNormalsPipelineLayout, 4, dynamicOffsets);
 			pvkCmdEndRenderPass(cmd);
 		}
 		{
@@ -1955,23 +2235,13 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			VkDeviceSize ssaoSize = ub[2].objectSize;
 			VkDeviceSize ssaoCount = ub[2].objectCount;
 			dynamicOffsets[0] = { mCurrFrame * (uint32_t)ssaoSize * (uint32_t)ssaoCount };
-			//normal
-			uint32_t w = mSsao->SsaoMapWidth();
-			uint32_t h = mSsao->SsaoMapHeight();
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValues[1] = { {0.0f,0.0f,0.0f} };
-
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = mSsao->getSsaoRenderPass();
-			renderPassBeginInfo.framebuffer = mSsao->getSsaoFramebuffer(0);
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
+			VkRenderPassBeginInfo renderPassBeginInfo = mRenderGraph->GetBeginInfo(SsaoMap);
 			auto ssaoViewport = mSsao->getSsaoViewport();
 			auto ssaoScissor = mSsao->getSsaoScissorRect();
 			pvkCmdSetViewport(cmd, 0, 1, &ssaoViewport);
 			pvkCmdSetScissor(cmd, 0, 1, &ssaoScissor);
 			//vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
-			Vulkan::transitionImageNoSubmit(cmd, mDepthImage.image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			mRenderGraph->RecordBarriers(cmd, SsaoMap);
 			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 
@@ -1991,31 +2261,18 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			//blur
 			auto ssub = *ssaoUniformDescriptors;
 			auto sstx = *ssaoTextureDescriptors;
-			auto tx = *textureDescriptors;
 			VkDescriptorSet descriptor6 = ssub[0];
-			VkDescriptorSet descriptor7 = tx[2];
 			VkDescriptorSet descriptor8 = sstx[0];
 			VkDescriptorSet descriptor9 = sstx[1];
-			VkDescriptorSet descriptor10 = sstx[2];
 			VkDescriptorSet descriptor11 = sstx[3];
-			//ssao
-			//blur pass
-			uint32_t w = mSsao->SsaoMapWidth();
-			uint32_t h = mSsao->SsaoMapHeight();
-			VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-			VkClearValue clearValues[1] = { {0.0f,0.0f,0.0f} };
-
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.renderPass = mSsao->getSsaoRenderPass();
-			renderPassBeginInfo.framebuffer = mSsao->getSsaoFramebuffer(1);//draw to second framebuffer (2nd image)
-			renderPassBeginInfo.renderArea = { 0,0,(uint32_t)w,(uint32_t)h };
+			VkDescriptorSet descriptor12 = sstx[4];
+			//blur, horizontally from the raw ambient map then vertically into the one the main pass samples
+			VkRenderPassBeginInfo renderPassBeginInfo = mRenderGraph->GetBeginInfo(BlurHorz);
 			auto ssaoViewport = mSsao->getSsaoViewport();
 			auto ssaoScissor = mSsao->getSsaoScissorRect();
 			pvkCmdSetViewport(cmd, 0, 1, &ssaoViewport);
 			pvkCmdSetScissor(cmd, 0, 1, &ssaoScissor);
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(0), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(1), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+			mRenderGraph->RecordBarriers(cmd, BlurHorz);
 			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 
@@ -2023,14 +2280,12 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 0, 1, &descriptor6, 1, dynamicOffsets);
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 1, 1, &descriptor8, 0, 0);//bind PC data once
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 2, 1, &descriptor9, 0, 0);//bind PC data once
-			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 3, 1, &descriptor7, 0, 0);//bind PC data once
+			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *ssaoPipelineLayout, 3, 1, &descriptor12, 0, 0);//bind PC data once
 
 			vkCmdDraw(cmd, 6, 1, 0, 0);
 			pvkCmdEndRenderPass(cmd);
-			//transition this image to shader read
-			Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(0), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(1), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-			renderPassBeginInfo.framebuffer = mSsao->getSsaoFramebuffer(0);//draw to first framebuffer (1st image)
+			renderPassBeginInfo = mRenderGraph->GetBeginInfo(BlurVert);
+			mRenderGraph->RecordBarriers(cmd, BlurVert);
 			pvkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 
@@ -2042,18 +2297,13 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 
 			vkCmdDraw(cmd, 6, 1, 0, 0);
 			pvkCmdEndRenderPass(cmd);
-
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(1), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			//Vulkan::transitionImageNoSubmit(cmd, mSsao->getSsaoImage(0), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
-
-
-
 		}
-		Vulkan::transitionImageNoSubmit(cmd, mDepthImage.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+		//the depth buffer back to an attachment, shadow and ambient maps to shader read
+		mRenderGraph->RecordBarriers(cmd, Main);
 		//start main render pass now
 		pvkCmdBeginRenderPass(cmd, &mRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		dynamicOffsets[0] = { mCurrFrame * (uint32_t)boneSize };
+		dynamicOffsets[0] = { boneOffset };
 		dynamicOffsets[1] = { mCurrFrame* (uint32_t)passSize* (uint32_t)passCount};// (uint32_t)(mCurrFrame * passSize * passCount);
 
 
@@ -2073,6 +2323,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_opaque_wireframe"]);
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_dq_opaque_wireframe"]);
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+			DrawVatCrowd(cmd, "vat_crowd_wireframe", *pipelineLayout, 7, dynamicOffsets);
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
 			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
@@ -2097,6 +2350,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_opaqueFlat"]);
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_dq_opaqueFlat"]);
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+			DrawVatCrowd(cmd, "vat_crowd_flat", *pipelineLayout, 7, dynamicOffsets);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
 			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
@@ -2121,6 +2377,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_opaqueNoSsao"]);
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_dq_opaqueNoSsao"]);
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+			DrawVatCrowd(cmd, "vat_crowd_noSsao", *pipelineLayout, 7, dynamicOffsets);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
 			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
@@ -2146,6 +2405,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt) {
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::Opaque]);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_opaque"]);
 			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["skinned_dq_opaque"]);
+			DrawRenderItems(cmd, *pipelineLayout, mRitemLayer[(int)RenderLayer::SkinnedOpaqueDQ]);
+			DrawVatCrowd(cmd, "vat_crowd", *pipelineLayout, 7, dynamicOffsets);
 			pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs["debug"]);
 			pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipelineLayout, 6, 1, &descriptor7, 0, 0);//bind PC data once
 			DrawRenderItems(cmd, *debugPipelineLayout, mRitemLayer[(int)RenderLayer::Debug]);
@@ -2187,16 +2449,60 @@ void SkinnedMeshApp::DrawRenderItems(VkCommandBuffer cmd, VkPipelineLayout layou
 		uint32_t cbvIndex = ri->ObjCBIndex;
 		uint32_t dyoffsets[1] = { (uint32_t)(cbvIndex * objectSize) };
 		pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSets.objectDescriptorSet, 1, dyoffsets);
-		pvkCmdDrawIndexed(cmd, ri->IndexCount, 1, 0, ri->BaseVertexLocation, 0);
+		pvkCmdDrawIndexed(cmd, ri->IndexCount, ri->InstanceCount, 0, ri->BaseVertexLocation, 0);
+	}
+}
+
+void SkinnedMeshApp::DrawVatCrowd(VkCommandBuffer cmd, const char* pso, VkPipelineLayout layout, uint32_t setCount, uint32_t* dynamicOffsets) {
+	if (!mDrawVatCrowd)
+		return;
+	//the vat set takes the bone set's slot, so the pass' sets 1 to setCount are rebound with the vat layout
+	//and restored to layout after. The shadow and normals passes only bind up to the texture array
+	VkDescriptorSet sets[7] = { descriptorSets.vatDescriptorSet, descriptorSets.passDescriptorSet, descriptorSets.materialDescriptorSet,
+		descriptorSets.textureArrayDescriptorSet, descriptorSets.cubeMapDescriptorSet, descriptorSets.shadowMapDescriptorSet, descriptorSets.ssaoMapDescriptorSet };
+	assert(setCount <= 7);
+	pvkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mPSOs[pso]);
+	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, *vatPipelineLayout, 1, setCount, sets, 1, &dynamicOffsets[1]);
+	DrawRenderItems(cmd, *vatPipelineLayout, mRitemLayer[(int)RenderLayer::VatCrowd]);
+	pvkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, setCount, &descriptorSets.boneDescriptorSet, 2, dynamicOffsets);
+}
+
+// Offline bake, no window: -bakevat <out.vat> [bones|vertices] [sampleRate]
+static int BakeVat(int argc, char** argv) {
+	std::vector<M3DLoader::SkinnedVertex> vertices;
+	std::vector<std::uint32_t> indices;
+	std::vector<M3DLoader::Subset> subsets;
+	std::vector<M3DLoader::M3dMaterial> mats;
+	SkinnedData skinnedInfo;
+	M3DLoader m3dLoader;
+	if (!m3dLoader.LoadM3d("Models\\soldier.m3d", vertices, indices, subsets, mats, skinnedInfo)) {
+		std::cerr << "Failed to load Models\\soldier.m3d" << std::endl;
+		return 1;
+	}
+	bool bakeVertices = argc > 3 && std::string(argv[3]) == "vertices";
+	float sampleRate = argc > 4 ? (float)atof(argv[4]) : 30.0f;
+	AnimationBaker baker(sampleRate);
+	VertexAnimationTexture vat;
+	if (bakeVertices)
+		baker.BakeSkinnedVertices(skinnedInfo, vertices, vat);
+	else
+		baker.BakeBoneMatrices(skinnedInfo, vat);
+	if (!AnimationBaker::Save(argv[2], vat)) {
+		std::cerr << "Failed to write " << argv[2] << std::endl;
+		return 1;
 	}
+	std::cout << argv[2] << ": " << vat.Width << "x" << vat.Height << "x" << vat.LayerCount << ", " << vat.Clips.size() << " clip(s)" << std::endl;
+	return 0;
 }
 
-int main()
+int main(int argc, char** argv)
 {
 	// Enable run-time memory check for debug builds.
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
+	if (argc > 2 && std::string(argv[1]) == "-bakevat")
+		return BakeVat(argc, argv);
 
 	try
 	{
@@ -0,0 +1,434 @@
+#include "AabbTree.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static float SurfaceArea(const glm::vec3& minW, const glm::vec3& maxW) {
+	glm::vec3 d = maxW - minW;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// Does the box outerMin/outerMax enclose minW/maxW?
+static bool Contains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& minW, const glm::vec3& maxW) {
+	return glm::all(glm::lessThanEqual(outerMin, minW)) && glm::all(glm::lessThanEqual(maxW, outerMax));
+}
+
+void AabbTree::Clear() {
+	mNodes.clear();
+	mRoot = -1;
+	mFreeList = -1;
+	mProxyCount = 0;
+}
+
+void AabbTree::Reserve(size_t proxyCount) {
+	mNodes.reserve(proxyCount * 2);//n leaves, n - 1 internal nodes
+}
+
+int32_t AabbTree::AllocateNode() {
+	int32_t nodeId;
+	if (mFreeList == -1) {
+		nodeId = (int32_t)mNodes.size();
+		mNodes.emplace_back();
+	}
+	else {
+		nodeId = mFreeList;
+		mFreeList = mNodes[nodeId].Parent;
+		mNodes[nodeId] = AabbTreeNode();
+	}
+	mNodes[nodeId].Height = 0;
+	return nodeId;
+}
+
+void AabbTree::FreeNode(int32_t nodeId) {
+	mNodes[nodeId].Parent = mFreeList;
+	mNodes[nodeId].Height = -1;
+	mFreeList = nodeId;
+}
+
+int32_t AabbTree::CreateProxy(const glm::vec3& minW, const glm::vec3& maxW, uint64_t userData) {
+	int32_t proxyId = AllocateNode();
+	AabbTreeNode& node = mNodes[proxyId];
+	node.Min = minW - glm::vec3(mMargin);
+	node.Max = maxW + glm::vec3(mMargin);
+	node.UserData = userData;
+	InsertLeaf(proxyId);
+	mProxyCount++;
+	return proxyId;
+}
+
+void AabbTree::DestroyProxy(int32_t proxyId) {
+	assert(mNodes[proxyId].IsLeaf());
+	RemoveLeaf(proxyId);
+	FreeNode(proxyId);
+	mProxyCount--;
+}
+
+bool AabbTree::MoveProxy(int32_t proxyId, const glm::vec3& minW, const glm::vec3& maxW) {
+	assert(mNodes[proxyId].IsLeaf());
+	if (Contains(mNodes[proxyId].Min, mNodes[proxyId].Max, minW, maxW))
+		return false;
+	RemoveLeaf(proxyId);
+	mNodes[proxyId].Min = minW - glm::vec3(mMargin);
+	mNodes[proxyId].Max = maxW + glm::vec3(mMargin);
+	InsertLeaf(proxyId);
+	return true;
+}
+
+void AabbTree::SetProxyBounds(int32_t proxyId, const glm::vec3& minW, const glm::vec3& maxW) {
+	assert(mNodes[proxyId].IsLeaf());
+	mNodes[proxyId].Min = minW - glm::vec3(mMargin);
+	mNodes[proxyId].Max = maxW + glm::vec3(mMargin);
+}
+
+void AabbTree::Refit() {
+	if (mRoot == -1)
+		return;
+	//pre-order puts parents before children, walk it backwards
+	std::vector<int32_t> order;
+	order.reserve(mNodes.size());
+	std::vector<int32_t> stack;
+	stack.push_back(mRoot);
+	while (!stack.empty()) {
+		int32_t nodeId = stack.back();
+		stack.pop_back();
+		const AabbTreeNode& node = mNodes[nodeId];
+		if (node.IsLeaf())
+			continue;
+		order.push_back(nodeId);
+		stack.push_back(node.Child1);
+		stack.push_back(node.Child2);
+	}
+	for (auto it = order.rbegin(); it != order.rend(); ++it) {
+		AabbTreeNode& node = mNodes[*it];
+		const AabbTreeNode& child1 = mNodes[node.Child1];
+		const AabbTreeNode& child2 = mNodes[node.Child2];
+		node.Min = glm::min(child1.Min, child2.Min);
+		node.Max = glm::max(child1.Max, child2.Max);
+	}
+}
+
+void AabbTree::InsertLeaf(int32_t leaf) {
+	if (mRoot == -1) {
+		mRoot = leaf;
+		mNodes[leaf].Parent = -1;
+		return;
+	}
+
+	//descend to the sibling with the lowest surface area cost
+	glm::vec3 leafMin = mNodes[leaf].Min;
+	glm::vec3 leafMax = mNodes[leaf].Max;
+	int32_t index = mRoot;
+	while (!mNodes[index].IsLeaf()) {
+		const AabbTreeNode& node = mNodes[index];
+		float area = SurfaceArea(node.Min, node.Max);
+		float combinedArea = SurfaceArea(glm::min(node.Min, leafMin), glm::max(node.Max, leafMax));
+
+		//cost of a new parent for this node and the leaf
+		float cost = 2.0f * combinedArea;
+		//minimum cost of pushing the leaf further down
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCost[2];
+		int32_t children[2] = { node.Child1, node.Child2 };
+		for (int i = 0; i < 2; ++i) {
+			const AabbTreeNode& child = mNodes[children[i]];
+			float childArea = SurfaceArea(glm::min(child.Min, leafMin), glm::max(child.Max, leafMax));
+			childCost[i] = child.IsLeaf() ? childArea + inheritanceCost : (childArea - SurfaceArea(child.Min, child.Max)) + inheritanceCost;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+		index = childCost[0] < childCost[1] ? children[0] : children[1];
+	}
+	int32_t sibling = index;
+
+	int32_t oldParent = mNodes[sibling].Parent;
+	int32_t newParent = AllocateNode();
+	AabbTreeNode& parent = mNodes[newParent];
+	parent.Parent = oldParent;
+	parent.Min = glm::min(leafMin, mNodes[sibling].Min);
+	parent.Max = glm::max(leafMax, mNodes[sibling].Max);
+	parent.Height = mNodes[sibling].Height + 1;
+	parent.Child1 = sibling;
+	parent.Child2 = leaf;
+	if (oldParent != -1) {
+		if (mNodes[oldParent].Child1 == sibling)
+			mNodes[oldParent].Child1 = newParent;
+		else
+			mNodes[oldParent].Child2 = newParent;
+	}
+	else {
+		mRoot = newParent;
+	}
+	mNodes[sibling].Parent = newParent;
+	mNodes[leaf].Parent = newParent;
+
+	FixUpwards(mNodes[leaf].Parent);
+}
+
+void AabbTree::RemoveLeaf(int32_t leaf) {
+	if (leaf == mRoot) {
+		mRoot = -1;
+		return;
+	}
+	int32_t parent = mNodes[leaf].Parent;
+	int32_t grandParent = mNodes[parent].Parent;
+	int32_t sibling = mNodes[parent].Child1 == leaf ? mNodes[parent].Child2 : mNodes[parent].Child1;
+
+	if (grandParent != -1) {
+		if (mNodes[grandParent].Child1 == parent)
+			mNodes[grandParent].Child1 = sibling;
+		else
+			mNodes[grandParent].Child2 = sibling;
+		mNodes[sibling].Parent = grandParent;
+		FreeNode(parent);
+		FixUpwards(grandParent);
+	}
+	else {
+		mRoot = sibling;
+		mNodes[sibling].Parent = -1;
+		FreeNode(parent);
+	}
+}
+
+void AabbTree::FixUpwards(int32_t nodeId) {
+	while (nodeId != -1) {
+		nodeId = Balance(nodeId);
+		AabbTreeNode& node = mNodes[nodeId];
+		const AabbTreeNode& child1 = mNodes[node.Child1];
+		const AabbTreeNode& child2 = mNodes[node.Child2];
+		node.Height = 1 + std::max(child1.Height, child2.Height);
+		node.Min = glm::min(child1.Min, child2.Min);
+		node.Max = glm::max(child1.Max, child2.Max);
+		nodeId = node.Parent;
+	}
+}
+
+// Rotate the taller grandchild up when A's children differ in height by more than one.
+int32_t AabbTree::Balance(int32_t iA) {
+	AabbTreeNode& A = mNodes[iA];
+	if (A.IsLeaf() || A.Height < 2)
+		return iA;
+
+	int32_t iB = A.Child1;
+	int32_t iC = A.Child2;
+	AabbTreeNode& B = mNodes[iB];
+	AabbTreeNode& C = mNodes[iC];
+	int32_t balance = C.Height - B.Height;
+
+	if (balance > 1) {
+		//rotate C up
+		int32_t iF = C.Child1;
+		int32_t iG = C.Child2;
+		AabbTreeNode& F = mNodes[iF];
+		AabbTreeNode& G = mNodes[iG];
+
+		C.Child1 = iA;
+		C.Parent = A.Parent;
+		A.Parent = iC;
+		if (C.Parent != -1) {
+			if (mNodes[C.Parent].Child1 == iA)
+				mNodes[C.Parent].Child1 = iC;
+			else
+				mNodes[C.Parent].Child2 = iC;
+		}
+		else {
+			mRoot = iC;
+		}
+
+		if (F.Height > G.Height) {
+			C.Child2 = iF;
+			A.Child2 = iG;
+			G.Parent = iA;
+			A.Min = glm::min(B.Min, G.Min);
+			A.Max = glm::max(B.Max, G.Max);
+			C.Min = glm::min(A.Min, F.Min);
+			C.Max = glm::max(A.Max, F.Max);
+			A.Height = 1 + std::max(B.Height, G.Height);
+			C.Height = 1 + std::max(A.Height, F.Height);
+		}
+		else {
+			C.Child2 = iG;
+			A.Child2 = iF;
+			F.Parent = iA;
+			A.Min = glm::min(B.Min, F.Min);
+			A.Max = glm::max(B.Max, F.Max);
+			C.Min = glm::min(A.Min, G.Min);
+			C.Max = glm::max(A.Max, G.Max);
+			A.Height = 1 + std::max(B.Height, F.Height);
+			C.Height = 1 + std::max(A.Height, G.Height);
+		}
+		return iC;
+	}
+
+	if (balance < -1) {
+		//rotate B up
+		int32_t iD = B.Child1;
+		int32_t iE = B.Child2;
+		AabbTreeNode& D = mNodes[iD];
+		AabbTreeNode& E = mNodes[iE];
+
+		B.Child1 = iA;
+		B.Parent = A.Parent;
+		A.Parent = iB;
+		if (B.Parent != -1) {
+			if (mNodes[B.Parent].Child1 == iA)
+				mNodes[B.Parent].Child1 = iB;
+			else
+				mNodes[B.Parent].Child2 = iB;
+		}
+		else {
+			mRoot = iB;
+		}
+
+		if (D.Height > E.Height) {
+			B.Child2 = iD;
+			A.Child1 = iE;
+			E.Parent = iA;
+			A.Min = glm::min(C.Min, E.Min);
+			A.Max = glm::max(C.Max, E.Max);
+			B.Min = glm::min(A.Min, D.Min);
+			B.Max = glm::max(A.Max, D.Max);
+			A.Height = 1 + std::max(C.Height, E.Height);
+			B.Height = 1 + std::max(A.Height, D.Height);
+		}
+		else {
+			B.Child2 = iE;
+			A.Child1 = iD;
+			D.Parent = iA;
+			A.Min = glm::min(C.Min, D.Min);
+			A.Max = glm::max(C.Max, D.Max);
+			B.Min = glm::min(A.Min, E.Min);
+			B.Max = glm::max(A.Max, E.Max);
+			A.Height = 1 + std::max(C.Height, D.Height);
+			B.Height = 1 + std::max(A.Height, E.Height);
+		}
+		return iB;
+	}
+	return iA;
+}
+
+void AabbTree::CollectLeaves(int32_t nodeId, std::vector<uint64_t>& results)const {
+	int32_t stack[QueryStackSize];
+	int32_t count = 0;
+	stack[count++] = nodeId;
+	while (count > 0) {
+		const AabbTreeNode& node = mNodes[stack[--count]];
+		if (node.IsLeaf()) {
+			results.push_back(node.UserData);
+		}
+		else {
+			stack[count++] = node.Child1;
+			stack[count++] = node.Child2;
+		}
+	}
+}
+
+void AabbTree::QueryFrustum(const glm::vec4 planes[6], std::vector<uint64_t>& results)const {
+	CPU_ZONE("aabb tree frustum query");
+	results.clear();
+	if (mRoot == -1)
+		return;
+	assert(Height() < QueryStackSize);
+	//each entry carries the planes its parent still straddles
+	int32_t stack[QueryStackSize];
+	uint32_t planeMasks[QueryStackSize];
+	int32_t count = 0;
+	stack[count] = mRoot;
+	planeMasks[count++] = 0x3f;
+	while (count > 0) {
+		--count;
+		int32_t nodeId = stack[count];
+		uint32_t planeMask = planeMasks[count];
+		const AabbTreeNode& node = mNodes[nodeId];
+		glm::vec3 center = 0.5f * (node.Min + node.Max);
+		glm::vec3 extents = 0.5f * (node.Max - node.Min);
+		//planes already cleared are skipped, a fully inside subtree costs no tests
+		bool outside = false;
+		for (int p = 0; p < 6; ++p) {
+			if ((planeMask & (1u << p)) == 0)
+				continue;
+			glm::vec3 n = glm::vec3(planes[p]);
+			float d = glm::dot(n, center) + planes[p].w;
+			float r = glm::dot(glm::abs(n), extents);
+			if (d + r < 0.0f) {
+				outside = true;
+				break;
+			}
+			if (d - r >= 0.0f)
+				planeMask &= ~(1u << p);
+		}
+		if (outside)
+			continue;
+		if (node.IsLeaf()) {
+			results.push_back(node.UserData);
+		}
+		else {
+			stack[count] = node.Child1;
+			planeMasks[count++] = planeMask;
+			stack[count] = node.Child2;
+			planeMasks[count++] = planeMask;
+		}
+	}
+}
+
+void AabbTree::QueryAabb(const glm::vec3& minW, const glm::vec3& maxW, std::vector<uint64_t>& results)const {
+	results.clear();
+	if (mRoot == -1)
+		return;
+	assert(Height() < QueryStackSize);
+	int32_t stack[QueryStackSize];
+	int32_t count = 0;
+	stack[count++] = mRoot;
+	while (count > 0) {
+		int32_t nodeId = stack[--count];
+		const AabbTreeNode& node = mNodes[nodeId];
+		if (glm::any(glm::lessThan(node.Max, minW)) || glm::any(glm::lessThan(maxW, node.Min)))
+			continue;
+		if (Contains(minW, maxW, node.Min, node.Max)) {
+			CollectLeaves(nodeId, results);
+		}
+		else if (node.IsLeaf()) {
+			results.push_back(node.UserData);
+		}
+		else {
+			stack[count++] = node.Child1;
+			stack[count++] = node.Child2;
+		}
+	}
+}
+
+void AabbTree::QueryRay(const glm::vec3& origin, const glm::vec3& dir, float maxDist, std::vector<AabbTreeHit>& results)const {
+	results.clear();
+	if (mRoot == -1)
+		return;
+	glm::vec3 invDir;
+	for (int i = 0; i < 3; ++i)
+		invDir[i] = dir[i] != 0.0f ? 1.0f / dir[i] : 1e30f;
+	assert(Height() < QueryStackSize);
+	int32_t stack[QueryStackSize];
+	int32_t count = 0;
+	stack[count++] = mRoot;
+	while (count > 0) {
+		int32_t nodeId = stack[--count];
+		const AabbTreeNode& node = mNodes[nodeId];
+		//slab test
+		glm::vec3 t0 = (node.Min - origin) * invDir;
+		glm::vec3 t1 = (node.Max - origin) * invDir;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDist));
+		if (tEnter > tExit)
+			continue;
+		if (node.IsLeaf()) {
+			results.push_back({ node.UserData, tEnter });
+		}
+		else {
+			stack[count++] = node.Child1;
+			stack[count++] = node.Child2;
+		}
+	}
+	std::sort(results.begin(), results.end(), [](const AabbTreeHit& a, const AabbTreeHit& b) { return a.Distance < b.Distance; });
+}
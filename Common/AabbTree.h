@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+///<summary>
+/// Dynamic AABB tree for scene level queries.  Render items or instances are
+/// registered as proxies with a world space box and a 64 bit user value (e.g.
+/// ritem index << 32 | instance index).  Leaves store a fattened box so small
+/// moves don't touch the tree; MoveProxy reinserts only when an object leaves
+/// its fat box, and SetProxyBounds + Refit updates many leaves in place
+/// without changing the topology.  Inserts pick the sibling with the smallest
+/// surface area cost and rotations keep the tree balanced.
+///
+/// Queries walk the tree from the root, a subtree that is fully inside the
+/// frustum is accepted without any further plane tests and one fully outside
+/// is rejected with a single test.
+///</summary>
+
+struct AabbTreeNode {
+	glm::vec3 Min{ 0.0f };
+	glm::vec3 Max{ 0.0f };
+	uint64_t UserData{ 0 };
+	int32_t Parent{ -1 };//next free node when on the free list
+	int32_t Child1{ -1 };
+	int32_t Child2{ -1 };
+	int32_t Height{ -1 };//0 for leaves, -1 when free
+
+	bool IsLeaf()const { return Child1 == -1; }
+};
+
+struct AabbTreeHit {
+	uint64_t UserData;
+	float Distance;//ray parameter where it enters the leaf's fat box
+};
+
+class AabbTree {
+	std::vector<AabbTreeNode> mNodes;
+	int32_t mRoot{ -1 };
+	int32_t mFreeList{ -1 };
+	uint32_t mProxyCount{ 0 };
+	float mMargin{ 0.1f };
+	// Depth first queries keep at most Height() + 1 nodes pending, inserts keep the
+	// tree balanced so a million proxies are about 30 high.
+	static const int32_t QueryStackSize = 128;
+
+	int32_t AllocateNode();
+	void FreeNode(int32_t nodeId);
+	void InsertLeaf(int32_t leaf);
+	void RemoveLeaf(int32_t leaf);
+	int32_t Balance(int32_t a);
+	void FixUpwards(int32_t nodeId);
+	void CollectLeaves(int32_t nodeId, std::vector<uint64_t>& results)const;
+public:
+	AabbTree(float margin = 0.1f) :mMargin(margin) {}
+
+	void Clear();
+	void Reserve(size_t proxyCount);
+
+	// Returns the proxy id used by the functions below.
+	int32_t CreateProxy(const glm::vec3& minW, const glm::vec3& maxW, uint64_t userData);
+	void DestroyProxy(int32_t proxyId);
+	// Reinserts only if the box left its fat bounds, returns true when it did.
+	bool MoveProxy(int32_t proxyId, const glm::vec3& minW, const glm::vec3& maxW);
+	// Overwrites a leaf's box without reinsertion, call Refit after a batch.
+	void SetProxyBounds(int32_t proxyId, const glm::vec3& minW, const glm::vec3& maxW);
+	// Recompute every internal box from its children, bottom up.
+	void Refit();
+
+	uint64_t GetUserData(int32_t proxyId)const { return mNodes[proxyId].UserData; }
+	const AabbTreeNode& GetNode(int32_t nodeId)const { return mNodes[nodeId]; }
+	uint32_t ProxyCount()const { return mProxyCount; }
+	int32_t Height()const { return mRoot == -1 ? 0 : mNodes[mRoot].Height; }
+
+	// Planes as from Camera::GetFrustumPlanes, normals point inward.
+	void QueryFrustum(const glm::vec4 planes[6], std::vector<uint64_t>& results)const;
+	void QueryAabb(const glm::vec3& minW, const glm::vec3& maxW, std::vector<uint64_t>& results)const;
+	// Leaves whose fat box the ray enters before maxDist, nearest first, so a
+	// picker can stop once its closest exact hit is nearer than the next entry.
+	void QueryRay(const glm::vec3& origin, const glm::vec3& dir, float maxDist, std::vector<AabbTreeHit>& results)const;
+};
@@ -0,0 +1,126 @@
+#include "BindlessHeap.h"
+#include <algorithm>
+
+BindlessHeap::BindlessHeap(VkDevice device_, VkPhysicalDeviceMemoryProperties& memoryProperties, VkSampler sampler, uint32_t maxTextures_, VkDeviceSize materialSize_, uint32_t maxMaterials_, uint32_t frameCount_) :VulkanObject(device_),
+	materialSize(materialSize_), maxMaterials(maxMaterials_), maxTextures(maxTextures_), frameCount(frameCount_) {
+	VkDescriptorSetLayoutBinding bindings[3] = {
+		{ MaterialBinding,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1,VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,nullptr },
+		{ SamplerBinding,VK_DESCRIPTOR_TYPE_SAMPLER,1,VK_SHADER_STAGE_FRAGMENT_BIT,nullptr },
+		{ TextureBinding,VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,maxTextures,VK_SHADER_STAGE_FRAGMENT_BIT,nullptr },
+	};
+	//only the texture array changes while bound
+	VkDescriptorBindingFlagsEXT bindingFlags[3] = { 0,0,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT };
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsCI{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT };
+	flagsCI.bindingCount = 3;
+	flagsCI.pBindingFlags = bindingFlags;
+	VkDescriptorSetLayoutCreateInfo layoutCI{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layoutCI.pNext = &flagsCI;
+	layoutCI.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutCI.bindingCount = 3;
+	layoutCI.pBindings = bindings;
+	VkResult res = vkCreateDescriptorSetLayout(device, &layoutCI, nullptr, &layout);
+	assert(res == VK_SUCCESS);
+
+	VkDescriptorPoolSize poolSizes[3] = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER,1 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,maxTextures },
+	};
+	VkDescriptorPoolCreateInfo poolCI{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolCI.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolCI.maxSets = 1;
+	poolCI.poolSizeCount = 3;
+	poolCI.pPoolSizes = poolSizes;
+	res = vkCreateDescriptorPool(device, &poolCI, nullptr, &pool);
+	assert(res == VK_SUCCESS);
+
+	VkDescriptorSetAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocInfo.descriptorPool = pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+	res = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	assert(res == VK_SUCCESS);
+
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;//initBuffer maps CPU_ONLY persistently
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	props.size = materialSize * maxMaterials * frameCount;
+	Vulkan::initBuffer(device, memoryProperties, props, materialBuffer);
+	materials = (uint8_t*)Vulkan::mapBuffer(device, materialBuffer);
+	memset(materials, 0, (size_t)props.size);
+
+	VkDescriptorBufferInfo bufferInfo{ materialBuffer.buffer,0,props.size };
+	VkDescriptorImageInfo samplerInfo{ sampler,VK_NULL_HANDLE,VK_IMAGE_LAYOUT_UNDEFINED };
+	VkWriteDescriptorSet writes[2] = { { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET } };
+	writes[0].dstSet = set;
+	writes[0].dstBinding = MaterialBinding;
+	writes[0].descriptorCount = 1;
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes[0].pBufferInfo = &bufferInfo;
+	writes[1].dstSet = set;
+	writes[1].dstBinding = SamplerBinding;
+	writes[1].descriptorCount = 1;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	writes[1].pImageInfo = &samplerInfo;
+	vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+}
+
+BindlessHeap::~BindlessHeap() {
+	Vulkan::unmapBuffer(device, materialBuffer);
+	Vulkan::cleanupBuffer(device, materialBuffer);
+	vkDestroyDescriptorPool(device, pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, layout, nullptr);
+}
+
+uint32_t BindlessHeap::AddTexture(VkImageView imageView) {
+	uint32_t index = UINT32_MAX;
+	if (!freeTextures.empty()) {
+		index = freeTextures.back();
+		freeTextures.pop_back();
+	}
+	else if (textureCount < maxTextures)
+		index = textureCount++;
+	else {
+		assert(false && "bindless heap full");
+		return UINT32_MAX;
+	}
+	VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE,imageView,VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	write.dstSet = set;
+	write.dstBinding = TextureBinding;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	liveTextures++;
+	return index;
+}
+
+void BindlessHeap::RemoveTexture(uint32_t index) {
+	assert(index < textureCount);
+	//frames in flight may still sample it, the slot's descriptor stays until it's reused
+	pendingFrees.push_back({ index,frameNumber });
+	liveTextures--;
+}
+
+void BindlessHeap::BeginFrame(uint32_t frame) {
+	assert(frame < frameCount);
+	currFrame = frame;
+	frameNumber++;
+	//anything removed frameCount frames ago is no longer read
+	auto done = std::partition(pendingFrees.begin(), pendingFrees.end(), [&](const PendingFree& p) {return frameNumber - p.Frame <= frameCount; });
+	for (auto it = done; it != pendingFrees.end(); ++it)
+		freeTextures.push_back(it->Index);
+	pendingFrees.erase(done, pendingFrees.end());
+}
+
+void BindlessHeap::WriteMaterial(uint32_t index, const void* data, size_t size) {
+	assert(index < maxMaterials && size <= materialSize);
+	memcpy(materials + materialSize * (MaterialBase() + index), data, size);
+}
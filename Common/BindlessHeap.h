@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include "Vulkan.h"
+#include "VulkanEx.h"
+
+///<summary>
+/// One descriptor set holding every texture and material a frame can touch,
+/// bound once per frame (VK_EXT_descriptor_indexing, VulkApp::mDescriptorIndexing):
+///
+///   binding 0  readonly buffer, MaterialData materials[] (frameCount copies)
+///   binding 1  sampler
+///   binding 2  texture2D textures[maxTextures], partially bound, update after bind
+///
+/// AddTexture writes the image view into a free slot and returns its index,
+/// which stays valid until RemoveTexture. Slots are updated in place while the
+/// set is bound by frames in flight, so loading or streaming textures never
+/// rebuilds a set. Removed slots are reused only after frameCount BeginFrames.
+///
+/// Materials are written into the current frame's copy. The shader reads
+/// materials[MaterialBase() + index], MaterialBase going in with the per
+/// object constants of that frame.
+///</summary>
+class BindlessHeap : public VulkanObject {
+public:
+	static const uint32_t MaterialBinding = 0;
+	static const uint32_t SamplerBinding = 1;
+	static const uint32_t TextureBinding = 2;
+private:
+	VkDescriptorPool pool{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout layout{ VK_NULL_HANDLE };
+	VkDescriptorSet set{ VK_NULL_HANDLE };
+	Vulkan::Buffer materialBuffer;
+	uint8_t* materials{ nullptr };
+	VkDeviceSize materialSize{ 0 };
+	uint32_t maxMaterials{ 0 };
+	uint32_t maxTextures{ 0 };
+	uint32_t frameCount{ 0 };
+	uint32_t currFrame{ 0 };
+	uint64_t frameNumber{ 0 };
+	uint32_t textureCount{ 0 };//slots ever used
+	uint32_t liveTextures{ 0 };
+	std::vector<uint32_t> freeTextures;
+	struct PendingFree {
+		uint32_t Index;
+		uint64_t Frame;
+	};
+	std::vector<PendingFree> pendingFrees;
+public:
+	// materialSize is the shader's array stride, frameCount the number of frame
+	// resources materials are written for. sampler is used for every texture.
+	BindlessHeap(VkDevice device_, VkPhysicalDeviceMemoryProperties& memoryProperties, VkSampler sampler, uint32_t maxTextures_, VkDeviceSize materialSize_, uint32_t maxMaterials_, uint32_t frameCount_);
+	BindlessHeap(const BindlessHeap& rhs) = delete;
+	BindlessHeap& operator=(const BindlessHeap& rhs) = delete;
+	~BindlessHeap();
+	operator VkDescriptorSet()const { return set; }
+	VkDescriptorSetLayout getLayout()const { return layout; }
+
+	// The image in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. Returns UINT32_MAX when full.
+	uint32_t AddTexture(VkImageView imageView);
+	void RemoveTexture(uint32_t index);
+
+	// frame is the frame resource index, after its fence has been waited on.
+	void BeginFrame(uint32_t frame);
+	uint32_t MaterialBase()const { return currFrame * maxMaterials; }
+	void WriteMaterial(uint32_t index, const void* data, size_t size);
+	template<typename T>
+	void WriteMaterial(uint32_t index, const T& data) { WriteMaterial(index, &data, sizeof(T)); }
+
+	uint32_t TextureCount()const { return liveTextures; }
+	uint32_t MaxTextures()const { return maxTextures; }
+};
@@ -36,6 +36,20 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf) {
 }
 
 
+void Camera::GetFrustumPlanes(glm::vec4 planes[6])const {
+	//Gribb/Hartmann, rows of viewProj, depth is [0,1]
+	glm::mat4 m = glm::transpose(mProj * mView);
+	planes[0] = m[3] + m[0];//left
+	planes[1] = m[3] - m[0];//right
+	planes[2] = m[3] + m[1];//bottom
+	planes[3] = m[3] - m[1];//top
+	planes[4] = m[2];//near
+	planes[5] = m[3] - m[2];//far
+	for (int i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
 void Camera::LookAt(glm::vec3 pos, glm::vec3 target, glm::vec3 worldUp) {
 	glm::vec3 L = glm::normalize(target - pos);
 	glm::vec3 R = glm::normalize(glm::cross(worldUp, L));
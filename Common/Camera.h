@@ -59,6 +59,10 @@ public:
 	glm::mat4 GetView()const { return mView; }
 	glm::mat4 GetProj()const { return mProj; }
 
+	//world space frustum planes (left, right, bottom, top, near, far) as (n,d),
+	//normals point inward and are unit length so n.p+d is a signed distance
+	void GetFrustumPlanes(glm::vec4 planes[6])const;
+
 	//strafe/walk the camera a distance d
 	void Strafe(float angle);
 	void Walk(float d);
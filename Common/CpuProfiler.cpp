@@ -0,0 +1,206 @@
+#include "CpuProfiler.h"
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	thread_local CpuProfiler* tlsProfiler = nullptr;//the profiler tlsRing belongs to
+	thread_local void* tlsRing = nullptr;
+
+	void appendEscaped(std::string& out, const char* text) {
+		for (; *text; ++text) {
+			if (*text == '"' || *text == '\\')
+				out += '\\';
+			out += *text;
+		}
+	}
+}
+
+CpuProfiler& CpuProfiler::Get() {
+	static CpuProfiler profiler;
+	return profiler;
+}
+
+uint64_t CpuProfiler::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CpuProfiler::Zone::Zone(const char* name_) : name(nullptr), start(0) {
+	CpuProfiler& profiler = CpuProfiler::Get();
+	if (!profiler.Enabled())
+		return;
+	profiler.threadRing()->Depth++;
+	name = name_;
+	start = now();
+}
+
+CpuProfiler::Zone::~Zone() {
+	if (name != nullptr)
+		CpuProfiler::Get().record(name, start, now());
+}
+
+CpuProfiler::Ring* CpuProfiler::threadRing() {
+	if (tlsProfiler != this) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRings.push_back(std::make_unique<Ring>());
+		mRings.back()->Thread = (uint32_t)mRings.size();
+		tlsRing = mRings.back().get();
+		tlsProfiler = this;
+	}
+	return (Ring*)tlsRing;
+}
+
+void CpuProfiler::record(const char* name, uint64_t start, uint64_t end) {
+	Ring* ring = threadRing();
+	uint32_t depth = --ring->Depth;
+	uint32_t head = ring->Head.load(std::memory_order_relaxed);
+	if (head - ring->Tail.load(std::memory_order_acquire) >= RingSize) {
+		ring->Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ring->Events[head & (RingSize - 1)] = { name,start,end,depth };
+	ring->Head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::Histogram::Add(double ms) {
+	//bucket i holds [2^(i/8), 2^((i+1)/8)) us
+	double us = ms * 1000.0;
+	int bucket = us <= 1.0 ? 0 : (int)(std::log2(us) * BucketsPerOctave);
+	Buckets[(std::min)(bucket, (int)BucketCount - 1)]++;
+	Count++;
+	MaxMs = (std::max)(MaxMs, ms);
+}
+
+double CpuProfiler::Histogram::Percentile(double fraction)const {
+	if (Count == 0)
+		return 0.0;
+	uint32_t rank = (std::max)(1u, (uint32_t)std::ceil(fraction * Count));
+	uint32_t seen = 0;
+	uint32_t bucket = 0;
+	for (; bucket < BucketCount - 1; ++bucket) {
+		seen += Buckets[bucket];
+		if (seen >= rank)
+			break;
+	}
+	//the bucket's geometric middle, never past the largest seen
+	double us = std::pow(2.0, (bucket + 0.5) / BucketsPerOctave);
+	return (std::min)(us / 1000.0, MaxMs);
+}
+
+CpuProfiler::ZoneStats& CpuProfiler::zoneStats(const char* name) {
+	//the same literal can have a different address in another translation unit
+	auto stats = std::find_if(mZones.begin(), mZones.end(), [&](const ZoneStats& s) {return s.Name == name || strcmp(s.Name, name) == 0; });
+	if (stats != mZones.end())
+		return *stats;
+	mZones.emplace_back();
+	mZones.back().Name = name;
+	return mZones.back();
+}
+
+void CpuProfiler::EndFrame() {
+	bool capturing = mCaptureFrames > 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& ring : mRings) {
+			uint32_t tail = ring->Tail.load(std::memory_order_relaxed);
+			uint32_t head = ring->Head.load(std::memory_order_acquire);
+			for (; tail != head; ++tail) {
+				const Event& event = ring->Events[tail & (RingSize - 1)];
+				ZoneStats& stats = zoneStats(event.Name);
+				stats.FrameMs += (event.End - event.Start) / 1000000.0;
+				stats.InFrame = true;
+				if (capturing && event.Start >= mTraceBase)
+					addTraceEvent(event, ring->Thread);
+			}
+			ring->Tail.store(tail, std::memory_order_release);
+			mDropped += ring->Dropped.exchange(0, std::memory_order_relaxed);
+		}
+	}
+	for (auto& stats : mZones) {
+		if (!stats.InFrame)
+			continue;
+		stats.Window.Add(stats.FrameMs);
+		if (capturing)
+			stats.Captured.Add(stats.FrameMs);
+		stats.FrameMs = 0.0;
+		stats.InFrame = false;
+	}
+	if (capturing)
+		mCaptureFrames--;
+	mCaptureFrame++;
+}
+
+std::vector<CpuProfiler::Percentiles> CpuProfiler::TakePercentiles() {
+	std::vector<Percentiles> percentiles;
+	for (auto& stats : mZones) {
+		Histogram& window = stats.Window;
+		if (window.Count == 0)
+			continue;
+		percentiles.push_back({ stats.Name,window.Count,window.Percentile(0.5),window.Percentile(0.95),window.Percentile(0.99),window.MaxMs });
+		window = Histogram();
+	}
+	return percentiles;
+}
+
+void CpuProfiler::addTraceEvent(const Event& event, uint32_t thread) {
+	char buffer[192];
+	if (!mTraceEvents.empty())
+		mTraceEvents += ",\n";
+	mTraceEvents += "{\"name\":\"";
+	appendEscaped(mTraceEvents, event.Name);
+	snprintf(buffer, sizeof(buffer), "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu,\"depth\":%u}}",
+		thread, (event.Start - mTraceBase) / 1000.0, (event.End - event.Start) / 1000.0, (unsigned long long)mCaptureFrame, event.Depth);
+	mTraceEvents += buffer;
+}
+
+void CpuProfiler::Capture(uint32_t frames) {
+	if (!Enabled())
+		return;
+	mCaptureFrames = frames;
+	mCaptureFrame = 0;
+	mTraceBase = now();
+	mTraceEvents.clear();
+	for (auto& stats : mZones)
+		stats.Captured = Histogram();
+}
+
+void CpuProfiler::writePercentiles(std::string& out, const char* name, const Histogram& histogram) {
+	char buffer[192];
+	out += "{\"name\":\"";
+	appendEscaped(out, name);
+	snprintf(buffer, sizeof(buffer), "\",\"frames\":%u,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+		histogram.Count, histogram.Percentile(0.5), histogram.Percentile(0.95), histogram.Percentile(0.99), histogram.MaxMs);
+	out += buffer;
+}
+
+bool CpuProfiler::WriteTrace(const char* path) {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	char buffer[128];
+	file << "{\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}}";
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& ring : mRings) {
+			snprintf(buffer, sizeof(buffer), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}", ring->Thread, ring->Thread);
+			file << buffer;
+		}
+	}
+	if (!mTraceEvents.empty())
+		file << ",\n" << mTraceEvents;
+	//per zone ms percentiles over the captured frames
+	std::string summary;
+	for (auto& stats : mZones) {
+		if (stats.Captured.Count == 0)
+			continue;
+		if (!summary.empty())
+			summary += ",\n";
+		writePercentiles(summary, stats.Name, stats.Captured);
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\",\"metadata\":{\"droppedZones\":" << mDropped << ",\"percentiles\":[\n" << summary << "\n]}}\n";
+	return file.good();
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+///<summary>
+/// Named cpu zones for every thread, cheap enough to leave in. CPU_ZONE("name")
+/// times the rest of the enclosing block with steady_clock; when the zone ends it
+/// goes into the calling thread's own ring, single producer and single consumer,
+/// so recording takes no lock (a full ring drops the zone and counts it). The first
+/// zone of a thread registers its ring, under the one lock.
+///
+/// EndFrame, on the thread that runs the frame, drains every ring, sums each zone
+/// name's time over the frame and adds the sum to that name's histogram, so a zone
+/// entered by several record threads counts once per frame. The histograms are
+/// logarithmic, 8 buckets an octave from 1us, so a percentile is within about 5%.
+/// TakePercentiles gives p50/p95/p99 since the last call. Capture keeps the next
+/// frames' zones as Chrome trace events, a track per thread, and WriteTrace saves
+/// them with the capture's percentiles, next to GpuProfiler's trace. The two clocks
+/// aren't correlated, so they're separate files.
+///
+/// Zone names must be string literals, they're kept by pointer.
+///</summary>
+class CpuProfiler {
+public:
+	struct Percentiles {
+		std::string Name;
+		uint32_t Frames{ 0 };//the zone was in
+		double P50Ms{ 0.0 };
+		double P95Ms{ 0.0 };
+		double P99Ms{ 0.0 };
+		double MaxMs{ 0.0 };
+	};
+	class Zone {
+		const char* name;
+		uint64_t start;
+	public:
+		Zone(const char* name_);
+		~Zone();
+		Zone(const Zone& rhs) = delete;
+		Zone& operator=(const Zone& rhs) = delete;
+	};
+private:
+	static const uint32_t RingSize = 4096;//power of 2
+	struct Event {
+		const char* Name;
+		uint64_t Start;
+		uint64_t End;
+		uint32_t Depth;
+	};
+	struct Ring {
+		Event Events[RingSize];
+		std::atomic<uint32_t> Head{ 0 };//written by the owning thread
+		std::atomic<uint32_t> Tail{ 0 };//written by EndFrame
+		std::atomic<uint32_t> Dropped{ 0 };
+		uint32_t Thread{ 0 };
+		uint32_t Depth{ 0 };
+	};
+	struct Histogram {
+		static const uint32_t BucketsPerOctave = 8;
+		static const uint32_t BucketCount = 8 * 24;//1us to 16s
+		uint32_t Buckets[BucketCount]{};
+		uint32_t Count{ 0 };
+		double MaxMs{ 0.0 };
+		void Add(double ms);
+		double Percentile(double fraction)const;
+	};
+	struct ZoneStats {
+		const char* Name{ nullptr };
+		double FrameMs{ 0.0 };//summed this frame
+		bool InFrame{ false };
+		Histogram Window;//since TakePercentiles
+		Histogram Captured;//since Capture
+	};
+	std::atomic<bool> mEnabled{ false };
+	std::mutex mMutex;//ring registration
+	std::vector<std::unique_ptr<Ring>> mRings;
+	std::vector<ZoneStats> mZones;
+	uint32_t mCaptureFrames{ 0 };
+	uint64_t mCaptureFrame{ 0 };
+	uint64_t mTraceBase{ 0 };
+	std::string mTraceEvents;
+	uint32_t mDropped{ 0 };
+	CpuProfiler() = default;
+
+	static uint64_t now();
+	Ring* threadRing();
+	void record(const char* name, uint64_t start, uint64_t end);
+	ZoneStats& zoneStats(const char* name);
+	void addTraceEvent(const Event& event, uint32_t thread);
+	static void writePercentiles(std::string& out, const char* name, const Histogram& histogram);
+public:
+	CpuProfiler(const CpuProfiler& rhs) = delete;
+	CpuProfiler& operator=(const CpuProfiler& rhs) = delete;
+	static CpuProfiler& Get();
+
+	// Off until enabled, a zone then costs a relaxed load.
+	void SetEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+	bool Enabled()const { return mEnabled.load(std::memory_order_relaxed); }
+
+	// After the frame's work, every thread's zones included, is done.
+	void EndFrame();
+	std::vector<Percentiles> TakePercentiles();
+	// Zones dropped by full rings, ever.
+	uint32_t Dropped()const { return mDropped; }
+
+	void Capture(uint32_t frames);
+	bool Capturing()const { return mCaptureFrames > 0; }
+	bool WriteTrace(const char* path);
+};
+
+#define CPU_ZONE_CONCAT2(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT2(a, b)
+#define CPU_ZONE(name) CpuProfiler::Zone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
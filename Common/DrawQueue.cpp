@@ -0,0 +1,137 @@
+#include "DrawQueue.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+
+uint32_t DrawQueue::Intern(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t handle, uint32_t bits) {
+	auto it = ids.find(handle);
+	if (it != ids.end())
+		return it->second;
+	//past what the key has room for everything shares the last id, still correct, just less grouping
+	uint32_t id = (std::min)((uint32_t)ids.size(), (1u << bits) - 1);
+	ids[handle] = id;
+	return id;
+}
+
+void DrawQueue::Clear() {
+	mPackets.clear();
+	mKeys.clear();
+}
+
+void DrawQueue::Add(const Packet& packet, uint32_t layer, float depth, bool transparent) {
+	assert(layer < 16);
+	uint64_t pipeline = Intern(mPipelineIds, (uint64_t)packet.Pipeline, 10);
+	uint64_t set = Intern(mSetIds, (uint64_t)packet.MaterialSet, 10);
+	uint64_t mesh = Intern(mMeshIds, (uint64_t)packet.VertexBuffer, 12);
+	depth = (std::min)((std::max)(depth, 0.0f), 1.0f);
+	uint64_t quantized = (uint64_t)(depth * ((1 << 28) - 1));
+	uint64_t key = (uint64_t)layer << 60;
+	if (transparent)
+		key |= (((1ull << 28) - 1 - quantized) << 32) | (pipeline << 22) | (set << 12) | mesh;
+	else
+		key |= (pipeline << 50) | (set << 40) | (mesh << 28) | quantized;
+	mPackets.push_back(packet);
+	mKeys.push_back(key);
+}
+
+void DrawQueue::Sort() {
+	CPU_ZONE("draw queue sort");
+	size_t count = mKeys.size();
+	mOrder.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+		mOrder[i] = i;
+	if (count < 2)
+		return;
+	mScratchKeys.resize(count);
+	mScratchOrder.resize(count);
+
+	uint64_t differing = 0;
+	for (size_t i = 1; i < count; ++i)
+		differing |= mKeys[i] ^ mKeys[0];
+	mCounts.resize(1 << 16);
+	for (uint32_t shift = 0; shift < 64; shift += 16) {
+		if (((differing >> shift) & 0xffff) == 0)
+			continue;
+		std::fill(mCounts.begin(), mCounts.end(), 0);
+		for (size_t i = 0; i < count; ++i)
+			mCounts[(mKeys[i] >> shift) & 0xffff]++;
+		uint32_t sum = 0;
+		for (auto& c : mCounts) {
+			uint32_t n = c;
+			c = sum;
+			sum += n;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t dst = mCounts[(mKeys[i] >> shift) & 0xffff]++;
+			mScratchKeys[dst] = mKeys[i];
+			mScratchOrder[dst] = mOrder[i];
+		}
+		mKeys.swap(mScratchKeys);
+		mOrder.swap(mScratchOrder);
+	}
+}
+
+void DrawQueue::Submit(VkCommandBuffer cmd) {
+	mStats = Stats{};
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkDescriptorSet materialSet = VK_NULL_HANDLE;
+	uint32_t materialSetIndex = UINT32_MAX;
+	VkDescriptorSet objectSet = VK_NULL_HANDLE;
+	uint32_t objectSetIndex = UINT32_MAX;
+	uint32_t objectOffset = 0;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize offsets[1] = { 0 };
+	for (uint32_t i : mOrder) {
+		const Packet& packet = mPackets[i];
+		if (packet.Pipeline != pipeline) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.Pipeline);
+			pipeline = packet.Pipeline;
+			mStats.PipelineBinds++;
+		}
+		else
+			mStats.PipelineBindsSaved++;
+		if (packet.Layout != layout) {
+			layout = packet.Layout;
+			materialSet = VK_NULL_HANDLE;
+			objectSet = VK_NULL_HANDLE;
+		}
+		if (packet.MaterialSet != VK_NULL_HANDLE) {
+			if (packet.MaterialSet != materialSet || packet.MaterialSetIndex != materialSetIndex) {
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, packet.MaterialSetIndex, 1, &packet.MaterialSet, 0, nullptr);
+				materialSet = packet.MaterialSet;
+				materialSetIndex = packet.MaterialSetIndex;
+				mStats.DescriptorBinds++;
+			}
+			else
+				mStats.DescriptorBindsSaved++;
+		}
+		if (packet.ObjectSet != VK_NULL_HANDLE) {
+			if (packet.ObjectSet != objectSet || packet.ObjectSetIndex != objectSetIndex || packet.ObjectOffset != objectOffset) {
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, packet.ObjectSetIndex, 1, &packet.ObjectSet, 1, &packet.ObjectOffset);
+				objectSet = packet.ObjectSet;
+				objectSetIndex = packet.ObjectSetIndex;
+				objectOffset = packet.ObjectOffset;
+				mStats.DescriptorBinds++;
+			}
+			else
+				mStats.DescriptorBindsSaved++;
+		}
+		if (packet.VertexBuffer != vertexBuffer) {
+			vkCmdBindVertexBuffers(cmd, 0, 1, &packet.VertexBuffer, offsets);
+			vertexBuffer = packet.VertexBuffer;
+			mStats.BufferBinds++;
+		}
+		else
+			mStats.BufferBindsSaved++;
+		if (packet.IndexBuffer != indexBuffer) {
+			vkCmdBindIndexBuffer(cmd, packet.IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			indexBuffer = packet.IndexBuffer;
+			mStats.BufferBinds++;
+		}
+		else
+			mStats.BufferBindsSaved++;
+		vkCmdDrawIndexed(cmd, packet.IndexCount, 1, packet.FirstIndex, packet.VertexOffset, 0);
+		mStats.Draws++;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "Vulkan.h"
+
+///<summary>
+/// Draws collected for one render pass, sorted on a 64 bit key and then
+/// submitted with only the binds that change from one draw to the next.
+///
+/// Add turns the packet's pipeline, material set and vertex buffer into small
+/// ids (kept from frame to frame, so keys stay stable) and builds the key:
+///
+///   opaque       layer:4 pipeline:10 set:10 mesh:12 depth:28, front to back
+///   transparent  layer:4 depth:28 pipeline:10 set:10 mesh:12, back to front
+///
+/// Layers keep their order (opaque before sky say), inside a layer opaque
+/// draws group by state and transparent ones keep the painter's order. Sort
+/// is an LSD radix sort, 16 bits a pass, skipping the digits every key shares.
+///
+/// Submit binds the pipeline, the material and object sets and the vertex and
+/// index buffers only when they differ from the previous draw, index buffers
+/// are bound at offset 0 and draws start at FirstIndex. A new pipeline layout
+/// forgets the bound sets. The counters say how many binds that saved.
+///</summary>
+class DrawQueue {
+public:
+	struct Packet {
+		VkPipeline Pipeline{ VK_NULL_HANDLE };
+		VkPipelineLayout Layout{ VK_NULL_HANDLE };
+		// Optional, per material or texture, bound without dynamic offsets.
+		VkDescriptorSet MaterialSet{ VK_NULL_HANDLE };
+		uint32_t MaterialSetIndex{ 0 };
+		// Optional, per object, with one dynamic offset.
+		VkDescriptorSet ObjectSet{ VK_NULL_HANDLE };
+		uint32_t ObjectSetIndex{ 0 };
+		uint32_t ObjectOffset{ 0 };
+		VkBuffer VertexBuffer{ VK_NULL_HANDLE };
+		VkBuffer IndexBuffer{ VK_NULL_HANDLE };
+		uint32_t IndexCount{ 0 };
+		uint32_t FirstIndex{ 0 };
+		int32_t VertexOffset{ 0 };
+	};
+	struct Stats {
+		uint32_t Draws{ 0 };
+		uint32_t PipelineBinds{ 0 };
+		uint32_t PipelineBindsSaved{ 0 };
+		uint32_t DescriptorBinds{ 0 };
+		uint32_t DescriptorBindsSaved{ 0 };
+		uint32_t BufferBinds{ 0 };
+		uint32_t BufferBindsSaved{ 0 };
+	};
+private:
+	std::vector<Packet> mPackets;
+	std::vector<uint64_t> mKeys;
+	std::vector<uint32_t> mOrder;
+	std::vector<uint64_t> mScratchKeys;
+	std::vector<uint32_t> mScratchOrder;
+	std::vector<uint32_t> mCounts;
+	std::unordered_map<uint64_t, uint32_t> mPipelineIds;
+	std::unordered_map<uint64_t, uint32_t> mSetIds;
+	std::unordered_map<uint64_t, uint32_t> mMeshIds;
+	Stats mStats;
+
+	static uint32_t Intern(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t handle, uint32_t bits);
+public:
+	// Drops last frame's draws, keeps the ids.
+	void Clear();
+	// depth in [0, 1], 0 nearest. layer < 16.
+	void Add(const Packet& packet, uint32_t layer, float depth, bool transparent = false);
+	void Sort();
+	// In Sort's order, inside a render pass with viewport and scissor set.
+	void Submit(VkCommandBuffer cmd);
+
+	uint32_t Size()const { return (uint32_t)mPackets.size(); }
+	// Of the last Submit.
+	const Stats& GetStats()const { return mStats; }
+};
@@ -0,0 +1,212 @@
+#include "FrustumCulling.h"
+#include "CpuProfiler.h"
+#include <cfloat>
+#include <cmath>
+#include <cassert>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+void FrustumCuller::Resize(size_t count) {
+	size_t padded = (count + 7) & ~(size_t)7;
+	if (mRadius.size() >= padded)
+		return;
+	mCenterX.resize(padded, 0.0f);
+	mCenterY.resize(padded, 0.0f);
+	mCenterZ.resize(padded, 0.0f);
+	mExtentX.resize(padded, 0.0f);
+	mExtentY.resize(padded, 0.0f);
+	mExtentZ.resize(padded, 0.0f);
+	mRadius.resize(padded, -FLT_MAX);//padding is outside every plane
+}
+
+void FrustumCuller::Clear() {
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mExtentX.clear();
+	mExtentY.clear();
+	mExtentZ.clear();
+	mRadius.clear();
+	mCount = 0;
+}
+
+void FrustumCuller::Reserve(size_t count) {
+	size_t padded = (count + 7) & ~(size_t)7;
+	mCenterX.reserve(padded);
+	mCenterY.reserve(padded);
+	mCenterZ.reserve(padded);
+	mExtentX.reserve(padded);
+	mExtentY.reserve(padded);
+	mExtentZ.reserve(padded);
+	mRadius.reserve(padded);
+}
+
+uint32_t FrustumCuller::AddBox(const glm::vec3& minW, const glm::vec3& maxW) {
+	uint32_t index = mCount++;
+	Resize(mCount);
+	glm::vec3 center = 0.5f * (minW + maxW);
+	glm::vec3 extents = 0.5f * (maxW - minW);
+	mCenterX[index] = center.x;
+	mCenterY[index] = center.y;
+	mCenterZ[index] = center.z;
+	mExtentX[index] = extents.x;
+	mExtentY[index] = extents.y;
+	mExtentZ[index] = extents.z;
+	mRadius[index] = 0.0f;
+	return index;
+}
+
+uint32_t FrustumCuller::AddBox(const glm::vec3& minL, const glm::vec3& maxL, const glm::mat4& world) {
+	uint32_t index = mCount++;
+	Resize(mCount);
+	SetBox(index, minL, maxL, world);
+	return index;
+}
+
+uint32_t FrustumCuller::AddSphere(const glm::vec3& centerW, float radius) {
+	uint32_t index = mCount++;
+	Resize(mCount);
+	mCenterX[index] = centerW.x;
+	mCenterY[index] = centerW.y;
+	mCenterZ[index] = centerW.z;
+	mExtentX[index] = 0.0f;
+	mExtentY[index] = 0.0f;
+	mExtentZ[index] = 0.0f;
+	mRadius[index] = radius;
+	return index;
+}
+
+void FrustumCuller::SetBox(uint32_t index, const glm::vec3& minL, const glm::vec3& maxL, const glm::mat4& world) {
+	//Arvo: the world extents are the local extents through |M|
+	glm::vec3 centerL = 0.5f * (minL + maxL);
+	glm::vec3 extentsL = 0.5f * (maxL - minL);
+	glm::vec3 center = glm::vec3(world * glm::vec4(centerL, 1.0f));
+	glm::mat3 absM = glm::mat3(glm::abs(glm::vec3(world[0])), glm::abs(glm::vec3(world[1])), glm::abs(glm::vec3(world[2])));
+	glm::vec3 extents = absM * extentsL;
+	mCenterX[index] = center.x;
+	mCenterY[index] = center.y;
+	mCenterZ[index] = center.z;
+	mExtentX[index] = extents.x;
+	mExtentY[index] = extents.y;
+	mExtentZ[index] = extents.z;
+	mRadius[index] = 0.0f;
+}
+
+ContainmentType FrustumCuller::Test(const glm::vec4 planes[6], const glm::vec3& center, const glm::vec3& extents, float radius) {
+	bool inside = true;
+	for (int p = 0; p < 6; ++p) {
+		glm::vec3 n = glm::vec3(planes[p]);
+		float d = glm::dot(n, center) + planes[p].w;
+		float r = glm::dot(glm::abs(n), extents) + radius;
+		if (d + r < 0.0f)
+			return DISJOINT;
+		if (d - r < 0.0f)
+			inside = false;
+	}
+	return inside ? CONTAINS : INTERSECTS;
+}
+
+#if defined(__AVX__)
+struct PlanesAVX {
+	__m256 nx[6], ny[6], nz[6], nw[6];
+	__m256 ax[6], ay[6], az[6];//|n|
+	PlanesAVX(const glm::vec4 planes[6]) {
+		for (int p = 0; p < 6; ++p) {
+			nx[p] = _mm256_set1_ps(planes[p].x);
+			ny[p] = _mm256_set1_ps(planes[p].y);
+			nz[p] = _mm256_set1_ps(planes[p].z);
+			nw[p] = _mm256_set1_ps(planes[p].w);
+			ax[p] = _mm256_set1_ps(fabsf(planes[p].x));
+			ay[p] = _mm256_set1_ps(fabsf(planes[p].y));
+			az[p] = _mm256_set1_ps(fabsf(planes[p].z));
+		}
+	}
+};
+#endif
+
+uint32_t FrustumCuller::Cull(const glm::vec4 planes[6], std::vector<uint32_t>& visible)const {
+	//room for a whole batch so the writes below don't need a branch
+	visible.resize(mRadius.size());
+	uint32_t visibleCount = Cull(planes, 0, mCount, visible.data());
+	visible.resize(visibleCount);
+	return visibleCount;
+}
+
+uint32_t FrustumCuller::Cull(const glm::vec4 planes[6], uint32_t begin, uint32_t end, uint32_t* visible)const {
+	CPU_ZONE("frustum cull");
+	assert((begin & 7) == 0 && ((end & 7) == 0 || end == mCount));
+	uint32_t visibleCount = 0;
+#if defined(__AVX__)
+	PlanesAVX pl(planes);
+	const __m256 zero = _mm256_setzero_ps();
+	//the last batch runs into the padding, which is always outside
+	for (size_t i = begin; i < end; i += 8) {
+		__m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+		__m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+		__m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+		__m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		__m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		__m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+		__m256 rad = _mm256_loadu_ps(&mRadius[i]);
+		__m256 outside = zero;
+		for (int p = 0; p < 6; ++p) {
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pl.nx[p], cx), _mm256_mul_ps(pl.ny[p], cy)), _mm256_add_ps(_mm256_mul_ps(pl.nz[p], cz), pl.nw[p]));
+			__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pl.ax[p], ex), _mm256_mul_ps(pl.ay[p], ey)), _mm256_add_ps(_mm256_mul_ps(pl.az[p], ez), rad));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_LT_OQ));
+		}
+		uint32_t mask = ~(uint32_t)_mm256_movemask_ps(outside) & 0xff;
+		for (uint32_t b = 0; b < 8; ++b) {
+			visible[visibleCount] = (uint32_t)i + b;
+			visibleCount += (mask >> b) & 1;
+		}
+	}
+#else
+	for (uint32_t i = begin; i < end; ++i) {
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			float d = planes[p].x * mCenterX[i] + planes[p].y * mCenterY[i] + planes[p].z * mCenterZ[i] + planes[p].w;
+			float r = fabsf(planes[p].x) * mExtentX[i] + fabsf(planes[p].y) * mExtentY[i] + fabsf(planes[p].z) * mExtentZ[i] + mRadius[i];
+			outside = d + r < 0.0f;
+		}
+		visible[visibleCount] = i;
+		visibleCount += outside ? 0 : 1;
+	}
+#endif
+	return visibleCount;
+}
+
+void FrustumCuller::Classify(const glm::vec4 planes[6], std::vector<uint8_t>& results)const {
+	results.resize(mRadius.size());
+#if defined(__AVX__)
+	PlanesAVX pl(planes);
+	const __m256 zero = _mm256_setzero_ps();
+	for (size_t i = 0; i < mRadius.size(); i += 8) {
+		__m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+		__m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+		__m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+		__m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		__m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		__m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+		__m256 rad = _mm256_loadu_ps(&mRadius[i]);
+		__m256 outside = zero;
+		__m256 crossing = zero;
+		for (int p = 0; p < 6; ++p) {
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pl.nx[p], cx), _mm256_mul_ps(pl.ny[p], cy)), _mm256_add_ps(_mm256_mul_ps(pl.nz[p], cz), pl.nw[p]));
+			__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pl.ax[p], ex), _mm256_mul_ps(pl.ay[p], ey)), _mm256_add_ps(_mm256_mul_ps(pl.az[p], ez), rad));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_LT_OQ));
+			crossing = _mm256_or_ps(crossing, _mm256_cmp_ps(_mm256_sub_ps(d, r), zero, _CMP_LT_OQ));
+		}
+		uint32_t outsideMask = (uint32_t)_mm256_movemask_ps(outside);
+		uint32_t crossingMask = (uint32_t)_mm256_movemask_ps(crossing);
+		for (uint32_t b = 0; b < 8; ++b) {
+			results[i + b] = ((outsideMask >> b) & 1) ? DISJOINT : ((crossingMask >> b) & 1) ? INTERSECTS : CONTAINS;
+		}
+	}
+#else
+	for (uint32_t i = 0; i < mCount; ++i) {
+		results[i] = Test(planes, glm::vec3(mCenterX[i], mCenterY[i], mCenterZ[i]), glm::vec3(mExtentX[i], mExtentY[i], mExtentZ[i]), mRadius[i]);
+	}
+#endif
+	results.resize(mCount);
+}
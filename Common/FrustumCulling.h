@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+///<summary>
+/// Frustum culling over world space bounds kept in structure of arrays form.
+/// Every object is a box (centre/extents) with an optional sphere radius on
+/// top, so boxes use radius 0 and spheres use zero extents.  The planes come
+/// from Camera::GetFrustumPlanes once per frame, and each plane is tested with
+/// the centre/extent method: d = n.c + w, r = |n|.e + radius, outside when
+/// d < -r, and fully inside that plane when d >= r.
+///
+/// With __AVX__ (/arch:AVX) 8 objects are tested per iteration, the arrays
+/// are padded to a multiple of 8 with objects that are always outside.
+///</summary>
+
+enum ContainmentType : uint8_t {
+	DISJOINT = 0,
+	INTERSECTS = 1,
+	CONTAINS = 2
+};
+
+class FrustumCuller {
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+	std::vector<float> mRadius;
+	uint32_t mCount{ 0 };
+
+	void Resize(size_t count);
+public:
+	FrustumCuller() = default;
+
+	void Clear();
+	void Reserve(size_t count);
+	uint32_t Count()const { return mCount; }
+
+	// Returns the index of the new object.
+	uint32_t AddBox(const glm::vec3& minW, const glm::vec3& maxW);
+	// Local bounds moved to a world space AABB that encloses the transformed box.
+	uint32_t AddBox(const glm::vec3& minL, const glm::vec3& maxL, const glm::mat4& world);
+	uint32_t AddSphere(const glm::vec3& centerW, float radius);
+	void SetBox(uint32_t index, const glm::vec3& minL, const glm::vec3& maxL, const glm::mat4& world);
+	void GetBox(uint32_t index, glm::vec3& center, glm::vec3& extents)const {
+		center = glm::vec3(mCenterX[index], mCenterY[index], mCenterZ[index]);
+		extents = glm::vec3(mExtentX[index], mExtentY[index], mExtentZ[index]);
+	}
+
+	// Indices of the objects that aren't outside, returns how many were written.
+	uint32_t Cull(const glm::vec4 planes[6], std::vector<uint32_t>& visible)const;
+	// Same over [begin, end) so threads can split the work: begin is a multiple
+	// of 8, end is too unless it is Count(), and visible has room for
+	// end - begin rounded up to 8.
+	uint32_t Cull(const glm::vec4 planes[6], uint32_t begin, uint32_t end, uint32_t* visible)const;
+	// One ContainmentType per object.
+	void Classify(const glm::vec4 planes[6], std::vector<uint8_t>& results)const;
+
+	// Scalar reference of the test above.
+	static ContainmentType Test(const glm::vec4 planes[6], const glm::vec3& center, const glm::vec3& extents, float radius);
+};
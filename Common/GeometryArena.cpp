@@ -0,0 +1,282 @@
+#include "GeometryArena.h"
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+RangeAllocator::RangeAllocator(uint32_t capacity_) {
+	Reset(capacity_);
+}
+
+void RangeAllocator::Reset(uint32_t capacity_, uint32_t used_) {
+	assert(used_ <= capacity_);
+	capacity = capacity_;
+	used = used_;
+	freeRanges.clear();
+	if (used_ < capacity_)
+		freeRanges[used_] = capacity_ - used_;
+}
+
+uint32_t RangeAllocator::Allocate(uint32_t count) {
+	assert(count > 0);
+	auto best = freeRanges.end();
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+		if (it->second >= count && (best == freeRanges.end() || it->second < best->second)) {
+			best = it;
+			if (best->second == count)
+				break;
+		}
+	}
+	if (best == freeRanges.end())
+		return Invalid;
+	uint32_t offset = best->first;
+	uint32_t remaining = best->second - count;
+	freeRanges.erase(best);
+	if (remaining > 0)
+		freeRanges[offset + count] = remaining;
+	used += count;
+	return offset;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count) {
+	assert(count > 0 && offset + count <= capacity && count <= used);
+	used -= count;
+	auto next = freeRanges.lower_bound(offset);
+	assert(next == freeRanges.end() || next->first >= offset + count);
+	//merge with the free range after, then the one before
+	if (next != freeRanges.end() && next->first == offset + count) {
+		count += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset) {
+			prev->second += count;
+			return;
+		}
+	}
+	freeRanges[offset] = count;
+}
+
+uint32_t RangeAllocator::LargestFree()const {
+	uint32_t largest = 0;
+	for (auto& range : freeRanges)
+		largest = (std::max)(largest, range.second);
+	return largest;
+}
+
+GeometryArena::GeometryArena(VkDevice device_, VkQueue queue_, VkCommandBuffer cmd_, VkPhysicalDeviceMemoryProperties& memoryProperties_, uint32_t vertexStride_, uint32_t maxVertices, uint32_t maxIndices) :VulkanObject(device_),
+	queue(queue_), cmd(cmd_), memoryProperties(memoryProperties_), vertexStride(vertexStride_), vertices(maxVertices), indices(maxIndices) {
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+#endif
+	//transfer source too, Defragment copies within them
+	props.bufferUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	props.size = (VkDeviceSize)maxVertices * vertexStride;
+	Vulkan::initBuffer(device, memoryProperties, props, vertexBuffer);
+	props.bufferUsage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	props.size = (VkDeviceSize)maxIndices * sizeof(uint32_t);
+	Vulkan::initBuffer(device, memoryProperties, props, indexBuffer);
+}
+
+GeometryArena::~GeometryArena() {
+	for (auto& mesh : meshes)
+		mesh.Geo->Arena = nullptr;
+	Vulkan::cleanupBuffer(device, indexBuffer);
+	Vulkan::cleanupBuffer(device, vertexBuffer);
+}
+
+void GeometryArena::submit(const std::function<void(VkCommandBuffer)>& record) {
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	VkResult res = vkBeginCommandBuffer(cmd, &beginInfo);
+	assert(res == VK_SUCCESS);
+	record(cmd);
+	//the copies before any later vertex input reads them
+	VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	res = vkEndCommandBuffer(cmd);
+	assert(res == VK_SUCCESS);
+
+	VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cmd;
+	VkFence fence = Vulkan::initFence(device);
+	res = vkQueueSubmit(queue, 1, &submitInfo, fence);
+	assert(res == VK_SUCCESS);
+	res = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+	assert(res == VK_SUCCESS);
+	vkDestroyFence(device, fence, nullptr);
+}
+
+bool GeometryArena::Add(MeshGeometry& geo, const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount) {
+	assert(geo.Arena == nullptr && vertexCount > 0 && indexCount > 0);
+	uint32_t firstVertex = vertices.Allocate(vertexCount);
+	if (firstVertex == RangeAllocator::Invalid)
+		return false;
+	uint32_t firstIndex = indices.Allocate(indexCount);
+	if (firstIndex == RangeAllocator::Invalid) {
+		vertices.Free(firstVertex, vertexCount);
+		return false;
+	}
+
+	VkDeviceSize vertexBytes = (VkDeviceSize)vertexCount * vertexStride;
+	VkDeviceSize indexBytes = (VkDeviceSize)indexCount * sizeof(uint32_t);
+	Vulkan::Buffer stagingBuffer;
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	props.size = vertexBytes + indexBytes;
+	Vulkan::initBuffer(device, memoryProperties, props, stagingBuffer);
+	uint8_t* ptr = (uint8_t*)Vulkan::mapBuffer(device, stagingBuffer);
+	memcpy(ptr, vertexData, (size_t)vertexBytes);
+	memcpy(ptr + vertexBytes, indexData, (size_t)indexBytes);
+	submit([&](VkCommandBuffer cmd_) {
+		VkBufferCopy vertexCopy{ 0,(VkDeviceSize)firstVertex * vertexStride,vertexBytes };
+		vkCmdCopyBuffer(cmd_, stagingBuffer.buffer, vertexBuffer.buffer, 1, &vertexCopy);
+		VkBufferCopy indexCopy{ vertexBytes,(VkDeviceSize)firstIndex * sizeof(uint32_t),indexBytes };
+		vkCmdCopyBuffer(cmd_, stagingBuffer.buffer, indexBuffer.buffer, 1, &indexCopy);
+		});
+	Vulkan::unmapBuffer(device, stagingBuffer);
+	Vulkan::cleanupBuffer(device, stagingBuffer);
+
+	geo.vertexBufferGPU = vertexBuffer;
+	geo.indexBufferGPU = indexBuffer;
+	geo.VertexByteStride = vertexStride;
+	geo.VertexBufferByteSize = (uint32_t)vertexBytes;
+	geo.IndexBufferByteSize = (uint32_t)indexBytes;
+	geo.Arena = this;
+	geo.BaseVertexLocation = firstVertex;
+	geo.StartIndexLocation = firstIndex;
+	meshes.push_back({ &geo,firstVertex,vertexCount,firstIndex,indexCount });
+	return true;
+}
+
+void GeometryArena::Remove(MeshGeometry& geo) {
+	auto it = std::find_if(meshes.begin(), meshes.end(), [&](const Mesh& mesh) {return mesh.Geo == &geo; });
+	assert(it != meshes.end());
+	vertices.Free(it->FirstVertex, it->VertexCount);
+	indices.Free(it->FirstIndex, it->IndexCount);
+	meshes.erase(it);
+	geo.vertexBufferGPU = Vulkan::Buffer();
+	geo.indexBufferGPU = Vulkan::Buffer();
+	geo.Arena = nullptr;
+	geo.BaseVertexLocation = 0;
+	geo.StartIndexLocation = 0;
+}
+
+VkDeviceSize GeometryArena::Defragment() {
+	//new, packed, locations keeping the current order; a mesh that's already in place isn't copied
+	std::vector<Mesh*> byVertex, byIndex;
+	for (auto& mesh : meshes) {
+		byVertex.push_back(&mesh);
+		byIndex.push_back(&mesh);
+	}
+	std::sort(byVertex.begin(), byVertex.end(), [](const Mesh* a, const Mesh* b) {return a->FirstVertex < b->FirstVertex; });
+	std::sort(byIndex.begin(), byIndex.end(), [](const Mesh* a, const Mesh* b) {return a->FirstIndex < b->FirstIndex; });
+	std::vector<uint32_t> newFirstVertex(meshes.size()), newFirstIndex(meshes.size());
+	//moved meshes go to a scratch buffer and back at their packed location
+	std::vector<VkBufferCopy> vertexToScratch, scratchToVertex, indexToScratch, scratchToIndex;
+	VkDeviceSize scratchSize = 0;
+	uint32_t packed = 0;
+	for (auto mesh : byVertex) {
+		newFirstVertex[mesh - meshes.data()] = packed;
+		if (mesh->FirstVertex != packed) {
+			VkDeviceSize bytes = (VkDeviceSize)mesh->VertexCount * vertexStride;
+			vertexToScratch.push_back({ (VkDeviceSize)mesh->FirstVertex * vertexStride,scratchSize,bytes });
+			scratchToVertex.push_back({ scratchSize,(VkDeviceSize)packed * vertexStride,bytes });
+			scratchSize += bytes;
+		}
+		packed += mesh->VertexCount;
+	}
+	packed = 0;
+	for (auto mesh : byIndex) {
+		newFirstIndex[mesh - meshes.data()] = packed;
+		if (mesh->FirstIndex != packed) {
+			VkDeviceSize bytes = (VkDeviceSize)mesh->IndexCount * sizeof(uint32_t);
+			indexToScratch.push_back({ (VkDeviceSize)mesh->FirstIndex * sizeof(uint32_t),scratchSize,bytes });
+			scratchToIndex.push_back({ scratchSize,(VkDeviceSize)packed * sizeof(uint32_t),bytes });
+			scratchSize += bytes;
+		}
+		packed += mesh->IndexCount;
+	}
+	if (scratchSize == 0)
+		return 0;
+
+	//through a scratch buffer, copy regions in one buffer mustn't overlap and moved meshes can
+	Vulkan::Buffer scratchBuffer;
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	props.size = scratchSize;
+	Vulkan::initBuffer(device, memoryProperties, props, scratchBuffer);
+	submit([&](VkCommandBuffer cmd_) {
+		if (!vertexToScratch.empty())
+			vkCmdCopyBuffer(cmd_, vertexBuffer.buffer, scratchBuffer.buffer, (uint32_t)vertexToScratch.size(), vertexToScratch.data());
+		if (!indexToScratch.empty())
+			vkCmdCopyBuffer(cmd_, indexBuffer.buffer, scratchBuffer.buffer, (uint32_t)indexToScratch.size(), indexToScratch.data());
+		VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		if (!scratchToVertex.empty())
+			vkCmdCopyBuffer(cmd_, scratchBuffer.buffer, vertexBuffer.buffer, (uint32_t)scratchToVertex.size(), scratchToVertex.data());
+		if (!scratchToIndex.empty())
+			vkCmdCopyBuffer(cmd_, scratchBuffer.buffer, indexBuffer.buffer, (uint32_t)scratchToIndex.size(), scratchToIndex.data());
+		});
+	Vulkan::cleanupBuffer(device, scratchBuffer);
+
+	uint32_t vertexCount = 0, indexCount = 0;
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		Mesh& mesh = meshes[i];
+		mesh.FirstVertex = mesh.Geo->BaseVertexLocation = newFirstVertex[i];
+		mesh.FirstIndex = mesh.Geo->StartIndexLocation = newFirstIndex[i];
+		vertexCount += mesh.VertexCount;
+		indexCount += mesh.IndexCount;
+	}
+	vertices.Reset(vertices.Capacity(), vertexCount);
+	indices.Reset(indices.Capacity(), indexCount);
+	bytesMoved += scratchSize;
+	return scratchSize;
+}
+
+void GeometryArena::Bind(VkCommandBuffer cmd_)const {
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd_, 0, 1, &vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(cmd_, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+VkDrawIndexedIndirectCommand GeometryArena::DrawCommand(const MeshGeometry& geo, const SubmeshGeometry& submesh, uint32_t instanceCount, uint32_t firstInstance)const {
+	assert(geo.Arena == this);
+	VkDrawIndexedIndirectCommand command{};
+	command.indexCount = submesh.IndexCount;
+	command.instanceCount = instanceCount;
+	command.firstIndex = geo.StartIndexLocation + submesh.StartIndexLocation;
+	command.vertexOffset = (int32_t)(geo.BaseVertexLocation + submesh.BaseVertexLocation);
+	command.firstInstance = firstInstance;
+	return command;
+}
+
+GeometryArena::Stats GeometryArena::GetStats()const {
+	Stats stats;
+	stats.VertexBytes = (VkDeviceSize)vertices.Used() * vertexStride;
+	stats.VertexCapacity = (VkDeviceSize)vertices.Capacity() * vertexStride;
+	stats.IndexBytes = (VkDeviceSize)indices.Used() * sizeof(uint32_t);
+	stats.IndexCapacity = (VkDeviceSize)indices.Capacity() * sizeof(uint32_t);
+	stats.Meshes = (uint32_t)meshes.size();
+	stats.FreeRanges = vertices.FreeRanges() + indices.FreeRanges();
+	stats.BytesMoved = bytesMoved;
+	return stats;
+}
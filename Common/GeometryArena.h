@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstdint>
+#include "Vulkan.h"
+#include "VulkanEx.h"
+#include "VulkUtil.h"
+
+///<summary>
+/// Ranges of a fixed size array handed out by offset and count. Free ranges are
+/// kept by offset so a freed range merges with its free neighbours, Allocate
+/// takes the smallest free range that fits (best fit keeps the big ranges for
+/// big meshes).
+///</summary>
+class RangeAllocator {
+	std::map<uint32_t, uint32_t> freeRanges;//offset to count
+	uint32_t capacity{ 0 };
+	uint32_t used{ 0 };
+public:
+	static const uint32_t Invalid = UINT32_MAX;
+	RangeAllocator(uint32_t capacity_ = 0);
+	// Everything below used_ allocated, the rest one free range.
+	void Reset(uint32_t capacity_, uint32_t used_ = 0);
+	// Offset of count elements, Invalid when no free range is big enough.
+	uint32_t Allocate(uint32_t count);
+	void Free(uint32_t offset, uint32_t count);
+
+	uint32_t Capacity()const { return capacity; }
+	uint32_t Used()const { return used; }
+	uint32_t LargestFree()const;
+	uint32_t FreeRanges()const { return (uint32_t)freeRanges.size(); }
+};
+
+///<summary>
+/// One device local vertex buffer and one 32 bit index buffer shared by every
+/// mesh of a vertex layout. Add uploads a mesh into ranges of them and makes
+/// the MeshGeometry a view of the arena: its vertexBufferGPU/indexBufferGPU are
+/// the arena's buffers and BaseVertexLocation/StartIndexLocation where its data
+/// starts. A pass binds the two buffers once and draws every item with
+///
+///   firstIndex   = geo.StartIndexLocation + submesh.StartIndexLocation
+///   vertexOffset = geo.BaseVertexLocation + submesh.BaseVertexLocation
+///
+/// which is also what DrawCommand fills in for vkCmdDrawIndexedIndirect.
+///
+/// Remove gives a mesh's ranges back, Defragment packs what's left to the start
+/// of both buffers and updates the meshes' locations. Neither waits for the
+/// gpu, whatever draws the meshes involved has to be done first (after
+/// vkDeviceWaitIdle, or with every frame's fence waited on). Uploads and moves
+/// are submitted on queue and waited for, like the buffer builders.
+///</summary>
+class GeometryArena : public VulkanObject {
+public:
+	struct Stats {
+		VkDeviceSize VertexBytes{ 0 };
+		VkDeviceSize VertexCapacity{ 0 };
+		VkDeviceSize IndexBytes{ 0 };
+		VkDeviceSize IndexCapacity{ 0 };
+		uint32_t Meshes{ 0 };
+		uint32_t FreeRanges{ 0 };		//vertex and index, 2 when packed
+		VkDeviceSize BytesMoved{ 0 };	//by Defragment, ever
+	};
+private:
+	struct Mesh {
+		MeshGeometry* Geo{ nullptr };
+		uint32_t FirstVertex{ 0 };
+		uint32_t VertexCount{ 0 };
+		uint32_t FirstIndex{ 0 };
+		uint32_t IndexCount{ 0 };
+	};
+	VkQueue queue{ VK_NULL_HANDLE };
+	VkCommandBuffer cmd{ VK_NULL_HANDLE };
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	uint32_t vertexStride{ 0 };
+	Vulkan::Buffer vertexBuffer;
+	Vulkan::Buffer indexBuffer;
+	RangeAllocator vertices;
+	RangeAllocator indices;
+	std::vector<Mesh> meshes;
+	VkDeviceSize bytesMoved{ 0 };
+	void submit(const std::function<void(VkCommandBuffer)>& record);
+public:
+	GeometryArena(VkDevice device_, VkQueue queue_, VkCommandBuffer cmd_, VkPhysicalDeviceMemoryProperties& memoryProperties_, uint32_t vertexStride_, uint32_t maxVertices, uint32_t maxIndices);
+	GeometryArena(const GeometryArena& rhs) = delete;
+	GeometryArena& operator=(const GeometryArena& rhs) = delete;
+	~GeometryArena();
+
+	// false, and geo untouched, when either buffer has no free range big enough.
+	bool Add(MeshGeometry& geo, const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount);
+	void Remove(MeshGeometry& geo);
+	// Returns the bytes moved, 0 when already packed.
+	VkDeviceSize Defragment();
+
+	void Bind(VkCommandBuffer cmd_)const;
+	VkDrawIndexedIndirectCommand DrawCommand(const MeshGeometry& geo, const SubmeshGeometry& submesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0)const;
+
+	VkBuffer VertexBuffer()const { return vertexBuffer.buffer; }
+	VkBuffer IndexBuffer()const { return indexBuffer.buffer; }
+	uint32_t VertexStride()const { return vertexStride; }
+	Stats GetStats()const;
+};
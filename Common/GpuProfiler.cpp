@@ -0,0 +1,225 @@
+#include "GpuProfiler.h"
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+namespace {
+	//in bit order, which is the order a statistics query writes them
+	const VkQueryPipelineStatisticFlags ProfiledStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	const uint32_t StatisticsCount = 3;
+
+	void appendEscaped(std::string& out, const char* text) {
+		for (; *text; ++text) {
+			if (*text == '"' || *text == '\\')
+				out += '\\';
+			out += *text;
+		}
+	}
+}
+
+const uint32_t GpuProfiler::NoQuery;
+
+GpuProfiler::GpuProfiler(VkDevice device, const VkPhysicalDeviceProperties& properties, const VkPhysicalDeviceFeatures& enabledFeatures, uint32_t timestampValidBits, uint32_t frameCount, uint32_t maxScopes)
+	: mDevice(device), mMaxScopes(maxScopes), mFrames(frameCount) {
+	if (timestampValidBits == 0)
+		return;
+	mTimestampMask = timestampValidBits >= 64 ? UINT64_MAX : (1ull << timestampValidBits) - 1;
+	mNsPerTick = properties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = frameCount * maxScopes * 2;
+	VkResult res = vkCreateQueryPool(mDevice, &poolInfo, nullptr, &mTimestamps);
+	assert(res == VK_SUCCESS);
+	if (enabledFeatures.pipelineStatisticsQuery) {
+		poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		poolInfo.queryCount = frameCount * maxScopes;
+		poolInfo.pipelineStatistics = ProfiledStatistics;
+		res = vkCreateQueryPool(mDevice, &poolInfo, nullptr, &mStatistics);
+		assert(res == VK_SUCCESS);
+		mStatisticsFlags = ProfiledStatistics;
+		mInheritedQueries = enabledFeatures.inheritedQueries == VK_TRUE;
+	}
+	mTicks.resize(maxScopes * 2);
+	mCounts.resize(maxScopes * StatisticsCount);
+}
+
+GpuProfiler::~GpuProfiler() {
+	if (mStatistics != VK_NULL_HANDLE)
+		vkDestroyQueryPool(mDevice, mStatistics, nullptr);
+	if (mTimestamps != VK_NULL_HANDLE)
+		vkDestroyQueryPool(mDevice, mTimestamps, nullptr);
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer cmd, uint32_t slot, bool statistics) {
+	if (!Enabled())
+		return;
+	assert(slot < mFrames.size() && mOpen.empty());
+	Frame& frame = mFrames[slot];
+	resolve(frame, slot);
+	frame.Scopes.clear();
+	frame.StatisticsQueries = 0;
+	frame.Number = mFrameNumber++;
+	mSlot = slot;
+	mStatisticsOpen = false;
+	vkCmdResetQueryPool(cmd, mTimestamps, slot * mMaxScopes * 2, mMaxScopes * 2);
+	if (mStatistics != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(cmd, mStatistics, slot * mMaxScopes, mMaxScopes);
+	BeginScope(cmd, "frame", statistics);
+}
+
+void GpuProfiler::BeginScope(VkCommandBuffer cmd, const char* name, bool statistics) {
+	if (!Enabled())
+		return;
+	Frame& frame = mFrames[mSlot];
+	if (frame.Scopes.size() == mMaxScopes) {
+		mOpen.push_back(NoQuery);
+		return;
+	}
+	Scope scope{ name,(uint32_t)mOpen.size(),(mSlot * mMaxScopes + (uint32_t)frame.Scopes.size()) * 2,NoQuery };
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mTimestamps, scope.Query);
+	if (statistics && mStatistics != VK_NULL_HANDLE && !mStatisticsOpen) {
+		scope.StatisticsQuery = mSlot * mMaxScopes + frame.StatisticsQueries++;
+		vkCmdBeginQuery(cmd, mStatistics, scope.StatisticsQuery, 0);
+		mStatisticsOpen = true;
+	}
+	mOpen.push_back((uint32_t)frame.Scopes.size());
+	frame.Scopes.push_back(scope);
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer cmd) {
+	if (!Enabled())
+		return;
+	assert(!mOpen.empty());
+	uint32_t index = mOpen.back();
+	mOpen.pop_back();
+	if (index == NoQuery)
+		return;
+	const Scope& scope = mFrames[mSlot].Scopes[index];
+	if (scope.StatisticsQuery != NoQuery) {
+		vkCmdEndQuery(cmd, mStatistics, scope.StatisticsQuery);
+		mStatisticsOpen = false;
+	}
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mTimestamps, scope.Query + 1);
+}
+
+void GpuProfiler::EndFrame(VkCommandBuffer cmd) {
+	while (!mOpen.empty())
+		EndScope(cmd);
+}
+
+void GpuProfiler::resolve(Frame& frame, uint32_t slot) {
+	uint32_t count = (uint32_t)frame.Scopes.size();
+	if (count == 0)
+		return;
+	//no WAIT bit, the slot's fence has been waited on. VK_NOT_READY would mean the frame
+	//was never submitted, its results are dropped
+	VkResult res = vkGetQueryPoolResults(mDevice, mTimestamps, slot * mMaxScopes * 2, count * 2, sizeof(uint64_t) * count * 2, mTicks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (res != VK_SUCCESS)
+		return;
+	if (frame.StatisticsQueries > 0) {
+		res = vkGetQueryPoolResults(mDevice, mStatistics, slot * mMaxScopes, frame.StatisticsQueries, sizeof(uint64_t) * StatisticsCount * frame.StatisticsQueries,
+			mCounts.data(), sizeof(uint64_t) * StatisticsCount, VK_QUERY_RESULT_64_BIT);
+		if (res != VK_SUCCESS)
+			return;
+	}
+
+	double msPerTick = mNsPerTick / 1000000.0;
+	uint64_t frameStart = mTicks[0];
+	mLastFrame.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		const Scope& scope = frame.Scopes[i];
+		Result& result = mLastFrame[i];
+		result.Name = scope.Name;
+		result.Depth = scope.Depth;
+		result.StartMs = ((mTicks[i * 2] - frameStart) & mTimestampMask) * msPerTick;
+		result.Ms = ((mTicks[i * 2 + 1] - mTicks[i * 2]) & mTimestampMask) * msPerTick;
+		result.HasStatistics = scope.StatisticsQuery != NoQuery;
+		if (result.HasStatistics) {
+			const uint64_t* counts = &mCounts[(scope.StatisticsQuery - slot * mMaxScopes) * StatisticsCount];
+			result.Primitives = counts[0];
+			result.VertexInvocations = counts[1];
+			result.FragmentInvocations = counts[2];
+		}
+		else
+			result.Primitives = result.VertexInvocations = result.FragmentInvocations = 0;
+
+		auto sum = std::find_if(mSums.begin(), mSums.end(), [&](const std::pair<Result, uint32_t>& s) {return s.first.Name == result.Name; });
+		if (sum == mSums.end()) {
+			mSums.push_back({ result,1 });
+			continue;
+		}
+		sum->first.StartMs += result.StartMs;
+		sum->first.Ms += result.Ms;
+		sum->first.Primitives += result.Primitives;
+		sum->first.VertexInvocations += result.VertexInvocations;
+		sum->first.FragmentInvocations += result.FragmentInvocations;
+		sum->second++;
+	}
+	if (mCaptureFrames > 0) {
+		addTraceEvents(frame);
+		mCaptureFrames--;
+	}
+}
+
+void GpuProfiler::addTraceEvents(const Frame& frame) {
+	if (!mTraceStarted) {
+		mTraceBase = mTicks[0];
+		mTraceStarted = true;
+	}
+	double usPerTick = mNsPerTick / 1000.0;
+	char buffer[256];
+	for (size_t i = 0; i < frame.Scopes.size(); ++i) {
+		const Result& result = mLastFrame[i];
+		if (!mTraceEvents.empty())
+			mTraceEvents += ",\n";
+		mTraceEvents += "{\"name\":\"";
+		appendEscaped(mTraceEvents, frame.Scopes[i].Name);
+		snprintf(buffer, sizeof(buffer), "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu",
+			((mTicks[i * 2] - mTraceBase) & mTimestampMask) * usPerTick, result.Ms * 1000.0, (unsigned long long)frame.Number);
+		mTraceEvents += buffer;
+		if (result.HasStatistics) {
+			snprintf(buffer, sizeof(buffer), ",\"primitives\":%llu,\"vertex invocations\":%llu,\"fragment invocations\":%llu",
+				(unsigned long long)result.Primitives, (unsigned long long)result.VertexInvocations, (unsigned long long)result.FragmentInvocations);
+			mTraceEvents += buffer;
+		}
+		mTraceEvents += "}}";
+	}
+}
+
+std::vector<GpuProfiler::Result> GpuProfiler::TakeAverages() {
+	std::vector<Result> averages;
+	for (auto& sum : mSums) {
+		Result average = sum.first;
+		average.StartMs /= sum.second;
+		average.Ms /= sum.second;
+		average.Primitives /= sum.second;
+		average.VertexInvocations /= sum.second;
+		average.FragmentInvocations /= sum.second;
+		averages.push_back(average);
+	}
+	mSums.clear();
+	return averages;
+}
+
+void GpuProfiler::Capture(uint32_t frames) {
+	if (!Enabled())
+		return;
+	mCaptureFrames = frames;
+	mTraceStarted = false;
+	mTraceEvents.clear();
+}
+
+bool GpuProfiler::WriteTrace(const char* path)const {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	file << "{\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"graphics queue\"}}";
+	if (!mTraceEvents.empty())
+		file << ",\n" << mTraceEvents;
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return file.good();
+}
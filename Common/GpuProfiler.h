@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Vulkan.h"
+
+///<summary>
+/// Gpu time and pipeline statistics of named scopes of a frame's primary command
+/// buffer, from core 1.0 queries only so it runs anywhere with timestamps, lavapipe
+/// included. Each frame slot has its own range of queries. BeginFrame reads back
+/// what the slot recorded last time round, which the wait on the slot's fence has
+/// already made available, then resets the range: results arrive a slot count of
+/// frames late and nothing ever waits on the gpu.
+///
+/// Scopes nest. A command buffer can only have one statistics query active, so a
+/// scope counts primitives and vertex and fragment invocations only when no scope
+/// around it does. Statistics need pipelineStatisticsQuery, and inheritedQueries
+/// for the secondaries executed inside a scope (RecordPasses sets their inheritance
+/// from StatisticsFlags). Without them scopes are only timed; a queue family with
+/// no timestampValidBits gets nothing and every call returns straight away.
+///
+/// Capture collects the next frames as Chrome trace events, one complete ("X")
+/// event per scope on a gpu track with the counts as args, and WriteTrace saves
+/// them as JSON that chrome://tracing and Perfetto open.
+///</summary>
+class GpuProfiler {
+public:
+	struct Result {
+		std::string Name;
+		uint32_t Depth{ 0 };
+		double StartMs{ 0.0 };//from the frame's first timestamp
+		double Ms{ 0.0 };
+		bool HasStatistics{ false };
+		uint64_t Primitives{ 0 };
+		uint64_t VertexInvocations{ 0 };
+		uint64_t FragmentInvocations{ 0 };
+	};
+private:
+	static const uint32_t NoQuery = UINT32_MAX;
+	struct Scope {
+		const char* Name;
+		uint32_t Depth;
+		uint32_t Query;//begin timestamp, the end is the next one
+		uint32_t StatisticsQuery;
+	};
+	struct Frame {
+		std::vector<Scope> Scopes;
+		uint32_t StatisticsQueries{ 0 };
+		uint64_t Number{ 0 };
+	};
+	VkDevice mDevice{ VK_NULL_HANDLE };
+	VkQueryPool mTimestamps{ VK_NULL_HANDLE };
+	VkQueryPool mStatistics{ VK_NULL_HANDLE };
+	VkQueryPipelineStatisticFlags mStatisticsFlags{ 0 };
+	bool mInheritedQueries{ false };
+	uint32_t mMaxScopes{ 0 };
+	uint64_t mTimestampMask{ 0 };
+	double mNsPerTick{ 1.0 };
+	std::vector<Frame> mFrames;//per slot
+	uint32_t mSlot{ 0 };
+	uint64_t mFrameNumber{ 0 };
+	std::vector<uint32_t> mOpen;//scope indices, NoQuery for one dropped past mMaxScopes
+	bool mStatisticsOpen{ false };
+	std::vector<uint64_t> mTicks;
+	std::vector<uint64_t> mCounts;
+	std::vector<Result> mLastFrame;
+	std::vector<std::pair<Result, uint32_t>> mSums;//by name in first seen order, with the frames summed
+	uint32_t mCaptureFrames{ 0 };
+	bool mTraceStarted{ false };
+	uint64_t mTraceBase{ 0 };
+	std::string mTraceEvents;
+
+	void resolve(Frame& frame, uint32_t slot);
+	void addTraceEvents(const Frame& frame);
+public:
+	// enabledFeatures is what the device was created with, timestampValidBits from the
+	// queue family the command buffers are submitted to.
+	GpuProfiler(VkDevice device, const VkPhysicalDeviceProperties& properties, const VkPhysicalDeviceFeatures& enabledFeatures, uint32_t timestampValidBits, uint32_t frameCount, uint32_t maxScopes = 64);
+	GpuProfiler(const GpuProfiler& rhs) = delete;
+	GpuProfiler& operator=(const GpuProfiler& rhs) = delete;
+	~GpuProfiler();
+
+	bool Enabled()const { return mTimestamps != VK_NULL_HANDLE; }
+	// What a secondary executed inside a scope has to inherit, 0 when that isn't possible.
+	VkQueryPipelineStatisticFlags StatisticsFlags()const { return mInheritedQueries ? mStatisticsFlags : 0; }
+
+	// Outside a render pass, at the start of the slot's command buffer: reads the slot's
+	// last results, resets its queries and opens the frame scope.
+	void BeginFrame(VkCommandBuffer cmd, uint32_t slot, bool statistics = false);
+	// name must outlive the frame's readback, a string literal.
+	void BeginScope(VkCommandBuffer cmd, const char* name, bool statistics = true);
+	void EndScope(VkCommandBuffer cmd);
+	// Closes every open scope, outside a render pass.
+	void EndFrame(VkCommandBuffer cmd);
+
+	const std::vector<Result>& LastFrame()const { return mLastFrame; }
+	// Per scope averages since the last call.
+	std::vector<Result> TakeAverages();
+
+	void Capture(uint32_t frames);
+	bool Capturing()const { return mCaptureFrames > 0; }
+	bool WriteTrace(const char* path)const;
+};
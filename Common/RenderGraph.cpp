@@ -0,0 +1,479 @@
+#include "RenderGraph.h"
+#include <algorithm>
+
+static bool IsDepthFormat(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool HasStencil(VkFormat format) {
+	return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(Resource resource, VkPipelineStageFlags stages) {
+	graph.AddAccess(pass, { resource,AccessType::Read,stages,false,{} });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::WriteColor(Resource resource, const VkClearColorValue* clear) {
+	VkClearValue clearValue{};
+	if (clear)
+		clearValue.color = *clear;
+	graph.AddAccess(pass, { resource,AccessType::Color,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,clear != nullptr,clearValue });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::WriteDepth(Resource resource, const VkClearDepthStencilValue* clear) {
+	VkClearValue clearValue{};
+	if (clear)
+		clearValue.depthStencil = *clear;
+	graph.AddAccess(pass, { resource,AccessType::Depth,VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,clear != nullptr,clearValue });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SideEffect() {
+	graph.passes[pass].sideEffect = true;
+	return *this;
+}
+
+RenderGraph::RenderGraph(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_) :VulkanObject(device_), memoryProperties(memoryProperties_) {
+}
+
+RenderGraph::~RenderGraph() {
+	Clear();
+}
+
+RenderGraph::Resource RenderGraph::CreateImage(const char* name, VkFormat format, uint32_t width, uint32_t height) {
+	assert(!compiled);
+	ResourceInfo info;
+	info.name = name;
+	info.format = format;
+	info.width = width;
+	info.height = height;
+	info.imported = false;
+	resources.push_back(info);
+	return (Resource)resources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(const char* name, VkImage image, VkImageView view, VkFormat format, uint32_t width, uint32_t height, VkImageLayout layout) {
+	assert(!compiled);
+	ResourceInfo info;
+	info.name = name;
+	info.format = format;
+	info.width = width;
+	info.height = height;
+	info.imported = true;
+	info.image = image;
+	info.view = view;
+	info.layout = layout;
+	resources.push_back(info);
+	return (Resource)resources.size() - 1;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name, bool external) {
+	assert(!compiled);
+	PassInfo info;
+	info.name = name;
+	info.external = external;
+	passes.push_back(info);
+	return PassBuilder(*this, (Pass)passes.size() - 1);
+}
+
+void RenderGraph::AddAccess(Pass pass, const Access& access) {
+	assert(access.resource < resources.size());
+	//reading and writing an image in the same pass would be a feedback loop
+	for (auto& other : passes[pass].accesses)
+		assert(other.resource != access.resource);
+	passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::Compile() {
+	assert(!compiled);
+	Cull();
+	AllocateTransients();
+	BuildBarriers();
+	for (Pass pass = 0; pass < passes.size(); ++pass)
+		if (!passes[pass].culled && !passes[pass].external)
+			BuildRenderPass(pass);
+	compiled = true;
+}
+
+void RenderGraph::Cull() {
+	//back to front: a pass is live if it has side effects or writes something a later
+	//live pass reads, loading an attachment reads what was there
+	std::vector<bool> needed(resources.size(), false);
+	for (Pass pass = (Pass)passes.size(); pass-- > 0;) {
+		PassInfo& info = passes[pass];
+		bool live = info.sideEffect;
+		for (auto& access : info.accesses)
+			if (access.type != AccessType::Read && needed[access.resource])
+				live = true;
+		info.culled = !live;
+		if (!live)
+			continue;
+		for (auto& access : info.accesses)
+			if (access.type == AccessType::Read || !access.clear)
+				needed[access.resource] = true;
+	}
+
+	for (Pass pass = 0; pass < passes.size(); ++pass) {
+		if (passes[pass].culled)
+			continue;
+		for (auto& access : passes[pass].accesses) {
+			ResourceInfo& resource = resources[access.resource];
+			resource.firstPass = (std::min)(resource.firstPass, pass);
+			resource.lastPass = (std::max)(resource.lastPass, pass);
+			resource.usage |= access.type == AccessType::Read ? VK_IMAGE_USAGE_SAMPLED_BIT :
+				access.type == AccessType::Color ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		}
+	}
+}
+
+void RenderGraph::AllocateTransients() {
+	std::vector<Resource> transients;
+	for (Resource r = 0; r < resources.size(); ++r) {
+		ResourceInfo& resource = resources[r];
+		if (resource.imported || resource.firstPass == UINT32_MAX)
+			continue;
+		VkImageCreateInfo imageCI{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = resource.format;
+		imageCI.extent = { resource.width,resource.height,1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCI.usage = resource.usage;
+		VkResult res = vkCreateImage(device, &imageCI, nullptr, &resource.image);
+		assert(res == VK_SUCCESS);
+		vkGetImageMemoryRequirements(device, resource.image, &resource.requirements);
+		transientBytes += resource.requirements.size;
+		transients.push_back(r);
+	}
+
+	//largest first, then by first use, each into the first block it fits in without
+	//overlapping the lifetime of anything already there
+	std::sort(transients.begin(), transients.end(), [&](Resource a, Resource b) {
+		if (resources[a].requirements.size != resources[b].requirements.size)
+			return resources[a].requirements.size > resources[b].requirements.size;
+		return resources[a].firstPass < resources[b].firstPass;
+		});
+	for (Resource r : transients) {
+		ResourceInfo& resource = resources[r];
+		for (uint32_t b = 0; b < blocks.size() && resource.block == UINT32_MAX; ++b) {
+			MemoryBlock& block = blocks[b];
+			if ((block.requirements.memoryTypeBits & resource.requirements.memoryTypeBits) == 0)
+				continue;
+			bool overlaps = false;
+			for (Resource other : block.resources)
+				if (resources[other].firstPass <= resource.lastPass && resource.firstPass <= resources[other].lastPass)
+					overlaps = true;
+			if (overlaps)
+				continue;
+			block.requirements.size = (std::max)(block.requirements.size, resource.requirements.size);
+			block.requirements.alignment = (std::max)(block.requirements.alignment, resource.requirements.alignment);
+			block.requirements.memoryTypeBits &= resource.requirements.memoryTypeBits;
+			block.resources.push_back(r);
+			resource.block = b;
+		}
+		if (resource.block == UINT32_MAX) {
+			MemoryBlock block;
+			block.requirements = resource.requirements;
+			block.resources.push_back(r);
+			resource.block = (uint32_t)blocks.size();
+			blocks.push_back(block);
+		}
+	}
+
+	for (auto& block : blocks) {
+		std::sort(block.resources.begin(), block.resources.end(), [&](Resource a, Resource b) {
+			return resources[a].firstPass < resources[b].firstPass;
+			});
+#ifdef __USE__VMA__
+		VmaAllocationCreateInfo allocCI{};
+		allocCI.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		VkResult res = vmaAllocateMemory(Vulkan::getAllocator(), &block.requirements, &allocCI, &block.allocation, nullptr);
+		assert(res == VK_SUCCESS);
+		for (Resource r : block.resources) {
+			res = vmaBindImageMemory(Vulkan::getAllocator(), block.allocation, resources[r].image);
+			assert(res == VK_SUCCESS);
+		}
+#else
+		VkMemoryAllocateInfo memAllocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memAllocInfo.allocationSize = block.requirements.size;
+		memAllocInfo.memoryTypeIndex = Vulkan::findMemoryType(block.requirements.memoryTypeBits, memoryProperties, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VkResult res = vkAllocateMemory(device, &memAllocInfo, nullptr, &block.memory);
+		assert(res == VK_SUCCESS);
+		for (Resource r : block.resources) {
+			res = vkBindImageMemory(device, resources[r].image, block.memory, 0);
+			assert(res == VK_SUCCESS);
+		}
+#endif
+		allocatedBytes += block.requirements.size;
+	}
+
+	for (Resource r : transients) {
+		ResourceInfo& resource = resources[r];
+		VkImageViewCreateInfo viewCI{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewCI.image = resource.image;
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = resource.format;
+		viewCI.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		viewCI.subresourceRange = { IsDepthFormat(resource.format) ? (VkImageAspectFlags)VK_IMAGE_ASPECT_DEPTH_BIT : (VkImageAspectFlags)VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1 };
+		VkResult res = vkCreateImageView(device, &viewCI, nullptr, &resource.view);
+		assert(res == VK_SUCCESS);
+	}
+}
+
+void RenderGraph::BuildBarriers() {
+	auto stateOf = [](const Access& access) {
+		State state;
+		state.valid = true;
+		state.stages = access.stages;
+		switch (access.type) {
+		case AccessType::Read:
+			state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			break;
+		case AccessType::Color:
+			state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			state.access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			state.write = true;
+			break;
+		case AccessType::Depth:
+			state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			state.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			state.write = true;
+			break;
+		}
+		return state;
+	};
+	auto dstAccessOf = [](const Access& access)->VkAccessFlags {
+		switch (access.type) {
+		case AccessType::Read:
+			return VK_ACCESS_SHADER_READ_BIT;
+		case AccessType::Color:
+			return VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		default:
+			return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
+	};
+
+	//once through for the state every resource ends the frame in, reads after the
+	//last write all have to finish before the next frame writes
+	std::vector<State> states(resources.size());
+	for (auto& info : passes) {
+		if (info.culled)
+			continue;
+		for (auto& access : info.accesses) {
+			State next = stateOf(access);
+			State& state = states[access.resource];
+			if (state.valid && !state.write && !next.write && state.layout == next.layout)
+				state.stages |= next.stages;
+			else
+				state = next;
+		}
+	}
+	for (Resource r = 0; r < resources.size(); ++r)
+		resources[r].final = states[r];
+
+	//then again for the barriers. A first use waits on the end of the frame before:
+	//an imported image on its own last use, a transient on the last use of whatever
+	//had its memory before it, which for the first one in a block is the last one
+	std::fill(states.begin(), states.end(), State{});
+	barrierCount = 0;
+	barrierBatches = 0;
+	for (auto& info : passes) {
+		if (info.culled)
+			continue;
+		for (auto& access : info.accesses) {
+			ResourceInfo& resource = resources[access.resource];
+			State next = stateOf(access);
+			State& state = states[access.resource];
+			State src = state;
+			bool firstUse = !state.valid;
+			bool sharedRead = false;
+			if (firstUse) {
+				if (resource.imported)
+					src = resource.final;
+				else {
+					auto& blockResources = blocks[resource.block].resources;
+					auto it = std::find(blockResources.begin(), blockResources.end(), access.resource);
+					src = resources[it == blockResources.begin() ? blockResources.back() : *(it - 1)].final;
+					src.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				}
+			}
+			else if (!state.write && !next.write && state.layout == next.layout) {
+				//the barrier into the read only made the write visible to the stages that
+				//read so far, a reader in another stage waits on the write with its own
+				if ((next.stages & ~state.stages) == 0)
+					continue;
+				sharedRead = true;
+				src.stages = state.waitStages;
+				src.access = state.waitAccess;
+			}
+			VkPipelineStageFlags srcStages = src.valid ? src.stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkPipelineStageFlags dstStages = next.stages;
+			if (sharedRead)
+				next.stages |= state.stages;
+			next.waitStages = srcStages;
+			next.waitAccess = src.access;
+			state = next;
+
+			VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			barrier.srcAccessMask = src.access;
+			barrier.dstAccessMask = dstAccessOf(access);
+			barrier.oldLayout = src.layout;
+			barrier.newLayout = next.layout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = resource.image;
+			VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+			if (IsDepthFormat(resource.format))
+				aspect = HasStencil(resource.format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+			barrier.subresourceRange = { aspect,0,1,0,1 };
+			if (firstUse && resource.imported)
+				info.importBarriers.push_back((uint32_t)info.barriers.size());
+			info.barriers.push_back(barrier);
+			info.srcStages |= srcStages;
+			info.dstStages |= dstStages;
+		}
+		if (!info.barriers.empty()) {
+			barrierCount += (uint32_t)info.barriers.size();
+			barrierBatches++;
+		}
+	}
+}
+
+void RenderGraph::BuildRenderPass(Pass pass) {
+	PassInfo& info = passes[pass];
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<VkAttachmentReference> colorRefs;
+	VkAttachmentReference depthRef{ VK_ATTACHMENT_UNUSED,VK_IMAGE_LAYOUT_UNDEFINED };
+	std::vector<VkImageView> views;
+	for (auto& access : info.accesses) {
+		if (access.type == AccessType::Read)
+			continue;
+		const ResourceInfo& resource = resources[access.resource];
+		assert(info.extent.width == 0 || (info.extent.width == resource.width && info.extent.height == resource.height));
+		info.extent = { resource.width,resource.height };
+		//load what an earlier pass or frame left, keep what a later pass or frame reads
+		bool loaded = resource.imported || resource.firstPass < pass;
+		bool stored = resource.imported || resource.lastPass > pass;
+		VkAttachmentLoadOp loadOp = access.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : loaded ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		VkAttachmentStoreOp storeOp = stored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		VkImageLayout layout = access.type == AccessType::Color ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentDescription attachment{};
+		attachment.format = resource.format;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = loadOp;
+		attachment.storeOp = storeOp;
+		attachment.stencilLoadOp = HasStencil(resource.format) ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = HasStencil(resource.format) ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = layout;//the barriers did the transition
+		attachment.finalLayout = layout;
+		VkAttachmentReference ref{ (uint32_t)attachments.size(),layout };
+		if (access.type == AccessType::Color)
+			colorRefs.push_back(ref);
+		else
+			depthRef = ref;
+		attachments.push_back(attachment);
+		views.push_back(resource.view);
+		info.clearValues.push_back(access.clearValue);
+	}
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = (uint32_t)colorRefs.size();
+	subpass.pColorAttachments = colorRefs.data();
+	subpass.pDepthStencilAttachment = depthRef.attachment == VK_ATTACHMENT_UNUSED ? nullptr : &depthRef;
+	VkRenderPassCreateInfo renderPassCI{ VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+	renderPassCI.attachmentCount = (uint32_t)attachments.size();
+	renderPassCI.pAttachments = attachments.data();
+	renderPassCI.subpassCount = 1;
+	renderPassCI.pSubpasses = &subpass;
+	VkResult res = vkCreateRenderPass(device, &renderPassCI, nullptr, &info.renderPass);
+	assert(res == VK_SUCCESS);
+
+	VkFramebufferCreateInfo framebufferCI{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	framebufferCI.renderPass = info.renderPass;
+	framebufferCI.attachmentCount = (uint32_t)views.size();
+	framebufferCI.pAttachments = views.data();
+	framebufferCI.width = info.extent.width;
+	framebufferCI.height = info.extent.height;
+	framebufferCI.layers = 1;
+	res = vkCreateFramebuffer(device, &framebufferCI, nullptr, &info.framebuffer);
+	assert(res == VK_SUCCESS);
+}
+
+VkRenderPassBeginInfo RenderGraph::GetBeginInfo(Pass pass)const {
+	const PassInfo& info = passes[pass];
+	assert(!info.external && !info.culled);
+	VkRenderPassBeginInfo beginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	beginInfo.renderPass = info.renderPass;
+	beginInfo.framebuffer = info.framebuffer;
+	beginInfo.renderArea = { {0,0},info.extent };
+	beginInfo.clearValueCount = (uint32_t)info.clearValues.size();
+	beginInfo.pClearValues = info.clearValues.data();
+	return beginInfo;
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer cmd, Pass pass) {
+	PassInfo& info = passes[pass];
+	if (info.culled || info.barriers.empty())
+		return;
+	//imported images come from wherever the last frame, or the app before it, left them
+	for (uint32_t i : info.importBarriers) {
+		VkImageMemoryBarrier& barrier = info.barriers[i];
+		auto it = std::find_if(resources.begin(), resources.end(), [&](const ResourceInfo& r) {return r.imported && r.image == barrier.image; });
+		barrier.oldLayout = it->layout;
+		it->layout = it->final.layout;
+	}
+	vkCmdPipelineBarrier(cmd, info.srcStages, info.dstStages, 0, 0, nullptr, 0, nullptr, (uint32_t)info.barriers.size(), info.barriers.data());
+}
+
+void RenderGraph::Release() {
+	for (auto& info : passes) {
+		if (info.framebuffer != VK_NULL_HANDLE)
+			vkDestroyFramebuffer(device, info.framebuffer, nullptr);
+		if (info.renderPass != VK_NULL_HANDLE)
+			vkDestroyRenderPass(device, info.renderPass, nullptr);
+	}
+	for (auto& resource : resources) {
+		if (resource.imported)
+			continue;
+		if (resource.view != VK_NULL_HANDLE)
+			vkDestroyImageView(device, resource.view, nullptr);
+		if (resource.image != VK_NULL_HANDLE)
+			vkDestroyImage(device, resource.image, nullptr);
+	}
+	for (auto& block : blocks) {
+#ifdef __USE__VMA__
+		vmaFreeMemory(Vulkan::getAllocator(), block.allocation);
+#else
+		vkFreeMemory(device, block.memory, nullptr);
+#endif
+	}
+}
+
+void RenderGraph::Clear() {
+	Release();
+	resources.clear();
+	passes.clear();
+	blocks.clear();
+	compiled = false;
+	transientBytes = 0;
+	allocatedBytes = 0;
+	barrierCount = 0;
+	barrierBatches = 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "Vulkan.h"
+#include "VulkanEx.h"
+
+///<summary>
+/// The passes of a frame and the images they use, declared once in execution
+/// order. Compile then
+///  - culls the passes whose results no live pass reads; side effect passes,
+///    like the one drawing to the swapchain, are always live,
+///  - gives the transient images memory, sharing one allocation between
+///    transients whose lifetimes (first to last live pass using them) don't
+///    overlap,
+///  - builds a render pass and framebuffer for every graph pass from its
+///    attachments, loading and storing only what is used before and after,
+///  - and works out the image barriers in front of every pass, one
+///    vkCmdPipelineBarrier per pass with all of them.
+///
+/// Graph render passes keep their attachments in attachment layout from
+/// begin to end, every layout change is one of the graph's barriers. An
+/// external pass begins a render pass of its own, the graph only puts the
+/// images it declares in the right layout first, so that render pass must
+/// end with them in the same layout.
+///
+/// Transients start every frame UNDEFINED. Imported images keep their
+/// contents and their layout is tracked from frame to frame.
+///</summary>
+class RenderGraph : public VulkanObject {
+public:
+	using Resource = uint32_t;
+	using Pass = uint32_t;
+
+	class PassBuilder {
+		RenderGraph& graph;
+		Pass pass;
+	public:
+		PassBuilder(RenderGraph& graph_, Pass pass_) :graph(graph_), pass(pass_) {}
+		// Sampled in stages.
+		PassBuilder& Read(Resource resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		// Attachments in declaration order, cleared or, without a clear value, loaded.
+		PassBuilder& WriteColor(Resource resource, const VkClearColorValue* clear = nullptr);
+		PassBuilder& WriteDepth(Resource resource, const VkClearDepthStencilValue* clear = nullptr);
+		// Live even when nothing reads what it writes.
+		PassBuilder& SideEffect();
+		operator Pass()const { return pass; }
+	};
+private:
+	enum class AccessType { Read, Color, Depth };
+	struct Access {
+		Resource resource;
+		AccessType type;
+		VkPipelineStageFlags stages;
+		bool clear;
+		VkClearValue clearValue;
+	};
+	// What a resource was last used for, the source of the next barrier.
+	struct State {
+		VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkPipelineStageFlags stages{ 0 };
+		VkAccessFlags access{ 0 };	//writes only, reads need no flushing
+		VkPipelineStageFlags waitStages{ 0 };	//what the barrier into this state waited on,
+		VkAccessFlags waitAccess{ 0 };	//so a later read in another stage can wait on it too
+		bool valid{ false };
+		bool write{ false };
+	};
+	struct ResourceInfo {
+		std::string name;
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+		bool imported;
+		VkImage image{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };	//imported: layout now, updated as the barriers are recorded
+		VkImageUsageFlags usage{ 0 };	//transient: from the accesses
+		VkMemoryRequirements requirements{};
+		uint32_t firstPass{ UINT32_MAX };	//live passes using it
+		uint32_t lastPass{ 0 };
+		uint32_t block{ UINT32_MAX };
+		State final;	//after its last use in the frame
+	};
+	struct PassInfo {
+		std::string name;
+		bool external;
+		bool sideEffect{ false };
+		bool culled{ false };
+		std::vector<Access> accesses;
+		VkRenderPass renderPass{ VK_NULL_HANDLE };
+		VkFramebuffer framebuffer{ VK_NULL_HANDLE };
+		VkExtent2D extent{ 0,0 };
+		std::vector<VkClearValue> clearValues;
+		std::vector<VkImageMemoryBarrier> barriers;
+		std::vector<uint32_t> importBarriers;	//first uses of imported images, oldLayout set when recorded
+		VkPipelineStageFlags srcStages{ 0 };
+		VkPipelineStageFlags dstStages{ 0 };
+	};
+	struct MemoryBlock {
+		VkMemoryRequirements requirements{};
+		std::vector<Resource> resources;	//by first use
+#ifdef __USE__VMA__
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+#else
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+#endif
+	};
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	std::vector<ResourceInfo> resources;
+	std::vector<PassInfo> passes;
+	std::vector<MemoryBlock> blocks;
+	bool compiled{ false };
+
+	VkDeviceSize transientBytes{ 0 };
+	VkDeviceSize allocatedBytes{ 0 };
+	uint32_t barrierCount{ 0 };
+	uint32_t barrierBatches{ 0 };
+
+	void AddAccess(Pass pass, const Access& access);
+	void Cull();
+	void AllocateTransients();
+	void BuildBarriers();
+	void BuildRenderPass(Pass pass);
+	void Release();
+public:
+	RenderGraph(VkDevice device_, VkPhysicalDeviceMemoryProperties memoryProperties_);
+	RenderGraph(const RenderGraph& rhs) = delete;
+	RenderGraph& operator=(const RenderGraph& rhs) = delete;
+	~RenderGraph();
+
+	// Created by the graph, only valid inside the frame.
+	Resource CreateImage(const char* name, VkFormat format, uint32_t width, uint32_t height);
+	// Owned elsewhere, in layout now.
+	Resource ImportImage(const char* name, VkImage image, VkImageView view, VkFormat format, uint32_t width, uint32_t height, VkImageLayout layout);
+	// external passes begin their own render pass.
+	PassBuilder AddPass(const char* name, bool external = false);
+
+	void Compile();
+	// Drops the passes, the images and everything Compile built, before declaring again,
+	// after a resize say. The device must be idle.
+	void Clear();
+
+	bool IsCulled(Pass pass)const { return passes[pass].culled; }
+	uint32_t PassCount()const { return (uint32_t)passes.size(); }
+	VkImage GetImage(Resource resource)const { return resources[resource].image; }
+	VkImageView GetImageView(Resource resource)const { return resources[resource].view; }
+	// Graph passes only, for pipelines and for beginning the pass.
+	VkRenderPass GetRenderPass(Pass pass)const { return passes[pass].renderPass; }
+	VkRenderPassBeginInfo GetBeginInfo(Pass pass)const;
+	// The pass's barriers, outside any render pass, right before it.
+	void RecordBarriers(VkCommandBuffer cmd, Pass pass);
+
+	// Per frame, for the stats.
+	uint32_t BarrierCount()const { return barrierCount; }
+	uint32_t BarrierBatches()const { return barrierBatches; }
+	VkDeviceSize TransientBytes()const { return transientBytes; }	//without aliasing
+	VkDeviceSize AllocatedBytes()const { return allocatedBytes; }
+};
@@ -0,0 +1,61 @@
+#include "RingBuffer.h"
+#include <algorithm>
+#include <cstdio>
+
+FrameRingBuffer::FrameRingBuffer(VkDevice device_, const VkPhysicalDeviceProperties& deviceProperties, VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize size_, uint32_t frameCount) :VulkanObject(device_),
+	uniformAlignment(deviceProperties.limits.minUniformBufferOffsetAlignment), storageAlignment(deviceProperties.limits.minStorageBufferOffsetAlignment), frameHeads(frameCount, 0) {
+	VkDeviceSize alignment = (std::max)(uniformAlignment, storageAlignment);
+	size = (size_ + alignment - 1) & ~(alignment - 1);
+	//dynamic offsets are 32 bit
+	assert(size <= UINT32_MAX);
+
+	Vulkan::BufferProperties props;
+#ifdef __USE__VMA__
+	props.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+#else
+	props.memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+#endif
+	props.bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	props.size = size;
+	Vulkan::initBuffer(device, memoryProperties, props, buffer);
+	ptr = (uint8_t*)Vulkan::mapBuffer(device, buffer);
+}
+
+FrameRingBuffer::~FrameRingBuffer() {
+	Vulkan::unmapBuffer(device, buffer);
+	Vulkan::cleanupBuffer(device, buffer);
+}
+
+void FrameRingBuffer::BeginFrame(uint32_t frame) {
+	if (currFrame != UINT32_MAX) {
+		frameHeads[currFrame] = head;
+		lastFrameBytes = head - frameStart;
+		peakFrameBytes = (std::max)(peakFrameBytes, lastFrameBytes);
+	}
+	//the slot's fence has signalled, frames finish in order
+	tail = frameHeads[frame];
+	currFrame = frame;
+	frameStart = head;
+	fullReported = false;
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::Allocate(VkDeviceSize bytes, VkDeviceSize alignment) {
+	assert(bytes <= size);
+	VkDeviceSize lap = head - head % size;
+	VkDeviceSize offset = (head % size + alignment - 1) & ~(alignment - 1);
+	//doesn't fit before the end, skip to the start
+	if (offset + bytes > size) {
+		lap += size;
+		offset = 0;
+	}
+	VkDeviceSize start = lap + offset;
+	if (start + bytes - tail > size) {
+		if (!fullReported) {
+			fprintf(stderr, "FrameRingBuffer full: %llu bytes requested, frames in flight use all %llu\n", (unsigned long long)bytes, (unsigned long long)size);
+			fullReported = true;
+		}
+		return Allocation{};
+	}
+	head = start + bytes;
+	return Allocation{ ptr + offset,(uint32_t)offset };
+}
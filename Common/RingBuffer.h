@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include "Vulkan.h"
+#include "VulkanEx.h"
+
+///<summary>
+/// One large persistently mapped buffer, usable as uniform and storage buffer,
+/// handed out front to back as per frame sub-allocations and wrapping around.
+/// Constants are written straight into it every frame and bound through
+/// dynamic uniform/storage descriptors whose buffer is this one at offset 0,
+/// with the allocation's offset as the dynamic offset.
+///
+/// BeginFrame(mCurrFrame) goes right after VulkApp::Update has waited on the
+/// slot's fence: everything allocated up to the end of that slot's last frame
+/// (and so every frame before it) is done on the gpu and reused. Allocations
+/// only live until then, anything written outside a frame is gone with the
+/// first frame slot that comes round.
+///</summary>
+class FrameRingBuffer : public VulkanObject {
+public:
+	struct Allocation {
+		void* Ptr{ nullptr };
+		uint32_t Offset{ 0 };	//from the start of the buffer, the dynamic offset
+	};
+private:
+	Vulkan::Buffer buffer;
+	uint8_t* ptr{ nullptr };
+	VkDeviceSize size{ 0 };
+	VkDeviceSize uniformAlignment{ 0 };
+	VkDeviceSize storageAlignment{ 0 };
+	// Running totals since creation, the offset in the buffer is modulo size.
+	VkDeviceSize head{ 0 };	//handed out
+	VkDeviceSize tail{ 0 };	//of those, what the gpu may still read starts here
+	std::vector<VkDeviceSize> frameHeads;	//head at the end of each slot's last frame
+	uint32_t currFrame{ UINT32_MAX };
+	VkDeviceSize frameStart{ 0 };
+	VkDeviceSize lastFrameBytes{ 0 };
+	VkDeviceSize peakFrameBytes{ 0 };
+	bool fullReported{ false };	//this frame
+public:
+	// size is rounded up to the larger alignment, frameCount is VulkApp's mMaxFrames.
+	FrameRingBuffer(VkDevice device_, const VkPhysicalDeviceProperties& deviceProperties, VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize size_, uint32_t frameCount);
+	FrameRingBuffer(const FrameRingBuffer& rhs) = delete;
+	FrameRingBuffer& operator=(const FrameRingBuffer& rhs) = delete;
+	~FrameRingBuffer();
+	operator VkBuffer()const { return buffer.buffer; }
+
+	void BeginFrame(uint32_t frame);
+	// alignment a power of two. Returns a null Ptr, and reports it once per frame
+	// on stderr, when the frames in flight already use the whole buffer.
+	Allocation Allocate(VkDeviceSize bytes, VkDeviceSize alignment);
+	Allocation AllocateUniform(VkDeviceSize bytes) { return Allocate(bytes, uniformAlignment); }
+	Allocation AllocateStorage(VkDeviceSize bytes) { return Allocate(bytes, storageAlignment); }
+	// Copies data in and sets offset to the dynamic offset. Returns false, leaving
+	// offset alone, when the ring is full; nothing may be bound for it then.
+	template<typename T>
+	bool PushUniform(const T& data, uint32_t& offset) {
+		Allocation allocation = AllocateUniform(sizeof(T));
+		if (!allocation.Ptr)
+			return false;
+		memcpy(allocation.Ptr, &data, sizeof(T));
+		offset = allocation.Offset;
+		return true;
+	}
+
+	VkDeviceSize Size()const { return size; }
+	VkDeviceSize LastFrameBytes()const { return lastFrameBytes; }	//including what wrapping skipped
+	VkDeviceSize PeakFrameBytes()const { return peakFrameBytes; }
+};
@@ -0,0 +1,119 @@
+#include "ShaderCache.h"
+#include <windows.h>
+#include <string>
+
+namespace {
+	//read only view of a whole file, unmapped when it goes out of scope
+	class MappedFile {
+		HANDLE file{ INVALID_HANDLE_VALUE };
+		HANDLE mapping{ nullptr };
+		const void* data{ nullptr };
+		size_t size{ 0 };
+	public:
+		MappedFile(const char* path) {
+			file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+				return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr)
+				return;
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data != nullptr)
+				size = (size_t)fileSize.QuadPart;
+		}
+		~MappedFile() {
+			if (data != nullptr)
+				UnmapViewOfFile(data);
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+		}
+		MappedFile(const MappedFile& rhs) = delete;
+		MappedFile& operator=(const MappedFile& rhs) = delete;
+		const void* Data()const { return data; }
+		size_t Size()const { return size; }
+	};
+}
+
+ShaderCache& ShaderCache::Get() {
+	static ShaderCache cache;
+	return cache;
+}
+
+ShaderCache::Entry ShaderCache::Acquire(VkDevice device, const char* path) {
+	MappedFile file(path);
+	assert(file.Data() != nullptr && file.Size() % sizeof(uint32_t) == 0);
+	const uint32_t* code = (const uint32_t*)file.Data();
+	uint64_t hash = Vulkan::hashSpirv(code, file.Size() / sizeof(uint32_t));
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto key = std::make_pair(device, hash);
+	auto it = mEntries.find(key);
+	if (it != mEntries.end()) {
+		mStats.Hits++;
+		it->second.RefCount++;
+		return it->second;
+	}
+	mStats.Misses++;
+	Entry entry;
+	entry.Hash = hash;
+	entry.RefCount = 1;
+	std::string bakedPath = std::string(path) + ".refl";
+	if (Vulkan::loadReflection(bakedPath.c_str(), hash, entry.Reflection))
+		mStats.Baked++;
+	else {
+		bool reflected = Vulkan::reflectSpirv(code, file.Size(), entry.Reflection);
+		assert(reflected);
+		(void)reflected;
+	}
+	//created straight from the mapped view, no copy
+	VkShaderModuleCreateInfo createInfo{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	createInfo.codeSize = file.Size();
+	createInfo.pCode = code;
+	VkResult res = vkCreateShaderModule(device, &createInfo, nullptr, &entry.Module);
+	assert(res == VK_SUCCESS);
+	mModules[entry.Module] = key;
+	return mEntries[key] = std::move(entry);
+}
+
+bool ShaderCache::Release(VkDevice device, VkShaderModule module) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mModules.find(module);
+	if (it == mModules.end())
+		return false;
+	Entry& entry = mEntries[it->second];
+	assert(entry.RefCount > 0);
+	if (--entry.RefCount == 0) {
+		vkDestroyShaderModule(device, module, nullptr);
+		mEntries.erase(it->second);
+		mModules.erase(it);
+	}
+	return true;
+}
+
+void ShaderCache::Clear(VkDevice device) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto it = mEntries.begin(); it != mEntries.end();) {
+		if (it->first.first == device) {
+			vkDestroyShaderModule(device, it->second.Module, nullptr);
+			mModules.erase(it->second.Module);
+			it = mEntries.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+uint32_t ShaderCache::Size() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (uint32_t)mEntries.size();
+}
+
+ShaderCache::Stats ShaderCache::GetStats() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include "Vulkan.h"
+#include "ShaderReflection.h"
+
+///<summary>
+/// Process wide cache of shader modules, keyed by the device and a 64 bit hash
+/// of the SPIR-V. The file is memory mapped, hashed and, the first time its
+/// contents are seen, turned into a VkShaderModule along with its reflection,
+/// read from the baked .refl file when there's a current one. Loading the
+/// same shader again (default.vert for the opaque, flat and wireframe pipelines
+/// say) hands back the same module and the reflection already done.
+///
+/// Every Acquire adds a reference, Release drops one and destroys the module
+/// with the last. Vulkan::cleanupShaderModule goes through Release, so code
+/// that cleans up what ShaderProgramLoader gave it doesn't change.
+///</summary>
+class ShaderCache {
+public:
+	struct Entry {
+		VkShaderModule Module{ VK_NULL_HANDLE };
+		ShaderReflection Reflection;
+		uint64_t Hash{ 0 };
+		uint32_t RefCount{ 0 };
+	};
+	struct Stats {
+		uint32_t Hits{ 0 };
+		uint32_t Misses{ 0 };
+		// Of the misses, how many had a current baked reflection.
+		uint32_t Baked{ 0 };
+	};
+private:
+	std::mutex mMutex;
+	std::map<std::pair<VkDevice, uint64_t>, Entry> mEntries;
+	std::unordered_map<VkShaderModule, std::pair<VkDevice, uint64_t>> mModules;
+	Stats mStats;
+	ShaderCache() = default;
+public:
+	ShaderCache(const ShaderCache& rhs) = delete;
+	ShaderCache& operator=(const ShaderCache& rhs) = delete;
+	static ShaderCache& Get();
+
+	// Returns a copy of the entry, its module holding one more reference.
+	Entry Acquire(VkDevice device, const char* path);
+	// false if module didn't come from the cache, it's the caller's to destroy then.
+	bool Release(VkDevice device, VkShaderModule module);
+	// Destroys whatever device still has in the cache, before the device goes.
+	void Clear(VkDevice device);
+
+	uint32_t Size();
+	Stats GetStats();
+};
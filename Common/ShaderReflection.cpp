@@ -0,0 +1,177 @@
+#include "ShaderReflection.h"
+#include <fstream>
+#include "../ThirdParty/spirv-reflect/spirv_reflect.h"
+
+namespace {
+	const uint32_t ReflectionMagic = 0x4c465253;//'SRFL'
+	const uint32_t ReflectionVersion = 2;//1 also carried descriptor bindings, push constants and specialization constants
+
+	struct ReflectionFileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t spirvHash;
+		uint32_t stage;
+		uint32_t vertexStride;
+		uint32_t attributeCount;
+	};
+
+	template<typename T>
+	void writeArray(std::ofstream& file, const std::vector<T>& items) {
+		if (!items.empty())
+			file.write((const char*)items.data(), sizeof(T) * items.size());
+	}
+
+	template<typename T>
+	bool readArray(std::ifstream& file, std::vector<T>& items, uint32_t count) {
+		items.resize(count);
+		if (count > 0)
+			file.read((char*)items.data(), sizeof(T) * count);
+		return file.good();
+	}
+}
+
+namespace Vulkan {
+	//FNV-1a, SPIR-V is a stream of words so hash it a word at a time
+	uint64_t hashSpirv(const uint32_t* code, size_t wordCount) {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < wordCount; ++i) {
+			hash ^= code[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	uint32_t vertexFormatSize(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_R32_UINT:
+		case VK_FORMAT_R32_SINT:
+		case VK_FORMAT_R32_SFLOAT:
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SNORM:
+		case VK_FORMAT_R8G8B8A8_UINT:
+		case VK_FORMAT_R8G8B8A8_SINT:
+		case VK_FORMAT_R16G16_UNORM:
+		case VK_FORMAT_R16G16_SNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+		case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+			return 4;
+		case VK_FORMAT_R32G32_UINT:
+		case VK_FORMAT_R32G32_SINT:
+		case VK_FORMAT_R32G32_SFLOAT:
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_SNORM:
+		case VK_FORMAT_R16G16B16A16_UINT:
+		case VK_FORMAT_R16G16B16A16_SINT:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 8;
+		case VK_FORMAT_R32G32B32_UINT:
+		case VK_FORMAT_R32G32B32_SINT:
+		case VK_FORMAT_R32G32B32_SFLOAT:
+			return 12;
+		case VK_FORMAT_R32G32B32A32_UINT:
+		case VK_FORMAT_R32G32B32A32_SINT:
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	bool reflectSpirv(const uint32_t* code, size_t size, ShaderReflection& reflection) {
+		SpvReflectShaderModule module = {};
+		if (spvReflectCreateShaderModule(size, code, &module) != SPV_REFLECT_RESULT_SUCCESS)
+			return false;
+
+		switch (module.shader_stage) {
+		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_VERTEX_BIT:
+			reflection.Stage = VK_SHADER_STAGE_VERTEX_BIT;
+			break;
+		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT:
+			reflection.Stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			break;
+		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_GEOMETRY_BIT:
+			reflection.Stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+			break;
+		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_COMPUTE_BIT:
+			reflection.Stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			break;
+		default:
+			spvReflectDestroyShaderModule(&module);
+			return false;
+		}
+
+		if (reflection.Stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			uint32_t count = 0;
+			for (uint32_t i = 0; i < module.input_variable_count; ++i) {
+				if (module.input_variables[i].built_in == -1)
+					count++;
+			}
+			//SpvReflectFormat has VkFormat's values
+			reflection.VertexAttributes.resize(count);
+			for (uint32_t i = 0; i < module.input_variable_count; ++i) {
+				SpvReflectInterfaceVariable& inputVar = module.input_variables[i];
+				if (inputVar.built_in != -1)
+					continue;
+				assert(inputVar.location < count);
+				VkVertexInputAttributeDescription& attribute = reflection.VertexAttributes[inputVar.location];
+				attribute.location = inputVar.location;
+				attribute.binding = 0;
+				attribute.format = (VkFormat)inputVar.format;
+				assert(vertexFormatSize(attribute.format) != 0);
+			}
+			uint32_t offset = 0;
+			for (auto& attribute : reflection.VertexAttributes) {
+				attribute.offset = offset;
+				offset += vertexFormatSize(attribute.format);
+			}
+			reflection.VertexInput.binding = 0;
+			reflection.VertexInput.stride = offset;
+			reflection.VertexInput.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		}
+
+		spvReflectDestroyShaderModule(&module);
+		return true;
+	}
+
+	void setVertexFormat(ShaderReflection& reflection, uint32_t location, VkFormat format) {
+		assert(location < reflection.VertexAttributes.size() && vertexFormatSize(format) != 0);
+		reflection.VertexAttributes[location].format = format;
+		uint32_t offset = 0;
+		for (auto& attribute : reflection.VertexAttributes) {
+			attribute.offset = offset;
+			offset += vertexFormatSize(attribute.format);
+		}
+		reflection.VertexInput.stride = offset;
+	}
+
+	bool loadReflection(const char* path, uint64_t spirvHash, ShaderReflection& reflection) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		ReflectionFileHeader header{};
+		file.read((char*)&header, sizeof(header));
+		if (!file.good() || header.magic != ReflectionMagic || header.version != ReflectionVersion || header.spirvHash != spirvHash)
+			return false;
+		ShaderReflection baked;
+		baked.Stage = (VkShaderStageFlagBits)header.stage;
+		if (!readArray(file, baked.VertexAttributes, header.attributeCount))
+			return false;
+		baked.VertexInput.binding = 0;
+		baked.VertexInput.stride = header.vertexStride;
+		baked.VertexInput.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		reflection = std::move(baked);
+		return true;
+	}
+
+	bool saveReflection(const char* path, uint64_t spirvHash, const ShaderReflection& reflection) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+		ReflectionFileHeader header{ ReflectionMagic,ReflectionVersion,spirvHash,(uint32_t)reflection.Stage,reflection.VertexInput.stride,
+			(uint32_t)reflection.VertexAttributes.size() };
+		file.write((const char*)&header, sizeof(header));
+		writeArray(file, reflection.VertexAttributes);
+		return file.good();
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Vulkan.h"
+
+///<summary>
+/// What the pipeline code needs to know about one shader stage: its stage and
+/// vertex inputs (one interleaved binding of the non builtin inputs).
+/// Descriptor set and pipeline layouts are still written out by each demo.
+///
+/// ShaderBake (Tools/ShaderBake, run by each compile.bat after glslc) writes
+/// this next to the SPIR-V as <shader>.spv.refl, so the runtime reads a few
+/// hundred bytes instead of reflecting. The baked file keeps the hash of the
+/// SPIR-V it came from, a stale one is ignored and the shader reflected with
+/// spirv-reflect instead. ShaderBake can also override an attribute's format
+/// with a packed one (R8G8B8A8_UNORM colours say), reflection only ever sees
+/// the 32 bit type the shader declares.
+///</summary>
+struct ShaderReflection {
+	VkShaderStageFlagBits Stage{ VK_SHADER_STAGE_VERTEX_BIT };
+	VkVertexInputBindingDescription VertexInput{};
+	std::vector<VkVertexInputAttributeDescription> VertexAttributes;
+};
+
+namespace Vulkan {
+	uint64_t hashSpirv(const uint32_t* code, size_t wordCount);
+	// Bytes per vertex of format, 0 for formats vertex input doesn't take.
+	uint32_t vertexFormatSize(VkFormat format);
+	// With spirv-reflect, false if the SPIR-V can't be parsed.
+	bool reflectSpirv(const uint32_t* code, size_t size, ShaderReflection& reflection);
+	// Reassigns the vertex attribute at location and repacks the offsets and stride.
+	void setVertexFormat(ShaderReflection& reflection, uint32_t location, VkFormat format);
+	// false if there's no baked file or it wasn't baked from SPIR-V with this hash.
+	bool loadReflection(const char* path, uint64_t spirvHash, ShaderReflection& reflection);
+	bool saveReflection(const char* path, uint64_t spirvHash, const ShaderReflection& reflection);
+}
@@ -0,0 +1,359 @@
+#include "SoftwareOcclusion.h"
+#include "ThreadPool.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+namespace {
+	// Work per task when transforming and setting up, small enough to spread a few
+	// occluders over every thread.
+	constexpr uint32_t VertexChunk = 2048;
+	constexpr uint32_t TriangleChunk = 1024;
+}
+
+SoftwareOcclusion::SoftwareOcclusion(uint32_t width, uint32_t height) {
+	Resize(width, height);
+}
+
+void SoftwareOcclusion::Resize(uint32_t width, uint32_t height) {
+	mTilesX = (std::max)(1u, (width + TileSize - 1) / TileSize);
+	mTilesY = (std::max)(1u, (height + TileSize - 1) / TileSize);
+	mWidth = mTilesX * TileSize;
+	mHeight = mTilesY * TileSize;
+	mDepth.assign((size_t)mWidth * mHeight, 1.0f);
+	mBlockMax.assign((size_t)(mWidth / BlockSize) * (mHeight / BlockSize), 1.0f);
+	mTileMax.assign((size_t)mTilesX * mTilesY, 1.0f);
+	mBins.clear();
+	mBinThreads = 0;
+}
+
+void SoftwareOcclusion::BeginFrame(const glm::mat4& viewProj) {
+	mViewProj = viewProj;
+	mOccluders.clear();
+}
+
+void SoftwareOcclusion::AddOccluder(const glm::mat4& world, const void* vertices, uint32_t vertexStride, uint32_t vertexCount, const uint32_t* indices, size_t indexCount) {
+	Occluder occluder;
+	occluder.WorldViewProj = mViewProj * world;
+	occluder.Vertices = (const uint8_t*)vertices;
+	occluder.VertexStride = vertexStride;
+	occluder.VertexCount = vertexCount;
+	occluder.Indices = indices;
+	occluder.TriangleCount = (uint32_t)(indexCount / 3);
+	occluder.FirstVertex = 0;
+	mOccluders.push_back(occluder);
+}
+
+void SoftwareOcclusion::Rasterize(ThreadPool& pool) {
+	CPU_ZONE("occlusion rasterize");
+	uint32_t tileCount = mTilesX * mTilesY;
+	uint32_t threadCount = pool.ThreadCount();
+	if (mBinThreads != threadCount) {
+		mBins.assign((size_t)threadCount * tileCount, {});
+		mBinThreads = threadCount;
+	}
+	for (auto& bin : mBins)
+		bin.clear();//keeps the capacity from earlier frames
+
+	//clip space positions of every occluder
+	uint32_t vertexCount = 0;
+	mTasks.clear();
+	for (uint32_t i = 0; i < (uint32_t)mOccluders.size(); ++i) {
+		Occluder& occluder = mOccluders[i];
+		occluder.FirstVertex = vertexCount;
+		vertexCount += occluder.VertexCount;
+		for (uint32_t begin = 0; begin < occluder.VertexCount; begin += VertexChunk)
+			mTasks.push_back({ i,begin,(std::min)(begin + VertexChunk,occluder.VertexCount) });
+	}
+	mClipVertices.resize(vertexCount);
+	mScreenVertices.resize(vertexCount);
+	pool.Run((uint32_t)mTasks.size(), [&](uint32_t taskIndex, uint32_t) {
+		const Task& task = mTasks[taskIndex];
+		const Occluder& occluder = mOccluders[task.Occluder];
+		glm::vec4* clip = mClipVertices.data() + occluder.FirstVertex;
+		glm::vec3* screen = mScreenVertices.data() + occluder.FirstVertex;
+		for (uint32_t v = task.Begin; v < task.End; ++v) {
+			glm::vec3 pos;
+			memcpy(&pos, occluder.Vertices + (size_t)occluder.VertexStride * v, sizeof(pos));
+			clip[v] = occluder.WorldViewProj * glm::vec4(pos, 1.0f);
+			if (clip[v].z >= 0.0f)
+				screen[v] = ToScreen(clip[v]);
+		}
+		});
+
+	//triangles into the bins of the tiles they touch
+	mTasks.clear();
+	for (uint32_t i = 0; i < (uint32_t)mOccluders.size(); ++i) {
+		const Occluder& occluder = mOccluders[i];
+		for (uint32_t begin = 0; begin < occluder.TriangleCount; begin += TriangleChunk)
+			mTasks.push_back({ i,begin,(std::min)(begin + TriangleChunk,occluder.TriangleCount) });
+	}
+	pool.Run((uint32_t)mTasks.size(), [&](uint32_t taskIndex, uint32_t threadIndex) {
+		const Task& task = mTasks[taskIndex];
+		const Occluder& occluder = mOccluders[task.Occluder];
+		const glm::vec4* clip = mClipVertices.data() + occluder.FirstVertex;
+		const glm::vec3* screen = mScreenVertices.data() + occluder.FirstVertex;
+		for (uint32_t t = task.Begin; t < task.End; ++t) {
+			const uint32_t* tri = occluder.Indices + 3 * (size_t)t;
+			SetupTriangle(clip, screen, tri, threadIndex);
+		}
+		});
+
+	//each tile has one writer
+	pool.Run(tileCount, [&](uint32_t taskIndex, uint32_t) {
+		RasterizeTile(taskIndex);
+		});
+}
+
+glm::vec3 SoftwareOcclusion::ToScreen(const glm::vec4& clip)const {
+	float invW = 1.0f / clip.w;
+	return glm::vec3((clip.x * invW * 0.5f + 0.5f) * (float)mWidth, (clip.y * invW * 0.5f + 0.5f) * (float)mHeight, clip.z * invW);
+}
+
+void SoftwareOcclusion::SetupTriangle(const glm::vec4* clip, const glm::vec3* screen, const uint32_t* tri, uint32_t threadIndex) {
+	const glm::vec4& c0 = clip[tri[0]];
+	const glm::vec4& c1 = clip[tri[1]];
+	const glm::vec4& c2 = clip[tri[2]];
+	//outside one of the side or far planes
+	if ((c0.x > c0.w && c1.x > c1.w && c2.x > c2.w) || (c0.x < -c0.w && c1.x < -c1.w && c2.x < -c2.w) ||
+		(c0.y > c0.w && c1.y > c1.w && c2.y > c2.w) || (c0.y < -c0.w && c1.y < -c1.w && c2.y < -c2.w) ||
+		(c0.z > c0.w && c1.z > c1.w && c2.z > c2.w))
+		return;
+	bool in0 = c0.z >= 0.0f;
+	bool in1 = c1.z >= 0.0f;
+	bool in2 = c2.z >= 0.0f;
+	if (in0 && in1 && in2) {
+		BinTriangle(screen[tri[0]], screen[tri[1]], screen[tri[2]], threadIndex);
+		return;
+	}
+	if (!in0 && !in1 && !in2)
+		return;
+	//clip against the near plane z = 0, leaves a triangle or a quad
+	const glm::vec4* in[3] = { &c0,&c1,&c2 };
+	glm::vec4 poly[4];
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < 3; ++i) {
+		const glm::vec4& a = *in[i];
+		const glm::vec4& b = *in[(i + 1) % 3];
+		if (a.z >= 0.0f)
+			poly[count++] = a;
+		if ((a.z >= 0.0f) != (b.z >= 0.0f)) {
+			float t = a.z / (a.z - b.z);
+			poly[count] = a + t * (b - a);
+			poly[count++].z = 0.0f;
+		}
+	}
+	glm::vec3 v[4];
+	for (uint32_t i = 0; i < count; ++i)
+		v[i] = ToScreen(poly[i]);
+	BinTriangle(v[0], v[1], v[2], threadIndex);
+	if (count == 4)
+		BinTriangle(v[0], v[2], v[3], threadIndex);
+}
+
+void SoftwareOcclusion::BinTriangle(const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2, uint32_t threadIndex) {
+	//pixel centres at x + 0.5, anything that covers none of them is dropped before
+	//any more setup, at this size that is most of a detailed mesh
+	float minX = (std::min)({ s0.x,s1.x,s2.x });
+	float maxX = (std::max)({ s0.x,s1.x,s2.x });
+	float minY = (std::min)({ s0.y,s1.y,s2.y });
+	float maxY = (std::max)({ s0.y,s1.y,s2.y });
+	//clamped so the casts can stand in for ceil and floor, a centre exactly on the
+	//left or top of the box is missed, which only ever hides less
+	float width = (float)mWidth;
+	float height = (float)mHeight;
+	Triangle tri;
+	tri.MinX = (int32_t)((std::min)((std::max)(minX - 0.5f, -1.0f), width) + 1.0f);
+	tri.MaxX = (std::min)((int32_t)mWidth - 1, (int32_t)((std::min)((std::max)(maxX - 0.5f, -1.0f), width) + 1.0f) - 1);
+	tri.MinY = (int32_t)((std::min)((std::max)(minY - 0.5f, -1.0f), height) + 1.0f);
+	tri.MaxY = (std::min)((int32_t)mHeight - 1, (int32_t)((std::min)((std::max)(maxY - 0.5f, -1.0f), height) + 1.0f) - 1);
+	if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+		return;
+
+	glm::vec3 v[3] = { s0,s1,s2 };
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (std::fabs(area) < 1e-8f)
+		return;
+	if (area < 0.0f) {
+		std::swap(v[1], v[2]);
+		area = -area;
+	}
+
+	//E(p) = cross(b - a, p - a), positive inside with the winding above
+	for (uint32_t i = 0; i < 3; ++i) {
+		const glm::vec3& a = v[i];
+		const glm::vec3& b = v[(i + 1) % 3];
+		tri.EdgeA[i] = a.y - b.y;
+		tri.EdgeB[i] = b.x - a.x;
+		tri.EdgeC[i] = -(tri.EdgeA[i] * a.x + tri.EdgeB[i] * a.y);
+	}
+	//depth plane, moved back by the most it changes from the centre to a pixel corner
+	float invArea = 1.0f / area;
+	float dzdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) * invArea;
+	float dzdy = ((v[1].x - v[0].x) * (v[2].z - v[0].z) - (v[2].x - v[0].x) * (v[1].z - v[0].z)) * invArea;
+	tri.DepthA = dzdx;
+	tri.DepthB = dzdy;
+	tri.DepthC = v[0].z - dzdx * v[0].x - dzdy * v[0].y + 0.5f * (std::fabs(dzdx) + std::fabs(dzdy));
+	tri.DepthMax = (std::max)({ v[0].z,v[1].z,v[2].z });
+
+	uint32_t tileCount = mTilesX * mTilesY;
+	std::vector<Triangle>* bins = mBins.data() + (size_t)threadIndex * tileCount;
+	for (int32_t ty = tri.MinY / (int32_t)TileSize; ty <= tri.MaxY / (int32_t)TileSize; ++ty)
+		for (int32_t tx = tri.MinX / (int32_t)TileSize; tx <= tri.MaxX / (int32_t)TileSize; ++tx)
+			bins[ty * mTilesX + tx].push_back(tri);
+}
+
+void SoftwareOcclusion::RasterizeTile(uint32_t tile) {
+	int32_t originX = (int32_t)((tile % mTilesX) * TileSize);
+	int32_t originY = (int32_t)((tile / mTilesX) * TileSize);
+	float* depth = mDepth.data();
+	for (int32_t y = originY; y < originY + (int32_t)TileSize; ++y)
+		std::fill_n(depth + (size_t)y * mWidth + originX, TileSize, 1.0f);
+
+	uint32_t tileCount = mTilesX * mTilesY;
+	for (uint32_t thread = 0; thread < mBinThreads; ++thread) {
+		for (const Triangle& tri : mBins[(size_t)thread * tileCount + tile]) {
+			//whole groups of 4 pixels, the edge functions reject the ones outside
+			int32_t x0 = (std::max)(tri.MinX, originX) & ~3;
+			int32_t x1 = (std::min)(tri.MaxX, originX + (int32_t)TileSize - 1);
+			int32_t y0 = (std::max)(tri.MinY, originY);
+			int32_t y1 = (std::min)(tri.MaxY, originY + (int32_t)TileSize - 1);
+#if defined(OCCLUSION_SSE)
+			__m128 stepX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 edgeA[3], edgeStep[3];
+			for (uint32_t i = 0; i < 3; ++i) {
+				edgeA[i] = _mm_set1_ps(tri.EdgeA[i]);
+				edgeStep[i] = _mm_set1_ps(4.0f * tri.EdgeA[i]);
+			}
+			__m128 depthA = _mm_set1_ps(tri.DepthA);
+			__m128 depthStep = _mm_set1_ps(4.0f * tri.DepthA);
+			__m128 depthMax = _mm_set1_ps(tri.DepthMax);
+			__m128 zero = _mm_setzero_ps();
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x0), stepX);
+			for (int32_t y = y0; y <= y1; ++y) {
+				float py = (float)y + 0.5f;
+				__m128 e[3];
+				for (uint32_t i = 0; i < 3; ++i)
+					e[i] = _mm_add_ps(_mm_mul_ps(edgeA[i], px), _mm_set1_ps(tri.EdgeB[i] * py + tri.EdgeC[i]));
+				__m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), _mm_set1_ps(tri.DepthB * py + tri.DepthC));
+				float* row = depth + (size_t)y * mWidth;
+				for (int32_t x = x0; x <= x1; x += 4) {
+					__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+					__m128 old = _mm_load_ps(row + x);
+					__m128 nearer = _mm_min_ps(old, _mm_min_ps(z, depthMax));
+					_mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+					for (uint32_t i = 0; i < 3; ++i)
+						e[i] = _mm_add_ps(e[i], edgeStep[i]);
+					z = _mm_add_ps(z, depthStep);
+				}
+			}
+#else
+			for (int32_t y = y0; y <= y1; ++y) {
+				float py = (float)y + 0.5f;
+				float* row = depth + (size_t)y * mWidth;
+				for (int32_t x = x0; x <= x1; ++x) {
+					float px = (float)x + 0.5f;
+					if (tri.EdgeA[0] * px + tri.EdgeB[0] * py + tri.EdgeC[0] < 0.0f ||
+						tri.EdgeA[1] * px + tri.EdgeB[1] * py + tri.EdgeC[1] < 0.0f ||
+						tri.EdgeA[2] * px + tri.EdgeB[2] * py + tri.EdgeC[2] < 0.0f)
+						continue;
+					float z = (std::min)(tri.DepthA * px + tri.DepthB * py + tri.DepthC, tri.DepthMax);
+					row[x] = (std::min)(row[x], z);
+				}
+			}
+#endif
+		}
+	}
+
+	//farthest depth per block and for the tile
+	uint32_t blocksPerRow = mWidth / BlockSize;
+	float tileMax = 0.0f;
+	for (int32_t by = originY; by < originY + (int32_t)TileSize; by += BlockSize) {
+		for (int32_t bx = originX; bx < originX + (int32_t)TileSize; bx += BlockSize) {
+			float blockMax = 0.0f;
+			for (int32_t y = by; y < by + (int32_t)BlockSize; ++y) {
+				const float* row = depth + (size_t)y * mWidth + bx;
+				for (uint32_t x = 0; x < BlockSize; ++x)
+					blockMax = (std::max)(blockMax, row[x]);
+			}
+			mBlockMax[(by / BlockSize) * blocksPerRow + bx / BlockSize] = blockMax;
+			tileMax = (std::max)(tileMax, blockMax);
+		}
+	}
+	mTileMax[tile] = tileMax;
+}
+
+bool SoftwareOcclusion::IsOccluded(const glm::vec3& minW, const glm::vec3& maxW)const {
+	if (mOccluders.empty())
+		return false;
+	glm::vec2 ndcMin(FLT_MAX);
+	glm::vec2 ndcMax(-FLT_MAX);
+	float zMin = FLT_MAX;
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec4 corner((i & 1) ? maxW.x : minW.x, (i & 2) ? maxW.y : minW.y, (i & 4) ? maxW.z : minW.z, 1.0f);
+		glm::vec4 clip = mViewProj * corner;
+		if (clip.w <= 1e-6f)
+			return false;//crosses the camera plane
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+		ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+		zMin = (std::min)(zMin, ndc.z);
+	}
+	if (zMin <= 0.0f || zMin > 1.0f)
+		return false;
+	if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+		return false;//off screen, the frustum test's business
+
+	//every pixel the box's rectangle touches, partly covered ones included
+	int32_t x0 = (std::max)(0, (int32_t)std::floor((ndcMin.x * 0.5f + 0.5f) * mWidth));
+	int32_t x1 = (std::min)((int32_t)mWidth - 1, (int32_t)std::floor((ndcMax.x * 0.5f + 0.5f) * mWidth));
+	int32_t y0 = (std::max)(0, (int32_t)std::floor((ndcMin.y * 0.5f + 0.5f) * mHeight));
+	int32_t y1 = (std::min)((int32_t)mHeight - 1, (int32_t)std::floor((ndcMax.y * 0.5f + 0.5f) * mHeight));
+
+	uint32_t blocksPerRow = mWidth / BlockSize;
+	for (int32_t ty = y0 / (int32_t)TileSize; ty <= y1 / (int32_t)TileSize; ++ty) {
+		for (int32_t tx = x0 / (int32_t)TileSize; tx <= x1 / (int32_t)TileSize; ++tx) {
+			if (mTileMax[ty * mTilesX + tx] < zMin)
+				continue;
+			int32_t bx0 = (std::max)(x0, tx * (int32_t)TileSize) / (int32_t)BlockSize;
+			int32_t bx1 = (std::min)(x1, (tx + 1) * (int32_t)TileSize - 1) / (int32_t)BlockSize;
+			int32_t by0 = (std::max)(y0, ty * (int32_t)TileSize) / (int32_t)BlockSize;
+			int32_t by1 = (std::min)(y1, (ty + 1) * (int32_t)TileSize - 1) / (int32_t)BlockSize;
+			for (int32_t by = by0; by <= by1; ++by) {
+				for (int32_t bx = bx0; bx <= bx1; ++bx) {
+					if (mBlockMax[by * blocksPerRow + bx] < zMin)
+						continue;
+					int32_t px0 = (std::max)(x0, bx * (int32_t)BlockSize);
+					int32_t px1 = (std::min)(x1, (bx + 1) * (int32_t)BlockSize - 1);
+					int32_t py0 = (std::max)(y0, by * (int32_t)BlockSize);
+					int32_t py1 = (std::min)(y1, (by + 1) * (int32_t)BlockSize - 1);
+					for (int32_t y = py0; y <= py1; ++y) {
+						const float* row = mDepth.data() + (size_t)y * mWidth;
+						for (int32_t x = px0; x <= px1; ++x)
+							if (row[x] >= zMin)
+								return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void SoftwareOcclusion::Visualize(uint8_t* pixels)const {
+	//z / w bunches up near 1, so stretch whatever range was drawn
+	float nearest = 1.0f;
+	for (float d : mDepth)
+		nearest = (std::min)(nearest, d);
+	float scale = nearest < 1.0f ? 1.0f / (1.0f - nearest) : 0.0f;
+	for (size_t i = 0; i < mDepth.size(); ++i) {
+		float d = mDepth[i];
+		pixels[i] = d >= 1.0f ? 0 : (uint8_t)(64.0f + 191.0f * (1.0f - (d - nearest) * scale));
+	}
+}
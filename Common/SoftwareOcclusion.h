@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+class ThreadPool;
+
+///<summary>
+/// Occlusion culling on the CPU, for when the GPU culling path isn't there.
+/// Each frame a few large occluders are rasterized into a small depth buffer
+/// (256x128 by default) and object boxes are tested against it before their
+/// instances are written out.
+///
+/// Rasterize splits the work over a ThreadPool twice. First the occluders'
+/// triangles are transformed, clipped to the near plane, set up and binned
+/// to the 32x32 pixel tiles they touch, in chunks, each thread into its own
+/// bins. Then every tile is one task: it is cleared, its triangles are
+/// rasterized four pixels per SSE instruction, and the farthest depth of
+/// every 8x8 block and of the whole tile is kept. IsOccluded skips the
+/// blocks and tiles that are nearer than the box without reading pixels.
+///
+/// Depth is z / w like the depth buffer: 0 near, 1 far, cleared to 1. An
+/// occluder covers the pixels whose centres it contains and writes the
+/// farthest depth its plane reaches inside the pixel, and a box is only
+/// occluded if its nearest point is behind every pixel of its screen
+/// rectangle.
+///</summary>
+
+class SoftwareOcclusion {
+public:
+	static constexpr uint32_t TileSize = 32;
+	static constexpr uint32_t BlockSize = 8;
+private:
+	// Edge functions A * x + B * y + C >= 0 inside, depth plane already made
+	// conservative for the pixel, all in pixels of the occlusion buffer.
+	struct Triangle {
+		float EdgeA[3];
+		float EdgeB[3];
+		float EdgeC[3];
+		float DepthA;
+		float DepthB;
+		float DepthC;
+		float DepthMax;
+		int32_t MinX, MinY, MaxX, MaxY;	//pixels whose centres can be inside
+	};
+	struct Occluder {
+		glm::mat4 WorldViewProj;
+		const uint8_t* Vertices;
+		uint32_t VertexStride;
+		uint32_t VertexCount;
+		const uint32_t* Indices;
+		uint32_t TriangleCount;
+		uint32_t FirstVertex;	//into mClipVertices
+	};
+	struct Task {
+		uint32_t Occluder;
+		uint32_t Begin;
+		uint32_t End;
+	};
+
+	uint32_t mWidth{ 0 };
+	uint32_t mHeight{ 0 };
+	uint32_t mTilesX{ 0 };
+	uint32_t mTilesY{ 0 };
+	glm::mat4 mViewProj{ 1.0f };
+
+	std::vector<float> mDepth;		//row major
+	std::vector<float> mBlockMax;	//row major over the 8x8 blocks
+	std::vector<float> mTileMax;	//row major over the tiles
+
+	std::vector<Occluder> mOccluders;
+	std::vector<glm::vec4> mClipVertices;
+	std::vector<glm::vec3> mScreenVertices;	//pixels and z / w, where z >= 0
+	std::vector<Task> mTasks;
+	std::vector<std::vector<Triangle>> mBins;	//[thread * tile count + tile]
+	uint32_t mBinThreads{ 0 };
+
+	glm::vec3 ToScreen(const glm::vec4& clip)const;
+	void SetupTriangle(const glm::vec4* clip, const glm::vec3* screen, const uint32_t* tri, uint32_t threadIndex);
+	void BinTriangle(const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2, uint32_t threadIndex);
+	void RasterizeTile(uint32_t tile);
+public:
+	SoftwareOcclusion(uint32_t width = 256, uint32_t height = 128);
+
+	// Rounded up to whole tiles.
+	void Resize(uint32_t width, uint32_t height);
+	uint32_t Width()const { return mWidth; }
+	uint32_t Height()const { return mHeight; }
+
+	// viewProj as the pass constants build it, y flipped so row 0 is the top.
+	void BeginFrame(const glm::mat4& viewProj);
+	// Position is the first member of the vertex, as TriangleBvh::Build assumes. The
+	// data has to stay put until Rasterize returns.
+	void AddOccluder(const glm::mat4& world, const void* vertices, uint32_t vertexStride, uint32_t vertexCount, const uint32_t* indices, size_t indexCount);
+	void Rasterize(ThreadPool& pool);
+
+	uint32_t OccluderCount()const { return (uint32_t)mOccluders.size(); }
+
+	// World space box against the buffer, safe from any thread after Rasterize.
+	bool IsOccluded(const glm::vec3& minW, const glm::vec3& maxW)const;
+	bool IsOccludedCenterExtents(const glm::vec3& center, const glm::vec3& extents)const { return IsOccluded(center - extents, center + extents); }
+
+	// Width * Height bytes for a debug view: black where nothing was drawn,
+	// occluders brighter the nearer they are.
+	void Visualize(uint8_t* pixels)const;
+};
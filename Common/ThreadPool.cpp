@@ -0,0 +1,67 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0)
+		threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+	for (uint32_t i = 1; i < threadCount; ++i)
+		mThreads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (auto& thread : mThreads)
+		thread.join();
+}
+
+void ThreadPool::Work(uint32_t threadIndex) {
+	for (uint32_t i = mNextTask.fetch_add(1); i < mTaskCount; i = mNextTask.fetch_add(1))
+		(*mTask)(i, threadIndex);
+}
+
+void ThreadPool::WorkerLoop(uint32_t threadIndex) {
+	uint64_t generation = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [&] {return mQuit || mGeneration != generation; });
+			if (mQuit)
+				return;
+			generation = mGeneration;
+		}
+		Work(threadIndex);
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (--mBusyWorkers == 0)
+				mDone.notify_one();
+		}
+	}
+}
+
+void ThreadPool::Run(uint32_t count, const std::function<void(uint32_t, uint32_t)>& task) {
+	if (count == 0)
+		return;
+	if (mThreads.empty() || count == 1) {
+		for (uint32_t i = 0; i < count; ++i)
+			task(i, 0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTaskCount = count;
+		mNextTask = 0;
+		mBusyWorkers = (uint32_t)mThreads.size();
+		mGeneration++;
+	}
+	mWake.notify_all();
+	Work(0);
+	//every worker has to check in before task goes out of scope
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [&] {return mBusyWorkers == 0; });
+	mTask = nullptr;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+///<summary>
+/// Fixed set of worker threads for data parallel loops inside a frame.
+/// Run hands out task indices [0, count) to the workers and the calling
+/// thread through one atomic counter and returns once every task has
+/// finished, so the caller can use the results straight away.  The threads
+/// sleep on a condition variable between runs; nothing is allocated per run.
+///</summary>
+class ThreadPool {
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	const std::function<void(uint32_t, uint32_t)>* mTask{ nullptr };
+	uint32_t mTaskCount{ 0 };
+	std::atomic<uint32_t> mNextTask{ 0 };
+	uint32_t mBusyWorkers{ 0 };
+	uint64_t mGeneration{ 0 };
+	bool mQuit{ false };
+
+	void WorkerLoop(uint32_t threadIndex);
+	void Work(uint32_t threadIndex);
+public:
+	// threadCount includes the calling thread, 0 uses every hardware thread.
+	ThreadPool(uint32_t threadCount = 0);
+	ThreadPool(const ThreadPool& rhs) = delete;
+	ThreadPool& operator=(const ThreadPool& rhs) = delete;
+	~ThreadPool();
+
+	uint32_t ThreadCount()const { return (uint32_t)mThreads.size() + 1; }
+
+	// task(taskIndex, threadIndex), threadIndex is 0 for the caller and
+	// below ThreadCount() so it can pick per thread scratch space.
+	void Run(uint32_t count, const std::function<void(uint32_t, uint32_t)>& task);
+};
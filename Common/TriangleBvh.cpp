@@ -0,0 +1,321 @@
+#include "TriangleBvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+static const int gBinCount = 12;
+static const uint32_t gMaxLeafTriangles = 8;
+//past this depth nodes are halved instead, which bounds the traversal stack
+static const uint32_t gMaxSahDepth = 64;
+static const uint32_t gStackSize = 128;
+//slab distances are rounded, grow the interval so triangles on a box face aren't lost
+static const float gSlabScale = 1.0f + 3.0f * FLT_EPSILON;
+
+static float SurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 e = max - min;
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+void TriangleBvh::Build(const void* vertices, uint32_t vertexStride, const uint32_t* indices, size_t indexCount) {
+	mNodes.clear();
+	mPackets.clear();
+	mTriangleCount = (uint32_t)(indexCount / 3);
+	if (mTriangleCount == 0)
+		return;
+
+	const uint8_t* pVertices = (const uint8_t*)vertices;
+	std::vector<glm::vec3> v0(mTriangleCount), v1(mTriangleCount), v2(mTriangleCount);
+	std::vector<BuildTriangle> tris(mTriangleCount);
+	for (uint32_t t = 0; t < mTriangleCount; ++t) {
+		v0[t] = *(const glm::vec3*)(pVertices + (size_t)vertexStride * indices[t * 3 + 0]);
+		v1[t] = *(const glm::vec3*)(pVertices + (size_t)vertexStride * indices[t * 3 + 1]);
+		v2[t] = *(const glm::vec3*)(pVertices + (size_t)vertexStride * indices[t * 3 + 2]);
+		BuildTriangle& tri = tris[t];
+		tri.Min = glm::min(v0[t], glm::min(v1[t], v2[t]));
+		tri.Max = glm::max(v0[t], glm::max(v1[t], v2[t]));
+		tri.Centroid = (v0[t] + v1[t] + v2[t]) * (1.0f / 3.0f);
+		tri.Triangle = t;
+	}
+
+	//a binary tree with at least one triangle per leaf never needs more
+	mNodes.reserve((size_t)mTriangleCount * 2);
+	mPackets.reserve(mTriangleCount / 4 + 1);
+	mNodes.emplace_back();
+	Subdivide(0, 0, tris, 0, mTriangleCount, v0.data(), v1.data(), v2.data());
+	mNodes.shrink_to_fit();
+	mPackets.shrink_to_fit();
+}
+
+void TriangleBvh::Subdivide(uint32_t nodeId, uint32_t depth, std::vector<BuildTriangle>& tris, uint32_t first, uint32_t count, const glm::vec3* v0, const glm::vec3* v1, const glm::vec3* v2) {
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; ++i) {
+		boundsMin = glm::min(boundsMin, tris[i].Min);
+		boundsMax = glm::max(boundsMax, tris[i].Max);
+		centroidMin = glm::min(centroidMin, tris[i].Centroid);
+		centroidMax = glm::max(centroidMax, tris[i].Centroid);
+	}
+	mNodes[nodeId].Min = boundsMin;
+	mNodes[nodeId].Max = boundsMax;
+	if (count <= 2) {
+		MakeLeaf(nodeId, tris, first, count, v0, v1, v2);
+		return;
+	}
+
+	//binned SAH: cost of a split is count * area on each side
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3 && depth < gMaxSahDepth; ++axis) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+			continue;
+		glm::vec3 binMin[gBinCount], binMax[gBinCount];
+		uint32_t binCount[gBinCount] = {};
+		for (int b = 0; b < gBinCount; ++b) {
+			binMin[b] = glm::vec3(FLT_MAX);
+			binMax[b] = glm::vec3(-FLT_MAX);
+		}
+		float scale = gBinCount / extent;
+		for (uint32_t i = first; i < first + count; ++i) {
+			int b = (std::min)(gBinCount - 1, (int)((tris[i].Centroid[axis] - centroidMin[axis]) * scale));
+			binCount[b]++;
+			binMin[b] = glm::min(binMin[b], tris[i].Min);
+			binMax[b] = glm::max(binMax[b], tris[i].Max);
+		}
+		//sweep from the right to get the right side of every split, then from the left
+		float rightArea[gBinCount - 1];
+		uint32_t rightCount[gBinCount - 1];
+		glm::vec3 sideMin(FLT_MAX), sideMax(-FLT_MAX);
+		uint32_t sideCount = 0;
+		for (int b = gBinCount - 1; b > 0; --b) {
+			sideCount += binCount[b];
+			if (binCount[b] > 0) {
+				sideMin = glm::min(sideMin, binMin[b]);
+				sideMax = glm::max(sideMax, binMax[b]);
+			}
+			rightCount[b - 1] = sideCount;
+			rightArea[b - 1] = sideCount > 0 ? SurfaceArea(sideMin, sideMax) : 0.0f;
+		}
+		sideMin = glm::vec3(FLT_MAX);
+		sideMax = glm::vec3(-FLT_MAX);
+		sideCount = 0;
+		for (int b = 0; b < gBinCount - 1; ++b) {
+			sideCount += binCount[b];
+			if (binCount[b] > 0) {
+				sideMin = glm::min(sideMin, binMin[b]);
+				sideMax = glm::max(sideMax, binMax[b]);
+			}
+			if (sideCount == 0 || rightCount[b] == 0)
+				continue;
+			float cost = sideCount * SurfaceArea(sideMin, sideMax) + rightCount[b] * rightArea[b];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	float leafCost = count * SurfaceArea(boundsMin, boundsMax);
+	if (count <= gMaxLeafTriangles && (bestAxis == -1 || leafCost <= bestCost)) {
+		MakeLeaf(nodeId, tris, first, count, v0, v1, v2);
+		return;
+	}
+
+	uint32_t leftCount = 0;
+	if (bestAxis != -1) {
+		float scale = gBinCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		auto mid = std::partition(tris.begin() + first, tris.begin() + first + count, [&](const BuildTriangle& tri) {
+			int b = (std::min)(gBinCount - 1, (int)((tri.Centroid[bestAxis] - centroidMin[bestAxis]) * scale));
+			return b <= bestSplit;
+			});
+		leftCount = (uint32_t)(mid - (tris.begin() + first));
+	}
+	if (leftCount == 0 || leftCount == count) {
+		//all the centroids in one spot, just halve the list
+		leftCount = count / 2;
+	}
+
+	uint32_t left = (uint32_t)mNodes.size();
+	mNodes.emplace_back();
+	mNodes.emplace_back();
+	mNodes[nodeId].LeftFirst = left;
+	mNodes[nodeId].Count = 0;
+	Subdivide(left, depth + 1, tris, first, leftCount, v0, v1, v2);
+	Subdivide(left + 1, depth + 1, tris, first + leftCount, count - leftCount, v0, v1, v2);
+}
+
+void TriangleBvh::MakeLeaf(uint32_t nodeId, std::vector<BuildTriangle>& tris, uint32_t first, uint32_t count, const glm::vec3* v0, const glm::vec3* v1, const glm::vec3* v2) {
+	mNodes[nodeId].LeftFirst = (uint32_t)mPackets.size();
+	mNodes[nodeId].Count = count;
+	for (uint32_t i = 0; i < count; i += 8) {
+		//padding lanes are degenerate, det is 0 so they never hit
+		TrianglePacket packet{};
+		for (uint32_t lane = 0; lane < 8; ++lane) {
+			packet.Triangle[lane] = UINT32_MAX;
+			if (i + lane >= count)
+				continue;
+			uint32_t t = tris[first + i + lane].Triangle;
+			//same edges as glm::intersectRayTriangle computes
+			glm::vec3 e1 = v1[t] - v0[t];
+			glm::vec3 e2 = v2[t] - v0[t];
+			packet.V0x[lane] = v0[t].x;
+			packet.V0y[lane] = v0[t].y;
+			packet.V0z[lane] = v0[t].z;
+			packet.E1x[lane] = e1.x;
+			packet.E1y[lane] = e1.y;
+			packet.E1z[lane] = e1.z;
+			packet.E2x[lane] = e2.x;
+			packet.E2y[lane] = e2.y;
+			packet.E2z[lane] = e2.z;
+			packet.Triangle[lane] = t;
+		}
+		mPackets.push_back(packet);
+	}
+}
+
+void TriangleBvh::IntersectPacket(const TrianglePacket& packet, const glm::vec3& orig, const glm::vec3& dir, uint32_t& tri, float& dist)const {
+	const float epsilon = std::numeric_limits<float>::epsilon();
+#if defined(__AVX__)
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+	__m256 e1x = _mm256_loadu_ps(packet.E1x), e1y = _mm256_loadu_ps(packet.E1y), e1z = _mm256_loadu_ps(packet.E1z);
+	__m256 e2x = _mm256_loadu_ps(packet.E2x), e2y = _mm256_loadu_ps(packet.E2y), e2z = _mm256_loadu_ps(packet.E2z);
+	//p = cross(dir, e2), det = dot(e1, p)
+	__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+	__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+	__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+	//s = orig - v0, u = dot(s, p), q = cross(s, e1), v = dot(dir, q)
+	__m256 sx = _mm256_sub_ps(_mm256_set1_ps(orig.x), _mm256_loadu_ps(packet.V0x));
+	__m256 sy = _mm256_sub_ps(_mm256_set1_ps(orig.y), _mm256_loadu_ps(packet.V0y));
+	__m256 sz = _mm256_sub_ps(_mm256_set1_ps(orig.z), _mm256_loadu_ps(packet.V0z));
+	__m256 u = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz));
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(e1y, sz));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(e1z, sx));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(e1x, sy));
+	__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz));
+	//glm tests u, v against det for either sign of det, flipping all three by det's sign does the same
+	__m256 detSign = _mm256_and_ps(det, signBit);
+	__m256 absDet = _mm256_xor_ps(det, detSign);
+	__m256 su = _mm256_xor_ps(u, detSign);
+	__m256 sv = _mm256_xor_ps(v, detSign);
+	__m256 mask = _mm256_cmp_ps(absDet, _mm256_set1_ps(epsilon), _CMP_GT_OQ);
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(su, zero, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(su, absDet, _CMP_LE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(sv, zero, _CMP_GE_OQ));
+	mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(su, sv), absDet, _CMP_LE_OQ));
+	int hits = _mm256_movemask_ps(mask);
+	if (hits == 0)
+		return;
+	__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+	hits &= _mm256_movemask_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+	alignas(32) float ts[8];
+	_mm256_store_ps(ts, t);
+	for (int lane = 0; lane < 8; ++lane) {
+		if (((hits >> lane) & 1) == 0)
+			continue;
+		if (ts[lane] < dist || (ts[lane] == dist && packet.Triangle[lane] < tri)) {
+			dist = ts[lane];
+			tri = packet.Triangle[lane];
+		}
+	}
+#else
+	for (int lane = 0; lane < 8; ++lane) {
+		glm::vec3 e1(packet.E1x[lane], packet.E1y[lane], packet.E1z[lane]);
+		glm::vec3 e2(packet.E2x[lane], packet.E2y[lane], packet.E2z[lane]);
+		glm::vec3 p = glm::cross(dir, e2);
+		float det = glm::dot(e1, p);
+		if (std::fabs(det) <= epsilon)
+			continue;
+		float sign = det < 0.0f ? -1.0f : 1.0f;
+		glm::vec3 s = orig - glm::vec3(packet.V0x[lane], packet.V0y[lane], packet.V0z[lane]);
+		float u = glm::dot(s, p) * sign;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(dir, q) * sign;
+		float absDet = det * sign;
+		if (u < 0.0f || u > absDet || v < 0.0f || u + v > absDet)
+			continue;
+		float t = glm::dot(e2, q) * (1.0f / det);
+		if (t < 0.0f)
+			continue;
+		if (t < dist || (t == dist && packet.Triangle[lane] < tri)) {
+			dist = t;
+			tri = packet.Triangle[lane];
+		}
+	}
+#endif
+}
+
+// Entry distance of the ray into the node's box, or FLT_MAX if it misses or
+// only enters beyond maxDist.  An axis the ray is parallel to only checks the
+// origin is within the slab, 0 * inf would be NaN when it lies on a face.
+static float IntersectNode(const TriangleBvhNode& node, const glm::vec3& orig, const glm::vec3& dir, const glm::vec3& invDir, float maxDist) {
+	float tMin = 0.0f;
+	float tMax = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (dir[axis] == 0.0f) {
+			if (orig[axis] < node.Min[axis] || orig[axis] > node.Max[axis])
+				return FLT_MAX;
+			continue;
+		}
+		float t0 = (node.Min[axis] - orig[axis]) * invDir[axis];
+		float t1 = (node.Max[axis] - orig[axis]) * invDir[axis];
+		tMin = (std::max)(tMin, (std::min)(t0, t1));
+		tMax = (std::min)(tMax, (std::max)(t0, t1));
+	}
+	if (tMin > tMax * gSlabScale || tMin > maxDist * gSlabScale)
+		return FLT_MAX;
+	return tMin;
+}
+
+bool TriangleBvh::Intersect(const glm::vec3& orig, const glm::vec3& dir, uint32_t& tri, float& dist)const {
+	tri = UINT32_MAX;
+	dist = INFINITY;
+	if (mNodes.empty())
+		return false;
+	glm::vec3 invDir = 1.0f / dir;
+	if (IntersectNode(mNodes[0], orig, dir, invDir, FLT_MAX) == FLT_MAX)
+		return false;
+
+	//node and the distance it was entered at, so nodes behind a newer hit are skipped
+	struct StackEntry {
+		uint32_t Node;
+		float Distance;
+	};
+	StackEntry stack[gStackSize];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0.0f };
+	while (stackSize > 0) {
+		StackEntry entry = stack[--stackSize];
+		if (entry.Distance > dist * gSlabScale)
+			continue;
+		const TriangleBvhNode& node = mNodes[entry.Node];
+		if (node.IsLeaf()) {
+			uint32_t packetCount = (node.Count + 7) / 8;
+			for (uint32_t p = 0; p < packetCount; ++p)
+				IntersectPacket(mPackets[node.LeftFirst + p], orig, dir, tri, dist);
+			continue;
+		}
+		//near child on top of the stack so its hits can prune the far one
+		float tLeft = IntersectNode(mNodes[node.LeftFirst], orig, dir, invDir, dist);
+		float tRight = IntersectNode(mNodes[node.LeftFirst + 1], orig, dir, invDir, dist);
+		uint32_t nearId = node.LeftFirst, farId = node.LeftFirst + 1;
+		if (tRight < tLeft) {
+			std::swap(tLeft, tRight);
+			std::swap(nearId, farId);
+		}
+		if (tRight != FLT_MAX)
+			stack[stackSize++] = { farId, tRight };
+		if (tLeft != FLT_MAX)
+			stack[stackSize++] = { nearId, tLeft };
+	}
+	return tri != UINT32_MAX;
+}
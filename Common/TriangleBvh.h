@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+///<summary>
+/// Bounding volume hierarchy over the triangles of one mesh, for picking.
+/// Built once from the CPU copies of the vertex and index buffers: nodes are
+/// split where the surface area heuristic is cheapest over 12 centroid bins.
+/// Leaves hold at most 8 triangles, stored as packets of 8 in structure of
+/// arrays form (v0 and the two edges) so Intersect tests a whole leaf at once.
+///
+/// The triangle test is the same Moller-Trumbore as glm::intersectRayTriangle
+/// with the operations in the same order, so hits and distances match
+/// Ray::IntersectMesh exactly.  Only hits in front of the origin count and
+/// equal distances go to the lower triangle index.
+///
+/// With __AVX__ (/arch:AVX) the 8 triangles of a packet are tested with one
+/// set of AVX instructions, otherwise one at a time.
+///</summary>
+
+struct TriangleBvhNode {
+	glm::vec3 Min{ 0.0f };
+	uint32_t LeftFirst{ 0 };	//inner: left child, right is LeftFirst + 1; leaf: first packet
+	glm::vec3 Max{ 0.0f };
+	uint32_t Count{ 0 };		//triangles in a leaf, 0 for inner nodes
+
+	bool IsLeaf()const { return Count != 0; }
+};
+
+struct TrianglePacket {
+	float V0x[8], V0y[8], V0z[8];
+	float E1x[8], E1y[8], E1z[8];
+	float E2x[8], E2y[8], E2z[8];
+	uint32_t Triangle[8];//index of the triangle in the index buffer, UINT32_MAX for padding
+};
+
+class TriangleBvh {
+	std::vector<TriangleBvhNode> mNodes;
+	std::vector<TrianglePacket> mPackets;
+	uint32_t mTriangleCount{ 0 };
+
+	struct BuildTriangle {
+		glm::vec3 Min;
+		glm::vec3 Max;
+		glm::vec3 Centroid;
+		uint32_t Triangle;
+	};
+	void Subdivide(uint32_t nodeId, uint32_t depth, std::vector<BuildTriangle>& tris, uint32_t first, uint32_t count, const glm::vec3* v0, const glm::vec3* v1, const glm::vec3* v2);
+	void MakeLeaf(uint32_t nodeId, std::vector<BuildTriangle>& tris, uint32_t first, uint32_t count, const glm::vec3* v0, const glm::vec3* v1, const glm::vec3* v2);
+	void IntersectPacket(const TrianglePacket& packet, const glm::vec3& orig, const glm::vec3& dir, uint32_t& tri, float& dist)const;
+public:
+	TriangleBvh() = default;
+
+	// Position is the first member of the vertex, as Ray::IntersectMesh assumes.
+	void Build(const void* vertices, uint32_t vertexStride, const uint32_t* indices, size_t indexCount);
+
+	uint32_t TriangleCount()const { return mTriangleCount; }
+	uint32_t NodeCount()const { return (uint32_t)mNodes.size(); }
+	const TriangleBvhNode& GetNode(uint32_t nodeId)const { return mNodes[nodeId]; }
+
+	// Nearest hit, tri is the triangle index (first index / 3) like Ray::IntersectMesh.
+	bool Intersect(const glm::vec3& orig, const glm::vec3& dir, uint32_t& tri, float& dist)const;
+};
@@ -1,4 +1,10 @@
 #include "VulkApp.h"
+#include "ShaderCache.h"
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cwchar>
 
 LRESULT CALLBACK
 MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -64,8 +70,18 @@ int VulkApp::Run()
 			if (!mAppPaused)
 			{
 				CalculateFrameStats();
-				Update(mTimer);
-				Draw(mTimer);
+				{
+					CPU_ZONE("frame");
+					{
+						CPU_ZONE("update");
+						Update(mTimer);
+					}
+					{
+						CPU_ZONE("draw");
+						Draw(mTimer);
+					}
+				}
+				endCpuFrame();
 			}
 			else
 			{
@@ -79,6 +95,12 @@ int VulkApp::Run()
 
 bool VulkApp::Initialize()
 {
+	// -frames N overrides the demo's mFramesInFlight.
+	for (int i = 1; i + 1 < __argc; ++i) {
+		if (strcmp(__argv[i], "-frames") == 0)
+			mFramesInFlight = (uint32_t)atoi(__argv[i + 1]);
+	}
+
 	if (!InitMainWindow())
 		return false;
 
@@ -228,6 +250,11 @@ LRESULT VulkApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		{
 			PostQuitMessage(0);
 		}
+		else if ((int)wParam == VK_F9) {
+			if (mGpuProfiler)
+				mGpuProfiler->Capture(mGpuTraceFrames);
+			CpuProfiler::Get().Capture(mCpuTraceFrames);
+		}
 		else if ((int)wParam == VK_F2)
 			//Set4xMsaaState(!m4xMsaaState);
 
@@ -282,6 +309,8 @@ bool VulkApp::InitMainWindow()
 bool VulkApp::InitVulkan() {
 	std::vector<const char*> requiredExtensions{ "VK_KHR_surface",VK_KHR_WIN32_SURFACE_EXTENSION_NAME };
 	std::vector<const char*> requiredLayers{ "VK_LAYER_KHRONOS_validation" };
+	if (mDescriptorIndexing)
+		requiredExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);//instance is 1.0, features2 comes from here
 	mInstance = Vulkan::initInstance(requiredExtensions, requiredLayers);
 	mSurface = Vulkan::initSurface(mInstance, mhAppInst, mhMainWnd);
 	mPhysicalDevice = choosePhysicalDevice(mInstance, mSurface, mQueues);
@@ -305,6 +334,16 @@ bool VulkApp::InitVulkan() {
 		enabledFeatures.samplerAnisotropy = VK_TRUE;
 	if (mDeviceFeatures.sampleRateShading)
 		enabledFeatures.sampleRateShading = VK_TRUE;
+	if (mDeviceFeatures.drawIndirectFirstInstance)
+		enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+	if (mDeviceFeatures.multiDrawIndirect)
+		enabledFeatures.multiDrawIndirect = VK_TRUE;
+	//the profiler times without them, these add its vertex and fragment counts
+	if (mGpuProfile && mDeviceFeatures.pipelineStatisticsQuery) {
+		enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+		if (mDeviceFeatures.inheritedQueries)
+			enabledFeatures.inheritedQueries = VK_TRUE;
+	}
 
 	if (mGeometryShader && mDeviceFeatures.geometryShader)
 		enabledFeatures.geometryShader = VK_TRUE;
@@ -312,8 +351,42 @@ bool VulkApp::InitVulkan() {
 		enabledFeatures.fillModeNonSolid = VK_TRUE;
 	}
 
+	//bindless heaps: partially bound, update after bind, non uniformly indexed sampled image arrays
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT enabledIndexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+	void* pNext = nullptr;
+	if (mDescriptorIndexing) {
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &extensionCount, extensions.data());
+		auto hasExtension = [&](const char* name) {
+			return std::find_if(extensions.begin(), extensions.end(), [&](const VkExtensionProperties& e) {return strcmp(e.extensionName, name) == 0; }) != extensions.end();
+		};
+		auto pvkGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(mInstance, "vkGetPhysicalDeviceFeatures2KHR");
+		if (pvkGetPhysicalDeviceFeatures2 && hasExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) && hasExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+			VkPhysicalDeviceFeatures2KHR features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR };
+			features2.pNext = &indexingFeatures;
+			pvkGetPhysicalDeviceFeatures2(mPhysicalDevice, &features2);
+		}
+		mDescriptorIndexingSupported = indexingFeatures.shaderSampledImageArrayNonUniformIndexing && indexingFeatures.runtimeDescriptorArray &&
+			indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+			indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+		if (mDescriptorIndexingSupported) {
+			deviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+			deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+			enabledIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			enabledIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+			enabledIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+			enabledIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			enabledIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			pNext = &enabledIndexingFeatures;
+		}
+	}
+
 	uint32_t queueCount = 2;
-	mDevice = initDevice(mPhysicalDevice, deviceExtensions, mQueues, enabledFeatures,queueCount);
+	mDevice = initDevice(mPhysicalDevice, deviceExtensions, mQueues, enabledFeatures,queueCount,pNext);
+	mPipelineCache = Vulkan::initPipelineCache(mDevice, mDeviceProperties, mPipelineCachePath.c_str(), &mPipelineCacheLoaded);
 
 	mGraphicsQueue = Vulkan::getDeviceQueue(mDevice, mQueues.graphicsQueueFamily);
 	mPresentQueue = Vulkan::getDeviceQueue(mDevice, mQueues.presentQueueFamily);
@@ -325,23 +398,39 @@ bool VulkApp::InitVulkan() {
 	mPresentMode = Vulkan::chooseSwapchainPresentMode(mPresentModes);
 	mSwapchainFormat = Vulkan::chooseSwapchainFormat(mSurfaceFormats);
 	vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, mSwapchainFormat.format, &mFormatProperties);
-	uint32_t swapChainImageCount = Vulkan::getSwapchainImageCount(mSurfaceCaps);
 	//mPresentComplete = Vulkan::initSemaphore(mDevice);
 	//mRenderComplete = Vulkan::initSemaphore(mDevice);
-	mMaxFrames = swapChainImageCount;
-	for (uint32_t i = 0; i < swapChainImageCount; i++) {
+	//frame slots, the render complete semaphores follow the swapchain images in CreateSwapchain
+	mMaxFrames = (std::min)((std::max)(mFramesInFlight, 2u), 4u);
+	for (uint32_t i = 0; i < mMaxFrames; i++) {
 		VkSemaphore presentComplete = Vulkan::initSemaphore(mDevice);
 		mPresentCompletes.push_back(presentComplete);
-		VkSemaphore renderComplete = Vulkan::initSemaphore(mDevice);
-		mRenderCompletes.push_back(renderComplete);
 		VkFence fence = Vulkan::initFence(mDevice, VK_FENCE_CREATE_SIGNALED_BIT);
 		mFences.push_back(fence);
 	}
 	mCommandPool = Vulkan::initCommandPool(mDevice, mQueues.graphicsQueueFamily);
 	mCommandBuffer = Vulkan::initCommandBuffer(mDevice, mCommandPool);
 
-	Vulkan::initCommandPools(mDevice, swapChainImageCount, mQueues.graphicsQueueFamily, mCommandPools);
+	Vulkan::initCommandPools(mDevice, mMaxFrames, mQueues.graphicsQueueFamily, mCommandPools);
+	if (mGpuProfile) {
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(mPhysicalDevice, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(mPhysicalDevice, &familyCount, families.data());
+		mGpuProfiler = std::make_unique<GpuProfiler>(mDevice, mDeviceProperties, enabledFeatures, families[mQueues.graphicsQueueFamily].timestampValidBits, mMaxFrames);
+		if (mGpuTraceOnStart)
+			mGpuProfiler->Capture(mGpuTraceFrames);
+	}
+	if (mCpuProfile) {
+		CpuProfiler::Get().SetEnabled(true);
+		if (mCpuTraceOnStart)
+			CpuProfiler::Get().Capture(mCpuTraceFrames);
+	}
 	Vulkan::initCommandBuffers(mDevice, mCommandPools, mCommandBuffers);
+	mRecordPool = std::make_unique<ThreadPool>(mRecordThreads);
+	Vulkan::initCommandPools(mDevice, mMaxFrames * mRecordPool->ThreadCount(), mQueues.graphicsQueueFamily, mSecondaryPools);
+	mSecondaryBuffers.resize(mSecondaryPools.size());
+	mSecondaryUsed.resize(mSecondaryPools.size(), 0);
 	VkDevice device = mDevice;
 	pvkAcquireNextImage = (PFN_vkAcquireNextImageKHR)vkGetDeviceProcAddr(device, "vkAcquireNextImageKHR");
 	assert(pvkAcquireNextImage);
@@ -361,6 +450,8 @@ bool VulkApp::InitVulkan() {
 	assert(pvkCmdBindIndexBuffer);
 	pvkCmdDrawIndexed = (PFN_vkCmdDrawIndexed)vkGetDeviceProcAddr(device, "vkCmdDrawIndexed");
 	assert(pvkCmdDrawIndexed);
+	pvkCmdDrawIndexedIndirect = (PFN_vkCmdDrawIndexedIndirect)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirect");
+	assert(pvkCmdDrawIndexedIndirect);
 	pvkCmdEndRenderPass = (PFN_vkCmdEndRenderPass)vkGetDeviceProcAddr(device, "vkCmdEndRenderPass");
 	assert(pvkCmdEndRenderPass);
 	pvkEndCommandBuffer = (PFN_vkEndCommandBuffer)vkGetDeviceProcAddr(device, "vkEndCommandBuffer");
@@ -393,10 +484,16 @@ bool VulkApp::InitVulkan() {
 
 void VulkApp::cleanupVulkan() {
 	vkDeviceWaitIdle(mDevice);
+	Vulkan::savePipelineCache(mDevice, mPipelineCache, mDeviceProperties, mPipelineCachePath.c_str());
+	Vulkan::cleanupPipelineCache(mDevice, mPipelineCache);
 	DestroySwapchain();
 	Vulkan::cleanupSwapchain(mDevice, mSwapchain);
 	Vulkan::cleanupCommandBuffers(mDevice, mCommandPools, mCommandBuffers);
 	Vulkan::cleanupCommandPools(mDevice, mCommandPools);
+	Vulkan::cleanupCommandPools(mDevice, mSecondaryPools);//frees their buffers too
+	mSecondaryBuffers.clear();
+	mRecordPool.reset();
+	mGpuProfiler.reset();
 	Vulkan::cleanupCommandBuffer(mDevice, mCommandPool, mCommandBuffer);
 	Vulkan::cleanupCommandPool(mDevice, mCommandPool);
 
@@ -404,9 +501,11 @@ void VulkApp::cleanupVulkan() {
 	//Vulkan::cleanupSemaphore(mDevice, mPresentComplete);
 	for (uint32_t i = 0;i < mMaxFrames; i++) {
 		Vulkan::cleanupSemaphore(mDevice, mPresentCompletes[i]);
-		Vulkan::cleanupSemaphore(mDevice, mRenderCompletes[i]);
 		Vulkan::cleanupFence(mDevice, mFences[i]);
 	}
+	for (auto renderComplete : mRenderCompletes)
+		Vulkan::cleanupSemaphore(mDevice, renderComplete);
+	ShaderCache::Get().Clear(mDevice);
 	Vulkan::cleanupDevice(mDevice);
 	Vulkan::cleanupSurface(mInstance, mSurface);
 	Vulkan::cleanupInstance(mInstance);
@@ -420,6 +519,9 @@ void VulkApp::CreateSwapchain() {
 		Vulkan::cleanupSwapchain(mDevice, oldSwapchain);
 	}
 	Vulkan::getSwapchainImages(mDevice, mSwapchain, mSwapchainImages);
+	//one per image: by the time an image is acquired again the present that waited on it is done
+	while (mRenderCompletes.size() < mSwapchainImages.size())
+		mRenderCompletes.push_back(Vulkan::initSemaphore(mDevice));
 	Vulkan::initSwapchainImageViews(mDevice, mSwapchainImages, mSwapchainFormat.format, mSwapchainImageViews);
 	VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT;
 	Vulkan::ImageProperties props;
@@ -454,6 +556,7 @@ void VulkApp::CreateSwapchain() {
 	rpProps.sampleCount = mMSAA ? numSamples : VK_SAMPLE_COUNT_1_BIT;
 	rpProps.depthFormat = mDepthBuffer ? mDepthFormat : VK_FORMAT_UNDEFINED;
 	rpProps.resolveFormat = mMSAA ? rpProps.colorFormat : VK_FORMAT_UNDEFINED;
+	rpProps.depthStoreOp = mDepthStoreOp;
 	mRenderPass = Vulkan::initRenderPass(mDevice, rpProps);
 	Vulkan::FramebufferProperties fbProps;
 	fbProps.colorAttachments = mSwapchainImageViews;
@@ -483,21 +586,42 @@ VkCommandBuffer VulkApp::BeginRender(bool startRenderPass) {
 	
 	
 	mSubmitInfo.pWaitSemaphores = &mPresentCompletes[mCurrFrame];
-	mSubmitInfo.pSignalSemaphores = &mRenderCompletes[mCurrFrame];
 	
 	mRenderPassBeginInfo.clearValueCount = sizeof(mClearValues) / sizeof(mClearValues[0]);
 	mRenderPassBeginInfo.pClearValues = mClearValues;
 	mPresentInfo.swapchainCount = 1;
 	mPresentInfo.pImageIndices = &mIndex;
-	mPresentInfo.pWaitSemaphores = &mRenderCompletes[mCurrFrame];
-	VkResult res = pvkAcquireNextImage(mDevice, mSwapchain, UINT64_MAX, mPresentCompletes[mCurrFrame], nullptr, &mIndex);
+	auto acquireStart = std::chrono::high_resolution_clock::now();
+	VkResult res;
+	{
+		CPU_ZONE("acquire");
+		res = pvkAcquireNextImage(mDevice, mSwapchain, UINT64_MAX, mPresentCompletes[mCurrFrame], nullptr, &mIndex);
+	}
 	assert(res == VK_SUCCESS);
-
-
-	VkCommandBuffer cmd = mCommandBuffers[mIndex];
+	mAcquireWaitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - acquireStart).count();
+	mSubmitInfo.pSignalSemaphores = &mRenderCompletes[mIndex];
+	mPresentInfo.pWaitSemaphores = &mRenderCompletes[mIndex];
+
+	//the slot's fence was waited on in Update, so everything recorded from its pool is done
+	VkCommandBuffer cmd = mCommandBuffers[mCurrFrame];
+	vkResetCommandPool(mDevice, mCommandPools[mCurrFrame], 0);
+	uint32_t recordThreads = mRecordPool->ThreadCount();
+	for (uint32_t thread = 0; thread < recordThreads; ++thread) {
+		uint32_t pool = mCurrFrame * recordThreads + thread;
+		if (mSecondaryUsed[pool] > 0)
+			vkResetCommandPool(mDevice, mSecondaryPools[pool], 0);
+		mSecondaryUsed[pool] = 0;
+	}
 
 
 	pvkBeginCommandBuffer(cmd, &mBeginInfo);
+	if (mGpuProfiler) {
+		//reads back what this slot recorded mMaxFrames ago
+		bool capturing = mGpuProfiler->Capturing();
+		mGpuProfiler->BeginFrame(cmd, mCurrFrame, startRenderPass);
+		if (capturing && !mGpuProfiler->Capturing())
+			mGpuProfiler->WriteTrace(mGpuTracePath.c_str());
+	}
 
 
 	mRenderPassBeginInfo.framebuffer = mFramebuffers[mIndex];
@@ -509,12 +633,14 @@ VkCommandBuffer VulkApp::BeginRender(bool startRenderPass) {
 
 void VulkApp::EndRender(VkCommandBuffer cmd) {
 	pvkCmdEndRenderPass(cmd);
+	if (mGpuProfiler)
+		mGpuProfiler->EndFrame(cmd);//the last pass's scope and the frame's
 
 
 	VkResult res = pvkEndCommandBuffer(cmd);
 	assert(res == VK_SUCCESS);
-	VkFence fence = mFences[mCurrFrame];
 	mSubmitInfo.pCommandBuffers = &cmd;
+	CPU_ZONE("submit and present");
 	res = pvkQueueSubmit(mGraphicsQueue, 1, &mSubmitInfo, mCurrFence);
 	assert(res == VK_SUCCESS);
 
@@ -524,13 +650,96 @@ void VulkApp::EndRender(VkCommandBuffer cmd) {
 	mFrameCount++;
 }
 
+void VulkApp::RecordPasses(VkCommandBuffer cmd, const std::vector<RecordedPass>& passes, const std::function<void(uint32_t, uint32_t, VkCommandBuffer)>& record) {
+	uint32_t passCount = (uint32_t)passes.size();
+	mSecondaryFirstTasks.resize(passCount);
+	mSecondaryTaskPasses.clear();
+	for (uint32_t pass = 0; pass < passCount; ++pass) {
+		mSecondaryFirstTasks[pass] = (uint32_t)mSecondaryTaskPasses.size();
+		mSecondaryTaskPasses.insert(mSecondaryTaskPasses.end(), passes[pass].TaskCount, pass);
+	}
+	uint32_t taskCount = (uint32_t)mSecondaryTaskPasses.size();
+	mSecondaryTasks.resize(taskCount);
+
+	uint32_t recordThreads = mRecordPool->ThreadCount();
+	//a named pass is a profiler scope, its secondaries run inside the scope's statistics query
+	VkQueryPipelineStatisticFlags profiledStatistics = mGpuProfiler ? mGpuProfiler->StatisticsFlags() : 0;
+	mRecordPool->Run(taskCount, [&](uint32_t task, uint32_t thread) {
+		CPU_ZONE("record pass");
+		uint32_t pass = mSecondaryTaskPasses[task];
+		const VkRenderPassBeginInfo& beginInfo = passes[pass].BeginInfo;
+		//only this thread touches its pool this frame
+		uint32_t pool = mCurrFrame * recordThreads + thread;
+		auto& buffers = mSecondaryBuffers[pool];
+		if (mSecondaryUsed[pool] == buffers.size())
+			buffers.push_back(Vulkan::initCommandBuffer(mDevice, mSecondaryPools[pool], VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+		VkCommandBuffer secondary = buffers[mSecondaryUsed[pool]++];
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		inheritanceInfo.renderPass = beginInfo.renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = beginInfo.framebuffer;
+		if (passes[pass].Name != nullptr)
+			inheritanceInfo.pipelineStatistics = profiledStatistics;
+		VkCommandBufferBeginInfo secondaryBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+		VkResult res = pvkBeginCommandBuffer(secondary, &secondaryBeginInfo);
+		assert(res == VK_SUCCESS);
+		const VkRect2D& area = beginInfo.renderArea;
+		VkViewport viewport = { (float)area.offset.x,(float)area.offset.y,(float)area.extent.width,(float)area.extent.height,0.0f,1.0f };
+		pvkCmdSetViewport(secondary, 0, 1, &viewport);
+		pvkCmdSetScissor(secondary, 0, 1, &area);
+		record(pass, task - mSecondaryFirstTasks[pass], secondary);
+		res = pvkEndCommandBuffer(secondary);
+		assert(res == VK_SUCCESS);
+		mSecondaryTasks[task] = secondary;
+	});
+
+	for (uint32_t pass = 0; pass < passCount; ++pass) {
+		const RecordedPass& recordedPass = passes[pass];
+		bool profiled = mGpuProfiler && recordedPass.Name != nullptr;
+		if (profiled)
+			mGpuProfiler->BeginScope(cmd, recordedPass.Name, profiledStatistics != 0);
+		if (recordedPass.Before)
+			recordedPass.Before(cmd);
+		pvkCmdBeginRenderPass(cmd, &recordedPass.BeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		if (recordedPass.TaskCount > 0)
+			vkCmdExecuteCommands(cmd, recordedPass.TaskCount, &mSecondaryTasks[mSecondaryFirstTasks[pass]]);
+		if (pass + 1 == passCount) {
+			assert(!recordedPass.After);//EndRender ends the last pass
+			break;
+		}
+		pvkCmdEndRenderPass(cmd);
+		if (recordedPass.After)
+			recordedPass.After(cmd);
+		if (profiled)
+			mGpuProfiler->EndScope(cmd);
+	}
+}
+
 void VulkApp::Update(const GameTimer& gt) {
 	mCurrFrame = (mCurrFrame + 1) % mMaxFrames;
 	mCurrFence = mFences[mCurrFrame];
-	vkWaitForFences(mDevice, 1, &mCurrFence, VK_TRUE, UINT64_MAX);
+	auto waitStart = std::chrono::high_resolution_clock::now();
+	{
+		CPU_ZONE("wait fence");
+		vkWaitForFences(mDevice, 1, &mCurrFence, VK_TRUE, UINT64_MAX);
+	}
+	mFenceWaitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
 	vkResetFences(mDevice, 1, &mCurrFence);
 }
 
+void VulkApp::endCpuFrame() {
+	CpuProfiler& profiler = CpuProfiler::Get();
+	if (!profiler.Enabled())
+		return;
+	bool capturing = profiler.Capturing();
+	profiler.EndFrame();
+	if (capturing && !profiler.Capturing())
+		profiler.WriteTrace(mCpuTracePath.c_str());
+}
+
 void VulkApp::CalculateFrameStats()
 {
 	// Code computes the average frames per second, and also the 
@@ -551,9 +760,37 @@ void VulkApp::CalculateFrameStats()
 		std::wstring fpsStr = std::to_wstring(fps);
 		std::wstring mspfStr = std::to_wstring(mspf);
 
+		//per frame averages, near zero fence wait with mspf above the gpu's time means the cpu is the limit
+		std::wstring fenceStr = std::to_wstring(mFenceWaitMs / frameCnt);
+		std::wstring acquireStr = std::to_wstring(mAcquireWaitMs / frameCnt);
+		mFenceWaitMs = 0.0;
+		mAcquireWaitMs = 0.0;
+
 		std::wstring windowText = mMainWndCaption +
 			L"    fps: " + fpsStr +
-			L"   mspf: " + mspfStr;
+			L"   mspf: " + mspfStr +
+			L"   wait fence: " + fenceStr +
+			L" acquire: " + acquireStr +
+			L" (" + std::to_wstring(mMaxFrames) + L" in flight)";
+		if (mGpuProfiler) {
+			//gpu ms per scope, the frame's first
+			windowText += L"   gpu:";
+			wchar_t scopeText[64];
+			for (auto& scope : mGpuProfiler->TakeAverages()) {
+				swprintf(scopeText, sizeof(scopeText) / sizeof(scopeText[0]), L" %hs %.2f", scope.Name.c_str(), scope.Ms);
+				windowText += scopeText;
+			}
+		}
+		if (CpuProfiler::Get().Enabled()) {
+			//the frame zone's, the others are in the trace
+			for (auto& zone : CpuProfiler::Get().TakePercentiles()) {
+				if (zone.Name != "frame")
+					continue;
+				wchar_t zoneText[96];
+				swprintf(zoneText, sizeof(zoneText) / sizeof(zoneText[0]), L"   cpu p50 %.2f p95 %.2f p99 %.2f", zone.P50Ms, zone.P95Ms, zone.P99Ms);
+				windowText += zoneText;
+			}
+		}
 
 		SetWindowText(mhMainWnd, windowText.c_str());
 
@@ -13,8 +13,13 @@
 #define NOMINMAX //we want std::max, not windows version
 #include <windows.h>
 #include <windowsx.h>
+#include <memory>
+#include <functional>
 #include "Vulkan.h"
 #include "GameTimer.h"
+#include "ThreadPool.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
 
 
 
@@ -43,6 +48,8 @@ protected:
     void cleanupVulkan();
 
     void CalculateFrameStats();
+    // Ends the cpu profiler's frame after Draw, writing the trace when a capture finishes.
+    void endCpuFrame();
 
     static VulkApp* mApp;
 
@@ -57,6 +64,8 @@ protected:
     bool        mDepthBuffer{ true };
     bool        mMSAA{ true };
     bool    mAllowWireframe{ false };
+    bool    mDescriptorIndexing{ false };//set before Initialize to ask for VK_EXT_descriptor_indexing
+    bool    mDescriptorIndexingSupported{ false };//what InitVulkan got, bindless needs it
 
 
     // Used to keep track of the delta-time and game time (4.4).
@@ -93,18 +102,23 @@ protected:
     VkSwapchainKHR                      mSwapchain{ VK_NULL_HANDLE };
     std::vector<VkImage>                mSwapchainImages;
     std::vector<VkImageView>            mSwapchainImageViews;
-    std::vector<VkSemaphore>            mPresentCompletes;
+    // Frame slots: mMaxFrames of everything below, indexed by mCurrFrame and
+    // independent of the swapchain image count. A slot's fence is waited on in
+    // Update before its pool, command buffer and any per frame data the app
+    // keys on mCurrFrame are reused.
+    std::vector<VkSemaphore>            mPresentCompletes;//acquire signals, per slot
     //VkSemaphore                         mPresentComplete{ VK_NULL_HANDLE };
-    std::vector<VkSemaphore>            mRenderCompletes;
+    std::vector<VkSemaphore>            mRenderCompletes;//present waits, per swapchain image
     std::vector<VkFence>                mFences;
     VkFence                             mCurrFence{ VK_NULL_HANDLE };
     //VkSemaphore                         mRenderComplete{ VK_NULL_HANDLE };
     VkCommandPool                       mCommandPool{ VK_NULL_HANDLE };
     VkCommandBuffer                     mCommandBuffer{ VK_NULL_HANDLE };
-    std::vector<VkCommandPool>          mCommandPools;
+    std::vector<VkCommandPool>          mCommandPools;//per slot, reset whole in BeginRender
     std::vector<VkCommandBuffer>        mCommandBuffers;
     VkFormat                            mDepthFormat = VK_FORMAT_D32_SFLOAT;
     VkImageUsageFlags                   mDepthImageUsage = 0;
+    VkAttachmentStoreOp                 mDepthStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;//STORE to read the depth after the main pass
     VkRenderPass                        mRenderPass{ VK_NULL_HANDLE };
     Vulkan::Image                               mDepthImage;
     Vulkan::Image                               mMsaaImage;
@@ -118,6 +132,7 @@ protected:
     PFN_vkCmdBindVertexBuffers pvkCmdBindVertexBuffers{ nullptr };
     PFN_vkCmdBindIndexBuffer pvkCmdBindIndexBuffer{ nullptr };
     PFN_vkCmdDrawIndexed pvkCmdDrawIndexed{ nullptr };
+    PFN_vkCmdDrawIndexedIndirect pvkCmdDrawIndexedIndirect{ nullptr };
     PFN_vkCmdEndRenderPass pvkCmdEndRenderPass{ nullptr };
     PFN_vkEndCommandBuffer pvkEndCommandBuffer{ nullptr };
     PFN_vkQueueWaitIdle pvkQueueWaitIdle{ nullptr };
@@ -137,8 +152,65 @@ protected:
     uint32_t                            mFrameCount = 0;
     uint32_t                            mCurrFrame{ (uint32_t)(-1) };
     uint32_t                            mMaxFrames{ 0 };
+    uint32_t                            mFramesInFlight{ 3 };//set before Initialize or with -frames N, clamped to 2-4, becomes mMaxFrames; the demos size their frame resources from it
+    // Time the cpu spends blocked each frame, summed until CalculateFrameStats shows
+    // the averages: waiting for the slot's fence means the gpu is behind, waiting in
+    // acquire means presentation is.
+    double                              mFenceWaitMs{ 0.0 };
+    double                              mAcquireWaitMs{ 0.0 };
+    // Shared by every pipeline the app builds (setPipelineCache), loaded in InitVulkan
+    // and written back in cleanupVulkan. mPipelineCacheLoaded says the start was warm.
+    VkPipelineCache                     mPipelineCache{ VK_NULL_HANDLE };
+    bool                                mPipelineCacheLoaded{ false };
+    std::string                         mPipelineCachePath{ "pipeline.cache" };
+    // Gpu timing, set mGpuProfile before Initialize. BeginRender to EndRender is the
+    // frame scope, with pipeline statistics when BeginRender starts the main pass,
+    // every RecordedPass with a Name is a scope of its own. CalculateFrameStats shows
+    // the scopes' averages; F9 captures the next mGpuTraceFrames frames and writes
+    // them to mGpuTracePath as a Chrome trace, mGpuTraceOnStart does it from the start.
+    bool                                mGpuProfile{ false };
+    std::unique_ptr<GpuProfiler>        mGpuProfiler;
+    std::string                         mGpuTracePath{ "gpu_trace.json" };
+    uint32_t                            mGpuTraceFrames{ 120 };
+    bool                                mGpuTraceOnStart{ false };
+    // Cpu zones (CPU_ZONE), set mCpuProfile before Initialize. Run times each frame and
+    // its update and draw, the demos time their constant uploads, animation and culling.
+    // CalculateFrameStats shows the frame's p50/p95/p99 over the last second; F9 also
+    // writes mCpuTraceFrames frames to mCpuTracePath, with every zone's percentiles.
+    bool                                mCpuProfile{ false };
+    std::string                         mCpuTracePath{ "cpu_trace.json" };
+    uint32_t                            mCpuTraceFrames{ 120 };
+    bool                                mCpuTraceOnStart{ false };
+    // Parallel recording through RecordPasses. mRecordThreads is set before Initialize,
+    // 0 for every hardware thread, 1 (the default) records on the calling thread only.
+    // Every record thread allocates secondary buffers from its own pool of the current
+    // slot, mSecondaryPools[slot * thread count + thread], reset in BeginRender along
+    // with the slot's primary pool.
+    uint32_t                            mRecordThreads{ 1 };
+    std::unique_ptr<ThreadPool>         mRecordPool;
+    std::vector<VkCommandPool>          mSecondaryPools;
+    std::vector<std::vector<VkCommandBuffer>> mSecondaryBuffers;//per pool, allocated as needed and kept
+    std::vector<uint32_t>               mSecondaryUsed;//per pool, this frame
+    std::vector<VkCommandBuffer>        mSecondaryTasks;//per task of the last RecordPasses
+    std::vector<uint32_t>               mSecondaryFirstTasks;//per pass of the last RecordPasses
+    std::vector<uint32_t>               mSecondaryTaskPasses;//per task of the last RecordPasses
+    struct RecordedPass {
+        VkRenderPassBeginInfo BeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+        uint32_t TaskCount{ 1 };
+        const char* Name{ nullptr };//gpu profiler scope, a string literal
+        std::function<void(VkCommandBuffer)> Before;//recorded on the primary before the pass begins, barriers and copies
+        std::function<void(VkCommandBuffer)> After;//and after it ends
+    };
     VkCommandBuffer BeginRender(bool startRenderPass=true);
     void            EndRender(VkCommandBuffer cmd);
+    // Records every task of every pass into its own secondary command buffer, spread
+    // over the record threads, then begins the passes on cmd in order and executes
+    // their buffers in task order. record(pass, task, secondary) may run on any record
+    // thread, so it must only read shared state; the secondary already has the pass's
+    // render area as viewport and scissor, nothing else is inherited. The last pass is
+    // left open for EndRender, so it is normally mRenderPassBeginInfo after
+    // BeginRender(false).
+    void            RecordPasses(VkCommandBuffer cmd, const std::vector<RecordedPass>& passes, const std::function<void(uint32_t, uint32_t, VkCommandBuffer)>& record);
 public:
     static VulkApp* GetApp();
 
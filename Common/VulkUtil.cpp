@@ -27,6 +27,15 @@ bool AABB::InsideFrustum(glm::mat4& MVP) {//
 	return inside;
 }
 
+AABB AABB::Transform(const glm::mat4& world)const {
+	glm::vec3 center = glm::vec3(world * glm::vec4(0.5f * (min + max), 1.0f));
+	glm::vec3 extents = 0.5f * (max - min);
+	glm::vec3 worldExtents = glm::abs(glm::vec3(world[0])) * extents.x + glm::abs(glm::vec3(world[1])) * extents.y + glm::abs(glm::vec3(world[2])) * extents.z;
+	glm::vec3 worldMin = center - worldExtents;
+	glm::vec3 worldMax = center + worldExtents;
+	return AABB(worldMin, worldMax);
+}
+
 bool AABB::Intersects(glm::vec3 Origin, glm::vec3 Direction, float& dist)const {
 
 	dist = -1.0f;
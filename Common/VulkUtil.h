@@ -2,10 +2,13 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/intersect.hpp>
 #include "Vulkan.h"
+#include "TriangleBvh.h"
+class GeometryArena;
 struct AABB {
 	glm::vec3 min = {};
 	glm::vec3 max = {};
@@ -17,6 +20,9 @@ struct AABB {
 
 	}
 
+	//box enclosing this one after transforming it by world
+	AABB Transform(const glm::mat4& world)const;
+
 	bool within(float l, float a, float r) {
 		return l < a&& a < r;
 	}
@@ -122,7 +128,8 @@ public:
 			
 			glm::vec2 bary;
 			float currDist = 0.0f;
-			if (glm::intersectRayTriangle(orig, dir, v0, v1, v2, bary, currDist)) {
+			//glm reports the line's hits, keep the ones in front of the origin
+			if (glm::intersectRayTriangle(orig, dir, v0, v1, v2, bary, currDist) && currDist >= 0.0f) {
 				hit = true;
 				if (currDist < dist) {
 					hitTri = currTri;
@@ -134,6 +141,10 @@ public:
 		tri = hitTri;
 		return hit;
 	}
+	// Same result as above through the mesh's triangle BVH.
+	bool IntersectMesh(const TriangleBvh& bvh, uint32_t& tri, float& dist)const {
+		return bvh.Intersect(orig, dir, tri, dist);
+	}
 };
 
 struct Sphere {
@@ -159,6 +170,14 @@ struct MeshGeometry {
 	uint32_t VertexBufferByteSize{ 0 };
 	uint32_t IndexBufferByteSize{ 0 };
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
+	// Optional, built from the CPU copies for picking (see TriangleBvh).
+	std::shared_ptr<TriangleBvh> Bvh;
+	// Set when the mesh lives in a GeometryArena: the buffers are the arena's, not
+	// the mesh's to clean up, and its vertices and indices start here in them.
+	// DrawArgs stay relative to the mesh, add these when drawing.
+	GeometryArena* Arena{ nullptr };
+	uint32_t BaseVertexLocation{ 0 };
+	uint32_t StartIndexLocation{ 0 };
 
 	~MeshGeometry() {
 		/*if (vertexBufferCPU != nullptr) {
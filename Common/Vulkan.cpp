@@ -7,6 +7,8 @@
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include "ShaderCache.h"
 
 
 
@@ -110,7 +112,7 @@ namespace Vulkan {
 		return physicalDevice;
 	}
 
-	VkDevice initDevice(VkPhysicalDevice physicalDevice, std::vector<const char*> deviceExtensions, Queues queues, VkPhysicalDeviceFeatures enabledFeatures,uint32_t queueCount) {
+	VkDevice initDevice(VkPhysicalDevice physicalDevice, std::vector<const char*> deviceExtensions, Queues queues, VkPhysicalDeviceFeatures enabledFeatures,uint32_t queueCount,const void* pNext) {
 		VkDevice device{ VK_NULL_HANDLE };
 		std::vector<float> queuePriorities(queueCount,1.0f);
 		std::vector<VkDeviceQueueCreateInfo> queueCIs;
@@ -124,6 +126,7 @@ namespace Vulkan {
 		}
 
 		VkDeviceCreateInfo deviceCI{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+		deviceCI.pNext = pNext;//extension feature structs
 		deviceCI.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
 		deviceCI.ppEnabledExtensionNames = deviceExtensions.data();
 		deviceCI.pEnabledFeatures = &enabledFeatures;
@@ -151,6 +154,12 @@ namespace Vulkan {
 		vkDestroyDevice(device, nullptr);
 	}
 
+#ifdef __USE__VMA__
+	VmaAllocator getAllocator() {
+		return allocator;
+	}
+#endif
+
 
 	VkQueue getDeviceQueue(VkDevice device, uint32_t queueFamily,uint32_t queueIndex) {
 		VkQueue queue{ VK_NULL_HANDLE };
@@ -246,11 +255,11 @@ namespace Vulkan {
 		}
 	}
 
-	VkCommandBuffer initCommandBuffer(VkDevice device, VkCommandPool commandPool) {
+	VkCommandBuffer initCommandBuffer(VkDevice device, VkCommandPool commandPool, VkCommandBufferLevel level) {
 		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
 		VkCommandBufferAllocateInfo cmdBufAI{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
 		cmdBufAI.commandPool = commandPool;
-		cmdBufAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cmdBufAI.level = level;
 		cmdBufAI.commandBufferCount = 1;
 		VkResult res = vkAllocateCommandBuffers(device, &cmdBufAI, &commandBuffer);
 		assert(res == VK_SUCCESS);
@@ -1342,7 +1351,9 @@ namespace Vulkan {
 
 
 	void cleanupShaderModule(VkDevice device, VkShaderModule shaderModule) {
-		vkDestroyShaderModule(device, shaderModule, nullptr);
+		//shared modules are destroyed with their last reference
+		if (!ShaderCache::Get().Release(device, shaderModule))
+			vkDestroyShaderModule(device, shaderModule, nullptr);
 	}
 
 	VkPipeline initGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<ShaderModule>& shaders, VkVertexInputBindingDescription& bindingDescription, std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, PipelineInfo& pipelineInfo) {
@@ -1479,14 +1490,14 @@ namespace Vulkan {
 		pipe.renderPass = renderPass;
 		pipe.layout = pipelineLayout;
 
-		VkResult res = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipe, nullptr, &pipeline);
+		VkResult res = vkCreateGraphicsPipelines(device, pipelineInfo.pipelineCache, 1, &pipe, nullptr, &pipeline);
 		assert(res == VK_SUCCESS);
 
 		return pipeline;
 
 	}
 
-	VkPipeline initComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, ShaderModule& shader) {
+	VkPipeline initComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, ShaderModule& shader, VkPipelineCache pipelineCache) {
 		VkPipeline pipeline{ VK_NULL_HANDLE };
 		VkPipelineShaderStageCreateInfo shaderCI{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
 		shaderCI.module = shader.shaderModule;
@@ -1495,12 +1506,94 @@ namespace Vulkan {
 		VkComputePipelineCreateInfo computeCI{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
 		computeCI.stage = shaderCI;
 		computeCI.layout = pipelineLayout;
-		VkResult res = vkCreateComputePipelines(device, nullptr, 1, &computeCI, nullptr, &pipeline);
+		VkResult res = vkCreateComputePipelines(device, pipelineCache, 1, &computeCI, nullptr, &pipeline);
 		assert(res == VK_SUCCESS);
 
 		return pipeline;
 	}
 
+	//written in front of the driver's data, the driver's own header has no driver version
+	struct PipelineCacheFileHeader {
+		uint32_t magic;
+		uint32_t headerSize;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint32_t reserved;//no padding, headers are compared with memcmp
+		uint64_t dataSize;
+	};
+	static const uint32_t PipelineCacheMagic = 0x48435056;//VPCH
+
+	static PipelineCacheFileHeader pipelineCacheHeader(const VkPhysicalDeviceProperties& deviceProperties, uint64_t dataSize) {
+		PipelineCacheFileHeader header{};
+		header.magic = PipelineCacheMagic;
+		header.headerSize = sizeof(PipelineCacheFileHeader);
+		header.vendorID = deviceProperties.vendorID;
+		header.deviceID = deviceProperties.deviceID;
+		header.driverVersion = deviceProperties.driverVersion;
+		memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.dataSize = dataSize;
+		return header;
+	}
+
+	VkPipelineCache initPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, const char* path, bool* loaded) {
+		std::vector<char> data;
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (file.is_open()) {
+			size_t fileSize = (size_t)file.tellg();
+			PipelineCacheFileHeader header{};
+			if (fileSize >= sizeof(header)) {
+				file.seekg(0);
+				file.read((char*)&header, sizeof(header));
+				PipelineCacheFileHeader expected = pipelineCacheHeader(deviceProperties, fileSize - sizeof(header));
+				//anything else (other gpu, driver update, truncated file) and the driver would have to reject it anyway
+				if (memcmp(&header, &expected, sizeof(header)) == 0) {
+					data.resize((size_t)header.dataSize);
+					file.read(data.data(), data.size());
+					if (!file)
+						data.clear();
+				}
+			}
+		}
+		VkPipelineCacheCreateInfo cacheCI{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+		cacheCI.initialDataSize = data.size();
+		cacheCI.pInitialData = data.empty() ? nullptr : data.data();
+		VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+		VkResult res = vkCreatePipelineCache(device, &cacheCI, nullptr, &pipelineCache);
+		if (res != VK_SUCCESS && !data.empty()) {
+			data.clear();
+			cacheCI.initialDataSize = 0;
+			cacheCI.pInitialData = nullptr;
+			res = vkCreatePipelineCache(device, &cacheCI, nullptr, &pipelineCache);
+		}
+		assert(res == VK_SUCCESS);
+		if (loaded)
+			*loaded = !data.empty();
+		return pipelineCache;
+	}
+
+	void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties& deviceProperties, const char* path) {
+		size_t dataSize = 0;
+		VkResult res = vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+		if (res != VK_SUCCESS || dataSize == 0)
+			return;
+		std::vector<char> data(dataSize);
+		res = vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data());
+		if (res != VK_SUCCESS)
+			return;
+		PipelineCacheFileHeader header = pipelineCacheHeader(deviceProperties, dataSize);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return;//read only folder, just no warm start next time
+		file.write((const char*)&header, sizeof(header));
+		file.write(data.data(), dataSize);
+	}
+
+	void cleanupPipelineCache(VkDevice device, VkPipelineCache pipelineCache) {
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	}
+
 
 	void cleanupPipeline(VkDevice device, VkPipeline pipeline) {
 		vkDestroyPipeline(device, pipeline, nullptr);
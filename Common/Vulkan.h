@@ -39,8 +39,11 @@ namespace Vulkan {
 	VkPhysicalDevice choosePhysicalDevice(VkInstance instance, VkSurfaceKHR surface, Queues& queues);
 
 
-	VkDevice initDevice(VkPhysicalDevice physicalDevice, std::vector<const char*> deviceExtensions, Queues queues, VkPhysicalDeviceFeatures enabledFeatures,uint32_t queueCount=1);
+	VkDevice initDevice(VkPhysicalDevice physicalDevice, std::vector<const char*> deviceExtensions, Queues queues, VkPhysicalDeviceFeatures enabledFeatures,uint32_t queueCount=1,const void* pNext=nullptr);
 	void cleanupDevice(VkDevice device);
+#ifdef __USE__VMA__
+	VmaAllocator getAllocator();//the device's, for allocations the helpers here don't cover
+#endif
 
 	VkQueue getDeviceQueue(VkDevice device, uint32_t queueFamily,uint32_t queueIndex=0);
 
@@ -57,7 +60,7 @@ namespace Vulkan {
 
 	VkCommandPool initCommandPool(VkDevice device, uint32_t queueFamily);
 	void initCommandPools(VkDevice device, size_t size, uint32_t queueFamily, std::vector<VkCommandPool>& commandPools);
-	VkCommandBuffer initCommandBuffer(VkDevice device, VkCommandPool commandPool);
+	VkCommandBuffer initCommandBuffer(VkDevice device, VkCommandPool commandPool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 	void initCommandBuffers(VkDevice device, std::vector<VkCommandPool>& commandPools, std::vector<VkCommandBuffer>& commandBuffers);
 	void cleanupCommandBuffers(VkDevice device, std::vector<VkCommandPool>& commandPools, std::vector<VkCommandBuffer>& commandBuffers);
 	void cleanupCommandBuffer(VkDevice device, VkCommandPool commandPool, VkCommandBuffer commandBuffer);
@@ -304,10 +307,16 @@ namespace Vulkan {
 		uint32_t specializationSize{ 0 };
 		uint8_t* specializationData{ nullptr };
 		std::vector<VkSpecializationMapEntry> specializationMap;
+		VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
 	};
 
 	VkPipeline initGraphicsPipeline(VkDevice, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<ShaderModule>& shaders, VkVertexInputBindingDescription& bindingDescription, std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, PipelineInfo& pipelineInfo);
-	VkPipeline initComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, ShaderModule& shader);
+	VkPipeline initComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, ShaderModule& shader, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+	//Pipeline cache kept on disk. The file is only used if it was saved by the same device and driver
+	//version, otherwise the cache starts empty. loaded says which.
+	VkPipelineCache initPipelineCache(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, const char* path, bool* loaded = nullptr);
+	void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties& deviceProperties, const char* path);
+	void cleanupPipelineCache(VkDevice device, VkPipelineCache pipelineCache);
 	/*VkPipeline initGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkExtent2D extent, std::vector<ShaderModule>& shaders, VkVertexInputBindingDescription& bindingDescription, std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT, bool depthTest = true, bool stencilTest = false, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT, VkBool32 blendEnable = VK_FALSE, VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL);
 	VkPipeline initGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkExtent2D extent, std::vector<ShaderModule>& shaders, VkVertexInputBindingDescription& bindingDescription, std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT, bool depthTest = true, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT, VkBool32 blendEnable = VK_FALSE, VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL);
 	VkPipeline initGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout pipelineLayout, std::vector<ShaderModule>& shaders, VkVertexInputBindingDescription& bindingDescription, std::vector<VkVertexInputAttributeDescription>& attributeDescriptions, VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT, bool depthTest = true, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT, VkBool32 blendEnable = VK_FALSE, VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL);
@@ -6,7 +6,7 @@
 
 #include <stb_image.h>
 #include <fstream>
-#include "../ThirdParty/spirv-reflect/spirv_reflect.h"
+#include "ShaderCache.h"
 
 
 InstanceBuilder::InstanceBuilder() {
@@ -257,28 +257,69 @@ VkDescriptorPool DescriptorSetPoolCache::getPool() {
 	return descriptorPool;
 }
 
-VkDescriptorPool DescriptorSetPoolCache::createPool() {
+VkDescriptorPool DescriptorSetPoolCache::createPool(bool everyType) {
 	//descriptor types currently supported
 	std::vector<VkDescriptorPoolSize> sizes = {
 		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,DESCRIPTOR_POOL_SIZE},
 		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,DESCRIPTOR_POOL_SIZE},
 		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,DESCRIPTOR_POOL_SIZE},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,DESCRIPTOR_POOL_SIZE},
 		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,DESCRIPTOR_POOL_SIZE},
 		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,DESCRIPTOR_POOL_SIZE},
 		{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,DESCRIPTOR_POOL_SIZE},
 		{VK_DESCRIPTOR_TYPE_SAMPLER,DESCRIPTOR_POOL_SIZE}
 	};
+	if (!everyType && tunedSetCount > 0) {
+		//DESCRIPTOR_POOL_SIZE sets of the average noted set, types never seen get none
+		sizes.clear();
+		for (auto& typeCount : tunedCounts) {
+			uint32_t size = (uint32_t)((typeCount.second * DESCRIPTOR_POOL_SIZE + tunedSetCount - 1) / tunedSetCount);
+			sizes.push_back({ typeCount.first,(std::max)(size,1u) });
+		}
+	}
 	VkDescriptorPool descriptorPool = Vulkan::initDescriptorPool(device, sizes, DESCRIPTOR_POOL_SIZE);
+	uint32_t capacity = 0;
+	for (auto& size : sizes)
+		capacity += size.descriptorCount;
+	poolCapacities[descriptorPool] = capacity;
+	tunedPools[descriptorPool] = !everyType && tunedSetCount > 0;
+	stats.Pools++;
+	stats.DescriptorCapacity += capacity;
 	return descriptorPool;
 }
 
 void DescriptorSetPoolCache::resetPools() {
+	tunedCounts = typeCounts;
+	tunedSetCount = setCount;
 	for (auto p : allocatedPools) {
 		vkResetDescriptorPool(device, p, 0);
 	}
-	freePools = allocatedPools;
+	freePools.insert(freePools.end(), allocatedPools.begin(), allocatedPools.end());
 	allocatedPools.clear();
+	//recycled pools are used before new ones, so an untuned one would keep the tuned sizes out
+	if (tunedSetCount > 0) {
+		auto untuned = std::partition(freePools.begin(), freePools.end(), [&](VkDescriptorPool p) {return tunedPools[p]; });
+		for (auto it = untuned; it != freePools.end(); ++it) {
+			stats.Pools--;
+			stats.DescriptorCapacity -= poolCapacities[*it];
+			poolCapacities.erase(*it);
+			tunedPools.erase(*it);
+			Vulkan::cleanupDescriptorPool(device, *it);
+		}
+		freePools.erase(untuned, freePools.end());
+	}
 	currentPool = VK_NULL_HANDLE;
+	stats.Resets++;
+	stats.SetsAllocated = 0;
+	stats.DescriptorsAllocated = 0;
+}
+
+void DescriptorSetPoolCache::noteUsage(const std::vector<VkDescriptorSetLayoutBinding>& bindings, uint32_t count) {
+	for (auto& binding : bindings) {
+		typeCounts[binding.descriptorType] += (uint64_t)binding.descriptorCount * count;
+		stats.DescriptorsAllocated += binding.descriptorCount * count;
+	}
+	setCount += count;
 }
 
 bool DescriptorSetPoolCache::allocateDescriptorSets(VkDescriptorSet* pSets, VkDescriptorSetLayout* pLayouts, uint32_t count) {
@@ -291,42 +332,94 @@ bool DescriptorSetPoolCache::allocateDescriptorSets(VkDescriptorSet* pSets, VkDe
 	allocInfo.descriptorSetCount = count;
 	allocInfo.descriptorPool = currentPool;
 	VkResult res = vkAllocateDescriptorSets(device, &allocInfo, pSets);
-
-	if (res == VK_SUCCESS) {
-		return true;
-	}
-	else if (res == VK_ERROR_FRAGMENTED_POOL || res == VK_ERROR_OUT_OF_POOL_MEMORY) {
-		currentPool = getPool();
+	//current pool's full, try a recycled (or new tuned) one, then one with room for every type
+	for (int attempt = 0; attempt < 2 && (res == VK_ERROR_FRAGMENTED_POOL || res == VK_ERROR_OUT_OF_POOL_MEMORY); ++attempt) {
+		currentPool = attempt == 0 ? getPool() : createPool(true);
 		allocatedPools.push_back(currentPool);
+		allocInfo.descriptorPool = currentPool;
 		res = vkAllocateDescriptorSets(device, &allocInfo, pSets);
-		if (res == VK_SUCCESS)
-			return true;
+	}
+	if (res == VK_SUCCESS) {
+		stats.SetsAllocated += count;
+		return true;
 	}
 	return false;
 }
 
 bool DescriptorSetPoolCache::allocateDescriptorSet(VkDescriptorSet* pSet, VkDescriptorSetLayout layout) {
-	if (currentPool == VK_NULL_HANDLE) {
-		currentPool = getPool();
-		allocatedPools.push_back(currentPool);
-	}
-	VkDescriptorSetAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-	allocInfo.pSetLayouts = &layout;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.descriptorPool = currentPool;
-	VkResult res = vkAllocateDescriptorSets(device, &allocInfo, pSet);
+	return allocateDescriptorSets(pSet, &layout, 1);
+}
 
-	if (res == VK_SUCCESS) {
+
+DescriptorSetCache::DescriptorSetCache(DescriptorSetPoolCache* pPool_) :pPool(pPool_) {
+
+}
+
+size_t DescriptorSetCache::KeyHash::operator()(const Key& k)const {
+	uint64_t hash = 0xcbf29ce484222325ull ^ (uint64_t)k.layout;
+	hash *= 0x100000001b3ull;
+	for (auto resource : k.resources) {
+		hash ^= resource;
+		hash *= 0x100000001b3ull;
+	}
+	return (size_t)hash;
+}
+
+bool DescriptorSetCache::get(VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings, std::vector<VkWriteDescriptorSet>& writes, VkDescriptorSet& set) {
+	Key key;
+	key.layout = layout;
+	for (auto& write : writes) {
+		key.resources.push_back(((uint64_t)write.dstBinding << 32) | (uint64_t)write.descriptorType);
+		key.resources.push_back(write.descriptorCount);
+		for (uint32_t i = 0; i < write.descriptorCount; ++i) {
+			if (write.pBufferInfo != nullptr) {
+				key.resources.push_back((uint64_t)write.pBufferInfo[i].buffer);
+				key.resources.push_back(write.pBufferInfo[i].offset);
+				key.resources.push_back(write.pBufferInfo[i].range);
+			}
+			else if (write.pImageInfo != nullptr) {
+				key.resources.push_back((uint64_t)write.pImageInfo[i].sampler);
+				key.resources.push_back((uint64_t)write.pImageInfo[i].imageView);
+				key.resources.push_back(write.pImageInfo[i].imageLayout);
+			}
+			else if (write.pTexelBufferView != nullptr) {
+				key.resources.push_back((uint64_t)write.pTexelBufferView[i]);
+			}
+		}
+	}
+	auto it = sets.find(key);
+	if (it != sets.end()) {
+		hits++;
+		set = it->second;
 		return true;
 	}
-	else if (res == VK_ERROR_FRAGMENTED_POOL || res == VK_ERROR_OUT_OF_POOL_MEMORY) {
-		currentPool = getPool();
-		allocatedPools.push_back(currentPool);
-		res = vkAllocateDescriptorSets(device, &allocInfo, pSet);
-		if (res == VK_SUCCESS)
-			return true;
+	misses++;
+	pPool->noteUsage(bindings, 1);
+	if (!pPool->allocateDescriptorSet(&set, layout))
+		return false;
+	for (auto& write : writes)
+		write.dstSet = set;
+	Vulkan::updateDescriptorSets(*pPool, writes);
+	sets[std::move(key)] = set;
+	return true;
+}
+
+void DescriptorSetCache::reset() {
+	pPool->resetPools();
+	sets.clear();
+}
+
+
+FrameDescriptorPools::FrameDescriptorPools(VkDevice device_, uint32_t frameCount) {
+	for (uint32_t i = 0; i < frameCount; ++i) {
+		pools.push_back(std::make_unique<DescriptorSetPoolCache>(device_));
+		caches.push_back(std::make_unique<DescriptorSetCache>(pools.back().get()));
 	}
-	return false;
+}
+
+void FrameDescriptorPools::beginFrame(uint32_t frame) {
+	currFrame = frame;
+	caches[currFrame]->reset();
 }
 
 
@@ -423,6 +516,7 @@ DescriptorSetBuilder& DescriptorSetBuilder::AddBinding(uint32_t binding, VkDescr
 
 bool DescriptorSetBuilder::build(VkDescriptorSet& set, VkDescriptorSetLayout& layout) {
 	layout = pLayout->create(bindings);
+	pPool->noteUsage(bindings, 1);
 	return pPool->allocateDescriptorSet(&set, layout);
 }
 
@@ -433,6 +527,7 @@ bool DescriptorSetBuilder::build(VkDescriptorSet& set) {
 
 bool DescriptorSetBuilder::build(std::vector<VkDescriptorSet>& sets, VkDescriptorSetLayout& layout, uint32_t count) {
 	layout = pLayout->create(bindings);
+	pPool->noteUsage(bindings, count);
 	sets.resize(count);
 	std::vector<VkDescriptorSetLayout> layouts(count, layout);
 	return pPool->allocateDescriptorSets(sets.data(), layouts.data(), count);
@@ -444,12 +539,14 @@ bool DescriptorSetBuilder::build(std::vector<VkDescriptorSet>& sets, uint32_t co
 }
 
 void DescriptorSetUpdater::setBindings() {
-	assert(pLayout->getBindings(descriptorSetLayout, bindings));
+	bool found = pLayout->getBindings(descriptorSetLayout, bindings);
+	assert(found);
 	writes.resize(bindings.size(), { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET });
 	for (size_t i = 0; i < bindings.size(); ++i) {
 		writes[i].descriptorType = bindings[i].descriptorType;
 		writes[i].descriptorCount = bindings[i].descriptorCount;
 		writes[i].dstSet = descriptorSet;
+		writes[i].dstBinding = bindings[i].binding;
 	}
 }
 
@@ -490,6 +587,13 @@ void DescriptorSetUpdater::update() {
 	//vkUpdateDescriptorSets(*pLayout, (uint32_t)writes.size(), writes.data(), 0, nullptr);
 }
 
+bool DescriptorSetUpdater::update(DescriptorSetCache* pCache, VkDescriptorSet& set) {
+	if (!pCache->get(descriptorSetLayout, bindings, writes, set))
+		return false;
+	descriptorSet = set;
+	return true;
+}
+
 UniformBufferBuilder::UniformBufferBuilder(VkDevice device_, VkPhysicalDeviceProperties& deviceProperties_, VkPhysicalDeviceMemoryProperties& memoryProperties_, VkDescriptorType descriptorType_, bool isMapped_)
 	:device(device_),deviceProperties(deviceProperties_),memoryProperties(memoryProperties_),descriptorType(descriptorType_),isMapped(isMapped_){
 
@@ -1139,103 +1243,20 @@ ShaderProgramLoader& ShaderProgramLoader::AddShaderPath(const char* shaderPath)
 	return *this;
 }
 
-void ShaderProgramLoader::load(std::vector<Vulkan::ShaderModule>& shaders_) {
-	//shaders_.resize(shaderPaths.size());
-	for (size_t i = 0; i < shaderPaths.size(); ++i) {
-		auto& shaderPath = shaderPaths[i];
-		std::ifstream file(shaderPath, std::ios::ate | std::ios::binary);
-		assert(file.is_open());
-
-
-		size_t fileSize = (size_t)file.tellg();
-		std::vector<char> shaderData(fileSize);
-
-		file.seekg(0);
-		file.read(shaderData.data(), fileSize);
-
-		file.close();
-		SpvReflectShaderModule module = {};
-		SpvReflectResult result = spvReflectCreateShaderModule(shaderData.size(), shaderData.data(), &module);
-		assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-
-		VkShaderStageFlagBits stage;
-		switch (module.shader_stage) {
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_VERTEX_BIT:
-			stage = VK_SHADER_STAGE_VERTEX_BIT;
-			break;
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT:
-			stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-			break;
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_GEOMETRY_BIT:
-			stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-			break;
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_COMPUTE_BIT:
-			stage = VK_SHADER_STAGE_COMPUTE_BIT;
-			break;
-		default:
-			assert(0);
-			break;
-		}
-
-		if (stage == VK_SHADER_STAGE_VERTEX_BIT) {
-
-			vertexAttributeDescriptions.resize(module.input_variable_count);
-
-			uint32_t offset = 0;
-			std::vector<uint32_t> sizes(module.input_variable_count);
-			std::vector<VkFormat> formats(module.input_variable_count);
-			for (uint32_t i = 0; i < module.input_variable_count; ++i) {
-				SpvReflectInterfaceVariable& inputVar = module.input_variables[i];
-				uint32_t size = 0;
-				VkFormat format;
-				switch (inputVar.format) {
-
-				case SPV_REFLECT_FORMAT_R32G32B32A32_SFLOAT:
-					format = VK_FORMAT_R32G32B32A32_SFLOAT;
-					size = sizeof(float) * 4;
-					break;
-				case SPV_REFLECT_FORMAT_R32G32B32_SFLOAT:
-					format = VK_FORMAT_R32G32B32_SFLOAT;
-					size = sizeof(float) * 3;
-					break;
-				case SPV_REFLECT_FORMAT_R32G32_SFLOAT:
-					format = VK_FORMAT_R32G32_SFLOAT;
-					size = sizeof(float) * 2;
-					break;
-				default:
-					assert(0);
-					break;
-				}
-				sizes[inputVar.location] = (uint32_t)size;
-				formats[inputVar.location] = format;
-			}
-
-			for (uint32_t i = 0; i < module.input_variable_count; i++) {
-
-				vertexAttributeDescriptions[i].location = i;
-				vertexAttributeDescriptions[i].offset = offset;
-				vertexAttributeDescriptions[i].format = formats[i];
-				offset += sizes[i];
-			}
-			vertexInputDescription.binding = 0;
-			vertexInputDescription.stride = offset;
-			vertexInputDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
+void ShaderProgramLoader::loadShaders() {
+	//the cache maps, reflects and creates each distinct shader once, and refcounts it
+	for (auto& shaderPath : shaderPaths) {
+		ShaderCache::Entry entry = ShaderCache::Get().Acquire(device, shaderPath.c_str());
+		if (entry.Reflection.Stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			vertexInputDescription = entry.Reflection.VertexInput;
+			vertexAttributeDescriptions = entry.Reflection.VertexAttributes;
 		}
-		spvReflectDestroyShaderModule(&module);
-
-		VkShaderModule shader = VK_NULL_HANDLE;
-
-		VkShaderModuleCreateInfo createInfo{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		createInfo.codeSize = shaderData.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderData.data());
-		VkResult res = vkCreateShaderModule(device, &createInfo, nullptr, &shader);
-		assert(res == VK_SUCCESS);
-		shaders.insert(std::pair<VkShaderStageFlagBits, VkShaderModule>(stage, shader));
-		//shaders.push_back(shader);
-		shaderData.clear();
+		shaders.insert(std::pair<VkShaderStageFlagBits, VkShaderModule>(entry.Reflection.Stage, entry.Module));
 	}
+}
+
+void ShaderProgramLoader::load(std::vector<Vulkan::ShaderModule>& shaders_) {
+	loadShaders();
 	//insert in order VERTEX,GEOMETRY,FRAGMENT
 	shaders_.clear();
 	if (shaders.find(VK_SHADER_STAGE_VERTEX_BIT) != shaders.end()) {
@@ -1257,115 +1278,7 @@ void ShaderProgramLoader::load(std::vector<Vulkan::ShaderModule>& shaders_) {
 }
 
 bool ShaderProgramLoader::load(std::vector<Vulkan::ShaderModule>& shaders_, VkVertexInputBindingDescription& vertexInputDescription_, std::vector<VkVertexInputAttributeDescription>& vertexAttributeDescriptions_) {
-	//shaders_.resize(shaderPaths.size());
-	for (size_t i = 0; i < shaderPaths.size(); ++i) {
-		auto& shaderPath = shaderPaths[i];
-		std::ifstream file(shaderPath, std::ios::ate | std::ios::binary);
-		assert(file.is_open());
-
-
-		size_t fileSize = (size_t)file.tellg();
-		std::vector<char> shaderData(fileSize);
-
-		file.seekg(0);
-		file.read(shaderData.data(), fileSize);
-
-		file.close();
-		SpvReflectShaderModule module = {};
-		SpvReflectResult result = spvReflectCreateShaderModule(shaderData.size(), shaderData.data(), &module);
-		assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-
-		VkShaderStageFlagBits stage;
-		switch (module.shader_stage) {
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_VERTEX_BIT:
-			stage = VK_SHADER_STAGE_VERTEX_BIT;
-			break;
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_FRAGMENT_BIT:
-			stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-			break;
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_GEOMETRY_BIT:
-			stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-			break;
-		case SpvReflectShaderStageFlagBits::SPV_REFLECT_SHADER_STAGE_COMPUTE_BIT:
-			stage = VK_SHADER_STAGE_COMPUTE_BIT;
-			break;
-		default:
-			assert(0);
-			break;
-		}
-
-		if (stage == VK_SHADER_STAGE_VERTEX_BIT) {
-			uint32_t count = 0;
-			for (uint32_t i = 0; i < module.input_variable_count; ++i) {
-				SpvReflectInterfaceVariable& inputVar = module.input_variables[i];
-				if (inputVar.built_in==-1)
-					count++;
-			}
-			vertexAttributeDescriptions.resize(count);
-
-			uint32_t offset = 0;
-			std::vector<uint32_t> sizes(count);
-			std::vector<VkFormat> formats(count);
-			
-			for (uint32_t i = 0; i < module.input_variable_count; ++i) {
-				SpvReflectInterfaceVariable& inputVar = module.input_variables[i];
-				if (inputVar.built_in!=-1)
-					continue;
-				uint32_t size = 0;
-				VkFormat format;
-				switch (inputVar.format) {
-				case SPV_REFLECT_FORMAT_R32G32B32A32_SINT:
-					format = VK_FORMAT_R32G32B32A32_SINT;
-					size = sizeof(uint32_t) * 4;
-					break;
-				case SPV_REFLECT_FORMAT_R32G32B32A32_SFLOAT:
-					format = VK_FORMAT_R32G32B32A32_SFLOAT;
-					size = sizeof(float) * 4;
-					break;
-				case SPV_REFLECT_FORMAT_R32G32B32_SFLOAT:
-					format = VK_FORMAT_R32G32B32_SFLOAT;
-					size = sizeof(float) * 3;
-					break;
-				case SPV_REFLECT_FORMAT_R32G32_SFLOAT:
-					format = VK_FORMAT_R32G32_SFLOAT;
-					size = sizeof(float) * 2;
-					break;
-				default:
-					assert(0);
-					break;
-				}
-				sizes[inputVar.location] = (uint32_t)size;
-				formats[inputVar.location] = format;
-				
-			}
-
-			//for (uint32_t i = 0; i < module.input_variable_count; i++) {
-			for(uint32_t i=0;i<count;i++){
-
-				vertexAttributeDescriptions[i].location = i;
-				vertexAttributeDescriptions[i].offset = offset;
-				vertexAttributeDescriptions[i].format = formats[i];
-				offset += sizes[i];
-			}
-			vertexInputDescription.binding = 0;
-			vertexInputDescription.stride = offset;
-			vertexInputDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		}
-		spvReflectDestroyShaderModule(&module);
-
-		VkShaderModule shader = VK_NULL_HANDLE;
-
-		VkShaderModuleCreateInfo createInfo{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-		createInfo.codeSize = shaderData.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderData.data());
-		VkResult res = vkCreateShaderModule(device, &createInfo, nullptr, &shader);
-		assert(res == VK_SUCCESS);
-		shaders.insert(std::pair<VkShaderStageFlagBits, VkShaderModule>(stage, shader));
-		//shaders.push_back(shader);
-		shaderData.clear();
-	}
+	loadShaders();
 	//insert in order VERTEX,GEOMETRY,FRAGMENT
 	shaders_.clear();
 	if (shaders.find(VK_SHADER_STAGE_VERTEX_BIT) != shaders.end()) {
@@ -1473,6 +1386,11 @@ PipelineBuilder& PipelineBuilder::setNoDraw(VkBool32 noDraw_) {
 	return *this;
 }
 
+PipelineBuilder& PipelineBuilder::setPipelineCache(VkPipelineCache pipelineCache_) {
+	pipelineCache = pipelineCache_;
+	return *this;
+}
+
 PipelineBuilder& PipelineBuilder::setStencilState(VkStencilOp failOp, VkStencilOp passOp, VkStencilOp depthFailOp, VkCompareOp compareOp, uint32_t compareMask, uint32_t writeMask, uint32_t reference) {
 	stencil.failOp = failOp;
 	stencil.passOp = passOp;
@@ -1518,6 +1436,7 @@ void PipelineBuilder::build(VkPipeline& pipeline) {
 	pipelineInfo.stencil = stencil;
 	pipelineInfo.frontFace = frontFace;
 	pipelineInfo.noDraw = noDraw;
+	pipelineInfo.pipelineCache = pipelineCache;
 	if (blend) {
 		VkPipelineColorBlendAttachmentState blendAttachment{};
 		blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -1577,14 +1496,40 @@ ComputePipelineBuilder& ComputePipelineBuilder::setShader(const char* pShader_)
 	return *this;
 }
 
+ComputePipelineBuilder& ComputePipelineBuilder::setPipelineCache(VkPipelineCache pipelineCache_) {
+	pipelineCache = pipelineCache_;
+	return *this;
+}
+
 VkPipeline ComputePipelineBuilder::build() {
 	VkShaderModule shader = Vulkan::initShaderModule(device, pShader);
 	Vulkan::ShaderModule shaderModule = { shader,VK_SHADER_STAGE_COMPUTE_BIT };
-	VkPipeline pipeline = Vulkan::initComputePipeline(device, pipelineLayout, shaderModule);
+	VkPipeline pipeline = Vulkan::initComputePipeline(device, pipelineLayout, shaderModule, pipelineCache);
 	Vulkan::cleanupShaderModule(device, shader);
 	return pipeline;
 }
 
+PipelineBatch& PipelineBatch::add(const PipelineBuilder& builder, VkPipeline& pipeline) {
+	jobs.push_back([builder, &pipeline]()mutable { builder.build(pipeline); });
+	return *this;
+}
+
+PipelineBatch& PipelineBatch::add(const ComputePipelineBuilder& builder, VkPipeline& pipeline) {
+	jobs.push_back([builder, &pipeline]()mutable { pipeline = builder.build(); });
+	return *this;
+}
+
+void PipelineBatch::build(ThreadPool* pool) {
+	std::unique_ptr<ThreadPool> ownPool;
+	if (pool == nullptr) {
+		ownPool = std::make_unique<ThreadPool>();
+		pool = ownPool.get();
+	}
+	//one pipeline per task, they're big enough that handing them out one at a time costs nothing
+	pool->Run((uint32_t)jobs.size(), [&](uint32_t task, uint32_t) { jobs[task](); });
+	jobs.clear();
+}
+
 VulkanBuffer::VulkanBuffer(VkDevice device_, Vulkan::Buffer& buffer_) : VulkanObject(device_), buffer(buffer_) {
 
 }
@@ -6,6 +6,7 @@
 #include <memory>
 #include <algorithm>
 #include "Vulkan.h"
+#include "ThreadPool.h"
 
 
 class InstanceBuilder {
@@ -185,20 +186,45 @@ public:
 };
 
 
+//Once reset, new pools are sized from the descriptor types the sets allocated before the reset
+//used (noteUsage, DescriptorSetBuilder and DescriptorSetCache call it), DESCRIPTOR_POOL_SIZE sets
+//each. Before the first reset, and when a tuned pool can't fit a set, every type gets
+//DESCRIPTOR_POOL_SIZE. Those untuned pools are destroyed at a reset once there are counts
+//to tune from, so the recycled pools are all tuned ones.
 class DescriptorSetPoolCache {
+public:
+	struct Stats {
+		uint32_t Pools{ 0 };
+		uint32_t Resets{ 0 };
+		uint32_t SetsAllocated{ 0 };//since the last reset
+		uint32_t DescriptorsAllocated{ 0 };//of the noted sets, since the last reset
+		uint32_t DescriptorCapacity{ 0 };//of every pool, what the pools' memory holds
+	};
+private:
 	VkDevice device{ VK_NULL_HANDLE };
 	VkDescriptorPool getPool();
 	VkDescriptorPool currentPool{ VK_NULL_HANDLE };
 	std::vector<VkDescriptorPool> allocatedPools;
 	std::vector<VkDescriptorPool> freePools;
-	VkDescriptorPool createPool();
+	std::unordered_map<VkDescriptorPool, uint32_t> poolCapacities;//descriptors
+	std::unordered_map<VkDescriptorPool, bool> tunedPools;
+	std::unordered_map<VkDescriptorType, uint64_t> typeCounts;//descriptors noted, ever
+	uint64_t setCount{ 0 };//sets noted, ever
+	std::unordered_map<VkDescriptorType, uint64_t> tunedCounts;//typeCounts at the last reset
+	uint64_t tunedSetCount{ 0 };
+	Stats stats;
+	VkDescriptorPool createPool(bool everyType = false);
 	DescriptorSetPoolCache() = delete;
 public:
 	DescriptorSetPoolCache(VkDevice device_);
 	~DescriptorSetPoolCache();
+	//everything allocated is released at once, the pools are kept
 	void resetPools();
 	bool allocateDescriptorSet(VkDescriptorSet* pSet, VkDescriptorSetLayout layout);
 	bool allocateDescriptorSets(VkDescriptorSet* pSet, VkDescriptorSetLayout* pLayouts, uint32_t count);
+	//count sets of a layout with these bindings are about to be allocated
+	void noteUsage(const std::vector<VkDescriptorSetLayoutBinding>& bindings, uint32_t count);
+	const Stats& getStats()const { return stats; }
 	operator VkDevice()const { return device; }
 };
 
@@ -250,6 +276,7 @@ public:
 };
 
 
+class DescriptorSetCache;
 class DescriptorSetUpdater {
 	DescriptorSetLayoutCache* pLayout{ nullptr };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
@@ -259,13 +286,58 @@ class DescriptorSetUpdater {
 	void setBindings();
 	DescriptorSetUpdater(DescriptorSetLayoutCache* pLayout_, VkDescriptorSetLayout descriptorSetLayout_, VkDescriptorSet descriptorSet_);
 public:
-	static DescriptorSetUpdater begin(DescriptorSetLayoutCache* pLayout_, VkDescriptorSetLayout descriptorSetLayout_, VkDescriptorSet descriptorSet_);
+	static DescriptorSetUpdater begin(DescriptorSetLayoutCache* pLayout_, VkDescriptorSetLayout descriptorSetLayout_, VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE);
 	DescriptorSetUpdater& AddBinding(uint32_t binding, VkDescriptorType type, VkDescriptorBufferInfo* bufferInfo);
 	DescriptorSetUpdater& AddBinding(uint32_t binding, VkDescriptorType type, VkDescriptorImageInfo* imageInfo,uint32_t count=1);
 	void update();
+	//instead of update, set is one with these bindings from pCache, written only if it's new
+	bool update(DescriptorSetCache* pCache, VkDescriptorSet& set);
 };
 
 
+//Returns the set already written with the same resources for a layout instead of allocating
+//and writing another, the key is the layout plus every buffer, image view, sampler and range
+//bound. Sets live as long as the pool, reset clears both.
+class DescriptorSetCache {
+	struct Key {
+		VkDescriptorSetLayout layout{ VK_NULL_HANDLE };
+		std::vector<uint64_t> resources;
+		bool operator==(const Key& other)const { return layout == other.layout && resources == other.resources; }
+	};
+	struct KeyHash {
+		size_t operator()(const Key& k)const;
+	};
+	DescriptorSetPoolCache* pPool{ nullptr };
+	std::unordered_map<Key, VkDescriptorSet, KeyHash> sets;
+	uint32_t hits{ 0 };
+	uint32_t misses{ 0 };
+public:
+	DescriptorSetCache(DescriptorSetPoolCache* pPool_);
+	DescriptorSetCache(const DescriptorSetCache& rhs) = delete;
+	DescriptorSetCache& operator=(const DescriptorSetCache& rhs) = delete;
+	//bindings are the layout's, writes its contents (dstSet is filled in on a miss)
+	bool get(VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings, std::vector<VkWriteDescriptorSet>& writes, VkDescriptorSet& set);
+	void reset();
+	uint32_t getHits()const { return hits; }
+	uint32_t getMisses()const { return misses; }
+	DescriptorSetPoolCache* getPool()const { return pPool; }
+};
+
+//Transient descriptor sets, one pool and cache per frame slot (VulkApp's mMaxFrames). Call
+//beginFrame(mCurrFrame) right after VulkApp::Update has waited on the slot's fence, its pool is
+//reset wholesale, nothing is freed set by set. The resets are what size each slot's pools from
+//what its last frame used.
+class FrameDescriptorPools {
+	std::vector<std::unique_ptr<DescriptorSetPoolCache>> pools;
+	std::vector<std::unique_ptr<DescriptorSetCache>> caches;
+	uint32_t currFrame{ 0 };
+public:
+	FrameDescriptorPools(VkDevice device_, uint32_t frameCount);
+	void beginFrame(uint32_t frame);
+	DescriptorSetPoolCache* getPool()const { return pools[currFrame].get(); }
+	DescriptorSetCache* getCache()const { return caches[currFrame].get(); }
+};
+
 struct UniformBufferInfo {
 	VkDeviceSize objectSize{ 0 };
 	VkDeviceSize objectCount{ 0 };
@@ -383,6 +455,7 @@ class ShaderProgramLoader {
 	std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptions;
 	std::unordered_map<VkShaderStageFlagBits, VkShaderModule> shaders;
 	ShaderProgramLoader(VkDevice device_);
+	void loadShaders();
 public:
 	static ShaderProgramLoader begin(VkDevice device_);
 	ShaderProgramLoader& AddShaderPath(const char* shaderPath);
@@ -438,6 +511,7 @@ class PipelineBuilder {
 	VkFrontFace frontFace{ VK_FRONT_FACE_COUNTER_CLOCKWISE };
 	VkBool32 noDraw{ VK_FALSE };
 	std::vector<SpecInfo> specializationInfo;
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
 	
 	PipelineBuilder(VkDevice device_, VkPipelineLayout pipelineLayout_, VkRenderPass renderPass_, std::vector<Vulkan::ShaderModule>& shaders_, VkVertexInputBindingDescription& vertexInputDescription_, std::vector<VkVertexInputAttributeDescription>& vertexAttributeDescriptions_);
 public:
@@ -456,6 +530,7 @@ public:
 	PipelineBuilder& setSpecializationConstant(VkShaderStageFlagBits shaderStage,uint32_t uval);
 	PipelineBuilder& setSpecializationConstant(VkShaderStageFlagBits shaderStage, int32_t ival);
 	PipelineBuilder& setSpecializationConstant(VkShaderStageFlagBits shaderStage, float fval);
+	PipelineBuilder& setPipelineCache(VkPipelineCache pipelineCache_);
 	void build(VkPipeline& pipeline);
 };
 
@@ -463,13 +538,27 @@ class ComputePipelineBuilder {
 	VkDevice device{ VK_NULL_HANDLE };
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	const char* pShader{ nullptr };
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
 	ComputePipelineBuilder(VkDevice device_, VkPipelineLayout pipelineLayout_);
 public:
 	static ComputePipelineBuilder begin(VkDevice device_, VkPipelineLayout pipelineLayout_);
 	ComputePipelineBuilder& setShader(const char* pShader_);
+	ComputePipelineBuilder& setPipelineCache(VkPipelineCache pipelineCache_);
 	VkPipeline build();
 };
 
+//Collects pipelines that don't depend on each other and compiles them together on worker
+//threads, pipeline caches are internally synchronized so they can all share one. The
+//builders are copied, but the shader modules they point at must live until build.
+class PipelineBatch {
+	std::vector<std::function<void()>> jobs;
+public:
+	PipelineBatch& add(const PipelineBuilder& builder, VkPipeline& pipeline);
+	PipelineBatch& add(const ComputePipelineBuilder& builder, VkPipeline& pipeline);
+	//pool nullptr uses a pool with every hardware thread for the duration of the build
+	void build(ThreadPool* pool = nullptr);
+};
+
 class VulkanObject {
 protected:
 	VkDevice device{ VK_NULL_HANDLE };
@@ -0,0 +1,118 @@
+#include "../../../Common/ShaderReflection.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+//Reflects compiled shaders once at build time, writing <shader>.spv.refl next to
+//each so ShaderCache doesn't have to run spirv-reflect at startup.
+//
+//  ShaderBake [-f location=FORMAT]... shader.spv...
+//
+//-f swaps a vertex input's format for a packed one, the vertex data has to be
+//written that way too. compile.bat runs it after glslc.
+
+namespace {
+	struct FormatName {
+		const char* name;
+		VkFormat format;
+	};
+	const FormatName packedFormats[] = {
+		{ "R8G8B8A8_UNORM",VK_FORMAT_R8G8B8A8_UNORM },
+		{ "R8G8B8A8_SNORM",VK_FORMAT_R8G8B8A8_SNORM },
+		{ "R8G8B8A8_UINT",VK_FORMAT_R8G8B8A8_UINT },
+		{ "R8G8B8A8_SINT",VK_FORMAT_R8G8B8A8_SINT },
+		{ "R16G16_UNORM",VK_FORMAT_R16G16_UNORM },
+		{ "R16G16_SNORM",VK_FORMAT_R16G16_SNORM },
+		{ "R16G16_SFLOAT",VK_FORMAT_R16G16_SFLOAT },
+		{ "R16G16B16A16_UNORM",VK_FORMAT_R16G16B16A16_UNORM },
+		{ "R16G16B16A16_SNORM",VK_FORMAT_R16G16B16A16_SNORM },
+		{ "R16G16B16A16_UINT",VK_FORMAT_R16G16B16A16_UINT },
+		{ "R16G16B16A16_SINT",VK_FORMAT_R16G16B16A16_SINT },
+		{ "R16G16B16A16_SFLOAT",VK_FORMAT_R16G16B16A16_SFLOAT },
+		{ "A2B10G10R10_UNORM_PACK32",VK_FORMAT_A2B10G10R10_UNORM_PACK32 },
+		{ "A2B10G10R10_SNORM_PACK32",VK_FORMAT_A2B10G10R10_SNORM_PACK32 },
+	};
+
+	struct FormatOverride {
+		uint32_t location;
+		VkFormat format;
+	};
+
+	bool parseOverride(const char* arg, FormatOverride& formatOverride) {
+		const char* equals = strchr(arg, '=');
+		if (equals == nullptr)
+			return false;
+		formatOverride.location = (uint32_t)atoi(arg);
+		for (auto& packed : packedFormats) {
+			if (strcmp(equals + 1, packed.name) == 0) {
+				formatOverride.format = packed.format;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool bake(const char* path, const std::vector<FormatOverride>& overrides) {
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << path << ": can't open" << std::endl;
+			return false;
+		}
+		size_t fileSize = (size_t)file.tellg();
+		std::vector<uint32_t> code(fileSize / sizeof(uint32_t));
+		file.seekg(0);
+		file.read((char*)code.data(), code.size() * sizeof(uint32_t));
+		file.close();
+
+		ShaderReflection reflection;
+		if (code.size() * sizeof(uint32_t) != fileSize || !Vulkan::reflectSpirv(code.data(), fileSize, reflection)) {
+			std::cerr << path << ": not SPIR-V spirv-reflect can read" << std::endl;
+			return false;
+		}
+		if (reflection.Stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			for (auto& formatOverride : overrides) {
+				if (formatOverride.location >= reflection.VertexAttributes.size()) {
+					std::cerr << path << ": no vertex input at location " << formatOverride.location << std::endl;
+					return false;
+				}
+				Vulkan::setVertexFormat(reflection, formatOverride.location, formatOverride.format);
+			}
+		}
+		std::string bakedPath = std::string(path) + ".refl";
+		if (!Vulkan::saveReflection(bakedPath.c_str(), Vulkan::hashSpirv(code.data(), code.size()), reflection)) {
+			std::cerr << bakedPath << ": can't write" << std::endl;
+			return false;
+		}
+		std::cout << bakedPath << ": " << reflection.VertexAttributes.size() << " inputs (stride " << reflection.VertexInput.stride << ")" << std::endl;
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<FormatOverride> overrides;
+	std::vector<const char*> paths;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			FormatOverride formatOverride;
+			if (!parseOverride(argv[++i], formatOverride)) {
+				std::cerr << "bad format override " << argv[i] << ", expected location=FORMAT" << std::endl;
+				return 1;
+			}
+			overrides.push_back(formatOverride);
+		}
+		else
+			paths.push_back(argv[i]);
+	}
+	if (paths.empty()) {
+		std::cerr << "usage: ShaderBake [-f location=FORMAT]... shader.spv..." << std::endl;
+		return 1;
+	}
+	int failed = 0;
+	for (auto path : paths) {
+		if (!bake(path, overrides))
+			failed++;
+	}
+	return failed == 0 ? 0 : 1;
+}